@@ -23,4 +23,8 @@
 
 - (IBAction)showHelp:(id)sender;
 
+- (IBAction)toggleTracing:(id)sender;
+- (IBAction)showTracingSummary:(id)sender;
+- (IBAction)saveTrace:(id)sender;
+
 @end
@@ -33,6 +33,12 @@ - (ApplicationController*)init
 	
 	// Make sure the PBGitDefaults is initialized, by calling a random method
 	[PBGitDefaults class];
+
+	// Find git while the app finishes launching rather than when the first
+	// repository opens
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+		[PBGitBinary path];
+	});
 	
 	started = NO;
 	return self;
@@ -62,7 +68,7 @@ - (BOOL)applicationOpenUntitledFile:(NSApplication *)theApplication
 
 - (void)applicationDidFinishLaunching:(NSNotification*)notification
 {
-
+	[self installTracingMenu];
 
 	started = YES;
 }
@@ -106,4 +112,74 @@ - (IBAction)showHelp:(id)sender
 	[[NSWorkspace sharedWorkspace] openURL:[NSURL URLWithString:@"https://github.com/josharian/gitx"]];
 }
 
+#pragma mark Performance tracing
+
+// Added in code rather than in MainMenu.xib so the items stay next to the
+// tracer they drive.
+- (void)installTracingMenu
+{
+	NSMenu *helpMenu = [NSApp helpMenu] ?: [[[[NSApp mainMenu] itemArray] lastObject] submenu];
+	if (!helpMenu)
+		return;
+
+	NSMenu *tracingMenu = [[NSMenu alloc] initWithTitle:@"Performance Tracing"];
+	[[tracingMenu addItemWithTitle:@"Record Trace" action:@selector(toggleTracing:) keyEquivalent:@""] setTarget:self];
+	[[tracingMenu addItemWithTitle:@"Show Summary" action:@selector(showTracingSummary:) keyEquivalent:@""] setTarget:self];
+	[[tracingMenu addItemWithTitle:@"Save Trace…" action:@selector(saveTrace:) keyEquivalent:@""] setTarget:self];
+
+	NSMenuItem *item = [[NSMenuItem alloc] initWithTitle:@"Performance Tracing" action:nil keyEquivalent:@""];
+	item.submenu = tracingMenu;
+	[helpMenu addItem:[NSMenuItem separatorItem]];
+	[helpMenu addItem:item];
+}
+
+- (BOOL)validateMenuItem:(NSMenuItem *)menuItem
+{
+	if ([menuItem action] == @selector(toggleTracing:))
+		[menuItem setState:[PBTracer shared].isEnabled ? NSControlStateValueOn : NSControlStateValueOff];
+	return YES;
+}
+
+- (IBAction)toggleTracing:(id)sender
+{
+	PBTracer *tracer = [PBTracer shared];
+	[tracer setEnabled:!tracer.isEnabled];
+}
+
+- (IBAction)showTracingSummary:(id)sender
+{
+	NSTextView *textView = [[NSTextView alloc] initWithFrame:NSMakeRect(0, 0, 640, 320)];
+	textView.editable = NO;
+	textView.font = [NSFont monospacedSystemFontOfSize:11 weight:NSFontWeightRegular];
+	textView.string = [[PBTracer shared] summary];
+
+	NSScrollView *scrollView = [[NSScrollView alloc] initWithFrame:textView.frame];
+	scrollView.hasVerticalScroller = YES;
+	scrollView.hasHorizontalScroller = YES;
+	scrollView.documentView = textView;
+
+	NSAlert *alert = [[NSAlert alloc] init];
+	alert.messageText = @"Performance Summary";
+	alert.informativeText = [PBTracer shared].isEnabled ? @"Times are per span since tracing was turned on." : @"Tracing is off.";
+	alert.accessoryView = scrollView;
+	[alert addButtonWithTitle:@"OK"];
+	[alert addButtonWithTitle:@"Reset"];
+	if ([alert runModal] == NSAlertSecondButtonReturn)
+		[[PBTracer shared] reset];
+}
+
+- (IBAction)saveTrace:(id)sender
+{
+	NSURL *defaultURL = [[PBTracer shared] defaultTraceURL];
+	NSSavePanel *panel = [NSSavePanel savePanel];
+	panel.directoryURL = [defaultURL URLByDeletingLastPathComponent];
+	panel.nameFieldStringValue = [defaultURL lastPathComponent];
+	if ([panel runModal] != NSModalResponseOK)
+		return;
+
+	NSError *error = nil;
+	if (![[PBTracer shared] writeTraceToURL:panel.URL error:&error])
+		[[NSAlert alertWithError:error] runModal];
+}
+
 @end
@@ -39,6 +39,7 @@ NS_ASSUME_NONNULL_BEGIN
 - (IBAction)refresh:(nullable id)sender;
 - (IBAction)commit:(nullable id)sender;
 - (IBAction)forceCommit:(nullable id)sender;
+- (IBAction)cancelCommit:(nullable id)sender;
 - (IBAction)signOff:(nullable id)sender;
 - (void)refreshDiff;
 @end
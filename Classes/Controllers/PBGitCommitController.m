@@ -18,6 +18,7 @@
 @interface PBGitCommitController ()
 - (void)refreshFinished:(NSNotification *)notification;
 - (void)commitWithVerification:(BOOL) doVerify;
+- (void)updateCommitButton;
 - (void)commitStatusUpdated:(NSNotification *)notification;
 - (void)commitFinished:(NSNotification *)notification;
 - (void)commitFailed:(NSNotification *)notification;
@@ -148,9 +149,22 @@ - (void) updateView
 
 - (IBAction)commit:(nullable id)sender
 {
+	// The commit button doubles as "Cancel" while a commit is running
+	if (index.commitProgress) {
+		[self cancelCommit:sender];
+		return;
+	}
     [self commitWithVerification:YES];
 }
 
+- (IBAction)cancelCommit:(nullable id)sender
+{
+	if (!index.commitProgress.isCancellable)
+		return;
+	self.status = @"Cancelling commit…";
+	[index cancelCommit];
+}
+
 - (IBAction)forceCommit:(nullable id)sender
 {
     [self commitWithVerification:NO];
@@ -181,6 +195,18 @@ - (void) commitWithVerification:(BOOL) doVerify
 	[commitMessageView setEditable:NO];
 
 	[index commitWithMessage:commitMessage andVerify:doVerify];
+	[self updateCommitButton];
+}
+
+- (void)updateCommitButton
+{
+	if (index.commitProgress) {
+		[commitButton setTitle:@"Cancel"];
+		[commitButton setEnabled:index.commitProgress.isCancellable];
+	} else {
+		[commitButton setTitle:@"Commit"];
+		[commitButton setEnabled:[[cachedFilesController arrangedObjects] count] > 0];
+	}
 }
 
 
@@ -194,11 +220,19 @@ - (void)refreshFinished:(NSNotification *)notification
 
 - (void)commitStatusUpdated:(NSNotification *)notification
 {
-	self.status = [[notification userInfo] objectForKey:@"description"];
+	NSDictionary *userInfo = [notification userInfo];
+	NSNumber *stage = userInfo[@"stage"];
+	NSNumber *stageCount = userInfo[@"stageCount"];
+	if (stage && stageCount)
+		self.status = [NSString stringWithFormat:@"%@ (%@ of %@)", userInfo[@"description"], stage, stageCount];
+	else
+		self.status = userInfo[@"description"];
+	[self updateCommitButton];
 }
 
 - (void)commitFinished:(NSNotification *)notification
 {
+	[self updateCommitButton];
 	[commitMessageView setEditable:YES];
 	[commitMessageView setString:@""];
 	[webController setStateMessage:notification.userInfo[@"description"]];
@@ -207,7 +241,13 @@ - (void)commitFinished:(NSNotification *)notification
 - (void)commitFailed:(NSNotification *)notification
 {
 	self.isBusy = NO;
+	[self updateCommitButton];
 	NSString *reason = [[notification userInfo] objectForKey:@"description"];
+	if ([[notification userInfo][@"cancelled"] boolValue]) {
+		self.status = reason;
+		[commitMessageView setEditable:YES];
+		return;
+	}
 	self.status = [@"Commit failed: " stringByAppendingString:reason];
 	[commitMessageView setEditable:YES];
 	[[repository windowController] showMessageSheet:@"Commit failed" infoText:reason];
@@ -216,6 +256,7 @@ - (void)commitFailed:(NSNotification *)notification
 - (void)commitHookFailed:(NSNotification *)notification
 {
 	self.isBusy = NO;
+	[self updateCommitButton];
 	NSString *reason = [[notification userInfo] objectForKey:@"description"];
 	self.status = [@"Commit hook failed: " stringByAppendingString:reason];
 	[commitMessageView setEditable:YES];
@@ -237,12 +278,7 @@ - (void)indexChanged:(NSNotification *)notification
 {
 	[cachedFilesController rearrangeObjects];
 	[unstagedFilesController rearrangeObjects];
-    if ([[cachedFilesController arrangedObjects] count]) {
-        [commitButton setEnabled:YES];
-    } else {
-        [commitButton setEnabled:NO];
-    }
-
+	[self updateCommitButton];
 }
 
 - (void)indexOperationFailed:(NSNotification *)notification
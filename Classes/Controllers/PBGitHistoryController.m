@@ -64,7 +64,6 @@ - (void)awakeFromNib
 	[commitList reloadData];
 
 	if (!repository.currentBranch) {
-		[repository reloadRefs];
 		[repository readCurrentBranch];
 	}
 	else
@@ -96,6 +95,14 @@ - (void)awakeFromNib
 	repository.currentBranchFilter = PBGitBranchFilterTypeAll;
 
 
+	// Date column strings are cached per commit for the current day; redraw them when the day rolls over.
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(calendarDayChanged:) name:NSCalendarDayChangedNotification object:nil];
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(calendarDayChanged:) name:NSSystemTimeZoneDidChangeNotification object:nil];
+	// Rows drawn before their subject and author were read are drawn again once they are.
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(commitTextsLoaded:) name:PBCommitTextCache.didLoadTextNotification object:repository.commitTexts];
+	// Whether the selection is on the head branch may only be known later.
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(ancestryUpdated:) name:PBCommitAncestry.didUpdateNotification object:repository.ancestry];
+
 	__weak typeof(self) weakSelf = self;
 	commitList.findPanelActionBlock = ^(id sender) {
 		__strong typeof(weakSelf) strongSelf = weakSelf;
@@ -116,10 +123,7 @@ - (void)updateKeys
 		if (![selectedCommit isEqual:lastObject]) {
 			selectedCommit = lastObject;
 
-			BOOL isOnHeadBranch = [selectedCommit isOnHeadBranch];
-			[mergeButton setEnabled:!isOnHeadBranch];
-			[cherryPickButton setEnabled:!isOnHeadBranch];
-			[rebaseButton setEnabled:!isOnHeadBranch];
+			[self updateBranchButtons];
 			// Track last known selected SHA to restore after updates
 			self.lastSelectedSHA = [selectedCommit sha] ?: @"";
 		}
@@ -134,6 +138,20 @@ - (void)updateKeys
 		self.webCommit = selectedCommit;
 }
 
+- (void)updateBranchButtons
+{
+	BOOL isOnHeadBranch = [selectedCommit isOnHeadBranch];
+	[mergeButton setEnabled:!isOnHeadBranch];
+	[cherryPickButton setEnabled:!isOnHeadBranch];
+	[rebaseButton setEnabled:!isOnHeadBranch];
+}
+
+- (void)ancestryUpdated:(NSNotification *)notification
+{
+	if (selectedCommit && [[commitController selectedObjects] lastObject] == selectedCommit)
+		[self updateBranchButtons];
+}
+
 
 - (PBGitCommit *) firstCommit
 {
@@ -224,6 +242,30 @@ - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(
 
 
 
+- (void)commitTextsLoaded:(NSNotification *)notification
+{
+	NSRange visibleRows = [commitList rowsInRect:[commitList visibleRect]];
+	if (visibleRows.length == 0)
+		return;
+	[commitList reloadDataForRowIndexes:[NSIndexSet indexSetWithIndexesInRange:visibleRows]
+	                      columnIndexes:[NSIndexSet indexSetWithIndexesInRange:NSMakeRange(0, (NSUInteger)[commitList numberOfColumns])]];
+}
+
+- (void)calendarDayChanged:(NSNotification *)notification
+{
+	dispatch_async(dispatch_get_main_queue(), ^{
+		[PBCommitDateColumnFormatter invalidate];
+
+		NSInteger column = [commitList columnWithIdentifier:@"DateColumn"];
+		if (column < 0)
+			return;
+
+		NSRange visibleRows = [commitList rowsInRect:[commitList visibleRect]];
+		[commitList reloadDataForRowIndexes:[NSIndexSet indexSetWithIndexesInRange:visibleRows]
+		                      columnIndexes:[NSIndexSet indexSetWithIndex:(NSUInteger)column]];
+	});
+}
+
 - (void)keyDown:(NSEvent*)event
 {
 	if ([[event charactersIgnoringModifiers] isEqualToString: @"f"] && [event modifierFlags] & NSEventModifierFlagOption && [event modifierFlags] & NSEventModifierFlagCommand)
@@ -499,6 +541,34 @@ - (IBAction) rebase:(id)sender
 
 #pragma mark - NSTableViewDelegate (View-Based)
 
+// Rows laid out from the commit-graph have no subject or author until they
+// are shown. When the first of them is drawn, read every visible row without
+// text in one batch, and queue a screenful above and below so scrolling finds
+// them ready.
+- (void)loadTextAroundRow:(NSInteger)row
+{
+	NSArray *commits = [commitController arrangedObjects];
+	NSRange visibleRows = NSUnionRange([commitList rowsInRect:[commitList visibleRect]], NSMakeRange((NSUInteger)row, 1));
+	NSUInteger margin = MAX(visibleRows.length, (NSUInteger)50);
+	NSUInteger start = visibleRows.location > margin ? visibleRows.location - margin : 0;
+	NSUInteger end = MIN(NSMaxRange(visibleRows) + margin, [commits count]);
+
+	NSMutableArray<NSString *> *visibleSHAs = [NSMutableArray array];
+	NSMutableArray<NSString *> *nearbySHAs = [NSMutableArray array];
+	for (NSUInteger index = start; index < end; index++) {
+		PBGitCommit *commit = commits[index];
+		if (![commit needsText])
+			continue;
+		if (NSLocationInRange(index, visibleRows))
+			[visibleSHAs addObject:commit.sha];
+		else
+			[nearbySHAs addObject:commit.sha];
+	}
+
+	[repository.commitTexts loadTextForSHAs:visibleSHAs];
+	[repository.commitTexts prefetchTextForSHAs:nearbySHAs];
+}
+
 - (NSView *)tableView:(NSTableView *)tableView viewForTableColumn:(NSTableColumn *)tableColumn row:(NSInteger)row
 {
 	if (tableView != commitList)
@@ -509,6 +579,8 @@ - (NSView *)tableView:(NSTableView *)tableView viewForTableColumn:(NSTableColumn
 		return nil;
 	
 	PBGitCommit *commit = [commits objectAtIndex:row];
+	if ([commit needsText])
+		[self loadTextAroundRow:row];
 	
 	NSString *identifier = [tableColumn identifier];
 	
@@ -569,36 +641,7 @@ - (NSView *)tableView:(NSTableView *)tableView viewForTableColumn:(NSTableColumn
 			]];
 		}
 		
-		NSDate *commitDate = [commit date];
-		NSString *dateString = @"";
-		if (commitDate) {
-			NSCalendar *calendar = [NSCalendar currentCalendar];
-			NSDate *now = [NSDate date];
-			NSDateComponents *commitComponents = [calendar components:(NSCalendarUnitYear | NSCalendarUnitMonth | NSCalendarUnitDay | NSCalendarUnitHour | NSCalendarUnitMinute) fromDate:commitDate];
-			NSDateComponents *nowComponents = [calendar components:(NSCalendarUnitYear | NSCalendarUnitMonth | NSCalendarUnitDay) fromDate:now];
-
-			BOOL isToday = (commitComponents.year == nowComponents.year &&
-							commitComponents.month == nowComponents.month &&
-							commitComponents.day == nowComponents.day);
-			BOOL isCurrentYear = (commitComponents.year == nowComponents.year);
-
-			// Format time as h:MMam/pm
-			NSInteger hour = commitComponents.hour;
-			NSString *ampm = (hour >= 12) ? @"pm" : @"am";
-			hour = hour % 12;
-			if (hour == 0) hour = 12;
-			NSString *time = [NSString stringWithFormat:@"%ld:%02ld%@", (long)hour, (long)commitComponents.minute, ampm];
-
-			if (isToday) {
-				dateString = time;
-			} else if (isCurrentYear) {
-				dateString = [NSString stringWithFormat:@"%ld/%ld, %@", (long)commitComponents.month, (long)commitComponents.day, time];
-			} else {
-				dateString = [NSString stringWithFormat:@"%ld/%ld/%ld, %@", (long)commitComponents.month, (long)commitComponents.day, (long)(commitComponents.year % 100), time];
-			}
-		}
-
-		cellView.textField.stringValue = dateString;
+		cellView.textField.stringValue = [commit dateColumnString];
 		// Text color will be handled by the table view's background style
 		return cellView;
 	}
@@ -20,6 +20,8 @@
 	IBOutlet NSPopUpButton *actionButton;
 
 	NSMutableArray *items;
+	NSMutableDictionary *itemsByRev; // PBGitRevSpecifier -> its leaf PBSourceViewItem
+	BOOL outlineUpdatesPending;
 
 	/* Specific things */
 	PBSourceViewItem *stage;
@@ -19,8 +19,10 @@ @interface PBGitSidebarController ()
 
 - (void)populateList;
 - (PBSourceViewItem *)addRevSpec:(PBGitRevSpecifier *)revSpec;
+- (PBSourceViewItem *)insertRevSpec:(PBGitRevSpecifier *)revSpec;
 - (PBSourceViewItem *)itemForRev:(PBGitRevSpecifier *)rev;
 - (void) removeRevSpec:(PBGitRevSpecifier *)rev;
+- (void) reloadSubmoduleItems;
 - (void) updateActionMenu;
 @end
 
@@ -35,6 +37,7 @@ - (id)initWithRepository:(PBGitRepository *)theRepository superController:(PBGit
 	self = [super initWithRepository:theRepository superController:controller];
 	[sourceView setDelegate:self];
 	items = [NSMutableArray array];
+	itemsByRev = [NSMutableDictionary dictionary];
 
 	return self;
 }
@@ -50,6 +53,8 @@ - (void)awakeFromNib
 
 	[repository addObserver:self forKeyPath:@"currentBranch" options:0 context:@"currentBranchChange"];
 	[repository addObserver:self forKeyPath:@"branches" options:(NSKeyValueObservingOptionOld | NSKeyValueObservingOptionNew) context:@"branchesModified"];
+	[repository addObserver:self forKeyPath:@"submodules" options:0 context:@"submodulesModified"];
+	[repository addObserver:self forKeyPath:@"refs" options:0 context:@"refsModified"];
 
     [sourceView setTarget:self];
     [sourceView setDoubleAction:@selector(doubleClicked:)];
@@ -63,6 +68,7 @@ - (void)awakeFromNib
 
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(expandCollapseItem:) name:NSOutlineViewItemWillExpandNotification object:sourceView];
     [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(expandCollapseItem:) name:NSOutlineViewItemWillCollapseNotification object:sourceView];
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(aheadBehindUpdated:) name:PBCommitAncestry.didUpdateNotification object:repository.ancestry];
 
 }
 
@@ -70,6 +76,7 @@ - (void)dealloc
 {
     [[NSNotificationCenter defaultCenter] removeObserver:self name:NSOutlineViewItemWillExpandNotification object:sourceView];
     [[NSNotificationCenter defaultCenter] removeObserver:self name:NSOutlineViewItemWillCollapseNotification object:sourceView];
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:PBCommitAncestry.didUpdateNotification object:nil];
 }
 
 - (void)closeView
@@ -79,6 +86,8 @@ - (void)closeView
 
 	[repository removeObserver:self forKeyPath:@"currentBranch"];
 	[repository removeObserver:self forKeyPath:@"branches"];
+	[repository removeObserver:self forKeyPath:@"submodules"];
+	[repository removeObserver:self forKeyPath:@"refs"];
 
 	[super closeView];
 }
@@ -86,7 +95,8 @@ - (void)closeView
 - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
 {
 	if ([@"currentBranchChange" isEqualToString:(__bridge NSString*)context]) {
-		[sourceView reloadData];
+		// Only the checked-out marker changes, which willDisplayCell: picks up on redraw.
+		[sourceView setNeedsDisplay:YES];
 		[self selectCurrentBranch];
 		return;
 	}
@@ -114,6 +124,29 @@ - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(
 			for (PBGitRevSpecifier *rev in removedRevSpecs)
 				[self removeRevSpec:rev];
 		}
+		else if (changeKind == NSKeyValueChangeSetting) {
+			// The repository's first ref listing, which arrives after the window opens
+			BOOL stageSelected = [self selectedItem] == stage;
+			[items removeAllObjects];
+			[itemsByRev removeAllObjects];
+			[self populateList];
+			if (stageSelected)
+				[self selectStage];
+			else
+				[self selectCurrentBranch];
+		}
+		return;
+	}
+
+	if ([@"refsModified" isEqualToString:(__bridge NSString*)context]) {
+		// Branches may have moved against their upstreams
+		[sourceView setNeedsDisplay:YES];
+		return;
+	}
+
+	if ([@"submodulesModified" isEqualToString:(__bridge NSString*)context]) {
+		[self reloadSubmoduleItems];
+		[sourceView reloadItem:submodules reloadChildren:YES];
 		return;
 	}
 
@@ -138,15 +171,12 @@ - (void) selectCurrentBranch
 {
 	PBGitRevSpecifier *rev = repository.currentBranch;
 	if (!rev) {
-		[repository reloadRefs];
 		[repository readCurrentBranch];
 		return;
 	}
 
 	PBSourceViewItem *item = [self addRevSpec:rev];
     if (item) {
-        [sourceView reloadData];
-	
         // Expand all parent items
         NSMutableArray *parents = [NSMutableArray array];
         id parentItem = item;
@@ -164,35 +194,72 @@ - (void) selectCurrentBranch
 
 - (PBSourceViewItem *) itemForRev:(PBGitRevSpecifier *)rev
 {
-	PBSourceViewItem *foundItem = nil;
-	for (PBSourceViewItem *item in items)
-		if ( (foundItem = [item findRev:rev]) != nil )
-			return foundItem;
-	return nil;
+	return [itemsByRev objectForKey:rev];
 }
 
-- (PBSourceViewItem *)addRevSpec:(PBGitRevSpecifier *)rev
+// Groups every outline change made during this pass of the run loop, which
+// covers all the branch insertions and removals of a single ref reload.
+- (void) beginCoalescedOutlineUpdates
 {
-    PBSourceViewItem *item = nil;
-    for (PBSourceViewItem *it in items)
-        if ( (item = [it findRev:rev]) != nil )
-            return item;
+	if (outlineUpdatesPending)
+		return;
 
-	if (![rev isSimpleRef]) {
-		[others addChild:[PBSourceViewItem itemWithRevSpec:rev]];
+	outlineUpdatesPending = YES;
+	[sourceView beginUpdates];
+	dispatch_async(dispatch_get_main_queue(), ^{
+		self->outlineUpdatesPending = NO;
+		[self->sourceView endUpdates];
+	});
+}
+
+// Adds rev to the model without touching the outline view and returns its item.
+- (PBSourceViewItem *)insertRevSpec:(PBGitRevSpecifier *)rev
+{
+	PBSourceViewItem *item = [itemsByRev objectForKey:rev];
+	if (item)
 		return item;
+
+	if (![rev isSimpleRef]) {
+		item = [PBSourceViewItem itemWithRevSpec:rev];
+		[others addChild:item];
+	}
+	else {
+		NSArray *pathComponents = [[rev simpleRef] componentsSeparatedByString:@"/"];
+		if ([pathComponents count] < 2) {
+			item = [PBSourceViewItem itemWithRevSpec:rev];
+			[branches addChild:item];
+		}
+		else if ([[pathComponents objectAtIndex:1] isEqualToString:@"heads"])
+			item = [branches addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
+		else if ([[rev simpleRef] hasPrefix:@"refs/tags/"])
+			item = [tags addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
+		else if ([[rev simpleRef] hasPrefix:@"refs/remotes/"])
+			item = [remotes addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
 	}
 
-	NSArray *pathComponents = [[rev simpleRef] componentsSeparatedByString:@"/"];
-	if ([pathComponents count] < 2)
-		[branches addChild:[PBSourceViewItem itemWithRevSpec:rev]];
-	else if ([[pathComponents objectAtIndex:1] isEqualToString:@"heads"])
-		[branches addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
-	else if ([[rev simpleRef] hasPrefix:@"refs/tags/"])
-		[tags addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
-	else if ([[rev simpleRef] hasPrefix:@"refs/remotes/"])
-		[remotes addRev:rev toPath:[pathComponents subarrayWithRange:NSMakeRange(2, [pathComponents count] - 2)]];
-    return item;
+	if (item)
+		[itemsByRev setObject:item forKey:rev];
+	return item;
+}
+
+- (PBSourceViewItem *)addRevSpec:(PBGitRevSpecifier *)rev
+{
+	PBSourceViewItem *item = [itemsByRev objectForKey:rev];
+	if (item)
+		return item;
+
+	item = [self insertRevSpec:rev];
+	if (!item)
+		return nil;
+
+	// Insert only the outermost new node; its new children load with it.
+	PBSourceViewItem *inserted = [item outermostExclusiveAncestor];
+	PBSourceViewItem *parent = inserted.parent;
+	[self beginCoalescedOutlineUpdates];
+	[sourceView insertItemsAtIndexes:[NSIndexSet indexSetWithIndex:(NSUInteger)[parent indexOfChild:inserted]]
+							inParent:parent
+					   withAnimation:NSTableViewAnimationEffectNone];
+	return item;
 }
 
 - (void) removeRevSpec:(PBGitRevSpecifier *)rev
@@ -202,9 +269,43 @@ - (void) removeRevSpec:(PBGitRevSpecifier *)rev
 	if (!item)
 		return;
 
-	PBSourceViewItem *parent = item.parent;
-	[parent removeChild:item];
-	[sourceView reloadData];
+	[itemsByRev removeObjectForKey:rev];
+
+	// Removing the item also drops the folders that only held it.
+	PBSourceViewItem *removed = [item outermostExclusiveAncestor];
+	PBSourceViewItem *parent = removed.parent;
+	NSInteger index = [parent indexOfChild:removed];
+	[item.parent removeChild:item];
+
+	if (index == NSNotFound)
+		return;
+
+	[self beginCoalescedOutlineUpdates];
+	[sourceView removeItemsAtIndexes:[NSIndexSet indexSetWithIndex:(NSUInteger)index]
+							inParent:parent
+					   withAnimation:NSTableViewAnimationEffectNone];
+}
+
+// Rebuilds the Submodules group from the repository's cached list, then fills
+// in each submodule's dirty state in the background.
+- (void) reloadSubmoduleItems
+{
+	for (PBSourceViewItem *item in [[submodules sortedChildren] copy])
+		[submodules removeChild:item];
+
+	NSArray *infos = repository.submodules;
+	for (PBSubmoduleInfo *info in infos)
+		[submodules addChild:[PBGitSVSubmoduleItem itemWithSubmodule:info]];
+
+	if ([infos count] == 0)
+		return;
+
+	__weak PBGitSidebarController *weakSelf = self;
+	[PBSubmoduleInfo loadStatusForSubmodules:infos completion:^{
+		PBGitSidebarController *strongSelf = weakSelf;
+		if (strongSelf && strongSelf->repository.submodules == infos)
+			[strongSelf->sourceView reloadItem:strongSelf->submodules reloadChildren:YES];
+	}];
 }
 
 - (void)setHistorySearch:(NSString *)searchString mode:(NSInteger)mode
@@ -267,9 +368,24 @@ - (BOOL)outlineView:(NSOutlineView *)outlineView isGroupItem:(id)item
 - (void)outlineView:(NSOutlineView *)outlineView willDisplayCell:(PBSourceViewCell *)cell forTableColumn:(NSTableColumn *)tableColumn item:(PBSourceViewItem *)item
 {
 	cell.isCheckedOut = [item.revSpecifier isEqual:[repository headRef]];
+	// Counted in the background the first time; aheadBehindUpdated: redraws
+	PBGitRef *ref = item.revSpecifier.ref;
+	cell.aheadBehind = [ref isBranch] ? [repository.ancestry aheadBehindForBranch:ref] : nil;
 	[cell setImage:[item icon]];
 }
 
+- (void)aheadBehindUpdated:(NSNotification *)notification
+{
+	[sourceView setNeedsDisplay:YES];
+}
+
+- (NSString *)outlineView:(NSOutlineView *)outlineView toolTipForCell:(NSCell *)cell rect:(NSRectPointer)rect tableColumn:(NSTableColumn *)tableColumn item:(id)item mouseLocation:(NSPoint)mouseLocation
+{
+	if ([item isKindOfClass:[PBGitSVSubmoduleItem class]])
+		return [(PBGitSVSubmoduleItem *)item toolTip];
+	return nil;
+}
+
 - (BOOL)outlineView:(NSOutlineView *)outlineView shouldSelectItem:(id)item
 {
 	return ![item isGroupItem];
@@ -298,39 +414,15 @@ - (void)populateList
 	submodules = [PBSourceViewItem groupItemWithTitle:@"Submodules"];
 	others = [PBSourceViewItem groupItemWithTitle:@"Other"];
 
-	for (PBGitRevSpecifier *rev in repository.branches) {
-		[self addRevSpec:rev];
-	}
-    
-    NSError *error = nil;
-    NSString *output = [repository executeGitCommand:@[@"submodule", @"status"] error:&error];
-    
-    if (!error && output) {
-        NSArray *lines = [output componentsSeparatedByString:@"\n"];
-        
-        for (NSString *line in lines) {
-            NSString *trimmedLine = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-            if (trimmedLine.length > 0) {
-                // Parse submodule status line: " <sha> <path> (<description>)"
-                // Skip the first character (status indicator) and parse the rest
-                NSString *statusLine = [trimmedLine substringFromIndex:1];
-                NSArray *components = [statusLine componentsSeparatedByString:@" "];
-                if (components.count >= 2) {
-                    NSString *path = [components objectAtIndex:1];
-                    NSString *name = [path lastPathComponent]; // Use path as name
-                    
-                    // Create a simple submodule info object
-                    PBSubmoduleInfo *subInfo = [[PBSubmoduleInfo alloc] init];
-                    subInfo.name = name;
-                    subInfo.path = path;
-                    subInfo.parentRepositoryURL = [NSURL fileURLWithPath:[repository workingDirectory]];
-                        
-                    [submodules addChild: [PBGitSVSubmoduleItem itemWithSubmodule:subInfo]];
-                }
-            }
-        }
-    }
+	// Sorted input lets each folder append its children instead of searching for a slot.
+	NSArray *sortedRevs = [repository.branches sortedArrayUsingComparator:^NSComparisonResult(PBGitRevSpecifier *rev1, PBGitRevSpecifier *rev2) {
+		return [[rev1 description] localizedStandardCompare:[rev2 description]];
+	}];
+	for (PBGitRevSpecifier *rev in sortedRevs)
+		[self insertRevSpec:rev];
     
+	[self reloadSubmoduleItems];
+
 	[items addObject:project];
 	[items addObject:branches];
 	[items addObject:remotes];
@@ -362,12 +454,12 @@ - (id)outlineView:(NSOutlineView *)outlineView child:(NSInteger)index ofItem:(id
 	if (!item)
 		return [items objectAtIndex:(NSUInteger)index];
 
-	return [[(PBSourceViewItem *)item sortedChildren] objectAtIndex:(NSUInteger)index];
+	return [(PBSourceViewItem *)item childAtIndex:index];
 }
 
 - (BOOL)outlineView:(NSOutlineView *)outlineView isItemExpandable:(id)item
 {
-	return [[(PBSourceViewItem *)item sortedChildren] count];
+	return [(PBSourceViewItem *)item numberOfChildren] > 0;
 }
 
 - (NSInteger)outlineView:(NSOutlineView *)outlineView numberOfChildrenOfItem:(id)item
@@ -375,7 +467,7 @@ - (NSInteger)outlineView:(NSOutlineView *)outlineView numberOfChildrenOfItem:(id
 	if (!item)
 		return (NSInteger)[items count];
 
-	return (NSInteger)[[(PBSourceViewItem *)item sortedChildren] count];
+	return [(PBSourceViewItem *)item numberOfChildren];
 }
 
 - (id)outlineView:(NSOutlineView *)outlineView objectValueForTableColumn:(NSTableColumn *)tableColumn byItem:(id)item
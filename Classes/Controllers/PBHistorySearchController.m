@@ -23,6 +23,8 @@ - (void)updateUI;
 - (void)setupSearchMenuTemplate;
 
 - (void)startBasicSearch;
+- (void)searchTextOfRows:(NSDictionary<NSString *, NSNumber *> *)unreadRows predicate:(NSPredicate *)searchPredicate;
+- (void)addBasicSearchMatches:(NSIndexSet *)matches generation:(NSUInteger)generation finished:(BOOL)finished;
 - (void)startBackgroundSearch;
 - (void)clearProgressIndicator;
 
@@ -39,6 +41,9 @@ - (void)showSearchRewindPanelReverse:(BOOL)isReversed;
 #define kGitXRegexSearchLabel @"Commit (pickaxe regex)"
 #define kGitXPathSearchLabel @"File path"
 
+// Commits whose text a basic search reads between updates of the results
+#define kGitXBasicSearchBatchSize 4096
+
 #define kGitXSearchArrangedObjectsContext @"GitXSearchArrangedObjectsContext"
 
 
@@ -94,6 +99,7 @@ - (IBAction)stepperPressed:(id)sender
 
 - (void)clearSearch
 {
+	currentSearchGeneration++;
 	[searchField setStringValue:@""];
 	if (results) {
 		results = nil;
@@ -408,6 +414,9 @@ - (void)startProgressIndicator
 
 - (void)startBasicSearch
 {
+	// Stops the text of an earlier search from being read
+	currentSearchGeneration++;
+
 	NSString *searchString = [searchField stringValue];
 	if ([searchString isEqualToString:@""]) {
 		[self clearSearch];
@@ -417,9 +426,12 @@ - (void)startBasicSearch
 	NSMutableIndexSet *indexes = [NSMutableIndexSet indexSet];
 	NSPredicate *searchPredicate = [NSPredicate predicateWithFormat:@"message CONTAINS[cd] %@ OR author CONTAINS[cd] %@ OR realSha BEGINSWITH[c] %@", searchString, searchString, searchString];
 
+	NSMutableDictionary<NSString *, NSNumber *> *unreadRows = [NSMutableDictionary dictionary];
 	NSUInteger index = 0;
 	for (PBGitCommit *commit in [commitController arrangedObjects]) {
-		if ([searchPredicate evaluateWithObject:commit])
+		if ([commit needsText])
+			unreadRows[commit.sha] = @(index);
+		else if ([searchPredicate evaluateWithObject:commit])
 			[indexes addIndex:index];
 		index++;
 	}
@@ -434,6 +446,74 @@ - (void)startBasicSearch
 	// Force reload to show search highlighting immediately
 	[historyController.commitList reloadData];
 	[self updateSelectedResult];
+
+	if ([unreadRows count] > 0)
+		[self searchTextOfRows:unreadRows predicate:searchPredicate];
+}
+
+// Commits listed without their text are read in bulk on a background queue,
+// without filling the history's text cache, and their matches are added to
+// the results as each batch comes in.
+- (void)searchTextOfRows:(NSDictionary<NSString *, NSNumber *> *)unreadRows predicate:(NSPredicate *)searchPredicate
+{
+	[self startProgressIndicator];
+
+	NSUInteger searchGeneration = currentSearchGeneration;
+	PBCommitTextCache *texts = historyController.repository.commitTexts;
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+		__block NSMutableIndexSet *found = [NSMutableIndexSet indexSet];
+		__block NSUInteger searched = 0;
+		NSError *error = nil;
+		BOOL read = [texts enumerateTextForSHAs:[unreadRows allKeys] error:&error handler:^(NSString *sha, PBCommitData *text, BOOL *stop) {
+			NSDictionary *fields = @{@"message": text.message ?: @"", @"author": text.authorName ?: @"", @"realSha": sha};
+			if ([searchPredicate evaluateWithObject:fields])
+				[found addIndex:[unreadRows[sha] unsignedIntegerValue]];
+
+			if (++searched % kGitXBasicSearchBatchSize == 0) {
+				if (searchGeneration != self->currentSearchGeneration) {
+					*stop = YES;
+					return;
+				}
+				NSIndexSet *batch = found;
+				found = [NSMutableIndexSet indexSet];
+				dispatch_async(dispatch_get_main_queue(), ^{
+					[self addBasicSearchMatches:batch generation:searchGeneration finished:NO];
+				});
+			}
+		}];
+		if (!read)
+			NSLog(@"Could not read commit messages to search: %@", error.localizedDescription);
+
+		NSIndexSet *batch = found;
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self addBasicSearchMatches:batch generation:searchGeneration finished:YES];
+		});
+	});
+}
+
+- (void)addBasicSearchMatches:(NSIndexSet *)matches generation:(NSUInteger)generation finished:(BOOL)finished
+{
+	// The rows have changed or another search has started
+	if (generation != currentSearchGeneration)
+		return;
+
+	BOOL hadResults = [results count] > 0;
+	if ([matches count] > 0) {
+		NSMutableIndexSet *merged = [results mutableCopy] ?: [NSMutableIndexSet indexSet];
+		[merged addIndexes:matches];
+		results = merged;
+	}
+
+	if (finished) {
+		[self updateSelectedResult];
+		return;
+	}
+
+	if ([matches count] > 0) {
+		[historyController.commitList reloadData];
+		if (!hadResults)
+			[self selectIndex:[results firstIndex]];
+	}
 }
 
 
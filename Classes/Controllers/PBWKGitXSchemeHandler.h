@@ -18,6 +18,11 @@ typedef PBGitRepository * _Nullable (^PBWKGitXRepositoryProvider)(void);
 
 - (instancetype)initWithRepositoryProvider:(PBWKGitXRepositoryProvider)provider NS_DESIGNATED_INITIALIZER;
 - (void)updateRepositoryProvider:(PBWKGitXRepositoryProvider)provider;
+
+// Holds `data` until the page fetches it, once, from the returned
+// gitx:///payload/<token> URL. Lets bulk text such as diffs skip the JSON
+// bridge. Only the most recent payloads are kept.
+- (NSURL *)publishPayload:(NSData *)data;
 - (instancetype)init NS_UNAVAILABLE;
 + (instancetype)new NS_UNAVAILABLE;
 
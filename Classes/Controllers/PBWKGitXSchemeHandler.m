@@ -6,12 +6,29 @@
 #import "PBWKGitXSchemeHandler.h"
 
 #import "PBGitRepository.h"
+#import "GitX-Swift.h"
 
 static NSString * const PBWKGitXSchemeHandlerErrorDomain = @"PBWKGitXSchemeHandlerErrorDomain";
 
+// Requests beyond this wait in the queue rather than tying up GCD threads
+// while they block on the blob store's reader pool.
+static const NSInteger PBWKGitXConcurrentRequests = 4;
+
+// Published payloads nobody fetched (a message the page dropped) are
+// discarded oldest first beyond this count.
+static const NSUInteger PBWKGitXMaximumPayloads = 16;
+
+static NSString * const PBWKGitXPayloadPathPrefix = @"/payload/";
+
 @interface PBWKGitXSchemeHandler ()
 @property (nonatomic, copy) PBWKGitXRepositoryProvider repositoryProvider;
-@property (nonatomic, strong) dispatch_queue_t workQueue;
+@property (nonatomic, strong) NSOperationQueue *workQueue;
+@property (nonatomic, strong) PBGitBlobStore *blobStore;
+// Tasks WebKit has stopped; they must not be messaged again. Guarded by @synchronized.
+@property (nonatomic, strong) NSHashTable<id<WKURLSchemeTask>> *stoppedTasks;
+// Token -> bytes, and tokens in publishing order. Main thread only.
+@property (nonatomic, strong) NSMutableDictionary<NSString *, NSData *> *payloads;
+@property (nonatomic, strong) NSMutableArray<NSString *> *payloadOrder;
 @end
 
 @implementation PBWKGitXSchemeHandler
@@ -25,7 +42,14 @@ - (instancetype)initWithRepositoryProvider:(PBWKGitXRepositoryProvider)provider
     }
 
     _repositoryProvider = [provider copy];
-    _workQueue = dispatch_queue_create("com.gitx.wkwebview.gitx-scheme", DISPATCH_QUEUE_SERIAL);
+    _workQueue = [[NSOperationQueue alloc] init];
+    _workQueue.name = @"com.gitx.wkwebview.gitx-scheme";
+    _workQueue.maxConcurrentOperationCount = PBWKGitXConcurrentRequests;
+    _workQueue.qualityOfService = NSQualityOfServiceUserInitiated;
+    _blobStore = [PBGitBlobStore shared];
+    _stoppedTasks = [NSHashTable weakObjectsHashTable];
+    _payloads = [NSMutableDictionary dictionary];
+    _payloadOrder = [NSMutableArray array];
     return self;
 }
 
@@ -36,10 +60,32 @@ - (void)updateRepositoryProvider:(PBWKGitXRepositoryProvider)provider
     }
 }
 
+- (NSURL *)publishPayload:(NSData *)data
+{
+    NSAssert([NSThread isMainThread], @"Payloads are published on the main thread");
+
+    NSString *token = [[NSUUID UUID] UUIDString];
+    self.payloads[token] = [data copy] ?: [NSData data];
+    [self.payloadOrder addObject:token];
+    while (self.payloadOrder.count > PBWKGitXMaximumPayloads) {
+        [self.payloads removeObjectForKey:self.payloadOrder.firstObject];
+        [self.payloadOrder removeObjectAtIndex:0];
+    }
+
+    return [NSURL URLWithString:[NSString stringWithFormat:@"gitx://%@%@", PBWKGitXPayloadPathPrefix, token]];
+}
+
 - (void)webView:(WKWebView *)webView startURLSchemeTask:(id<WKURLSchemeTask>)urlSchemeTask
 {
     (void)webView;
 
+    // Payloads have no host, which no blob URL can have
+    NSURL *taskURL = urlSchemeTask.request.URL;
+    if (taskURL.host.length == 0 && [taskURL.path hasPrefix:PBWKGitXPayloadPathPrefix]) {
+        [self servePayloadForTask:urlSchemeTask];
+        return;
+    }
+
     PBWKGitXRepositoryProvider provider = self.repositoryProvider;
     PBGitRepository *repository = provider ? provider() : nil;
     if (!repository) {
@@ -60,7 +106,13 @@ - (void)webView:(WKWebView *)webView startURLSchemeTask:(id<WKURLSchemeTask>)url
         return;
     }
 
-    dispatch_async(self.workQueue, ^{
+    NSString *rangeHeader = [request valueForHTTPHeaderField:@"Range"];
+
+    [self.workQueue addOperationWithBlock:^{
+        if ([self isTaskStopped:urlSchemeTask]) {
+            return;
+        }
+
         NSString *host = url.host ?: @"";
         NSString *path = url.path ?: @"";
         if ([path hasPrefix:@"/"]) {
@@ -71,47 +123,168 @@ - (void)webView:(WKWebView *)webView startURLSchemeTask:(id<WKURLSchemeTask>)url
             NSError *error = [NSError errorWithDomain:PBWKGitXSchemeHandlerErrorDomain
                                                  code:3
                                              userInfo:@{ NSLocalizedDescriptionKey: @"Invalid gitx URL" }];
-            dispatch_async(dispatch_get_main_queue(), ^{
+            [self performOnMainForTask:urlSchemeTask block:^{
                 [urlSchemeTask didFailWithError:error];
-            });
+            }];
             return;
         }
 
         NSString *specifier = [NSString stringWithFormat:@"%@:%@", host, path];
-        NSArray *arguments = @[ @"cat-file", @"blob", specifier ];
+        __block BOOL respondedToTask = NO;
 
         NSError *gitError = nil;
-        NSData *data = [repository executeGitCommandReturningData:arguments error:&gitError];
+        BOOL succeeded = [self.blobStore readBlob:specifier
+                                     inRepository:repository
+                                     rangeForBlob:^NSRange(PBGitBlobInfo *info) {
+            NSRange range = NSMakeRange(0, (NSUInteger)info.size);
+            NSHTTPURLResponse *response = [self responseForURL:url blob:info rangeHeader:rangeHeader range:&range];
+            respondedToTask = YES;
+            [self performOnMainForTask:urlSchemeTask block:^{
+                [urlSchemeTask didReceiveResponse:response];
+            }];
+            if (response.statusCode == 416 || [self isTaskStopped:urlSchemeTask]) {
+                return NSMakeRange(NSNotFound, 0);
+            }
+            return range;
+        }
+                                     chunkHandler:^BOOL(NSData *chunk) {
+            [self performOnMainForTask:urlSchemeTask block:^{
+                [urlSchemeTask didReceiveData:chunk];
+            }];
+            return ![self isTaskStopped:urlSchemeTask];
+        }
+                                            error:&gitError];
 
-        if (!data) {
+        if (!succeeded) {
+            NSMutableDictionary *userInfo = [@{ NSLocalizedDescriptionKey: @"Failed to load gitx resource" } mutableCopy];
+            if (gitError) {
+                userInfo[NSUnderlyingErrorKey] = gitError;
+            }
             NSError *error = [NSError errorWithDomain:PBWKGitXSchemeHandlerErrorDomain
                                                  code:5
-                                             userInfo:@{ NSLocalizedDescriptionKey: @"Failed to load gitx resource" }];
-            dispatch_async(dispatch_get_main_queue(), ^{
+                                             userInfo:userInfo];
+            [self performOnMainForTask:urlSchemeTask block:^{
                 [urlSchemeTask didFailWithError:error];
-            });
+            }];
             return;
         }
 
-        dispatch_async(dispatch_get_main_queue(), ^{
-            NSURLResponse *response = [[NSURLResponse alloc] initWithURL:url
-                                                                 MIMEType:nil
-                                                    expectedContentLength:(NSInteger)data.length
-                                                         textEncodingName:nil];
-            [urlSchemeTask didReceiveResponse:response];
-            if (data.length > 0) {
-                [urlSchemeTask didReceiveData:data];
-            }
-            [urlSchemeTask didFinish];
-        });
-    });
+        if (respondedToTask) {
+            [self performOnMainForTask:urlSchemeTask block:^{
+                [urlSchemeTask didFinish];
+            }];
+        }
+    }];
 }
 
 - (void)webView:(WKWebView *)webView stopURLSchemeTask:(id<WKURLSchemeTask>)urlSchemeTask
 {
-    // Tasks are short-lived and executed on a serial queue; nothing to cancel explicitly.
     (void)webView;
-    (void)urlSchemeTask;
+    @synchronized (self.stoppedTasks) {
+        [self.stoppedTasks addObject:urlSchemeTask];
+    }
+}
+
+#pragma mark - Helpers
+
+// Payloads are already in memory, so they are answered right here on the
+// main thread in one piece. Each can be fetched once.
+- (void)servePayloadForTask:(id<WKURLSchemeTask>)urlSchemeTask
+{
+    NSURL *url = urlSchemeTask.request.URL;
+    NSString *token = [url.path substringFromIndex:PBWKGitXPayloadPathPrefix.length];
+    NSData *data = self.payloads[token];
+    if (!data) {
+        NSError *error = [NSError errorWithDomain:PBWKGitXSchemeHandlerErrorDomain
+                                             code:6
+                                         userInfo:@{ NSLocalizedDescriptionKey: @"Bridge payload is no longer available" }];
+        [urlSchemeTask didFailWithError:error];
+        return;
+    }
+    [self.payloads removeObjectForKey:token];
+    [self.payloadOrder removeObject:token];
+
+    // The page is a file:// document, so the fetch is cross-origin
+    NSDictionary<NSString *, NSString *> *headers = @{
+        @"Content-Type": @"text/plain; charset=utf-8",
+        @"Content-Length": [NSString stringWithFormat:@"%lu", (unsigned long)data.length],
+        @"Cache-Control": @"no-store",
+        @"Access-Control-Allow-Origin": @"*",
+    };
+    NSHTTPURLResponse *response = [[NSHTTPURLResponse alloc] initWithURL:url statusCode:200 HTTPVersion:@"HTTP/1.1" headerFields:headers];
+    [urlSchemeTask didReceiveResponse:response];
+    [urlSchemeTask didReceiveData:data];
+    [urlSchemeTask didFinish];
+}
+
+- (BOOL)isTaskStopped:(id<WKURLSchemeTask>)urlSchemeTask
+{
+    @synchronized (self.stoppedTasks) {
+        return [self.stoppedTasks containsObject:urlSchemeTask];
+    }
+}
+
+// WebKit raises if a stopped task is messaged, and stops arrive on the main
+// thread, so the check has to happen there too.
+- (void)performOnMainForTask:(id<WKURLSchemeTask>)urlSchemeTask block:(dispatch_block_t)block
+{
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (![self isTaskStopped:urlSchemeTask]) {
+            block();
+        }
+    });
+}
+
+// A 200 for the whole blob, or a 206 / 416 when the request carries a single
+// "bytes=" range. Multiple ranges are answered with the whole blob, which
+// HTTP allows. On return `range` holds the bytes to send.
+- (NSHTTPURLResponse *)responseForURL:(NSURL *)url blob:(PBGitBlobInfo *)info rangeHeader:(nullable NSString *)rangeHeader range:(NSRange *)range
+{
+    NSUInteger size = (NSUInteger)info.size;
+    NSMutableDictionary<NSString *, NSString *> *headers = [@{
+        @"Accept-Ranges": @"bytes",
+        @"ETag": [NSString stringWithFormat:@"\"%@\"", info.oid],
+    } mutableCopy];
+    NSInteger statusCode = 200;
+    *range = NSMakeRange(0, size);
+
+    NSString *spec = [rangeHeader stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+    if ([spec hasPrefix:@"bytes="] && ![spec containsString:@","]) {
+        NSArray<NSString *> *bounds = [[spec substringFromIndex:6] componentsSeparatedByString:@"-"];
+        if (bounds.count == 2) {
+            NSString *first = bounds[0];
+            NSString *last = bounds[1];
+            unsigned long long start = 0;
+            unsigned long long end = size > 0 ? size - 1 : 0;
+            BOOL valid = YES;
+
+            if (first.length == 0) {
+                // "bytes=-N" is the last N bytes.
+                unsigned long long suffix = strtoull(last.UTF8String, NULL, 10);
+                valid = last.length > 0 && suffix > 0;
+                start = suffix >= size ? 0 : size - suffix;
+            } else {
+                start = strtoull(first.UTF8String, NULL, 10);
+                if (last.length > 0) {
+                    end = MIN(end, strtoull(last.UTF8String, NULL, 10));
+                    valid = strtoull(last.UTF8String, NULL, 10) >= start;
+                }
+            }
+
+            if (!valid || start >= size) {
+                statusCode = 416;
+                headers[@"Content-Range"] = [NSString stringWithFormat:@"bytes */%lu", (unsigned long)size];
+                *range = NSMakeRange(0, 0);
+            } else {
+                statusCode = 206;
+                headers[@"Content-Range"] = [NSString stringWithFormat:@"bytes %llu-%llu/%lu", start, end, (unsigned long)size];
+                *range = NSMakeRange((NSUInteger)start, (NSUInteger)(end - start + 1));
+            }
+        }
+    }
+
+    headers[@"Content-Length"] = [NSString stringWithFormat:@"%lu", (unsigned long)range->length];
+    return [[NSHTTPURLResponse alloc] initWithURL:url statusCode:statusCode HTTPVersion:@"HTTP/1.1" headerFields:headers];
 }
 
 @end
@@ -13,6 +13,7 @@
 
 @interface PBWebChangesController ()
 - (NSDictionary *)bridgeDictionaryForChangedFile:(PBChangedFile *)file;
+- (NSString *)diffKeyForFile:(PBChangedFile *)file cached:(BOOL)cached;
 @end
 
 @implementation PBWebChangesController
@@ -108,8 +109,10 @@ - (void) refreshWithForce:(BOOL)force
 	NSMutableDictionary *payload = [NSMutableDictionary dictionary];
 	payload[@"cached"] = @(selectedFileIsCached);
 	payload[@"forceRefresh"] = @(force);
-	if (selectedFile)
+	if (selectedFile) {
 		payload[@"file"] = [self bridgeDictionaryForChangedFile:selectedFile];
+		payload[@"diffKey"] = [self diffKeyForFile:selectedFile cached:selectedFileIsCached];
+	}
 
 	[self sendBridgeEventWithType:@"commitSelectionChanged" payload:payload];
 }
@@ -162,16 +165,33 @@ - (NSDictionary *)bridgeDictionaryForChangedFile:(PBChangedFile *)file
 	return dictionary;
 }
 
+// Names the diff the commit view would be shown for a file: its path and
+// the blobs compared. The work tree has no blob name until it is hashed,
+// so its size and modification time stand in for one.
+- (NSString *)diffKeyForFile:(PBChangedFile *)file cached:(BOOL)cached
+{
+	NSString *path = file.path ?: @"";
+	if (cached)
+		return [NSString stringWithFormat:@"%@\nindex\n%@\n%@", path, file.headBlobSHA ?: @"", file.indexBlobSHA ?: @""];
+
+	NSString *fullPath = [[controller.repository workingDirectory] stringByAppendingPathComponent:path];
+	NSDictionary *attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:fullPath error:nil];
+	return [NSString stringWithFormat:@"%@\nworktree\n%@\n%llu:%.6f", path, file.indexBlobSHA ?: @"",
+	        [attributes fileSize], [[attributes fileModificationDate] timeIntervalSinceReferenceDate]];
+}
+
 - (void)handleBridgeMessage:(NSString *)type payload:(NSDictionary *)payload
 {
 	if ([type isEqualToString:@"commitApplyPatch"]) {
-		NSString *patch = nil;
-		id patchValue = payload[@"patch"];
-		if ([patchValue isKindOfClass:[NSString class]])
-			patch = patchValue;
-		else if ([patchValue respondsToSelector:@selector(description)])
-			patch = [patchValue description];
-		if (patch.length == 0)
+		// Either a single "patch" or a "patches" array to apply as one batch
+		NSMutableArray *patches = [NSMutableArray array];
+		id patchValue = payload[@"patches"] ?: payload[@"patch"];
+		for (id value in ([patchValue isKindOfClass:[NSArray class]] ? patchValue : @[ patchValue ?: @"" ])) {
+			NSString *patch = [value isKindOfClass:[NSString class]] ? value : [value description];
+			if (patch.length)
+				[patches addObject:patch];
+		}
+		if (patches.count == 0)
 			return;
 
 		BOOL reverse = NO;
@@ -184,7 +204,7 @@ - (void)handleBridgeMessage:(NSString *)type payload:(NSDictionary *)payload
 		if ([stageValue respondsToSelector:@selector(boolValue)])
 			stage = [stageValue boolValue];
 
-		[controller.index applyPatch:patch stage:stage reverse:reverse];
+		[controller.index applyPatches:patches stage:stage reverse:reverse];
 		[self sendBridgeEventWithType:@"commitHunkApplied" payload:@{}];
 		return;
 	}
@@ -230,8 +250,11 @@ - (void)handleBridgeMessage:(NSString *)type payload:(NSDictionary *)payload
 		else if ([contextValue respondsToSelector:@selector(integerValue)])
 			contextLines = (NSUInteger)MAX(0, [contextValue integerValue]);
 
+		// Taken before the diff, so a change made meanwhile gives a new key
+		NSString *diffKey = [self diffKeyForFile:selectedFile cached:selectedFileIsCached];
 		BOOL diffWasTruncated = NO;
-		NSString *diff = [controller.index diffForFile:selectedFile staged:selectedFileIsCached contextLines:contextLines truncated:&diffWasTruncated];
+		unsigned long long fileSize = 0;
+		NSString *diff = [controller.index diffForFile:selectedFile staged:selectedFileIsCached contextLines:contextLines truncated:&diffWasTruncated fullSize:&fileSize];
 		BOOL isBinary = (diff == nil);
 		if (!diff)
 			diff = @"";
@@ -240,14 +263,17 @@ - (void)handleBridgeMessage:(NSString *)type payload:(NSDictionary *)payload
 		response[@"path"] = currentPath ?: @"";
 		response[@"cached"] = @(selectedFileIsCached);
 		response[@"contextLines"] = @(contextLines);
-		response[@"diff"] = diff;
 		response[@"isBinary"] = @(isBinary);
 		response[@"isNewFile"] = @((selectedFile.status == PBChangedFileStatusNew));
+		response[@"diffKey"] = diffKey;
 		response[@"diffWasTruncated"] = @(diffWasTruncated);
-		if (diffWasTruncated)
+		// A deletion is only previewed; the page cuts it once re-windowed
+		if (diffWasTruncated || selectedFile.status == PBChangedFileStatusDeleted)
 			response[@"truncateLimit"] = @([PBGitIndex diffPreviewTruncationLimit]);
+		if (fileSize)
+			response[@"fileSize"] = @(fileSize);
 
-		[self sendBridgeEventWithType:@"commitDiff" payload:response];
+		[self sendBridgeEventWithType:@"commitDiff" payload:response bulkFields:@{ @"diff": diff }];
 		return;
 	}
 
@@ -33,6 +33,10 @@ NS_ASSUME_NONNULL_BEGIN
 
 - (void)handleBridgeMessage:(NSString *)type payload:(nullable NSDictionary *)payload NS_REQUIRES_SUPER;
 - (void)sendBridgeEventWithType:(NSString *)type payload:(NSDictionary *)payload;
+// As above, but large strings in `bulkFields` are handed to the page as raw
+// bytes through the gitx:// scheme instead of being escaped into the message.
+// The page's bridge fetches them before delivery, so handlers see ordinary fields.
+- (void)sendBridgeEventWithType:(NSString *)type payload:(NSDictionary *)payload bulkFields:(NSDictionary<NSString *, NSString *> *)bulkFields;
 
 @property (nonatomic, strong, readonly, nullable) id<PBWebBridge> bridge;
 @property (nonatomic, strong, readonly, nullable) WKWebView *webView;
@@ -11,6 +11,10 @@
 #import "PBWebBridge.h"
 #import "PBWKWebViewBridge.h"
 #import "PBWKGitXSchemeHandler.h"
+#import "GitX-Swift.h"
+
+// Bulk fields shorter than this go inline; escaping them costs less than a fetch
+static const NSUInteger PBWebControllerBulkFieldThreshold = 16 * 1024;
 
 @interface PBWebController ()
 @property (nonatomic, strong, nullable) id<PBWebBridge> bridge;
@@ -21,6 +25,7 @@ @interface PBWebController ()
 @property (nonatomic, strong) NSMutableArray<NSDictionary *> *pendingBridgeMessages;
 - (void)configureBridgeUserScriptsIfNeeded;
 - (void)handleDecodedBridgePayload:(NSDictionary *)payload;
+- (void)recordTraceSpan:(NSDictionary *)payload;
 - (void)flushPendingBridgeMessages;
 - (void)dispatchBridgeMessage:(NSDictionary *)message;
 - (NSArray<NSString *> *)bridgeUserScriptResourceNames;
@@ -188,6 +193,15 @@ - (void)configureBridgeUserScriptsIfNeeded
 		[contentController addUserScript:script];
 	}
 
+	// Pages report their render timings only while tracing; pages loaded
+	// before it was turned on stay quiet.
+	if ([PBTracer shared].isEnabled) {
+		WKUserScript *script = [[WKUserScript alloc] initWithSource:@"window.gitxTracing = true;"
+						injectionTime:WKUserScriptInjectionTimeAtDocumentStart
+				 forMainFrameOnly:NO];
+		[contentController addUserScript:script];
+	}
+
 	self.bridgeUserScriptsInstalled = YES;
 }
 
@@ -211,9 +225,32 @@ - (void)handleDecodedBridgePayload:(NSDictionary *)payload
 		return;
 	}
 
+	if ([type isEqualToString:@"traceSpan"]) {
+		[self recordTraceSpan:payload];
+		return;
+	}
+
 	[self handleBridgeMessage:type payload:payload];
 }
 
+- (void)recordTraceSpan:(NSDictionary *)payload
+{
+	NSString *name = payload[@"name"];
+	NSString *category = payload[@"category"];
+	NSNumber *duration = payload[@"duration"];
+	NSDictionary *args = payload[@"args"];
+	if (![name isKindOfClass:[NSString class]] || ![duration isKindOfClass:[NSNumber class]])
+		return;
+	if (![category isKindOfClass:[NSString class]])
+		category = @"web";
+	if (![args isKindOfClass:[NSDictionary class]])
+		args = nil;
+
+	// The page measures in milliseconds
+	uint64_t nanoseconds = (uint64_t)MAX(0.0, [duration doubleValue] * 1e6);
+	[[PBTracer shared] recordSpan:name category:category duration:nanoseconds args:args];
+}
+
 - (NSArray *)contextMenuItemsForBridge:(id<PBWebBridge>)bridge elementInfo:(NSDictionary *)elementInfo defaultMenuItems:(NSArray *)defaultMenuItems
 {
 	#pragma unused(bridge, elementInfo)
@@ -246,6 +283,31 @@ - (void)sendBridgeEventWithType:(NSString *)type payload:(NSDictionary *)payload
 	[self dispatchBridgeMessage:message];
 }
 
+- (void)sendBridgeEventWithType:(NSString *)type payload:(NSDictionary *)payload bulkFields:(NSDictionary<NSString *, NSString *> *)bulkFields
+{
+	NSMutableDictionary *message = [payload mutableCopy] ?: [NSMutableDictionary dictionary];
+	NSMutableDictionary *bulk = [NSMutableDictionary dictionary];
+
+	// Registration can fail, in which case the page could never fetch the payload
+	PBWKGitXSchemeHandler *schemeHandler = self.gitxSchemeHandler;
+	if (schemeHandler && [self.webView.configuration urlSchemeHandlerForURLScheme:@"gitx"] != schemeHandler)
+		schemeHandler = nil;
+
+	for (NSString *key in bulkFields) {
+		NSString *value = bulkFields[key];
+		if (schemeHandler && value.length >= PBWebControllerBulkFieldThreshold) {
+			NSURL *url = [schemeHandler publishPayload:[value dataUsingEncoding:NSUTF8StringEncoding]];
+			bulk[key] = url.absoluteString;
+		} else {
+			message[key] = value;
+		}
+	}
+	if (bulk.count)
+		message[@"bulk"] = bulk;
+
+	[self sendBridgeEventWithType:type payload:message];
+}
+
 - (void)closeView
 {
 	[self.webView stopLoading];
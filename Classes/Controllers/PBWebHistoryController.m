@@ -10,9 +10,15 @@
 #import "PBWebBridge.h"
 #import "GitX-Swift.h"
 
+// Beyond either size the patch isn't generated up front; the page shows the
+// file list and asks for single files, or the whole patch, on demand.
+static const NSUInteger PBWebHistoryDeferredPatchFileCount = 500;
+static const NSInteger PBWebHistoryDeferredPatchLineCount = 20000;
+
 @interface PBWebHistoryController ()
 - (NSDictionary *)bridgeDictionaryForCommit:(PBGitCommit *)commit currentRef:(NSString *)currentRef;
 - (NSArray *)bridgeRefsForCommit:(PBGitCommit *)commit;
+- (void)loadPatchForCommit:(NSString *)sha paths:(NSArray<NSString *> *)paths;
 @end
 
 @implementation PBWebHistoryController
@@ -77,20 +83,45 @@ - (void) changeContentTo: (PBGitCommit *) content
 							@"sha": sha ?: @"" }];
 	currentSha = sha;
 
-	// Load extended commit details asynchronously
-	NSMutableArray *taskArguments = [NSMutableArray arrayWithObjects:@"show", @"--pretty=raw", @"-M", @"--no-color", currentSha, nil];
-	if (![PBGitDefaults showWhitespaceDifferences])
-		[taskArguments insertObject:@"-w" atIndex:1];
-
+	// Load the message, file list and patch asynchronously, and independently,
+	// so the list shows up without waiting for the patch text
 	NSString *shaToLoad = currentSha;
-	[repository executeGitCommandAsync:taskArguments completion:^(NSString *output, NSString *error, int exitCode) {
+	[repository executeGitCommandAsync:@[@"show", @"--pretty=raw", @"--no-patch", @"--no-color", shaToLoad] completion:^(NSString *output, NSString *error, int exitCode) {
 		if (!output)
 			return;
 
-		NSDictionary *payload = @{ @"sha": shaToLoad ?: @"", @"details": output ?: @"" };
-		[self sendBridgeEventWithType:@"commitDetails" payload:payload];
+		[self sendBridgeEventWithType:@"commitDetails"
+							  payload:@{ @"sha": shaToLoad ?: @"" }
+						   bulkFields:@{ @"details": output ?: @"" }];
 	}];
 
+	if (content.parents.count > 1) {
+		// diff-tree lists nothing for a merge; its combined diff is all there is
+		[self loadPatchForCommit:shaToLoad paths:nil];
+	} else {
+		[PBCommitFileList loadForCommit:shaToLoad
+						   inRepository:(PBGitRepository *)repository
+					   ignoreWhitespace:![PBGitDefaults showWhitespaceDifferences]
+							 completion:^(NSArray<NSDictionary<NSString *, id> *> *files) {
+			if (![currentSha isEqualToString:shaToLoad])
+				return;
+			if (!files) {
+				[self loadPatchForCommit:shaToLoad paths:nil];
+				return;
+			}
+
+			NSInteger changedLines = 0;
+			for (NSDictionary *file in files)
+				changedLines += MAX(0, [file[@"added"] integerValue]) + MAX(0, [file[@"deleted"] integerValue]);
+			BOOL deferPatch = files.count > PBWebHistoryDeferredPatchFileCount || changedLines > PBWebHistoryDeferredPatchLineCount;
+
+			[self sendBridgeEventWithType:@"commitFileList"
+								  payload:@{ @"sha": shaToLoad, @"files": files, @"patchDeferred": @(deferPatch) }];
+			if (!deferPatch)
+				[self loadPatchForCommit:shaToLoad paths:nil];
+		}];
+	}
+
 	// Fetch git notes if this commit has them
 	if ([content hasNotes]) {
 		NSArray<NSString *> *noteRefs = [(PBGitRepository *)repository noteRefs];
@@ -117,6 +148,36 @@ - (void) changeContentTo: (PBGitCommit *) content
 	}
 }
 
+// The patch of `sha` without its header, limited to `paths` if given. A
+// whole patch is sent as commitPatch, a limited one as commitFileDiff.
+- (void)loadPatchForCommit:(NSString *)sha paths:(NSArray<NSString *> *)paths
+{
+	NSMutableArray *arguments = [NSMutableArray arrayWithObjects:@"show", @"--format=", @"-M", @"--no-color", sha, nil];
+	if (![PBGitDefaults showWhitespaceDifferences])
+		[arguments insertObject:@"-w" atIndex:1];
+	if (paths.count) {
+		// File names, not patterns: *, ?, [ or a leading : mean nothing here
+		[arguments addObject:@"--"];
+		for (NSString *path in paths)
+			[arguments addObject:[@":(literal)" stringByAppendingString:path]];
+	}
+
+	[repository executeGitCommandAsync:arguments completion:^(NSString *output, NSString *error, int exitCode) {
+		if (!output || ![currentSha isEqualToString:sha])
+			return;
+
+		if (paths.count) {
+			[self sendBridgeEventWithType:@"commitFileDiff"
+								  payload:@{ @"sha": sha, @"path": paths.lastObject }
+							   bulkFields:@{ @"diff": output }];
+		} else {
+			[self sendBridgeEventWithType:@"commitPatch"
+								  payload:@{ @"sha": sha }
+							   bulkFields:@{ @"diff": output }];
+		}
+	}];
+}
+
 - (void)selectCommit:(NSString *)sha
 {
 	// Validate SHA using git rev-parse before creating PBCommitID
@@ -171,6 +232,27 @@ - (void)handleBridgeMessage:(NSString *)type payload:(NSDictionary *)payload
 		return;
 	}
 
+	if ([type isEqualToString:@"requestCommitPatch"] || [type isEqualToString:@"requestFileDiff"]) {
+		NSString *sha = payload[@"sha"];
+		if (![sha isKindOfClass:[NSString class]] || ![sha isEqualToString:currentSha])
+			return;
+
+		NSMutableArray<NSString *> *paths = nil;
+		if ([type isEqualToString:@"requestFileDiff"]) {
+			// A rename needs both sides in the pathspec to be detected; the new one goes last
+			paths = [NSMutableArray array];
+			for (NSString *key in @[ @"oldPath", @"path" ]) {
+				NSString *path = payload[key];
+				if ([path isKindOfClass:[NSString class]] && path.length && ![paths containsObject:path])
+					[paths addObject:path];
+			}
+			if (paths.count == 0)
+				return;
+		}
+		[self loadPatchForCommit:sha paths:paths];
+		return;
+	}
+
 	[super handleBridgeMessage:type payload:payload];
 }
 
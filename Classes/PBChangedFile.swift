@@ -10,6 +10,10 @@ import Cocoa
     @objc var path: String
     @objc var commitBlobSHA: String?
     @objc var commitBlobMode: String?
+    /// Blobs the last listings compared: HEAD's against the index's for
+    /// staged changes, the index's against the work tree for unstaged ones
+    @objc var headBlobSHA: String?
+    @objc var indexBlobSHA: String?
     @objc var status: PBChangedFileStatus = .modified
     @objc var hasStagedChanges: Bool = false
     @objc var hasUnstagedChanges: Bool = false
@@ -5,11 +5,17 @@ import Darwin
 @objc(PBGraphCellInfo)
 final class PBGraphCellInfo: NSObject {
     private var linesStorage: UnsafeMutablePointer<PBGitGraphLine>?
+    private var preparedGeometry: PBGraphGeometry?
 
     @objc var position: Int
     @objc var numColumns: Int
     @objc var sign: Int8
     @objc var nLines: Int
+    /// Column lanes past the graph's lane limit are folded into, or 0
+    @objc var overflowColumn: Int = 0
+    /// Folded lanes passing through the top and bottom half of the row
+    @objc var overflowAbove: Int = 0
+    @objc var overflowBelow: Int = 0
 
     @objc(initWithPosition:andLines:)
     init(position: Int, andLines lines: UnsafeMutablePointer<PBGitGraphLine>?) {
@@ -40,10 +46,27 @@ final class PBGraphCellInfo: NSObject {
             if linesStorage != newValue {
                 freeLinesStorage()
                 linesStorage = newValue
+                preparedGeometry = nil
             }
         }
     }
 
+    /// `lines` laid out for drawing. The grapher prepares it once the row
+    /// is complete; otherwise it is made the first time it is asked for.
+    var geometry: PBGraphGeometry {
+        if let preparedGeometry {
+            return preparedGeometry
+        }
+        return prepareGeometry()
+    }
+
+    @discardableResult
+    func prepareGeometry() -> PBGraphGeometry {
+        let geometry = PBGraphGeometry(lines: linesStorage, count: nLines)
+        preparedGeometry = geometry
+        return geometry
+    }
+
     private func freeLinesStorage() {
         if let pointer = linesStorage {
             free(pointer)
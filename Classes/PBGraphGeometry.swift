@@ -0,0 +1,44 @@
+import Foundation
+
+/// The lines of one graph row, laid out once when the row is graphed so
+/// drawing it takes one stroke per colour instead of a path per line.
+///
+/// Each segment is a pair of `points`, from where the line enters the row to
+/// the commit's centre row height. Segments are grouped by palette colour,
+/// one `runs` entry per colour used. Nothing here needs AppKit; the view
+/// only scales points to its rect and picks the run's colour.
+@objcMembers
+@objc(PBGraphGeometry)
+final class PBGraphGeometry: NSObject {
+    /// Lane colours lines cycle through; the view's palette has this many.
+    static let paletteSize = Int(PBGraphPaletteSize)
+
+    let segmentCount: Int
+    let runCount: Int
+    /// Two per segment
+    let points: UnsafeMutablePointer<PBGitGraphPoint>
+    let runs: UnsafeMutablePointer<PBGitGraphColorRun>
+
+    /// The work is done by PBGraphGeometryBuild, in plain C next to the lane
+    /// layout, so tests/graph-layout can check it without AppKit.
+    @objc(initWithLines:count:)
+    init(lines: UnsafePointer<PBGitGraphLine>?, count: Int) {
+        let count = lines == nil ? 0 : max(count, 0)
+        segmentCount = count
+        points = UnsafeMutablePointer<PBGitGraphPoint>.allocate(capacity: max(count * 2, 1))
+        runs = UnsafeMutablePointer<PBGitGraphColorRun>.allocate(capacity: PBGraphGeometry.paletteSize)
+        runCount = Int(PBGraphGeometryBuild(lines, Int32(count), points, runs))
+        super.init()
+    }
+
+    deinit {
+        points.deallocate()
+        runs.deallocate()
+    }
+
+    /// Bytes held, for cache budgets.
+    var byteCount: Int {
+        return 48 + segmentCount * 2 * MemoryLayout<PBGitGraphPoint>.stride
+            + PBGraphGeometry.paletteSize * MemoryLayout<PBGitGraphColorRun>.stride
+    }
+}
@@ -294,10 +294,12 @@ final class PBEasyPipe: NSObject {
         }
 
         logIfNeeded(command: executablePath, arguments: arguments, directory: workingDirectory)
+        let span = PBTracer.shared.beginCommand(executablePath, arguments: arguments)
 
         do {
             try launch(process)
         } catch {
+            span?.endCommand(bytes: 0, exitCode: -1)
             return nil
         }
 
@@ -309,6 +311,7 @@ final class PBEasyPipe: NSObject {
         let standardOutput = outputPipe.fileHandleForReading.readDataToEndOfFile()
         let standardError = errorPipe.fileHandleForReading.readDataToEndOfFile()
         process.waitUntilExit()
+        span?.endCommand(bytes: standardOutput.count, exitCode: process.terminationStatus)
 
         return (standardOutput, standardError, process.terminationStatus)
     }
@@ -0,0 +1,426 @@
+import Foundation
+
+/// Records timed spans for git invocations and the history, index and diff
+/// pipelines, so slow repositories can be profiled on the machine that has
+/// them. Spans are kept in memory; `summary()` gives per-name p50/p95 and
+/// `writeTrace(to:)` saves them as Chrome trace-event JSON, which
+/// chrome://tracing and Perfetto open directly.
+///
+/// Tracing is off unless the PBTracingEnabled default is set (or it is turned
+/// on from the Help menu). While it is off `beginSpan` returns nil, so
+/// instrumented code pays for one flag check.
+@objcMembers
+@objc(PBTracer)
+final class PBTracer: NSObject {
+    static let shared = PBTracer()
+
+    /// Events kept for export; the oldest are dropped beyond this
+    private static let maxEvents = 200_000
+    /// Durations kept per span name for percentiles
+    private static let samplesPerName = 1024
+    /// A main thread that takes longer than this to answer a ping is recorded
+    /// as a stall
+    private static let stallThreshold: UInt64 = 100_000_000
+    private static let stallPingInterval = DispatchTimeInterval.milliseconds(50)
+
+    private struct Event {
+        let name: String
+        let category: String
+        let start: UInt64
+        let duration: UInt64
+        let threadID: UInt64
+        let args: [String: Any]?
+    }
+
+    private final class Stats {
+        var count = 0
+        var totalDuration: UInt64 = 0
+        var totalBytes = 0
+        var failures = 0
+        var samples: [UInt64] = []
+        var nextSample = 0
+    }
+
+    private let lock = NSLock()
+    private let origin = DispatchTime.now().uptimeNanoseconds
+    private var events: [Event] = []
+    private var firstEvent = 0
+    private var stats: [String: Stats] = [:]
+    private var threadNames: [UInt64: String] = [:]
+    private var enabled = false
+    private var stallTimer: DispatchSourceTimer?
+    private var stallPingStart: UInt64 = 0
+
+    private override init() {
+        super.init()
+        if PBGitDefaults.tracingEnabled() {
+            setEnabled(true)
+        }
+    }
+
+    // MARK: - Recording
+
+    var isEnabled: Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return enabled
+    }
+
+    /// Turns recording on or off and remembers the choice across launches.
+    /// Spans already recorded are kept until `reset()`.
+    @objc(setEnabled:)
+    func setEnabled(_ isOn: Bool) {
+        lock.lock()
+        let changed = enabled != isOn
+        enabled = isOn
+        lock.unlock()
+
+        if PBGitDefaults.tracingEnabled() != isOn {
+            PBGitDefaults.setTracingEnabled(isOn)
+        }
+        if changed {
+            isOn ? startStallWatchdog() : stopStallWatchdog()
+        }
+    }
+
+    /// Starts timing `name`, or returns nil if tracing is off. Call `end` on
+    /// the span from any thread.
+    @objc(beginSpan:category:)
+    func beginSpan(_ name: String, category: String) -> PBTraceSpan? {
+        guard isEnabled else {
+            return nil
+        }
+        return PBTraceSpan(tracer: self, name: name, category: category)
+    }
+
+    /// Times `body` under `name` (Swift only).
+    func measure<T>(_ name: String, category: String, _ body: () throws -> T) rethrows -> T {
+        let span = beginSpan(name, category: category)
+        defer { span?.end() }
+        return try body()
+    }
+
+    /// Records `duration` nanoseconds of work that was timed in pieces, as
+    /// one span ending now.
+    @objc(recordSpan:category:duration:args:)
+    func recordSpan(_ name: String, category: String, duration: UInt64, args: [String: Any]?) {
+        guard isEnabled else {
+            return
+        }
+        record(name: name, category: category, start: nil, duration: duration, args: args)
+    }
+
+    /// Records a span that was timed elsewhere, such as in the web views.
+    /// `start` is in `DispatchTime` nanoseconds; nil means it ended now.
+    func record(name: String,
+                category: String,
+                start: UInt64?,
+                duration: UInt64,
+                args: [String: Any]?) {
+        let now = DispatchTime.now().uptimeNanoseconds
+        let begin = start ?? (now > duration ? now - duration : 0)
+        let threadID = PBTracer.currentThreadID()
+
+        lock.lock()
+        defer { lock.unlock() }
+        guard enabled else {
+            return
+        }
+
+        if threadNames[threadID] == nil {
+            threadNames[threadID] = PBTracer.currentThreadName()
+        }
+
+        let event = Event(name: name,
+                          category: category,
+                          start: begin > origin ? begin - origin : 0,
+                          duration: duration,
+                          threadID: threadID,
+                          args: args)
+        if events.count < PBTracer.maxEvents {
+            events.append(event)
+        } else {
+            events[firstEvent] = event
+            firstEvent = (firstEvent + 1) % PBTracer.maxEvents
+        }
+
+        let entry = stats[name] ?? Stats()
+        stats[name] = entry
+        entry.count += 1
+        entry.totalDuration += duration
+        if let bytes = args?["bytes"] as? Int {
+            entry.totalBytes += bytes
+        }
+        // A command stopped early is killed by us, not failing
+        if let exitCode = args?["exitCode"] as? Int32, exitCode != 0, args?["stopped"] as? Bool != true {
+            entry.failures += 1
+        }
+        if entry.samples.count < PBTracer.samplesPerName {
+            entry.samples.append(duration)
+        } else {
+            entry.samples[entry.nextSample] = duration
+            entry.nextSample = (entry.nextSample + 1) % PBTracer.samplesPerName
+        }
+    }
+
+    /// Drops everything recorded so far.
+    func reset() {
+        lock.lock()
+        events.removeAll()
+        firstEvent = 0
+        stats.removeAll()
+        lock.unlock()
+    }
+
+    // MARK: - Commands
+
+    /// The span name for running `executablePath`: for git, "git" and its
+    /// subcommand, skipping global options such as `-c key=value` and
+    /// `--git-dir=...`; for anything else, the executable's name.
+    class func spanName(forCommand executablePath: String, arguments: [String]) -> String {
+        let executable = (executablePath as NSString).lastPathComponent
+        guard executable == "git" else {
+            return executable
+        }
+
+        var index = 0
+        while index < arguments.count {
+            let argument = arguments[index]
+            if argument == "-c" || argument == "-C" {
+                index += 2
+                continue
+            }
+            if argument.hasPrefix("-") {
+                index += 1
+                continue
+            }
+            return "git " + argument
+        }
+        return "git"
+    }
+
+    /// Starts a span for running `executablePath` with `arguments`. End it
+    /// with `endCommand(bytes:exitCode:)`.
+    func beginCommand(_ executablePath: String, arguments: [String]) -> PBTraceSpan? {
+        guard isEnabled else {
+            return nil
+        }
+        let name = PBTracer.spanName(forCommand: executablePath, arguments: arguments)
+        let span = PBTraceSpan(tracer: self, name: name, category: "process")
+        span.args["argv"] = arguments.prefix(8).joined(separator: " ")
+        return span
+    }
+
+    // MARK: - Reporting
+
+    /// One line per span name, slowest total first: count, p50, p95, max,
+    /// total time, and bytes read and failures where there were any.
+    func summary() -> String {
+        lock.lock()
+        let snapshot = stats.map { ($0.key, $0.value.count, $0.value.totalDuration, $0.value.totalBytes,
+                                    $0.value.failures, $0.value.samples) }
+        lock.unlock()
+
+        if snapshot.isEmpty {
+            return "No spans recorded."
+        }
+
+        let rows = snapshot.sorted { $0.2 > $1.2 }
+        let nameWidth = max(32, rows.map { $0.0.count }.max() ?? 0)
+        var lines = ["span".padding(toLength: nameWidth, withPad: " ", startingAt: 0) +
+                     "   count    p50 ms    p95 ms    max ms   total ms"]
+        for (name, count, total, bytes, failures, samples) in rows {
+            let sorted = samples.sorted()
+            var line = name.padding(toLength: nameWidth, withPad: " ", startingAt: 0)
+            line += String(format: " %7d %9.1f %9.1f %9.1f %10.1f",
+                           count,
+                           PBTracer.milliseconds(PBTracer.percentile(sorted, 0.50)),
+                           PBTracer.milliseconds(PBTracer.percentile(sorted, 0.95)),
+                           PBTracer.milliseconds(sorted.last ?? 0),
+                           PBTracer.milliseconds(total))
+            if bytes > 0 {
+                line += "  " + ByteCountFormatter.string(fromByteCount: Int64(bytes), countStyle: .file)
+            }
+            if failures > 0 {
+                line += "  \(failures) failed"
+            }
+            lines.append(line)
+        }
+        return lines.joined(separator: "\n")
+    }
+
+    /// Writes the recorded spans to `url` in the Chrome trace-event format.
+    @objc(writeTraceToURL:error:)
+    func writeTrace(to url: URL) throws {
+        lock.lock()
+        let ordered = Array(events[firstEvent...] + events[..<firstEvent])
+        let names = threadNames
+        lock.unlock()
+
+        let pid = Int(ProcessInfo.processInfo.processIdentifier)
+        var traceEvents: [[String: Any]] = names.map { threadID, name in
+            ["name": "thread_name", "ph": "M", "pid": pid, "tid": threadID, "args": ["name": name]]
+        }
+        traceEvents.reserveCapacity(traceEvents.count + ordered.count)
+        for event in ordered {
+            var entry: [String: Any] = [
+                "name": event.name,
+                "cat": event.category,
+                "ph": "X",
+                "ts": Double(event.start) / 1000,
+                "dur": Double(event.duration) / 1000,
+                "pid": pid,
+                "tid": event.threadID
+            ]
+            if let args = event.args, JSONSerialization.isValidJSONObject(args) {
+                entry["args"] = args
+            }
+            traceEvents.append(entry)
+        }
+
+        let data = try JSONSerialization.data(withJSONObject: ["traceEvents": traceEvents, "displayTimeUnit": "ms"])
+        try data.write(to: url, options: .atomic)
+    }
+
+    /// Where traces are saved unless the user picks a place:
+    /// ~/Library/Logs/GitX/GitX-<date>.trace.json
+    func defaultTraceURL() -> URL {
+        let logs = FileManager.default.urls(for: .libraryDirectory, in: .userDomainMask).first!
+            .appendingPathComponent("Logs/GitX", isDirectory: true)
+        try? FileManager.default.createDirectory(at: logs, withIntermediateDirectories: true)
+
+        let formatter = DateFormatter()
+        formatter.locale = Locale(identifier: "en_US_POSIX")
+        formatter.dateFormat = "yyyy-MM-dd-HHmmss"
+        return logs.appendingPathComponent("GitX-\(formatter.string(from: Date())).trace.json")
+    }
+
+    // MARK: - Main thread stalls
+
+    // A timer on a background queue pings the main queue; when a ping takes
+    // longer than the threshold to be answered, the wait is recorded as a
+    // stall on the main thread's track.
+    private func startStallWatchdog() {
+        let timer = DispatchSource.makeTimerSource(queue: DispatchQueue.global(qos: .utility))
+        timer.schedule(deadline: .now() + PBTracer.stallPingInterval, repeating: PBTracer.stallPingInterval)
+        timer.setEventHandler { [weak self] in
+            self?.pingMainThread()
+        }
+        lock.lock()
+        stallTimer = timer
+        lock.unlock()
+        timer.resume()
+    }
+
+    private func stopStallWatchdog() {
+        lock.lock()
+        let timer = stallTimer
+        stallTimer = nil
+        lock.unlock()
+        timer?.cancel()
+    }
+
+    private func pingMainThread() {
+        lock.lock()
+        let waiting = stallPingStart != 0
+        if !waiting {
+            stallPingStart = DispatchTime.now().uptimeNanoseconds
+        }
+        lock.unlock()
+        if waiting {
+            return
+        }
+
+        DispatchQueue.main.async { [weak self] in
+            guard let self else {
+                return
+            }
+            let now = DispatchTime.now().uptimeNanoseconds
+            self.lock.lock()
+            let start = self.stallPingStart
+            self.stallPingStart = 0
+            self.lock.unlock()
+
+            if now - start >= PBTracer.stallThreshold {
+                self.record(name: "main thread stall", category: "main", start: start, duration: now - start, args: nil)
+            }
+        }
+    }
+
+    // MARK: - Helpers
+
+    private class func percentile(_ sorted: [UInt64], _ fraction: Double) -> UInt64 {
+        guard !sorted.isEmpty else {
+            return 0
+        }
+        let index = Int((Double(sorted.count - 1) * fraction).rounded())
+        return sorted[index]
+    }
+
+    private class func milliseconds(_ nanoseconds: UInt64) -> Double {
+        return Double(nanoseconds) / 1_000_000
+    }
+
+    private class func currentThreadID() -> UInt64 {
+        var threadID: UInt64 = 0
+        pthread_threadid_np(nil, &threadID)
+        return threadID
+    }
+
+    private class func currentThreadName() -> String {
+        if Thread.isMainThread {
+            return "main"
+        }
+        if let name = Thread.current.name, !name.isEmpty {
+            return name
+        }
+        let label = String(cString: __dispatch_queue_get_label(nil))
+        return label.isEmpty ? "thread" : label
+    }
+}
+
+/// A span started by `PBTracer.beginSpan`. Ending it more than once records it
+/// once.
+@objcMembers
+@objc(PBTraceSpan)
+final class PBTraceSpan: NSObject {
+    private weak var tracer: PBTracer?
+    private let name: String
+    private let category: String
+    private let start = DispatchTime.now().uptimeNanoseconds
+    private var ended = false
+
+    /// Extra detail exported with the span; "bytes" and a nonzero "exitCode"
+    /// also show up in the summary
+    var args: [String: Any] = [:]
+
+    fileprivate init(tracer: PBTracer, name: String, category: String) {
+        self.tracer = tracer
+        self.name = name
+        self.category = category
+    }
+
+    func end() {
+        guard !ended else {
+            return
+        }
+        ended = true
+        let duration = DispatchTime.now().uptimeNanoseconds - start
+        tracer?.record(name: name, category: category, start: start, duration: duration,
+                       args: args.isEmpty ? nil : args)
+    }
+
+    @objc(endWithArgs:)
+    func end(withArgs extra: [String: Any]) {
+        args.merge(extra) { _, new in new }
+        end()
+    }
+
+    /// Ends a git command span with the bytes it wrote to stdout and its exit
+    /// code.
+    func endCommand(bytes: Int, exitCode: Int32) {
+        args["bytes"] = bytes
+        args["exitCode"] = exitCode
+        end()
+    }
+}
@@ -8,6 +8,7 @@
 #import "PBGitRevisionCellView.h"
 #import "PBGitHistoryController.h"
 #import "GitXTextFieldCell.h"
+#import "PBGitGraphLine.h"
 #import "GitX-Swift.h"
 
 static const int COLUMN_WIDTH = 10;
@@ -21,9 +22,10 @@ - (BOOL)isFlipped
 	return YES;
 }
 
+// Indexed by the palette colours of PBGraphGeometry runs
 + (NSArray *)laneColors
 {
-	static const size_t colorCount = 8;
+	const size_t colorCount = (size_t)PBGraphGeometry.paletteSize;
 	static NSArray *laneColors = nil;
 	if (!laneColors) {
 		float segment = 1.0f / colorCount;
@@ -67,44 +69,87 @@ + (NSColor *)lineShadowColor
 	return shadowColor;
 }
 
-- (void)drawLineFromColumn:(int)from toColumn:(int)to inRect:(NSRect)r offset:(int)offset color:(int)c
++ (NSShadow *)lineShadow
 {
-	NSPoint origin = r.origin;
-	
-	NSPoint source = NSMakePoint(origin.x + COLUMN_WIDTH * from, origin.y + offset);
-	NSPoint center = NSMakePoint(origin.x + COLUMN_WIDTH * to, origin.y + r.size.height * 0.5 + 0.5);
+	static NSShadow *shadow = nil;
+	if (!shadow) {
+		shadow = [NSShadow new];
+		[shadow setShadowColor:[self lineShadowColor]];
+		[shadow setShadowOffset:NSMakeSize(0.5f, -0.5f)];
+	}
+	return shadow;
+}
 
-	if (ENABLE_SHADOW) {
-		[NSGraphicsContext saveGraphicsState];
+static inline CGPoint PBGraphPointInRect(struct PBGitGraphPoint point, NSRect r)
+{
+	// The commit's centre sits half a point below the middle of the row
+	CGFloat y = point.y == 0.5f ? r.size.height * 0.5 + 0.5 : r.size.height * point.y;
+	return CGPointMake(r.origin.x + COLUMN_WIDTH * point.x, r.origin.y + y);
+}
 
-		NSShadow *shadow = [NSShadow new];
-		[shadow setShadowColor:[[self class] lineShadowColor]];
-		[shadow setShadowOffset:NSMakeSize(0.5f, -0.5f)];
-		[shadow set];
+// Strokes the row's lines one palette colour at a time, straight from the
+// geometry the grapher prepared, without building a path per line.
+- (void)drawGeometry:(PBGraphGeometry *)geometry inRect:(NSRect)r
+{
+	if (geometry.segmentCount == 0)
+		return;
+
+	CGContextRef context = [[NSGraphicsContext currentContext] CGContext];
+	NSArray *colors = [PBGitRevisionGraphView laneColors];
+	const struct PBGitGraphPoint *points = geometry.points;
+	const struct PBGitGraphColorRun *runs = geometry.runs;
+
+	[NSGraphicsContext saveGraphicsState];
+	if (ENABLE_SHADOW)
+		[[[self class] lineShadow] set];
+	CGContextSetLineWidth(context, 2);
+	CGContextSetLineCap(context, kCGLineCapRound);
+
+	for (NSInteger run = 0; run < geometry.runCount; run++) {
+		[(NSColor *)[colors objectAtIndex:(NSUInteger)runs[run].color] setStroke];
+		CGContextBeginPath(context);
+		for (int segment = runs[run].start; segment < runs[run].start + runs[run].count; segment++) {
+			CGPoint source = PBGraphPointInRect(points[segment * 2], r);
+			CGPoint center = PBGraphPointInRect(points[segment * 2 + 1], r);
+			CGContextMoveToPoint(context, source.x, source.y);
+			CGContextAddLineToPoint(context, center.x, center.y);
+		}
+		CGContextStrokePath(context);
 	}
-	NSArray* colors = [PBGitRevisionGraphView laneColors];
-	[(NSColor*)[colors objectAtIndex: ((NSUInteger)c % [colors count])] set];
-	
-	NSBezierPath * path = [NSBezierPath bezierPath];
-	[path setLineWidth:2];
-	[path setLineCapStyle:NSRoundLineCapStyle];
-	[path moveToPoint: source];
-	[path lineToPoint: center];
-	[path stroke];
 
-	if (ENABLE_SHADOW) {
-		[NSGraphicsContext restoreGraphicsState];
+	[NSGraphicsContext restoreGraphicsState];
+}
+
+// Lanes past the graph's lane limit share one column, drawn as a dotted
+// grey line through the halves of the row they pass.
+- (void)drawOverflowInRect:(NSRect)r
+{
+	PBGraphCellInfo *cellInfo = self.cellInfo;
+	CGContextRef context = [[NSGraphicsContext currentContext] CGContext];
+	CGFloat x = r.origin.x + COLUMN_WIDTH * cellInfo.overflowColumn;
+	CGFloat center = r.origin.y + r.size.height * 0.5 + 0.5;
+	const CGFloat dash[] = { 1, 3 };
+
+	CGContextSaveGState(context);
+	[[NSColor grayColor] setStroke];
+	CGContextSetLineWidth(context, 2);
+	CGContextSetLineDash(context, 0, dash, 2);
+	CGContextBeginPath(context);
+	if (cellInfo.overflowAbove > 0) {
+		CGContextMoveToPoint(context, x, r.origin.y);
+		CGContextAddLineToPoint(context, x, center);
+	}
+	if (cellInfo.overflowBelow > 0) {
+		CGContextMoveToPoint(context, x, center);
+		CGContextAddLineToPoint(context, x, NSMaxY(r));
 	}
+	CGContextStrokePath(context);
+	CGContextRestoreGState(context);
 }
 
 - (BOOL)isCurrentCommit
 {
-	NSString *thisSha = [self.commit sha];
-
-	PBGitRepository* repository = [self.commit repository];
-	NSString *currentSha = [repository headSHA];
-
-	return [currentSha isEqual:thisSha];
+	return self.commit.decoration.isHead;
 }
 
 - (void)drawCircleInRect:(NSRect)r
@@ -114,21 +159,10 @@ - (void)drawCircleInRect:(NSRect)r
 	NSPoint columnOrigin = { origin.x + COLUMN_WIDTH * c, origin.y};
 
 	NSRect oval = { columnOrigin.x - 5, columnOrigin.y + r.size.height * 0.5 - 5, 10, 10};
+	CGContextRef context = [[NSGraphicsContext currentContext] CGContext];
 
-	NSBezierPath * path = [NSBezierPath bezierPathWithOvalInRect:oval];
-	if (ENABLE_SHADOW && false) {
-		[NSGraphicsContext saveGraphicsState];
-		NSShadow *shadow = [NSShadow new];
-		[shadow setShadowColor:[[self class] shadowColor]];
-		[shadow setShadowOffset:NSMakeSize(0.5f, -0.5f)];
-		[shadow setShadowBlurRadius:2.0f];
-		[shadow set];
-	}
 	[[NSColor blackColor] set];
-	[path fill];
-	if (ENABLE_SHADOW && false) {
-		[NSGraphicsContext restoreGraphicsState];
-	}
+	CGContextFillEllipseInRect(context, NSRectToCGRect(oval));
 	
 	NSRect smallOval = { columnOrigin.x - 4, columnOrigin.y + r.size.height * 0.5 - 4, 8, 8};
 
@@ -138,8 +172,7 @@ - (void)drawCircleInRect:(NSRect)r
 		[[NSColor whiteColor] set];
 	}
 
-	NSBezierPath *smallPath = [NSBezierPath bezierPathWithOvalInRect:smallOval];
-	[smallPath fill];
+	CGContextFillEllipseInRect(context, NSRectToCGRect(smallOval));
 }
 
 - (void)drawTriangleInRect:(NSRect)r sign:(char)sign
@@ -170,37 +203,24 @@ - (void)drawTriangleInRect:(NSRect)r sign:(char)sign
 	[path stroke];
 }
 
-- (NSMutableDictionary*)attributesForRefLabelSelected:(BOOL)selected
+- (NSDictionary*)attributesForRefLabelSelected:(BOOL)selected
 {
-	NSMutableDictionary *attributes = [[NSMutableDictionary alloc] initWithCapacity:2];
-	NSMutableParagraphStyle* style = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
-	
-	[style setAlignment:NSTextAlignmentCenter];
-	[attributes setObject:style forKey:NSParagraphStyleAttributeName];
-	[attributes setObject:[NSFont fontWithName:@"LucidaGrande" size:10] forKey:NSFontAttributeName];
-
-	NSShadow *shadow = nil;
-
-	if (selected && false) {
-		[attributes setObject:[NSColor alternateSelectedControlTextColor] forKey:NSForegroundColorAttributeName];
-		if (ENABLE_SHADOW) {
-			shadow = [NSShadow new];
-			[shadow setShadowColor:[NSColor blackColor]];
-			[shadow setShadowBlurRadius:2.0f];
-		}
-	}
-
-	if (shadow) {
-		attributes[NSShadowAttributeName] = shadow;
+	// The label attributes never change, and decorations cache label sizes measured with them.
+	static NSDictionary *attributes = nil;
+	if (!attributes) {
+		NSMutableParagraphStyle* style = [[NSParagraphStyle defaultParagraphStyle] mutableCopy];
+		[style setAlignment:NSTextAlignmentCenter];
+		attributes = @{
+			NSParagraphStyleAttributeName: style,
+			NSFontAttributeName: [NSFont fontWithName:@"LucidaGrande" size:10] ?: [NSFont systemFontOfSize:10],
+		};
 	}
 
 	return attributes;
 }
 
-- (NSColor*)colorForRef:(PBGitRef*)ref
+- (NSColor*)colorForRef:(PBGitRef*)ref isHEAD:(BOOL)isHEAD
 {
-	BOOL isHEAD = [ref.ref isEqualToString:[[[self.controller repository] headRef] simpleRef]];
-
 	if (isHEAD) {
 		return [NSColor colorWithCalibratedRed: 0Xfc/256.0 green:0Xa6/256.0 blue: 0X4f/256.0 alpha: 1.0];
 	}
@@ -228,9 +248,9 @@ - (NSArray *)rectsForRefsinRect:(NSRect)rect
 	lastRect.origin.x = round(lastRect.origin.x);
 	lastRect.origin.y = round(lastRect.origin.y);
 	
-	for (PBGitRef *ref in self.commit.refs) {
-		NSMutableDictionary* attributes = [self attributesForRefLabelSelected:NO];
-		NSSize textSize = [[ref shortName] sizeWithAttributes:attributes];
+	NSArray *labelSizes = [self.commit.decoration labelSizesWithAttributes:[self attributesForRefLabelSelected:NO]];
+	for (NSValue *sizeValue in labelSizes) {
+		NSSize textSize = [sizeValue sizeValue];
 		
 		NSRect newRect = lastRect;
 		newRect.size.width = textSize.width + ref_padding;
@@ -249,12 +269,12 @@ - (NSArray *)rectsForRefsinRect:(NSRect)rect
 
 - (void)drawLabelAtIndex:(int)index inRect:(NSRect)rect
 {
-	NSArray *refs = self.commit.refs;
-	PBGitRef *ref = [refs objectAtIndex:(NSUInteger)index];
+	PBGitCommitDecoration *decoration = self.commit.decoration;
+	PBGitRef *ref = [decoration.refs objectAtIndex:(NSUInteger)index];
 	
-	NSMutableDictionary* attributes = [self attributesForRefLabelSelected:NO];
+	NSDictionary* attributes = [self attributesForRefLabelSelected:NO];
 	NSBezierPath *border = [NSBezierPath bezierPathWithRoundedRect:rect cornerRadius: 3.0];
-	[[self colorForRef:ref] set];
+	[[self colorForRef:ref isHEAD:(decoration.headRefIndex == index)] set];
 	
 
 	if (ENABLE_SHADOW) {
@@ -308,14 +328,9 @@ - (void)drawRect:(NSRect)dirtyRect
 		NSRect ownRect;
 		NSDivideRect(rect, &ownRect, &rect, pathWidth, NSMinXEdge);
 
-		int i;
-		struct PBGitGraphLine *lines = self.cellInfo.lines;
-		for (i = 0; i < self.cellInfo.nLines; i++) {
-			if (lines[i].upper == 0)
-				[self drawLineFromColumn: lines[i].from toColumn: lines[i].to inRect:ownRect offset: ownRect.size.height color: lines[i].colorIndex];
-			else
-				[self drawLineFromColumn: lines[i].from toColumn: lines[i].to inRect:ownRect offset: 0 color:lines[i].colorIndex];
-		}
+		[self drawGeometry:self.cellInfo.geometry inRect:ownRect];
+		if (self.cellInfo.overflowColumn > 0)
+			[self drawOverflowInRect:ownRect];
 
 		if (self.cellInfo.sign == '<' || self.cellInfo.sign == '>')
 			[self drawTriangleInRect: ownRect sign: self.cellInfo.sign];
@@ -323,10 +338,11 @@ - (void)drawRect:(NSRect)dirtyRect
 			[self drawCircleInRect: ownRect];
 	}
 
-	if ([self.commit hasNotes])
+	PBGitCommitDecoration *decoration = self.commit.decoration;
+	if (decoration.hasNotes)
 		[self drawNotesBadgeInRect:&rect];
 
-	if ([self.commit refs] && [[self.commit refs] count])
+	if (decoration.hasRefs)
 		[self drawRefsInRect:&rect];
 
 	// Draw the subject text
@@ -360,9 +376,14 @@ - (void)drawNotesBadgeInRect:(NSRect *)refRect
 	static const int ref_padding = 10;
 	static const int ref_spacing = 4;
 
-	NSMutableDictionary *attributes = [self attributesForRefLabelSelected:NO];
+	NSDictionary *attributes = [self attributesForRefLabelSelected:NO];
 	NSString *label = @"\U0001F4CC"; // 📌
-	NSSize textSize = [label sizeWithAttributes:attributes];
+	static NSSize textSize;
+	static BOOL measured = NO;
+	if (!measured) {
+		textSize = [label sizeWithAttributes:attributes];
+		measured = YES;
+	}
 
 	NSRect badgeRect;
 	badgeRect.origin.x = round(refRect->origin.x);
@@ -438,7 +459,7 @@ - (void)rightMouseDown:(NSEvent *)event
 
 	id ref = nil;
 	if (i >= 0)
-		ref = [[self.commit refs] objectAtIndex:(NSUInteger)i];
+		ref = [self.commit.decoration.refs objectAtIndex:(NSUInteger)i];
 
 	NSArray *items = nil;
 	if (ref)
@@ -2,6 +2,8 @@ import Cocoa
 
 @objc class PBRefMenuItem: NSMenuItem {
     @objc var refish: PBGitRefish?
+    /// Kept by the items it sets, for as long as the menu is around
+    private var pendingHeadBranch: PendingHeadBranch?
 
     @objc(itemWithTitle:action:enabled:)
     static func item(withTitle title: String, action selector: Selector?, enabled isEnabled: Bool) -> PBRefMenuItem {
@@ -15,6 +17,44 @@ import Cocoa
         return unsafeDowncast(super.separator(), to: Self.self)
     }
 
+    /// An item that is disabled when the commit is already on HEAD's branch.
+    /// While that isn't known it is disabled with its other title, and
+    /// `PendingHeadBranch` sets it once it is.
+    private static func item(_ choice: HeadBranchChoice, isOnHeadBranch: Bool?) -> PBRefMenuItem {
+        let item = PBRefMenuItem.item(withTitle: choice.offHeadTitle, action: nil, enabled: false)
+        if let isOnHeadBranch {
+            item.set(choice, isOnHeadBranch: isOnHeadBranch)
+        }
+        return item
+    }
+
+    fileprivate func set(_ choice: HeadBranchChoice, isOnHeadBranch: Bool) {
+        title = isOnHeadBranch ? choice.onHeadTitle : choice.offHeadTitle
+        action = isOnHeadBranch ? nil : choice.action
+        isEnabled = !isOnHeadBranch
+    }
+
+    /// Whether `sha` is HEAD or one of its ancestors; nil until the ancestry
+    /// has been worked out.
+    private static func headBranchContains(_ sha: String?, in repo: PBGitRepository?) -> Bool? {
+        guard let sha, let repo, let headSHA = repo.headSHA() else {
+            return false
+        }
+        return repo.ancestry.knownIsSHA(sha, ancestorOf: headSHA)
+    }
+
+    /// Builds the items that depend on HEAD's branch, and if that isn't
+    /// known yet, has them set when it is.
+    private static func headBranchItems(_ choices: [HeadBranchChoice], in repo: PBGitRepository?, isOnHeadBranch: @escaping () -> Bool?) -> [PBRefMenuItem] {
+        let answer = isOnHeadBranch()
+        let items = choices.map { item($0, isOnHeadBranch: answer) }
+        if answer == nil, let repo {
+            let pending = PendingHeadBranch(items: Array(zip(items, choices)), ancestry: repo.ancestry, isOnHeadBranch: isOnHeadBranch)
+            items.forEach { $0.pendingHeadBranch = pending }
+        }
+        return items
+    }
+
     @objc(defaultMenuItemsForRef:inRepository:target:)
     static func defaultMenuItems(for ref: PBGitRef?, in repo: PBGitRepository?, target: Any?) -> [PBRefMenuItem]? {
         guard let ref = ref, let repo = repo, let target = target else {
@@ -28,7 +68,6 @@ import Cocoa
         let headRef = repo.headRef()?.ref
         let headRefName = headRef?.shortName() ?? ""
         let isHead = ref.isEqual(to: headRef)
-        let isOnHeadBranch = isHead ? true : repo.isRef(onHeadBranch: ref)
         let isDetachedHead = (isHead && headRefName == "HEAD")
 
         let isRemote = (ref.isRemote && !ref.isRemoteBranch)
@@ -55,17 +94,14 @@ import Cocoa
 
             items.append(.separator())
 
-            // merge ref
-            let mergeTitle = isOnHeadBranch
-                ? "Merge"
-                : "Merge \(targetRefName) into \(headRefName)"
-            items.append(.item(withTitle: mergeTitle, action: #selector(merge(_:)), enabled: !isOnHeadBranch))
-
-            // rebase
-            let rebaseTitle = isOnHeadBranch
-                ? "Rebase"
-                : "Rebase \(headRefName) on \(targetRefName)"
-            items.append(.item(withTitle: rebaseTitle, action: #selector(rebaseHeadBranch(_:)), enabled: !isOnHeadBranch))
+            // merge ref, rebase
+            let choices = [
+                HeadBranchChoice(onHeadTitle: "Merge", offHeadTitle: "Merge \(targetRefName) into \(headRefName)", action: #selector(merge(_:))),
+                HeadBranchChoice(onHeadTitle: "Rebase", offHeadTitle: "Rebase \(headRefName) on \(targetRefName)", action: #selector(rebaseHeadBranch(_:))),
+            ]
+            items += headBranchItems(choices, in: repo) { [weak repo] in
+                isHead ? true : PBRefMenuItem.headBranchContains(repo?.shaForRef(ref), in: repo)
+            }
 
             items.append(.separator())
         }
@@ -99,7 +135,6 @@ import Cocoa
         var items: [PBRefMenuItem] = []
 
         let headBranchName = commit.repository?.headRef()?.ref?.shortName() ?? ""
-        let isOnHeadBranch = commit.isOnHeadBranch()
 
         items.append(.item(withTitle: "Checkout Commit", action: #selector(checkout(_:)), enabled: true))
         items.append(.separator())
@@ -118,23 +153,15 @@ import Cocoa
         }
         items.append(.separator())
 
-        // merge commit
-        let mergeTitle = isOnHeadBranch
-            ? "Merge commit"
-            : "Merge commit into \(headBranchName)"
-        items.append(.item(withTitle: mergeTitle, action: #selector(merge(_:)), enabled: !isOnHeadBranch))
-
-        // cherry pick
-        let cherryPickTitle = isOnHeadBranch
-            ? "Cherry pick commit"
-            : "Cherry pick commit to \(headBranchName)"
-        items.append(.item(withTitle: cherryPickTitle, action: #selector(cherryPick(_:)), enabled: !isOnHeadBranch))
-
-        // rebase
-        let rebaseTitle = isOnHeadBranch
-            ? "Rebase commit"
-            : "Rebase \(headBranchName) on commit"
-        items.append(.item(withTitle: rebaseTitle, action: #selector(rebaseHeadBranch(_:)), enabled: !isOnHeadBranch))
+        // merge commit, cherry pick, rebase
+        let choices = [
+            HeadBranchChoice(onHeadTitle: "Merge commit", offHeadTitle: "Merge commit into \(headBranchName)", action: #selector(merge(_:))),
+            HeadBranchChoice(onHeadTitle: "Cherry pick commit", offHeadTitle: "Cherry pick commit to \(headBranchName)", action: #selector(cherryPick(_:))),
+            HeadBranchChoice(onHeadTitle: "Rebase commit", offHeadTitle: "Rebase \(headBranchName) on commit", action: #selector(rebaseHeadBranch(_:))),
+        ]
+        items += headBranchItems(choices, in: commit.repository) { [weak commit] in
+            PBRefMenuItem.headBranchContains(commit?.sha, in: commit?.repository)
+        }
 
         for item in items {
             item.target = target as AnyObject?
@@ -159,4 +186,48 @@ import Cocoa
     @objc private func copyPatch(_ sender: Any?) {}
     @objc private func copyGitHubURL(_ sender: Any?) {}
     @objc private func cherryPick(_ sender: Any?) {}
-}
\ No newline at end of file
+}
+
+/// The two ways an item can read depending on whether its commit is
+/// already on HEAD's branch, where it would have nothing to do.
+private struct HeadBranchChoice {
+    let onHeadTitle: String
+    let offHeadTitle: String
+    let action: Selector
+}
+
+/// Waits for the ancestry a menu was built without, then sets its items as
+/// they would have been built. The menu may still be open; it shows the
+/// change straight away.
+private final class PendingHeadBranch {
+    private var observer: NSObjectProtocol?
+
+    init(items: [(PBRefMenuItem, HeadBranchChoice)], ancestry: PBCommitAncestry, isOnHeadBranch: @escaping () -> Bool?) {
+        let entries = items.map { (item: WeakItem(item: $0.0), choice: $0.1) }
+        // Posted on the main thread; handled there, menu tracking or not
+        observer = NotificationCenter.default.addObserver(forName: PBCommitAncestry.didUpdateNotification, object: ancestry, queue: nil) { [weak self] _ in
+            guard let answer = isOnHeadBranch() else {
+                return
+            }
+            for entry in entries {
+                entry.item.item?.set(entry.choice, isOnHeadBranch: answer)
+            }
+            self?.stopObserving()
+        }
+    }
+
+    deinit {
+        stopObserving()
+    }
+
+    private func stopObserving() {
+        if let observer {
+            NotificationCenter.default.removeObserver(observer)
+        }
+        observer = nil
+    }
+}
+
+private struct WeakItem {
+    weak var item: PBRefMenuItem?
+}
@@ -98,6 +98,19 @@ import Cocoa
         return badge("✔", for: cell)
     }
 
+    /// "↑2 ↓5" for a branch that has moved away from its upstream.
+    @objc(aheadBehindBadge:forCell:)
+    static func aheadBehindBadge(_ counts: PBAheadBehind, for cell: NSTextFieldCell) -> NSImage {
+        var parts: [String] = []
+        if counts.ahead > 0 {
+            parts.append("↑\(counts.ahead)")
+        }
+        if counts.behind > 0 {
+            parts.append("↓\(counts.behind)")
+        }
+        return badge(parts.joined(separator: " "), for: cell)
+    }
+
     @objc(numericBadge:forCell:)
     static func numericBadge(_ number: Int, for cell: NSTextFieldCell) -> NSImage {
         return badge("\(number)", for: cell)
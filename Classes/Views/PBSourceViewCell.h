@@ -9,11 +9,14 @@
 #import <Cocoa/Cocoa.h>
 #import "PBIconAndTextCell.h"
 
+@class PBAheadBehind;
 
 @interface PBSourceViewCell : PBIconAndTextCell {
 	BOOL isCheckedOut;
 }
 
 @property (assign) BOOL isCheckedOut;
+// Shown for branches that differ from their upstream
+@property (strong) PBAheadBehind *aheadBehind;
 
 @end
@@ -16,6 +16,7 @@
 @implementation PBSourceViewCell
 
 @synthesize isCheckedOut;
+@synthesize aheadBehind;
 
 # pragma mark context menu delegate methods
 
@@ -32,25 +33,32 @@ - (NSMenu *) menuForEvent:(NSEvent *)event inRect:(NSRect)rect ofView:(NSOutline
 
 #pragma mark drawing
 
+// Draws `badge` at the right edge of `cellFrame` and takes its width out.
+- (void)drawBadge:(NSImage *)badge inFrame:(NSRect *)cellFrame
+{
+	NSSize imageSize = [badge size];
+	NSRect imageFrame;
+	NSDivideRect(*cellFrame, &imageFrame, cellFrame, imageSize.width + 3, NSMaxXEdge);
+	imageFrame.size = imageSize;
+
+	// center the decal verctically
+	imageFrame.origin.y += ceil((cellFrame->size.height - imageFrame.size.height) / 2);
+
+	[badge drawInRect:imageFrame
+			 fromRect:NSZeroRect
+			operation:NSCompositingOperationSourceOver
+			 fraction:1.0f
+	   respectFlipped:YES
+				hints:nil];
+}
+
 - (void)drawWithFrame:(NSRect)cellFrame inView:(NSView *)outlineView
 {
-	if (isCheckedOut) {
-		NSImage *checkedOutImage = [PBSourceViewBadge checkedOutBadgeForCell:self];
-		NSSize imageSize = [checkedOutImage size];
-		NSRect imageFrame;
-		NSDivideRect(cellFrame, &imageFrame, &cellFrame, imageSize.width + 3, NSMaxXEdge);
-		imageFrame.size = imageSize;
-
-		// center the decal verctically
-		imageFrame.origin.y += ceil((cellFrame.size.height - imageFrame.size.height) / 2);
-
-		[checkedOutImage drawInRect:imageFrame
-						   fromRect:NSZeroRect
-						  operation:NSCompositingOperationSourceOver
-						   fraction:1.0f
-					 respectFlipped:YES
-							  hints:nil];
-	}
+	if (isCheckedOut)
+		[self drawBadge:[PBSourceViewBadge checkedOutBadgeForCell:self] inFrame:&cellFrame];
+
+	if (aheadBehind && ![aheadBehind isEven])
+		[self drawBadge:[PBSourceViewBadge aheadBehindBadge:aheadBehind forCell:self] inFrame:&cellFrame];
 
 	[super drawWithFrame:cellFrame inView:outlineView];
 }
@@ -3,9 +3,12 @@ import Cocoa
 @objc(PBSourceViewItem)
 @objcMembers
 open class PBSourceViewItem: NSObject {
-    private var childrenSet = NSMutableOrderedSet()
+    // Kept sorted by title as children are added, so the outline view can
+    // index into it directly and a ref reload only shifts the affected rows.
+    private var children: [PBSourceViewItem] = []
+    // Folder and remote nodes by title, for O(1) path walks in addRev(_:toPath:).
+    private var containersByTitle: [String: PBSourceViewItem] = [:]
     private var _title: String?
-    private var _sortedChildren: [PBSourceViewItem]?
 
     @objc var revSpecifier: PBGitRevSpecifier?
     @objc var isGroupItem: Bool = false
@@ -26,15 +29,50 @@ open class PBSourceViewItem: NSObject {
     }
 
     @objc var sortedChildren: [PBSourceViewItem] {
-        if _sortedChildren == nil {
-            let newArray = childrenSet.sortedArray { obj1, obj2 in
-                let item1 = obj1 as! PBSourceViewItem
-                let item2 = obj2 as! PBSourceViewItem
-                return item1.title.localizedStandardCompare(item2.title)
+        children
+    }
+
+    @objc var numberOfChildren: Int {
+        children.count
+    }
+
+    @objc(childAtIndex:)
+    func child(at index: Int) -> PBSourceViewItem {
+        children[index]
+    }
+
+    /// Position of `child` in `sortedChildren`, or NSNotFound.
+    @objc(indexOfChild:)
+    func index(of child: PBSourceViewItem) -> Int {
+        guard child.parent === self else { return NSNotFound }
+
+        let title = child.title ?? ""
+        var index = insertionIndex(forTitle: title)
+        // Equal titles sort together; step back to the first of them.
+        while index > 0 && children[index - 1].title.localizedStandardCompare(title) == .orderedSame {
+            index -= 1
+        }
+        while index < children.count {
+            if children[index] === child {
+                return index
+            }
+            if children[index].title.localizedStandardCompare(title) != .orderedSame {
+                break
             }
-            _sortedChildren = newArray as? [PBSourceViewItem]
+            index += 1
+        }
+        return children.firstIndex { $0 === child } ?? NSNotFound
+    }
+
+    /// The highest ancestor (or self) that exists only to hold this item, i.e.
+    /// the node that appeared when this item was added and that disappears
+    /// when it is removed. Group items are never returned.
+    @objc var outermostExclusiveAncestor: PBSourceViewItem {
+        var node = self
+        while let parent = node.parent, !parent.isGroupItem, parent.children.count == 1 {
+            node = parent
         }
-        return _sortedChildren ?? []
+        return node
     }
 
     @objc var iconName: String! {
@@ -78,52 +116,65 @@ open class PBSourceViewItem: NSObject {
         return PBGitSVOtherRevItem.otherItem(with: revSpecifier)
     }
 
-    @objc func addChild(_ child: PBSourceViewItem?) {
-        guard let child = child else { return }
+    /// Inserts `child` at its sorted position and returns that index.
+    @discardableResult
+    @objc func addChild(_ child: PBSourceViewItem?) -> Int {
+        guard let child = child else { return NSNotFound }
+        if child.parent === self {
+            let existing = index(of: child)
+            if existing != NSNotFound {
+                return existing
+            }
+        }
 
-        childrenSet.add(child)
-        _sortedChildren = nil
+        let index = insertionIndex(forTitle: child.title ?? "")
+        children.insert(child, at: index)
+        if child.revSpecifier == nil, let title = child.title {
+            containersByTitle[title] = child
+        }
         child.parent = self
+        return index
     }
 
     @objc func removeChild(_ child: PBSourceViewItem?) {
         guard let child = child else { return }
 
-        childrenSet.remove(child)
-        _sortedChildren = nil
-        if !isGroupItem && childrenSet.count == 0 {
+        let index = index(of: child)
+        guard index != NSNotFound else { return }
+        children.remove(at: index)
+        if let title = child.title, containersByTitle[title] === child {
+            containersByTitle.removeValue(forKey: title)
+        }
+        if !isGroupItem && children.isEmpty {
             parent?.removeChild(self)
         }
     }
 
-    @objc func addRev(_ theRevSpecifier: PBGitRevSpecifier, toPath path: [String]) {
-        if path.count == 1 {
-            let item = PBSourceViewItem.item(withRevSpec: theRevSpecifier)
-            addChild(item)
-            return
-        }
-
-        let firstTitle = path[0]
-        var node: PBSourceViewItem? = nil
-        for child in childrenSet {
-            if let item = child as? PBSourceViewItem, item.title == firstTitle {
-                node = item
-                break
+    /// Adds an item for `theRevSpecifier` under the folders named by `path`,
+    /// creating them as needed, and returns the new leaf item.
+    @discardableResult
+    @objc func addRev(_ theRevSpecifier: PBGitRevSpecifier, toPath path: [String]) -> PBSourceViewItem {
+        var node: PBSourceViewItem = self
+        for folderTitle in path.dropLast() {
+            if let existing = node.containersByTitle[folderTitle] {
+                node = existing
+                continue
             }
-        }
 
-        if node == nil {
-            if firstTitle == theRevSpecifier.ref?.remoteName {
-                node = PBGitSVRemoteItem.remoteItem(withTitle: firstTitle)
+            let folder: PBSourceViewItem
+            if folderTitle == theRevSpecifier.ref?.remoteName {
+                folder = PBGitSVRemoteItem.remoteItem(withTitle: folderTitle)
             } else {
-                node = PBGitSVFolderItem.folderItem(withTitle: firstTitle)
-                node?.isExpanded = (title == "BRANCHES")
+                folder = PBGitSVFolderItem.folderItem(withTitle: folderTitle)
+                folder.isExpanded = (node.title == "BRANCHES")
             }
-            addChild(node)
+            node.addChild(folder)
+            node = folder
         }
 
-        let subpath = Array(path.dropFirst())
-        node?.addRev(theRevSpecifier, toPath: subpath)
+        let item = PBSourceViewItem.item(withRevSpec: theRevSpecifier)
+        node.addChild(item)
+        return item
     }
 
     @objc func findRev(_ rev: PBGitRevSpecifier) -> PBSourceViewItem? {
@@ -131,9 +182,8 @@ open class PBSourceViewItem: NSObject {
             return self
         }
 
-        for child in childrenSet {
-            if let item = child as? PBSourceViewItem,
-               let found = item.findRev(rev) {
+        for item in children {
+            if let found = item.findRev(rev) {
                 return found
             }
         }
@@ -141,6 +191,25 @@ open class PBSourceViewItem: NSObject {
         return nil
     }
 
+    private func insertionIndex(forTitle title: String) -> Int {
+        // Refs usually arrive sorted, so appending is the common case.
+        if let last = children.last, last.title.localizedStandardCompare(title) != .orderedDescending {
+            return children.count
+        }
+
+        var low = 0
+        var high = children.count
+        while low < high {
+            let mid = (low + high) / 2
+            if children[mid].title.localizedStandardCompare(title) == .orderedDescending {
+                high = mid
+            } else {
+                low = mid + 1
+            }
+        }
+        return low
+    }
+
     @objc func iconNamed(_ name: String) -> NSImage {
         guard let iconImage = NSImage(named: name) else {
             return NSImage()
@@ -163,61 +232,6 @@ open class PBSourceViewItem: NSObject {
 }
 
 
-@objc(PBSubmoduleInfo)
-@objcMembers
-final class PBSubmoduleInfo: NSObject {
-    var name: String?
-    var path: String?
-    var parentRepositoryURL: URL?
-
-    @objc(submodulesForRepositoryURL:)
-    class func submodules(for repositoryURL: URL) -> [PBSubmoduleInfo] {
-        let gitPath = PBGitBinary.path() ?? "/usr/bin/git"
-        var exitCode: Int32 = 0
-        guard let output = PBEasyPipe.outputForCommand(
-            gitPath,
-            withArgs: [
-                "config",
-                "--file",
-                ".gitmodules",
-                "--get-regexp",
-                "^submodule\\..*\\.path$"
-            ],
-            inDir: repositoryURL.path,
-            retValue: &exitCode
-        ), exitCode == 0 else {
-            return []
-        }
-
-        var submodules: [PBSubmoduleInfo] = []
-
-        output.split(separator: "\n").forEach { rawLine in
-            guard !rawLine.isEmpty else { return }
-            let line = String(rawLine)
-
-            guard let pathRange = line.range(of: "submodule."),
-                  let dotPathRange = line.range(of: ".path "),
-                  pathRange.upperBound <= dotPathRange.lowerBound else {
-                return
-            }
-
-            let name = String(line[pathRange.upperBound..<dotPathRange.lowerBound])
-            let pathComponent = String(line[dotPathRange.upperBound...]).trimmingCharacters(in: .whitespacesAndNewlines)
-            guard !name.isEmpty, !pathComponent.isEmpty else {
-                return
-            }
-
-            let info = PBSubmoduleInfo()
-            info.name = name
-            info.path = pathComponent
-            info.parentRepositoryURL = repositoryURL
-            submodules.append(info)
-        }
-
-        return submodules
-    }
-}
-
 @objc(PBGitSVSubmoduleItem)
 @objcMembers
 final class PBGitSVSubmoduleItem: PBSourceViewItem {
@@ -237,12 +251,11 @@ final class PBGitSVSubmoduleItem: PBSourceViewItem {
     }
 
     var path: URL? {
-        guard let parent = submodule?.parentRepositoryURL,
-              let relative = submodule?.path else {
-            return nil
-        }
+        submodule?.worktreeURL
+    }
 
-        return parent.appendingPathComponent(relative)
+    var toolTip: String? {
+        submodule?.statusDescription
     }
 }
 
@@ -76,36 +76,43 @@ final class GitAsyncCommand: NSObject {
         process.arguments = arguments
         process.currentDirectoryURL = URL(fileURLWithPath: workingDirectory)
         process.environment = sanitizedEnvironment()
+        let qualityOfService = GitWorkspace.shared.qualityOfService(forRepositoryAt: workingDirectory)
+        process.qualityOfService = qualityOfService
 
         let outputPipe = Pipe()
         let errorPipe = Pipe()
         process.standardOutput = outputPipe
         process.standardError = errorPipe
 
-        // Use a background queue for the process
-        DispatchQueue.global(qos: .userInitiated).async {
-            do {
-                try process.run()
-            } catch {
-                let result = GitCommandResult(
-                    output: Data(),
-                    error: "Failed to launch: \(error.localizedDescription)".data(using: .utf8) ?? Data(),
-                    exitCode: -1
-                )
-                DispatchQueue.main.async { completion(result) }
-                return
-            }
+        // Use a background queue for the process, waiting there for a
+        // workspace slot; background repositories get a lower priority queue
+        let queueQoS: DispatchQoS.QoSClass = qualityOfService == .userInitiated ? .userInitiated : .utility
+        DispatchQueue.global(qos: queueQoS).async {
+            let result = GitWorkspace.shared.withProcessSlot(forRepositoryAt: workingDirectory) { () -> GitCommandResult in
+                let span = PBTracer.shared.beginCommand(gitPath, arguments: arguments)
+                do {
+                    try process.run()
+                } catch {
+                    span?.endCommand(bytes: 0, exitCode: -1)
+                    return GitCommandResult(
+                        output: Data(),
+                        error: "Failed to launch: \(error.localizedDescription)".data(using: .utf8) ?? Data(),
+                        exitCode: -1
+                    )
+                }
 
-            // Read output (blocks until process completes)
-            let outputData = outputPipe.fileHandleForReading.readDataToEndOfFile()
-            let errorData = errorPipe.fileHandleForReading.readDataToEndOfFile()
-            process.waitUntilExit()
+                // Read output (blocks until process completes)
+                let outputData = outputPipe.fileHandleForReading.readDataToEndOfFile()
+                let errorData = errorPipe.fileHandleForReading.readDataToEndOfFile()
+                process.waitUntilExit()
+                span?.endCommand(bytes: outputData.count, exitCode: process.terminationStatus)
 
-            let result = GitCommandResult(
-                output: outputData,
-                error: errorData,
-                exitCode: process.terminationStatus
-            )
+                return GitCommandResult(
+                    output: outputData,
+                    error: errorData,
+                    exitCode: process.terminationStatus
+                )
+            }
 
             DispatchQueue.main.async { completion(result) }
         }
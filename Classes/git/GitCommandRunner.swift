@@ -48,15 +48,18 @@ final class GitCommandRunner: NSObject {
 
         var exitStatus: Int32 = -1
         var stderrOutput: NSString?
-        guard var output = PBEasyPipe.outputForCommand(
-            gitPath,
-            withArgs: argumentStrings,
-            inDir: workingDirectory,
-            byExtendingEnvironment: environment,
-            inputString: input,
-            retValue: &exitStatus,
-            standardError: &stderrOutput
-        ), exitStatus == 0 else {
+        let result = GitWorkspace.shared.withProcessSlot(forRepositoryAt: workingDirectory) {
+            PBEasyPipe.outputForCommand(
+                gitPath,
+                withArgs: argumentStrings,
+                inDir: workingDirectory,
+                byExtendingEnvironment: environment,
+                inputString: input,
+                retValue: &exitStatus,
+                standardError: &stderrOutput
+            )
+        }
+        guard var output = result, exitStatus == 0 else {
             let suggestion = stderrOutput as String?
             let message = exitStatus == -1
                 ? "Git command execution failed"
@@ -81,6 +84,185 @@ final class GitCommandRunner: NSObject {
         return output
     }
 
+    /// Runs a git command and hands its standard output to `handler` one record
+    /// at a time, split on `separator`, as the bytes arrive instead of after the
+    /// process exits. The trailing record is delivered at EOF. Returning false
+    /// from the handler stops reading and terminates the process.
+    @objc(streamWithArguments:repository:recordSeparator:handler:error:)
+    func stream(arguments anyArguments: [Any],
+                repository: PBGitRepository,
+                recordSeparator separator: Data,
+                handler: (Data) -> Bool,
+                error: NSErrorPointer) -> Bool {
+        guard !separator.isEmpty else {
+            assignError(code: .invalidArguments,
+                        description: "Git command arguments cannot be empty",
+                        recoverySuggestion: nil,
+                        errorPointer: error)
+            return false
+        }
+
+        var buffer = Data()
+        return readOutput(arguments: anyArguments, repository: repository, error: error) { chunk in
+            buffer.append(chunk)
+
+            var recordStart = buffer.startIndex
+            var keepReading = true
+            while let range = buffer.range(of: separator, in: recordStart..<buffer.endIndex) {
+                let record = buffer.subdata(in: recordStart..<range.lowerBound)
+                recordStart = range.upperBound
+                if !handler(record) {
+                    keepReading = false
+                    break
+                }
+            }
+            buffer.removeSubrange(buffer.startIndex..<recordStart)
+            return keepReading
+        } atEnd: {
+            if !buffer.isEmpty {
+                _ = handler(buffer)
+            }
+        }
+    }
+
+    /// Runs a git command and returns at most `limit` bytes of its standard
+    /// output, terminating the process as soon as that much has arrived.
+    @objc(readPrefixWithArguments:repository:limit:error:)
+    func readPrefix(arguments anyArguments: [Any],
+                    repository: PBGitRepository,
+                    limit: Int,
+                    error: NSErrorPointer) -> Data? {
+        var prefix = Data()
+        let succeeded = readOutput(arguments: anyArguments, repository: repository, error: error) { chunk in
+            prefix.append(chunk.prefix(limit - prefix.count))
+            return prefix.count < limit
+        } atEnd: {}
+        return succeeded ? prefix : nil
+    }
+
+    /// Launches git and passes each chunk of standard output to `chunkHandler`
+    /// until it returns false (which terminates the process) or output ends,
+    /// in which case `atEnd` runs. A nonzero exit is only an error if the
+    /// process ran to completion. The process holds a workspace slot for as
+    /// long as it runs.
+    private func readOutput(arguments anyArguments: [Any],
+                            repository: PBGitRepository,
+                            error: NSErrorPointer,
+                            chunkHandler: (Data) -> Bool,
+                            atEnd: () -> Void) -> Bool {
+        return GitWorkspace.shared.withProcessSlot(forRepositoryAt: repository.workingDirectory()) {
+            runProcess(arguments: anyArguments,
+                       repository: repository,
+                       error: error,
+                       chunkHandler: chunkHandler,
+                       atEnd: atEnd)
+        }
+    }
+
+    private func runProcess(arguments anyArguments: [Any],
+                            repository: PBGitRepository,
+                            error: NSErrorPointer,
+                            chunkHandler: (Data) -> Bool,
+                            atEnd: () -> Void) -> Bool {
+        let argumentStrings = coerceArguments(anyArguments)
+        guard !argumentStrings.isEmpty else {
+            assignError(code: .invalidArguments,
+                        description: "Git command arguments cannot be empty",
+                        recoverySuggestion: nil,
+                        errorPointer: error)
+            return false
+        }
+
+        guard let gitPath = PBGitBinary.path(), !gitPath.isEmpty else {
+            assignError(code: .gitNotFound,
+                        description: "Git binary not found",
+                        recoverySuggestion: PBGitBinary.notFoundError(),
+                        errorPointer: error)
+            return false
+        }
+
+        let workingDirectory = repository.workingDirectory()
+
+        if UserDefaults.standard.bool(forKey: "Show Debug Messages") {
+            let joined = argumentStrings.joined(separator: " ")
+            NSLog("Streaming git command: %@ %@ in %@", gitPath, joined, workingDirectory ?? "(nil)")
+        }
+
+        let process = Process()
+        process.executableURL = URL(fileURLWithPath: gitPath)
+        process.arguments = argumentStrings
+        if let workingDirectory {
+            process.currentDirectoryURL = URL(fileURLWithPath: workingDirectory)
+        }
+        process.environment = mergedEnvironment(with: nil)
+        process.qualityOfService = GitWorkspace.shared.qualityOfService(forRepositoryAt: workingDirectory)
+
+        let outputPipe = Pipe()
+        let errorPipe = Pipe()
+        process.standardOutput = outputPipe
+        process.standardError = errorPipe
+
+        let span = PBTracer.shared.beginCommand(gitPath, arguments: argumentStrings)
+        do {
+            try process.run()
+        } catch let launchError {
+            span?.endCommand(bytes: 0, exitCode: -1)
+            assignError(code: .commandFailed,
+                        description: "Git command execution failed",
+                        recoverySuggestion: launchError.localizedDescription,
+                        errorPointer: error)
+            return false
+        }
+
+        // Drain stderr on the side so a chatty command can't block on a full pipe.
+        var errorData = Data()
+        let errorGroup = DispatchGroup()
+        errorGroup.enter()
+        DispatchQueue.global(qos: .utility).async {
+            errorData = errorPipe.fileHandleForReading.readDataToEndOfFile()
+            errorGroup.leave()
+        }
+
+        let reader = outputPipe.fileHandleForReading
+        var stopped = false
+        var bytesRead = 0
+        while !stopped {
+            let chunk = reader.availableData
+            if chunk.isEmpty {
+                break
+            }
+            bytesRead += chunk.count
+            stopped = !chunkHandler(chunk)
+        }
+
+        if stopped {
+            process.terminate()
+        } else {
+            atEnd()
+        }
+
+        process.waitUntilExit()
+        errorGroup.wait()
+        span?.args["stopped"] = stopped
+        span?.endCommand(bytes: bytesRead, exitCode: process.terminationStatus)
+
+        guard stopped || process.terminationStatus == 0 else {
+            let joined = argumentStrings.joined(separator: " ")
+            var userInfo: [String: Any] = [
+                NSLocalizedDescriptionKey: "Git command failed with exit code \(process.terminationStatus)",
+                "GitCommand": "Command: git \(joined)",
+                "ExitCode": NSNumber(value: process.terminationStatus)
+            ]
+            if let suggestion = String(data: errorData, encoding: .utf8), !suggestion.isEmpty {
+                userInfo[NSLocalizedRecoverySuggestionErrorKey] = suggestion
+            }
+            assignError(code: .commandFailed, userInfo: userInfo, errorPointer: error)
+            return false
+        }
+
+        return true
+    }
+
     private func coerceArguments(_ arguments: [Any]) -> [String] {
         var result: [String] = []
         result.reserveCapacity(arguments.count)
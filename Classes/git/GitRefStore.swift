@@ -0,0 +1,556 @@
+import Foundation
+
+/// One ref, as listed by `GitRefStore` or parsed from `git for-each-ref`.
+@objcMembers
+@objc(GitRefEntry)
+final class GitRefEntry: NSObject {
+    /// Full name, such as "refs/heads/main"
+    let name: String
+    /// The object the ref names; the tag object for an annotated tag
+    let sha: String
+    /// The commit an annotated tag points at, when packed-refs records it
+    let peeledSHA: String?
+    /// "tag" for an annotated tag known to be one, otherwise "commit". Telling
+    /// a commit from the rare ref to a tree or blob means reading the object,
+    /// so the store reports those as "commit" too.
+    let objectType: String
+
+    init(name: String, sha: String, peeledSHA: String?, objectType: String) {
+        self.name = name
+        self.sha = sha
+        self.peeledSHA = peeledSHA
+        self.objectType = objectType
+        super.init()
+    }
+
+    /// Entries from `for-each-ref --format=%(refname)%09%(objecttype)%09%(objectname)`.
+    @objc(entriesFromListing:)
+    class func entries(fromListing listing: String) -> [GitRefEntry] {
+        var entries: [GitRefEntry] = []
+        listing.enumerateLines { line, _ in
+            let fields = line.split(separator: "\t", omittingEmptySubsequences: false)
+            guard fields.count >= 3 else {
+                return
+            }
+            entries.append(GitRefEntry(name: String(fields[0]), sha: String(fields[2]),
+                                       peeledSHA: nil, objectType: String(fields[1])))
+        }
+        return entries
+    }
+}
+
+/// Reads refs straight from the files backend: loose files under refs/ and
+/// the packed-refs file, without starting git.
+///
+/// packed-refs is memory-mapped and only re-read when its size, inode or
+/// modification time changes; single refs are found in it by binary search
+/// over the mapped bytes. The loose scan keeps what it read per directory and
+/// only lists a directory again when its modification time changes. git
+/// updates a ref by renaming a lock file over it, which always touches the
+/// directory, so an unchanged directory means unchanged refs.
+///
+/// Safe to use from any thread.
+@objcMembers
+@objc(GitRefStore)
+final class GitRefStore: NSObject {
+    let gitDir: URL
+    let commonDir: URL
+
+    private let lock = NSLock()
+    private var packed: PackedRefs?
+    private var looseDirectories: [String: LooseDirectory] = [:]
+    private var snapshot: [GitRefEntry]?
+
+    /// Refs kept per worktree rather than in the common directory.
+    private static let perWorktreePrefixes = ["refs/bisect/", "refs/worktree/", "refs/rewritten/"]
+    private static let maxSymrefDepth = 5
+
+    init(gitDir: URL, commonDir: URL) {
+        self.gitDir = gitDir
+        self.commonDir = commonDir
+        super.init()
+    }
+
+    /// A store for the repository at `location`, or nil when its refs are not
+    /// kept in files (the reftable backend), in which case ask git.
+    @objc(storeForLocation:)
+    class func store(for location: GitRepoLocation) -> GitRefStore? {
+        var isDirectory: ObjCBool = false
+        if FileManager.default.fileExists(atPath: location.commonDir.appendingPathComponent("reftable").path,
+                                          isDirectory: &isDirectory), isDirectory.boolValue {
+            return nil
+        }
+        return GitRefStore(gitDir: location.gitDir, commonDir: location.commonDir)
+    }
+
+    // MARK: - Queries
+
+    /// Every ref under refs/, sorted by name the way git sorts them, with
+    /// symbolic refs resolved. Returns the previous array as is when nothing
+    /// on disk changed since the last call.
+    func allRefs() -> [GitRefEntry] {
+        lock.lock()
+        defer { lock.unlock() }
+
+        // Loose before packed: `git pack-refs` writes packed-refs before it
+        // deletes the loose files, so a ref moving between them is always
+        // seen in one or the other.
+        var loose: [String: String] = [:]
+        var visited = Set<String>()
+        var changed = false
+        var roots = [(commonDir, false)]
+        if gitDir.standardizedFileURL != commonDir.standardizedFileURL {
+            roots.append((gitDir, true))
+        }
+        for (directory, perWorktree) in roots {
+            scanLoose(path: directory.appendingPathComponent("refs").path, name: "refs/",
+                      perWorktreeOnly: perWorktree, skipPerWorktree: !perWorktree && roots.count > 1,
+                      into: &loose, visited: &visited, changed: &changed)
+        }
+        for key in looseDirectories.keys where !visited.contains(key) {
+            looseDirectories[key] = nil
+            changed = true
+        }
+        if refreshPacked() {
+            changed = true
+        }
+
+        if let snapshot, !changed {
+            return snapshot
+        }
+
+        let entries = merge(loose: loose)
+        snapshot = entries
+        return entries
+    }
+
+    /// The ref called `name` ("HEAD" or a full name under refs/), with
+    /// symbolic refs followed, or nil if there is no such ref. Reads at most
+    /// one loose file per step and a binary search of packed-refs.
+    @objc(refNamed:)
+    func ref(named name: String) -> GitRefEntry? {
+        guard name == "HEAD" || name.hasPrefix("refs/"), !name.contains("..") else {
+            return nil
+        }
+
+        lock.lock()
+        defer { lock.unlock() }
+
+        var current = name
+        for _ in 0...GitRefStore.maxSymrefDepth {
+            if let contents = readLooseFile(named: current) {
+                if let target = GitRefStore.symrefTarget(contents) {
+                    current = target
+                    continue
+                }
+                guard GitRefStore.isHexSHA(contents) else {
+                    return nil
+                }
+                return GitRefEntry(name: name, sha: contents, peeledSHA: nil, objectType: "commit")
+            }
+
+            _ = refreshPacked()
+            guard let record = packed?.find(current) else {
+                return nil
+            }
+            return GitRefEntry(name: name, sha: record.sha, peeledSHA: record.peeled,
+                               objectType: record.peeled != nil ? "tag" : "commit")
+        }
+        return nil
+    }
+
+    /// The first ref, in name order, whose name is `name` or ends in
+    /// "/`name`", matching what `git show-ref <name>` prints first.
+    @objc(firstRefMatchingName:)
+    func firstRef(matching name: String) -> GitRefEntry? {
+        guard !name.isEmpty else {
+            return nil
+        }
+        let suffix = "/" + name
+        return allRefs().first { $0.name == name || $0.name.hasSuffix(suffix) }
+    }
+
+    /// Whether `name` is a valid full ref name, by the rules of
+    /// `git check-ref-format` without options: at least two components, none
+    /// starting with "." or ending with ".lock", no "..", "@{", "//",
+    /// control characters, spaces or any of ~^:?*[\, and not ending in "/"
+    /// or ".", or being "@".
+    @objc(isValidRefName:)
+    class func isValidRefName(_ name: String) -> Bool {
+        if name.isEmpty || name == "@" || name.hasSuffix(".") {
+            return false
+        }
+
+        let components = name.split(separator: "/", omittingEmptySubsequences: false)
+        guard components.count >= 2 else {
+            return false
+        }
+        for component in components {
+            if component.isEmpty || component.hasPrefix(".") || component.hasSuffix(".lock") {
+                return false
+            }
+        }
+
+        var previous: UInt8 = 0
+        for byte in name.utf8 {
+            switch byte {
+            case 0..<0x20, 0x7f, UInt8(ascii: " "), UInt8(ascii: "~"), UInt8(ascii: "^"), UInt8(ascii: ":"),
+                 UInt8(ascii: "?"), UInt8(ascii: "*"), UInt8(ascii: "["), UInt8(ascii: "\\"):
+                return false
+            case UInt8(ascii: ".") where previous == UInt8(ascii: "."):
+                return false
+            case UInt8(ascii: "{") where previous == UInt8(ascii: "@"):
+                return false
+            default:
+                break
+            }
+            previous = byte
+        }
+        return true
+    }
+
+    // MARK: - Loose refs
+
+    /// Adds the loose refs under `path` (whose ref name prefix is `name`) to
+    /// `refs` as name -> file contents, reusing cached directory listings.
+    private func scanLoose(path: String, name: String, perWorktreeOnly: Bool, skipPerWorktree: Bool,
+                           into refs: inout [String: String], visited: inout Set<String>, changed: inout Bool) {
+        guard let stamp = FileStamp(path: path), stamp.isDirectory else {
+            return
+        }
+        visited.insert(path)
+
+        var directory: LooseDirectory
+        if let cached = looseDirectories[path], cached.stamp == stamp {
+            directory = cached
+        } else {
+            directory = readLooseDirectory(path: path, stamp: stamp, previous: looseDirectories[path])
+            looseDirectories[path] = directory
+            changed = true
+        }
+
+        for (file, contents) in directory.files {
+            let refName = name + file
+            if includes(refName, perWorktreeOnly: perWorktreeOnly, skipPerWorktree: skipPerWorktree) {
+                refs[refName] = contents.text
+            }
+        }
+        for subdirectory in directory.subdirectories {
+            let refName = name + subdirectory + "/"
+            if skipPerWorktree && GitRefStore.perWorktreePrefixes.contains(refName) {
+                continue
+            }
+            scanLoose(path: (path as NSString).appendingPathComponent(subdirectory), name: refName,
+                      perWorktreeOnly: perWorktreeOnly, skipPerWorktree: skipPerWorktree,
+                      into: &refs, visited: &visited, changed: &changed)
+        }
+    }
+
+    private func includes(_ refName: String, perWorktreeOnly: Bool, skipPerWorktree: Bool) -> Bool {
+        let isPerWorktree = GitRefStore.perWorktreePrefixes.contains { refName.hasPrefix($0) }
+        return perWorktreeOnly ? isPerWorktree : !(skipPerWorktree && isPerWorktree)
+    }
+
+    /// Lists a directory whose stamp changed. Files whose own stamp is
+    /// unchanged keep their cached contents, so one new branch in a directory
+    /// of thousands costs a stat per file rather than a read.
+    private func readLooseDirectory(path: String, stamp: FileStamp, previous: LooseDirectory?) -> LooseDirectory {
+        var directory = LooseDirectory(stamp: stamp)
+        guard let names = try? FileManager.default.contentsOfDirectory(atPath: path) else {
+            return directory
+        }
+
+        for entry in names {
+            // Lock files and anything git wouldn't accept as a ref component
+            if entry.hasPrefix(".") || entry.hasSuffix(".lock") {
+                continue
+            }
+            let entryPath = (path as NSString).appendingPathComponent(entry)
+            guard let entryStamp = FileStamp(path: entryPath) else {
+                continue
+            }
+            if entryStamp.isDirectory {
+                directory.subdirectories.append(entry)
+                continue
+            }
+            if let cached = previous?.files[entry], cached.stamp == entryStamp {
+                directory.files[entry] = cached
+            } else if let text = GitRefStore.readRefFile(entryPath) {
+                directory.files[entry] = LooseFile(stamp: entryStamp, text: text)
+            }
+        }
+        return directory
+    }
+
+    /// Contents of the loose file for ref `name`, trimmed, or nil.
+    private func readLooseFile(named name: String) -> String? {
+        let isPerWorktree = name == "HEAD" || GitRefStore.perWorktreePrefixes.contains { name.hasPrefix($0) }
+        let base = isPerWorktree ? gitDir : commonDir
+        return GitRefStore.readRefFile(base.appendingPathComponent(name).path)
+    }
+
+    private class func readRefFile(_ path: String) -> String? {
+        guard let data = FileManager.default.contents(atPath: path) else {
+            return nil
+        }
+        let text = String(decoding: data, as: UTF8.self).trimmingCharacters(in: .whitespacesAndNewlines)
+        return text.isEmpty ? nil : text
+    }
+
+    // MARK: - Packed refs
+
+    /// Re-maps packed-refs if it changed on disk. Returns whether it did.
+    private func refreshPacked() -> Bool {
+        let path = commonDir.appendingPathComponent("packed-refs").path
+        guard let stamp = FileStamp(path: path) else {
+            defer { packed = nil }
+            return packed != nil
+        }
+        if let packed, packed.stamp == stamp {
+            return false
+        }
+        packed = PackedRefs(path: path, stamp: stamp)
+        return true
+    }
+
+    /// Loose and packed refs as one sorted list, loose taking precedence.
+    private func merge(loose: [String: String]) -> [GitRefEntry] {
+        let looseNames = loose.keys.sorted { $0.utf8.lexicographicallyPrecedes($1.utf8) }
+        let packedCount = packed?.count ?? 0
+        var entries: [GitRefEntry] = []
+        entries.reserveCapacity(looseNames.count + packedCount)
+
+        var looseIndex = 0
+        var packedIndex = 0
+        while looseIndex < looseNames.count || packedIndex < packedCount {
+            let packedName = packedIndex < packedCount ? packed?.name(at: packedIndex) : nil
+            if looseIndex < looseNames.count {
+                let looseName = looseNames[looseIndex]
+                if packedName == nil || !packedName!.utf8.lexicographicallyPrecedes(looseName.utf8) {
+                    if packedName == looseName {
+                        packedIndex += 1
+                    }
+                    looseIndex += 1
+                    if let entry = looseEntry(named: looseName, contents: loose[looseName]!, loose: loose) {
+                        entries.append(entry)
+                    }
+                    continue
+                }
+            }
+            if let packed, let name = packedName {
+                let record = packed.record(at: packedIndex)
+                entries.append(GitRefEntry(name: name, sha: record.sha, peeledSHA: record.peeled,
+                                           objectType: record.peeled != nil ? "tag" : "commit"))
+            }
+            packedIndex += 1
+        }
+        return entries
+    }
+
+    /// An entry for a loose ref, following symbolic refs through the loose
+    /// and packed refs; nil for broken or dangling refs, which git skips too.
+    private func looseEntry(named name: String, contents: String, loose: [String: String]) -> GitRefEntry? {
+        var text = contents
+        for _ in 0...GitRefStore.maxSymrefDepth {
+            guard let target = GitRefStore.symrefTarget(text) else {
+                return GitRefStore.isHexSHA(text)
+                    ? GitRefEntry(name: name, sha: text, peeledSHA: nil, objectType: "commit") : nil
+            }
+            if let next = loose[target] {
+                text = next
+            } else if let record = packed?.find(target) {
+                return GitRefEntry(name: name, sha: record.sha, peeledSHA: record.peeled,
+                                   objectType: record.peeled != nil ? "tag" : "commit")
+            } else {
+                return nil
+            }
+        }
+        return nil
+    }
+
+    private class func symrefTarget(_ contents: String) -> String? {
+        guard contents.hasPrefix("ref:") else {
+            return nil
+        }
+        return contents.dropFirst(4).trimmingCharacters(in: .whitespaces)
+    }
+
+    private class func isHexSHA(_ string: String) -> Bool {
+        return (string.utf8.count == 40 || string.utf8.count == 64) && string.utf8.allSatisfy {
+            ($0 >= UInt8(ascii: "0") && $0 <= UInt8(ascii: "9")) || ($0 >= UInt8(ascii: "a") && $0 <= UInt8(ascii: "f"))
+        }
+    }
+}
+
+/// What identifies a version of a file or directory on disk.
+struct FileStamp: Equatable {
+    let modified: timespec
+    let size: off_t
+    let inode: ino_t
+    let isDirectory: Bool
+
+    init?(path: String) {
+        var info = stat()
+        guard stat(path, &info) == 0 else {
+            return nil
+        }
+        modified = info.st_mtimespec
+        size = info.st_size
+        inode = info.st_ino
+        isDirectory = (info.st_mode & S_IFMT) == S_IFDIR
+    }
+
+    static func == (lhs: FileStamp, rhs: FileStamp) -> Bool {
+        return lhs.modified.tv_sec == rhs.modified.tv_sec && lhs.modified.tv_nsec == rhs.modified.tv_nsec
+            && lhs.size == rhs.size && lhs.inode == rhs.inode && lhs.isDirectory == rhs.isDirectory
+    }
+}
+
+private struct LooseFile {
+    let stamp: FileStamp
+    let text: String
+}
+
+private struct LooseDirectory {
+    let stamp: FileStamp
+    var files: [String: LooseFile] = [:]
+    var subdirectories: [String] = []
+
+    init(stamp: FileStamp) {
+        self.stamp = stamp
+    }
+}
+
+/// A memory-mapped packed-refs file. Records are located once, as byte
+/// offsets into the mapping; names and SHAs become strings only when asked
+/// for.
+///
+/// The file is a "# pack-refs with: <traits>" header, then one
+/// "<sha> <name>" line per ref, each optionally followed by "^<sha>" with
+/// the commit an annotated tag peels to. git writes it sorted by name (the
+/// "sorted" trait); an unsorted file is sorted here.
+private final class PackedRefs {
+    struct Record {
+        var shaStart: Int
+        var nameStart: Int
+        var nameEnd: Int
+        var peeledStart: Int
+    }
+
+    let stamp: FileStamp
+    private let data: Data
+    private var records: [Record] = []
+    private var shaLength = 40
+
+    var count: Int {
+        return records.count
+    }
+
+    init?(path: String, stamp: FileStamp) {
+        guard let data = try? Data(contentsOf: URL(fileURLWithPath: path), options: .alwaysMapped) else {
+            return nil
+        }
+        self.stamp = stamp
+        self.data = data
+        parse()
+    }
+
+    private func parse() {
+        var sorted = false
+        data.withUnsafeBytes { (buffer: UnsafeRawBufferPointer) in
+            let bytes = buffer.bindMemory(to: UInt8.self)
+            var position = 0
+            while position < bytes.count {
+                var end = position
+                while end < bytes.count && bytes[end] != UInt8(ascii: "\n") {
+                    end += 1
+                }
+                defer { position = end + 1 }
+
+                let first = bytes[position]
+                if first == UInt8(ascii: "#") {
+                    let header = String(decoding: UnsafeBufferPointer(rebasing: bytes[position..<end]), as: UTF8.self)
+                    sorted = header.contains(" sorted")
+                } else if first == UInt8(ascii: "^") {
+                    if !records.isEmpty {
+                        records[records.count - 1].peeledStart = position + 1
+                    }
+                } else if end > position {
+                    var space = position
+                    while space < end && bytes[space] != UInt8(ascii: " ") {
+                        space += 1
+                    }
+                    guard space < end, space - position == 40 || space - position == 64 else {
+                        continue
+                    }
+                    shaLength = space - position
+                    var nameEnd = end
+                    if nameEnd > space + 1 && bytes[nameEnd - 1] == UInt8(ascii: "\r") {
+                        nameEnd -= 1
+                    }
+                    records.append(Record(shaStart: position, nameStart: space + 1, nameEnd: nameEnd, peeledStart: -1))
+                }
+            }
+
+            if !sorted {
+                records.sort { PackedRefs.compare(bytes, $0, bytes, $1) < 0 }
+            }
+        }
+    }
+
+    func name(at index: Int) -> String {
+        let record = records[index]
+        return string(record.nameStart, record.nameEnd)
+    }
+
+    func record(at index: Int) -> (sha: String, peeled: String?) {
+        let record = records[index]
+        let peeled = record.peeledStart >= 0 ? string(record.peeledStart, record.peeledStart + shaLength) : nil
+        return (string(record.shaStart, record.shaStart + shaLength), peeled)
+    }
+
+    /// Binary search for `name` over the mapped names.
+    func find(_ name: String) -> (sha: String, peeled: String?)? {
+        let key = Array(name.utf8)
+        let index: Int? = data.withUnsafeBytes { (buffer: UnsafeRawBufferPointer) in
+            let bytes = buffer.bindMemory(to: UInt8.self)
+            return key.withUnsafeBufferPointer { keyBytes -> Int? in
+                let keyRecord = Record(shaStart: 0, nameStart: 0, nameEnd: keyBytes.count, peeledStart: -1)
+                var low = 0
+                var high = records.count - 1
+                while low <= high {
+                    let middle = (low + high) / 2
+                    let order = PackedRefs.compare(bytes, records[middle], keyBytes, keyRecord)
+                    if order < 0 {
+                        low = middle + 1
+                    } else if order > 0 {
+                        high = middle - 1
+                    } else {
+                        return middle
+                    }
+                }
+                return nil
+            }
+        }
+        return index.map { record(at: $0) }
+    }
+
+    private func string(_ start: Int, _ end: Int) -> String {
+        return data.withUnsafeBytes { (buffer: UnsafeRawBufferPointer) in
+            String(decoding: UnsafeBufferPointer(rebasing: buffer.bindMemory(to: UInt8.self)[start..<end]), as: UTF8.self)
+        }
+    }
+
+    /// Byte order of two records' names, as git sorts them.
+    private static func compare(_ lhsBytes: UnsafeBufferPointer<UInt8>, _ lhs: Record,
+                                _ rhsBytes: UnsafeBufferPointer<UInt8>, _ rhs: Record) -> Int {
+        let lhsLength = lhs.nameEnd - lhs.nameStart
+        let rhsLength = rhs.nameEnd - rhs.nameStart
+        let order = memcmp(lhsBytes.baseAddress! + lhs.nameStart, rhsBytes.baseAddress! + rhs.nameStart,
+                           min(lhsLength, rhsLength))
+        if order != 0 {
+            return Int(order)
+        }
+        return lhsLength - rhsLength
+    }
+}
@@ -1,14 +1,99 @@
 import Foundation
 
+/// Where a repository lives on disk, as found by walking up from a path.
+@objc(GitRepoLocation)
+@objcMembers
+final class GitRepoLocation: NSObject {
+    /// Top of the work tree, or nil for a bare repository
+    let workDir: URL?
+    /// The repository's own git directory (per-worktree for linked worktrees)
+    let gitDir: URL
+    /// Where objects and shared refs live; differs from `gitDir` in linked worktrees
+    let commonDir: URL
+
+    var isBare: Bool {
+        return workDir == nil
+    }
+
+    init(workDir: URL?, gitDir: URL, commonDir: URL) {
+        self.workDir = workDir
+        self.gitDir = gitDir
+        self.commonDir = commonDir
+        super.init()
+    }
+}
+
 @objc(GitRepoFinder)
 @objcMembers
 final class GitRepoFinder: NSObject {
+    /// Finds the repository containing `fileURL` the way git does, without
+    /// running git: walk up looking for a `.git` directory or gitfile, or a
+    /// directory that is itself a git directory, stopping at the filesystem
+    /// root or a change of device.
+    ///
+    /// Returns nil when nothing is found or for setups git resolves in ways
+    /// this doesn't (core.worktree), so callers fall back to `git rev-parse`.
+    @objc(locationForURL:)
+    class func location(for fileURL: URL) -> GitRepoLocation? {
+        guard fileURL.isFileURL else {
+            return nil
+        }
+
+        let fileManager = FileManager.default
+        var directory = fileURL.standardizedFileURL.resolvingSymlinksInPath()
+        let device = deviceOf(directory.path)
+
+        while true {
+            let dotGit = directory.appendingPathComponent(".git")
+            var isDirectory: ObjCBool = false
+            if fileManager.fileExists(atPath: dotGit.path, isDirectory: &isDirectory) {
+                let gitDir = isDirectory.boolValue ? dotGit : gitDirFromGitfile(dotGit)
+                if let gitDir, let commonDir = commonDirIfGitDirectory(gitDir) {
+                    return hasConfiguredWorktree(commonDir) ? nil
+                        : GitRepoLocation(workDir: directory, gitDir: gitDir, commonDir: commonDir)
+                }
+            }
+
+            if let commonDir = commonDirIfGitDirectory(directory) {
+                return hasConfiguredWorktree(commonDir) ? nil
+                    : GitRepoLocation(workDir: nil, gitDir: directory, commonDir: commonDir)
+            }
+
+            let parent = directory.deletingLastPathComponent()
+            if parent.path == directory.path || deviceOf(parent.path) != device {
+                return nil
+            }
+            directory = parent
+        }
+    }
+
+    /// What HEAD in `gitDir` names: a full ref name such as "refs/heads/main"
+    /// when it is symbolic, or a SHA when detached. Nil if HEAD can't be read
+    /// directly (for example with the reftable backend, whose HEAD file is a
+    /// placeholder).
+    @objc(headInGitDir:)
+    class func head(inGitDir gitDir: URL) -> String? {
+        guard let contents = try? String(contentsOf: gitDir.appendingPathComponent("HEAD"), encoding: .utf8) else {
+            return nil
+        }
+        let head = contents.trimmingCharacters(in: .whitespacesAndNewlines)
+        if head.hasPrefix("ref: ") {
+            let ref = String(head.dropFirst(5)).trimmingCharacters(in: .whitespaces)
+            return ref.hasPrefix("refs/") && ref != "refs/heads/.invalid" ? ref : nil
+        }
+        return isHexSHA(head) ? head : nil
+    }
+
     @objc(workDirForURL:)
     class func workDir(for fileURL: URL) -> URL? {
         guard fileURL.isFileURL else {
             return nil
         }
 
+        if let location = location(for: fileURL) {
+            return location.workDir
+        }
+
         let gitPath = PBGitBinary.path() ?? "/usr/bin/git"
         var exitCode: Int32 = 0
         let output = PBEasyPipe.outputForCommand(
@@ -31,6 +116,10 @@ final class GitRepoFinder: NSObject {
             return nil
         }
 
+        if let location = location(for: fileURL) {
+            return location.gitDir
+        }
+
         let gitPath = PBGitBinary.path() ?? "/usr/bin/git"
         var exitCode: Int32 = 0
         let output = PBEasyPipe.outputForCommand(
@@ -60,6 +149,70 @@ final class GitRepoFinder: NSObject {
         return URL(fileURLWithPath: absolutePath, isDirectory: true)
     }
 
+    // MARK: - Private helpers
+
+    /// The directory a gitfile ("gitdir: <path>") points to, relative to the
+    /// gitfile's own directory.
+    private class func gitDirFromGitfile(_ gitfile: URL) -> URL? {
+        guard let contents = try? String(contentsOf: gitfile, encoding: .utf8) else {
+            return nil
+        }
+        let line = contents.trimmingCharacters(in: .whitespacesAndNewlines)
+        guard line.hasPrefix("gitdir: ") else {
+            return nil
+        }
+        return resolve(String(line.dropFirst(8)), relativeTo: gitfile.deletingLastPathComponent())
+    }
+
+    /// git's test for a git directory: a HEAD file, and objects and refs
+    /// directories in it or in the common directory named by its commondir
+    /// file. Returns the common directory, which is `directory` itself unless
+    /// this is a linked worktree.
+    private class func commonDirIfGitDirectory(_ directory: URL) -> URL? {
+        let fileManager = FileManager.default
+        guard fileManager.fileExists(atPath: directory.appendingPathComponent("HEAD").path) else {
+            return nil
+        }
+
+        var commonDir = directory
+        if let contents = try? String(contentsOf: directory.appendingPathComponent("commondir"), encoding: .utf8) {
+            let path = contents.trimmingCharacters(in: .whitespacesAndNewlines)
+            if !path.isEmpty {
+                commonDir = resolve(path, relativeTo: directory)
+            }
+        }
+
+        var isDirectory: ObjCBool = false
+        guard fileManager.fileExists(atPath: commonDir.appendingPathComponent("objects").path, isDirectory: &isDirectory),
+              isDirectory.boolValue,
+              fileManager.fileExists(atPath: commonDir.appendingPathComponent("refs").path) else {
+            return nil
+        }
+        return commonDir
+    }
+
+    /// core.worktree moves the work tree away from the .git directory; leave
+    /// that to git.
+    private class func hasConfiguredWorktree(_ commonDir: URL) -> Bool {
+        guard let config = try? String(contentsOf: commonDir.appendingPathComponent("config"), encoding: .utf8) else {
+            return false
+        }
+        return config.range(of: "worktree", options: .caseInsensitive) != nil
+    }
+
+    private class func resolve(_ path: String, relativeTo base: URL) -> URL {
+        let absolute = path.hasPrefix("/") ? path : (base.path as NSString).appendingPathComponent(path)
+        return URL(fileURLWithPath: (absolute as NSString).standardizingPath, isDirectory: true)
+    }
+
+    private class func deviceOf(_ path: String) -> Int? {
+        return (try? FileManager.default.attributesOfItem(atPath: path))?[.systemNumber] as? Int
+    }
+
+    private class func isHexSHA(_ string: String) -> Bool {
+        return (string.count == 40 || string.count == 64) && string.allSatisfy { $0.isHexDigit }
+    }
+
     private class func trimmedPath(from output: String?) -> String? {
         guard let raw = output?.trimmingCharacters(in: .whitespacesAndNewlines), !raw.isEmpty else {
             return nil
@@ -0,0 +1,339 @@
+import AppKit
+
+/// Memory a document (or the app as a whole) can give back on request,
+/// registered with `GitWorkspace` so one budget covers every open
+/// repository.
+@objc(GitWorkspaceCache)
+protocol GitWorkspaceCache: AnyObject {
+    /// Approximate bytes held that `trimWorkspaceCache(toCost:)` could free.
+    var workspaceCacheCost: Int { get }
+    /// Drops contents, least recently used first, until at most `cost`
+    /// bytes remain. Called on the main thread.
+    @objc(trimWorkspaceCacheToCost:)
+    func trimWorkspaceCache(toCost cost: Int)
+}
+
+/// Resources shared by every open repository window.
+///
+/// Git processes started through `GitCommandRunner` and `GitAsyncCommand`
+/// wait for one of a fixed number of slots. Free slots go to the repository
+/// in the key window first and then round-robin across the others, which
+/// also can't take the last few slots between them, so fifteen windows
+/// refreshing in the background don't starve the one being used.
+///
+/// Caches register with a memory budget that spans all documents. When it
+/// is exceeded, the caches of the repositories used least recently are
+/// trimmed first, then caches shared by all of them, and the foreground
+/// repository's last.
+@objcMembers
+@objc(GitWorkspace)
+final class GitWorkspace: NSObject {
+    /// Posted on the main thread when the foreground repository changes, so
+    /// queues and threads that outlive a focus change can move to their
+    /// repository's new quality of service.
+    static let foregroundDidChangeNotification = Notification.Name("GitWorkspaceForegroundDidChange")
+
+    static let shared = GitWorkspace(
+        processLimit: min(max(ProcessInfo.processInfo.activeProcessorCount, 4), 12),
+        reservedForegroundSlots: 2,
+        memoryBudget: GitWorkspace.defaultMemoryBudget()
+    )
+
+    let processLimit: Int
+    let reservedForegroundSlots: Int
+    let memoryBudget: Int
+
+    private let lock = NSLock()
+
+    // Scheduling, keyed by working directory
+    private var foregroundKey: String?
+    private var running = 0
+    private var runningByKey: [String: Int] = [:]
+    private var waiting: [String: [Waiter]] = [:]
+    /// Repositories with waiting jobs, in the order they are next served
+    private var waitingOrder: [String] = []
+    private static let slotThreadKey = "GitWorkspaceProcessSlot"
+
+    // Memory budget
+    private var caches: [Registration] = []
+    private var lastUsed: [String: Date] = [:]
+    private var budgetCheckScheduled = false
+    private static let budgetCheckDelay: TimeInterval = 1
+
+    private final class Waiter {
+        let semaphore = DispatchSemaphore(value: 0)
+    }
+
+    private struct Registration {
+        weak var cache: GitWorkspaceCache?
+        /// nil for caches shared by all repositories
+        weak var repository: PBGitRepository?
+        let isShared: Bool
+    }
+
+    init(processLimit: Int, reservedForegroundSlots: Int, memoryBudget: Int) {
+        self.processLimit = processLimit
+        self.reservedForegroundSlots = min(reservedForegroundSlots, processLimit - 1)
+        self.memoryBudget = memoryBudget
+        super.init()
+
+        NotificationCenter.default.addObserver(self,
+                                               selector: #selector(windowDidBecomeKey(_:)),
+                                               name: NSWindow.didBecomeKeyNotification,
+                                               object: nil)
+    }
+
+    /// An eighth of physical memory, kept between 256 MB and 2 GB.
+    private class func defaultMemoryBudget() -> Int {
+        let eighth = Int(clamping: ProcessInfo.processInfo.physicalMemory / 8)
+        return min(max(eighth, 256 << 20), 2 << 30)
+    }
+
+    // MARK: - Foreground
+
+    /// The repository whose window is key gets git processes first and has
+    /// its caches trimmed last.
+    @objc(setForegroundRepository:)
+    func setForeground(_ repository: PBGitRepository?) {
+        let key = repository?.workingDirectory()
+        lock.lock()
+        let changed = foregroundKey != key
+        foregroundKey = key
+        if let key {
+            lastUsed[key] = Date()
+        }
+        if changed {
+            dispatchWaiters()
+        }
+        lock.unlock()
+
+        if changed {
+            setNeedsBudgetCheck()
+            if Thread.isMainThread {
+                NotificationCenter.default.post(name: GitWorkspace.foregroundDidChangeNotification, object: self)
+            } else {
+                DispatchQueue.main.async {
+                    NotificationCenter.default.post(name: GitWorkspace.foregroundDidChangeNotification, object: self)
+                }
+            }
+        }
+    }
+
+    /// Quality of service for work done on behalf of the repository at
+    /// `key`: background repositories run at utility priority. A git process
+    /// keeps what it had when it launched; longer-lived queues and threads
+    /// ask again on `foregroundDidChangeNotification`.
+    @objc(qualityOfServiceForRepositoryAtPath:)
+    func qualityOfService(forRepositoryAt key: String?) -> QualityOfService {
+        lock.lock()
+        defer { lock.unlock() }
+        return foregroundKey == nil || key == foregroundKey ? .userInitiated : .utility
+    }
+
+    @objc private func windowDidBecomeKey(_ notification: Notification) {
+        guard let window = notification.object as? NSWindow,
+              let repository = NSDocumentController.shared.document(for: window) as? PBGitRepository else {
+            return
+        }
+        setForeground(repository)
+    }
+
+    // MARK: - Git processes
+
+    /// Runs `body`, which starts a git process for the repository at `key`,
+    /// once a process slot is free for it. The main thread never waits, and
+    /// a thread that already holds a slot (a streaming handler that runs
+    /// another command) reuses it rather than deadlocking.
+    func withProcessSlot<T>(forRepositoryAt key: String?, _ body: () throws -> T) rethrows -> T {
+        let threadDictionary = Thread.current.threadDictionary
+        guard !Thread.isMainThread, threadDictionary[GitWorkspace.slotThreadKey] == nil else {
+            return try body()
+        }
+
+        let key = key ?? ""
+        acquireSlot(for: key)
+        threadDictionary[GitWorkspace.slotThreadKey] = key
+        defer {
+            threadDictionary.removeObject(forKey: GitWorkspace.slotThreadKey)
+            releaseSlot(for: key)
+        }
+        return try body()
+    }
+
+    /// Runs `body` on the current thread as if it held a process slot, for
+    /// work the main thread is blocked on: like the main thread itself, it
+    /// mustn't queue behind background jobs.
+    @objc(performExemptFromProcessSlots:)
+    func performExemptFromProcessSlots(_ body: () -> Void) {
+        let threadDictionary = Thread.current.threadDictionary
+        guard threadDictionary[GitWorkspace.slotThreadKey] == nil else {
+            body()
+            return
+        }
+        threadDictionary[GitWorkspace.slotThreadKey] = ""
+        defer { threadDictionary.removeObject(forKey: GitWorkspace.slotThreadKey) }
+        body()
+    }
+
+    private func acquireSlot(for key: String) {
+        lock.lock()
+        if waiting.isEmpty && canStart(key) {
+            start(key)
+            lock.unlock()
+            return
+        }
+
+        let waiter = Waiter()
+        if waiting[key] == nil {
+            waitingOrder.append(key)
+        }
+        waiting[key, default: []].append(waiter)
+        dispatchWaiters()
+        lock.unlock()
+
+        let span = PBTracer.shared.beginSpan("git slot wait", category: "git")
+        waiter.semaphore.wait()
+        span?.end(withArgs: ["repository": key])
+    }
+
+    private func releaseSlot(for key: String) {
+        lock.lock()
+        running -= 1
+        runningByKey[key, default: 1] -= 1
+        if runningByKey[key] == 0 {
+            runningByKey[key] = nil
+        }
+        dispatchWaiters()
+        lock.unlock()
+    }
+
+    /// Called with `lock` held.
+    private func canStart(_ key: String) -> Bool {
+        guard running < processLimit else {
+            return false
+        }
+        guard let foregroundKey, key != foregroundKey else {
+            return true
+        }
+        let backgroundRunning = running - runningByKey[foregroundKey, default: 0]
+        return backgroundRunning < processLimit - reservedForegroundSlots
+    }
+
+    /// Called with `lock` held.
+    private func start(_ key: String) {
+        running += 1
+        runningByKey[key, default: 0] += 1
+    }
+
+    /// Hands free slots to waiting jobs: the foreground repository's first,
+    /// then one job per repository in turn. Called with `lock` held.
+    private func dispatchWaiters() {
+        while !waitingOrder.isEmpty {
+            let next: String?
+            if let foregroundKey, waiting[foregroundKey] != nil, canStart(foregroundKey) {
+                next = foregroundKey
+            } else {
+                next = waitingOrder.first(where: canStart)
+            }
+            guard let key = next, var queue = waiting[key] else {
+                return
+            }
+
+            let waiter = queue.removeFirst()
+            waitingOrder.removeAll { $0 == key }
+            if queue.isEmpty {
+                waiting[key] = nil
+            } else {
+                waiting[key] = queue
+                waitingOrder.append(key)
+            }
+            start(key)
+            waiter.semaphore.signal()
+        }
+    }
+
+    // MARK: - Memory budget
+
+    /// Adds `cache` to the budget as belonging to `repository`, or to all
+    /// repositories when it is nil. The workspace holds it weakly.
+    @objc(registerCache:forRepository:)
+    func register(_ cache: GitWorkspaceCache, for repository: PBGitRepository?) {
+        lock.lock()
+        caches.removeAll { $0.cache == nil || $0.cache === cache }
+        caches.append(Registration(cache: cache, repository: repository, isShared: repository == nil))
+        lock.unlock()
+    }
+
+    /// Asks for the budget to be checked soon. Cheap enough to call after
+    /// every insertion; checks are coalesced and run on the main thread.
+    func setNeedsBudgetCheck() {
+        lock.lock()
+        let schedule = !budgetCheckScheduled
+        budgetCheckScheduled = true
+        lock.unlock()
+
+        if schedule {
+            DispatchQueue.main.asyncAfter(deadline: .now() + GitWorkspace.budgetCheckDelay) { [weak self] in
+                self?.enforceBudget()
+            }
+        }
+    }
+
+    /// Total bytes held by registered caches.
+    var memoryCost: Int {
+        return liveRegistrations().reduce(0) { $0 + ($1.cache?.workspaceCacheCost ?? 0) }
+    }
+
+    /// Trims caches, least recently used repository first, until the total
+    /// is within the budget.
+    func enforceBudget() {
+        lock.lock()
+        budgetCheckScheduled = false
+        lock.unlock()
+
+        let registrations = trimOrder(liveRegistrations())
+        var total = registrations.reduce(0) { $0 + ($1.cache?.workspaceCacheCost ?? 0) }
+        guard total > memoryBudget else {
+            return
+        }
+
+        let span = PBTracer.shared.beginSpan("memory budget trim", category: "workspace")
+        let before = total
+        for registration in registrations where total > memoryBudget {
+            guard let cache = registration.cache else {
+                continue
+            }
+            let cost = cache.workspaceCacheCost
+            cache.trimWorkspaceCache(toCost: max(0, cost - (total - memoryBudget)))
+            total -= cost - cache.workspaceCacheCost
+        }
+        span?.end(withArgs: ["before": before, "after": total, "budget": memoryBudget])
+    }
+
+    private func liveRegistrations() -> [Registration] {
+        lock.lock()
+        defer { lock.unlock() }
+        caches.removeAll { $0.cache == nil || (!$0.isShared && $0.repository == nil) }
+        return caches
+    }
+
+    /// Background repositories by last use, then shared caches, then the
+    /// foreground repository.
+    private func trimOrder(_ registrations: [Registration]) -> [Registration] {
+        lock.lock()
+        let foregroundKey = self.foregroundKey
+        let lastUsed = self.lastUsed
+        lock.unlock()
+
+        func rank(_ registration: Registration) -> (Int, Date) {
+            guard let key = registration.repository?.workingDirectory() else {
+                return (1, .distantPast)
+            }
+            return key == foregroundKey ? (2, .distantPast) : (0, lastUsed[key] ?? .distantPast)
+        }
+        return registrations
+            .map { ($0, rank($0)) }
+            .sorted { $0.1.0 != $1.1.0 ? $0.1.0 < $1.1.0 : $0.1.1 < $1.1.1 }
+            .map { $0.0 }
+    }
+}
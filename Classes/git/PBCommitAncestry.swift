@@ -0,0 +1,780 @@
+import Foundation
+
+/// How far a branch has moved from its upstream.
+@objcMembers
+@objc(PBAheadBehind)
+final class PBAheadBehind: NSObject {
+    /// Commits on the branch that the upstream doesn't have
+    let ahead: Int
+    /// Commits on the upstream that the branch doesn't have
+    let behind: Int
+
+    init(ahead: Int, behind: Int) {
+        self.ahead = ahead
+        self.behind = behind
+        super.init()
+    }
+
+    var isEven: Bool {
+        return ahead == 0 && behind == 0
+    }
+}
+
+/// Answers ancestry questions (is-ancestor, merge base, ahead/behind) from
+/// what the repository already has in memory, without starting git.
+///
+/// Commits are looked up in the commit-graph file, whose generation numbers
+/// let a walk stop as soon as it is below the commit it is looking for.
+/// Commits the graph doesn't cover yet, or every commit when there is no
+/// graph, come from the project history list, numbered the same way on
+/// first use.
+///
+/// Answers are cached by the pair of commits asked about, which never goes
+/// stale; when refs reload, pairs whose commits no ref points at any more
+/// are dropped so the cache follows the current branches.
+@objcMembers
+@objc(PBCommitAncestry)
+final class PBCommitAncestry: NSObject, GitWorkspaceCache {
+    /// Posted on the main thread when ahead/behind counts requested with
+    /// `aheadBehind(forBranch:)` become available.
+    static let didUpdateNotification = Notification.Name("PBCommitAncestryDidUpdate")
+
+    private struct TipPair: Hashable {
+        let first: String
+        let second: String
+    }
+
+    private struct Comparison {
+        let ahead: Int
+        let behind: Int
+        let mergeBase: String?
+    }
+
+    /// Rough bytes per cached answer: key strings, value and table slot
+    private static let answerCost = 192
+    /// Commits a walk on the main thread may visit before leaving the
+    /// question to the background
+    private static let quickWalkLimit = 20_000
+
+    private struct Upstreams {
+        let stamp: FileStamp?
+        let refs: [String: String]
+    }
+
+    private weak var repository: PBGitRepository?
+    /// Guards the answers and bookkeeping; never held during a walk
+    private let lock = NSLock()
+    /// Serializes walks, which add to the table as they go
+    private let walkLock = NSLock()
+    private var table: Table?
+    private var tableCost = 0
+    private var comparisons: [TipPair: Comparison] = [:]
+    private var ancestors: [TipPair: Bool] = [:]
+    private var upstreams: Upstreams?
+
+    private let queue = DispatchQueue(label: "net.phere.gitx.ancestry", qos: .utility)
+    private var queued = Set<TipPair>()
+    private var queuedAncestors = Set<TipPair>()
+
+    @objc(initWithRepository:)
+    init(repository: PBGitRepository) {
+        self.repository = repository
+        super.init()
+    }
+
+    // MARK: - Commits
+
+    /// Whether `ancestor` is `descendant` or one of its ancestors. False
+    /// when either commit isn't known.
+    ///
+    /// On the main thread false is also returned while the answer is being
+    /// worked out; see `knownIsSHA(_:ancestorOf:)`.
+    @objc(isSHA:ancestorOfSHA:)
+    func isSHA(_ ancestor: String, ancestorOf descendant: String) -> Bool {
+        if Thread.isMainThread {
+            return knownIsSHA(ancestor, ancestorOf: descendant) ?? false
+        }
+        if ancestor == descendant {
+            return true
+        }
+        let pair = TipPair(first: ancestor, second: descendant)
+        lock.lock()
+        let cached = ancestors[pair] ?? comparisons[pair].map { $0.ahead == 0 }
+        lock.unlock()
+        return cached ?? checkAncestor(pair) ?? false
+    }
+
+    /// Whether `ancestor` is `descendant` or one of its ancestors, when that
+    /// can be told on the main thread without waiting: it was worked out
+    /// before, or both commits are already numbered and a short walk
+    /// settles it. Otherwise the question is answered in the background,
+    /// followed by `didUpdateNotification`, and this returns nil. Numbering
+    /// the history list for a walk (all of it, without a commit graph)
+    /// takes too long for a menu to wait on.
+    func knownIsSHA(_ ancestor: String, ancestorOf descendant: String) -> Bool? {
+        if ancestor == descendant {
+            return true
+        }
+        let pair = TipPair(first: ancestor, second: descendant)
+
+        lock.lock()
+        let cached = ancestors[pair] ?? comparisons[pair].map { $0.ahead == 0 }
+        lock.unlock()
+        if let cached {
+            return cached
+        }
+        if let answer = quickCheckAncestor(pair) {
+            return answer
+        }
+
+        lock.lock()
+        let schedule = queuedAncestors.insert(pair).inserted
+        lock.unlock()
+        if schedule {
+            scheduleComparisons()
+        }
+        return nil
+    }
+
+    private func checkAncestor(_ pair: TipPair) -> Bool? {
+        let result: Bool? = withTable { table in
+            guard let ancestorID = table.id(for: pair.first), let descendantID = table.id(for: pair.second) else {
+                return nil
+            }
+            let span = PBTracer.shared.beginSpan("is-ancestor", category: "ancestry")
+            let result = table.isAncestor(ancestorID, of: descendantID)
+            span?.end(withArgs: ["result": result])
+            return result
+        }
+        guard let result else {
+            return nil
+        }
+
+        lock.lock()
+        ancestors[pair] = result
+        lock.unlock()
+        GitWorkspace.shared.setNeedsBudgetCheck()
+        return result
+    }
+
+    /// `checkAncestor` for the main thread: only with the table already
+    /// built and not in use by a walk, only for commits it has numbered,
+    /// and giving up after `quickWalkLimit` commits.
+    private func quickCheckAncestor(_ pair: TipPair) -> Bool? {
+        guard let repository, walkLock.try() else {
+            return nil
+        }
+        defer { walkLock.unlock() }
+
+        let listed = repository.revisionList?.projectCommits ?? PBCommitList.empty
+        guard let table, table.listed === listed, table.graph === usableGraph(repository),
+              let ancestorID = table.numberedID(for: pair.first),
+              let descendantID = table.numberedID(for: pair.second),
+              let result = table.isAncestor(ancestorID, of: descendantID, limit: PBCommitAncestry.quickWalkLimit) else {
+            return nil
+        }
+
+        lock.lock()
+        ancestors[pair] = result
+        lock.unlock()
+        GitWorkspace.shared.setNeedsBudgetCheck()
+        return result
+    }
+
+    /// A best common ancestor of the two commits, as `git merge-base` gives
+    /// without `--all`; nil when they share no history or aren't known.
+    @objc(mergeBaseOfSHA:andSHA:)
+    func mergeBase(of first: String, and second: String) -> String? {
+        return compare(first, second)?.mergeBase
+    }
+
+    /// Commits reachable from `sha` but not `base` (ahead) and the other way
+    /// round (behind), as `git rev-list --left-right --count sha...base`.
+    @objc(aheadBehindOfSHA:relativeToSHA:)
+    func aheadBehind(of sha: String, relativeTo base: String) -> PBAheadBehind? {
+        guard let comparison = compare(sha, base) else {
+            return nil
+        }
+        return PBAheadBehind(ahead: comparison.ahead, behind: comparison.behind)
+    }
+
+    private func compare(_ first: String, _ second: String) -> Comparison? {
+        let pair = TipPair(first: first, second: second)
+        lock.lock()
+        let cached = comparisons[pair]
+        lock.unlock()
+        if let cached {
+            return cached
+        }
+
+        let comparison: Comparison? = withTable { table in
+            guard let firstID = table.id(for: first), let secondID = table.id(for: second) else {
+                return nil
+            }
+            let span = PBTracer.shared.beginSpan("ahead-behind", category: "ancestry")
+            let (ahead, behind, base) = table.paint(firstID, secondID)
+            span?.end(withArgs: ["ahead": ahead, "behind": behind])
+            return Comparison(ahead: ahead, behind: behind, mergeBase: base.map(table.sha(of:)))
+        }
+        guard let comparison else {
+            return nil
+        }
+
+        lock.lock()
+        comparisons[pair] = comparison
+        lock.unlock()
+        GitWorkspace.shared.setNeedsBudgetCheck()
+        return comparison
+    }
+
+    // MARK: - Branches
+
+    /// The branch that the local branch `branch` is set to follow with
+    /// `branch.<name>.remote` and `branch.<name>.merge`: a remote-tracking
+    /// branch, or another local branch when the remote is ".".
+    @objc(upstreamForBranch:)
+    func upstream(forBranch branch: PBGitRef) -> PBGitRef? {
+        guard branch.isBranch, let name = upstreamRefs()[branch.ref] else {
+            return nil
+        }
+        return PBGitRef.refFromString(name)
+    }
+
+    /// Ahead/behind counts of `branch` against its upstream, if they are
+    /// known. Otherwise they are worked out in the background, followed by
+    /// `didUpdateNotification`, and this returns nil; so does a branch
+    /// without an upstream, or whose upstream hasn't been fetched.
+    ///
+    /// Call on the main thread, where ref SHAs are updated.
+    @objc(aheadBehindForBranch:)
+    func aheadBehind(forBranch branch: PBGitRef) -> PBAheadBehind? {
+        guard let repository,
+              let upstream = upstream(forBranch: branch),
+              let local = repository.listedSHA(forRefName: branch.ref),
+              let remote = repository.listedSHA(forRefName: upstream.ref) else {
+            return nil
+        }
+
+        let pair = TipPair(first: local, second: remote)
+        lock.lock()
+        let comparison = comparisons[pair]
+        let schedule = comparison == nil && queued.insert(pair).inserted
+        lock.unlock()
+
+        if let comparison {
+            return PBAheadBehind(ahead: comparison.ahead, behind: comparison.behind)
+        }
+        if schedule {
+            scheduleComparisons()
+        }
+        return nil
+    }
+
+    /// Requests for many branches at once (a sidebar full), and ancestry
+    /// questions asked on the main thread, are answered together and
+    /// announced with one notification.
+    private func scheduleComparisons() {
+        queue.async { [weak self] in
+            guard let self else { return }
+            self.lock.lock()
+            let pairs = self.queued
+            let ancestorPairs = self.queuedAncestors
+            self.queued.removeAll()
+            self.queuedAncestors.removeAll()
+            self.lock.unlock()
+            guard !pairs.isEmpty || !ancestorPairs.isEmpty else {
+                return
+            }
+
+            // Pairs not listed yet are asked for again on the next redraw;
+            // announcing them would only bring them straight back
+            let answered = pairs.filter { self.compare($0.first, $0.second) != nil }
+            let answeredAncestors = ancestorPairs.filter { self.checkAncestor($0) != nil }
+            guard !answered.isEmpty || !answeredAncestors.isEmpty else {
+                return
+            }
+            DispatchQueue.main.async {
+                NotificationCenter.default.post(name: PBCommitAncestry.didUpdateNotification, object: self)
+            }
+        }
+    }
+
+    /// Refs were reloaded: forgets answers about commits no ref points at
+    /// any more, and rereads upstreams. Commits listed since are picked up
+    /// by the next walk. Call on the main thread.
+    @objc(refsDidChangeWithTips:)
+    func refsDidChange(withTips tips: Set<String>) {
+        lock.lock()
+        comparisons = comparisons.filter { tips.contains($0.key.first) && tips.contains($0.key.second) }
+        ancestors = ancestors.filter { tips.contains($0.key.second) }
+        upstreams = nil
+        lock.unlock()
+    }
+
+    // MARK: - GitWorkspaceCache
+
+    var workspaceCacheCost: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return tableCost + (comparisons.count + ancestors.count) * PBCommitAncestry.answerCost
+    }
+
+    @objc(trimWorkspaceCacheToCost:)
+    func trimWorkspaceCache(toCost cost: Int) {
+        lock.lock()
+        let answersCost = (comparisons.count + ancestors.count) * PBCommitAncestry.answerCost
+        let dropTable = tableCost > 0 && tableCost + answersCost > cost
+        if answersCost > cost {
+            comparisons.removeAll()
+            ancestors.removeAll()
+        }
+        lock.unlock()
+
+        // The table is rebuilt by the next walk; a walk in progress keeps it
+        if dropTable && walkLock.try() {
+            table = nil
+            lock.lock()
+            tableCost = 0
+            lock.unlock()
+            walkLock.unlock()
+        }
+    }
+
+    // MARK: - Private
+
+    /// Runs `body` with a table that covers the current graph and history
+    /// list, one walk at a time.
+    private func withTable<T>(_ body: (Table) -> T?) -> T? {
+        guard let repository else {
+            return nil
+        }
+        walkLock.lock()
+        defer { walkLock.unlock() }
+
+        let graph = usableGraph(repository)
+        let listed = repository.revisionList?.projectCommits ?? PBCommitList.empty
+        if table == nil || table?.graph !== graph || table?.listed !== listed {
+            table = Table(graph: graph, listed: listed)
+        }
+        guard let table else {
+            return nil
+        }
+
+        let result = body(table)
+        lock.lock()
+        tableCost = table.cost
+        lock.unlock()
+        return result
+    }
+
+    private func usableGraph(_ repository: PBGitRepository) -> PBCommitGraph? {
+        let graph = repository.commitGraph()
+        // Graphs from before git wrote generation numbers can't bound a walk
+        if let graph, graph.count > 0, graph.generation(at: 0) == 0 {
+            return nil
+        }
+        return graph
+    }
+
+    /// branch ref → upstream ref, read from the repository's config file,
+    /// or from `git config` when the file uses includes or can't be found.
+    private func upstreamRefs() -> [String: String] {
+        let path = repository?.configPath()
+        let stamp = path.flatMap { FileStamp(path: $0) }
+
+        lock.lock()
+        if let upstreams, upstreams.stamp == stamp {
+            lock.unlock()
+            return upstreams.refs
+        }
+        lock.unlock()
+
+        var entries: [(String, String)]?
+        if let path, let text = try? String(contentsOfFile: path, encoding: .utf8),
+           text.range(of: "[include", options: .caseInsensitive) == nil {
+            entries = PBCommitAncestry.branchEntries(inConfig: text)
+        } else if let output = try? repository?.executeGitCommand(["config", "-z", "--get-regexp", "^branch\\..*\\.(remote|merge)$"]) {
+            entries = output.split(separator: "\0").compactMap { entry in
+                let parts = entry.split(separator: "\n", maxSplits: 1)
+                return parts.count == 2 ? (String(parts[0]), String(parts[1])) : nil
+            }
+        }
+
+        var remotes: [String: String] = [:]
+        var merges: [String: String] = [:]
+        for (key, value) in entries ?? [] {
+            if key.hasSuffix(".remote") {
+                remotes[String(key.dropFirst(7).dropLast(7))] = value
+            } else if key.hasSuffix(".merge") {
+                merges[String(key.dropFirst(7).dropLast(6))] = value
+            }
+        }
+
+        var refs: [String: String] = [:]
+        for (name, merge) in merges {
+            guard let remote = remotes[name], merge.hasPrefix("refs/heads/") else {
+                continue
+            }
+            // A remote of "." tracks another local branch
+            refs["refs/heads/" + name] = remote == "." ? merge
+                : "refs/remotes/\(remote)/" + merge.dropFirst("refs/heads/".count)
+        }
+
+        lock.lock()
+        upstreams = Upstreams(stamp: stamp, refs: refs)
+        lock.unlock()
+        return refs
+    }
+
+    /// `branch.<name>.remote` and `branch.<name>.merge` entries of a config
+    /// file, keyed the way `git config --get-regexp` prints them. Later
+    /// entries win, as in git.
+    class func branchEntries(inConfig text: String) -> [(String, String)] {
+        var entries: [(String, String)] = []
+        var section: String?
+
+        for rawLine in text.split(whereSeparator: \.isNewline) {
+            var line = rawLine.trimmingCharacters(in: .whitespaces)
+            if line.isEmpty || line.hasPrefix("#") || line.hasPrefix(";") {
+                continue
+            }
+
+            if line.hasPrefix("[") {
+                section = branchName(inSectionHeader: line)
+                guard let end = line.firstIndex(of: "]") else {
+                    continue
+                }
+                // A key may follow the header on the same line
+                line = line[line.index(after: end)...].trimmingCharacters(in: .whitespaces)
+                if line.isEmpty {
+                    continue
+                }
+            }
+
+            guard let section, let equals = line.firstIndex(of: "=") else {
+                continue
+            }
+            let key = line[..<equals].trimmingCharacters(in: .whitespaces).lowercased()
+            guard key == "remote" || key == "merge" else {
+                continue
+            }
+            let value = configValue(String(line[line.index(after: equals)...]))
+            entries.append(("branch.\(section).\(key)", value))
+        }
+        return entries
+    }
+
+    /// The branch in `[branch "name"]`, or in the old `[branch.name]` form.
+    private class func branchName(inSectionHeader header: String) -> String? {
+        guard let end = header.firstIndex(of: "]") else {
+            return nil
+        }
+        let inside = header[header.index(after: header.startIndex)..<end]
+        if let quote = inside.firstIndex(of: "\"") {
+            guard inside[..<quote].trimmingCharacters(in: .whitespaces).lowercased() == "branch" else {
+                return nil
+            }
+            var name = ""
+            var escaped = false
+            for character in inside[inside.index(after: quote)...] {
+                if escaped {
+                    name.append(character)
+                    escaped = false
+                } else if character == "\\" {
+                    escaped = true
+                } else if character == "\"" {
+                    return name
+                } else {
+                    name.append(character)
+                }
+            }
+            return nil
+        }
+        let trimmed = inside.trimmingCharacters(in: .whitespaces).lowercased()
+        guard trimmed.hasPrefix("branch.") else {
+            return nil
+        }
+        return String(trimmed.dropFirst(7))
+    }
+
+    /// A value with its comment dropped and quotes and escapes resolved.
+    private class func configValue(_ raw: String) -> String {
+        var value = ""
+        var quoted = false
+        var escaped = false
+        for character in raw {
+            if escaped {
+                switch character {
+                case "n": value.append("\n")
+                case "t": value.append("\t")
+                default: value.append(character)
+                }
+                escaped = false
+            } else if character == "\\" {
+                escaped = true
+            } else if character == "\"" {
+                quoted.toggle()
+            } else if !quoted && (character == "#" || character == ";") {
+                break
+            } else {
+                value.append(character)
+            }
+        }
+        return value.trimmingCharacters(in: .whitespaces)
+    }
+}
+
+// MARK: - Commit table
+
+/// Commits numbered for walking: ids below `graph.count` are commit-graph
+/// positions, the rest are listed commits the graph doesn't have, added
+/// (with their ancestors) the first time they are asked about.
+private final class Table {
+    let graph: PBCommitGraph?
+    let listed: PBCommitList
+
+    private let base: Int
+    private var listedRows: [String: Int]?
+    private var ids: [String: Int] = [:]
+    private var shas: [String] = []
+    private var parents: [[Int]] = []
+    private var generations: [UInt32] = []
+
+    init(graph: PBCommitGraph?, listed: PBCommitList) {
+        self.graph = graph
+        self.base = graph?.count ?? 0
+        self.listed = listed
+    }
+
+    /// Bytes held beyond the memory-mapped graph.
+    var cost: Int {
+        return (listedRows?.count ?? 0) * 80 + ids.count * 160
+    }
+
+    func id(for sha: String) -> Int? {
+        return known(sha) ?? add(sha)
+    }
+
+    /// The id of a commit already numbered, without numbering any.
+    func numberedID(for sha: String) -> Int? {
+        return known(sha)
+    }
+
+    func sha(of id: Int) -> String {
+        if let graph, id < base {
+            return graph.sha(at: id)
+        }
+        return shas[id - base]
+    }
+
+    func generation(of id: Int) -> UInt32 {
+        if let graph, id < base {
+            return graph.generation(at: id)
+        }
+        return generations[id - base]
+    }
+
+    func appendParents(of id: Int, to list: inout [Int]) {
+        if let graph, id < base {
+            graph.appendParents(at: id, to: &list)
+        } else {
+            list.append(contentsOf: parents[id - base])
+        }
+    }
+
+    // MARK: Walks
+
+    /// Depth-first from `descendant`, never going below the generation of
+    /// `ancestor`, since nothing there can reach it.
+    func isAncestor(_ ancestor: Int, of descendant: Int) -> Bool {
+        return isAncestor(ancestor, of: descendant, limit: .max) ?? false
+    }
+
+    /// As above, but nil once more than `limit` commits have been visited.
+    func isAncestor(_ ancestor: Int, of descendant: Int, limit: Int) -> Bool? {
+        if ancestor == descendant {
+            return true
+        }
+        let floor = generation(of: ancestor)
+        guard floor < generation(of: descendant) else {
+            return false
+        }
+
+        var visited = Set<Int>([descendant])
+        var stack = [descendant]
+        var list: [Int] = []
+        while let id = stack.popLast() {
+            list.removeAll(keepingCapacity: true)
+            appendParents(of: id, to: &list)
+            for parent in list {
+                if parent == ancestor {
+                    return true
+                }
+                if generation(of: parent) > floor && visited.insert(parent).inserted {
+                    if visited.count > limit {
+                        return nil
+                    }
+                    stack.append(parent)
+                }
+            }
+        }
+        return false
+    }
+
+    /// Walks down from both commits at once, highest generation first,
+    /// painting each commit with the side(s) it is reachable from. Since
+    /// every child of a commit has a higher generation, a commit's paint is
+    /// final when it is taken off the queue, so one-sided commits can be
+    /// counted as they go by. The walk stops once everything still queued
+    /// is reachable from both sides, and the first two-sided commit reached
+    /// is a best merge base.
+    func paint(_ first: Int, _ second: Int) -> (ahead: Int, behind: Int, mergeBase: Int?) {
+        let left: UInt8 = 1, right: UInt8 = 2, both: UInt8 = 3
+        var paint: [Int: UInt8] = [first: left]
+        paint[second, default: 0] |= right
+
+        var queue = GenerationQueue()
+        queue.push(first, generation: generation(of: first))
+        if second != first {
+            queue.push(second, generation: generation(of: second))
+        }
+        // Queued commits reachable from only one side
+        var oneSided = first == second ? 0 : 2
+
+        var ahead = 0
+        var behind = 0
+        var mergeBase: Int?
+        var list: [Int] = []
+        while oneSided > 0, let id = queue.pop() {
+            let sides = paint[id] ?? 0
+            switch sides {
+            case left:
+                ahead += 1
+                oneSided -= 1
+            case right:
+                behind += 1
+                oneSided -= 1
+            default:
+                if mergeBase == nil {
+                    mergeBase = id
+                }
+            }
+
+            list.removeAll(keepingCapacity: true)
+            appendParents(of: id, to: &list)
+            for parent in list {
+                guard let old = paint[parent] else {
+                    paint[parent] = sides
+                    queue.push(parent, generation: generation(of: parent))
+                    if sides != both {
+                        oneSided += 1
+                    }
+                    continue
+                }
+                let new = old | sides
+                if new != old {
+                    paint[parent] = new
+                    if new == both {
+                        oneSided -= 1
+                    }
+                }
+            }
+        }
+        return (ahead, behind, mergeBase ?? queue.peek())
+    }
+
+    // MARK: Listed commits
+
+    private func known(_ sha: String) -> Int? {
+        return graph?.position(of: sha) ?? ids[sha]
+    }
+
+    /// Numbers `sha` and any of its ancestors not yet numbered, parents
+    /// first, so each generation is one more than its parents' highest.
+    private func add(_ sha: String) -> Int? {
+        if listedRows == nil {
+            var rows: [String: Int] = [:]
+            rows.reserveCapacity(listed.count)
+            for row in 0..<listed.count {
+                rows[listed.commit(at: row).sha] = row
+            }
+            listedRows = rows
+        }
+        guard let rows = listedRows, rows[sha] != nil else {
+            return nil
+        }
+
+        var stack = [sha]
+        while let top = stack.last {
+            if known(top) != nil {
+                stack.removeLast()
+                continue
+            }
+            let parentSHAs = rows[top].map { listed.commit(at: $0).parents } ?? []
+            let pending = parentSHAs.filter { known($0) == nil && rows[$0] != nil }
+            if !pending.isEmpty {
+                stack.append(contentsOf: pending)
+                continue
+            }
+            stack.removeLast()
+
+            // Parents that aren't listed anywhere (a shallow or partial
+            // history) are left out
+            let parentIDs = parentSHAs.compactMap(known)
+            ids[top] = base + shas.count
+            shas.append(top)
+            parents.append(parentIDs)
+            generations.append(1 + (parentIDs.map(generation(of:)).max() ?? 0))
+        }
+        return ids[sha]
+    }
+}
+
+/// Max-heap of commit ids by generation.
+private struct GenerationQueue {
+    private var heap: [(generation: UInt32, id: Int)] = []
+
+    func peek() -> Int? {
+        return heap.first?.id
+    }
+
+    mutating func push(_ id: Int, generation: UInt32) {
+        heap.append((generation, id))
+        var child = heap.count - 1
+        while child > 0 {
+            let parent = (child - 1) / 2
+            guard isHigher(heap[child], heap[parent]) else {
+                break
+            }
+            heap.swapAt(child, parent)
+            child = parent
+        }
+    }
+
+    mutating func pop() -> Int? {
+        guard let top = heap.first else {
+            return nil
+        }
+        let last = heap.removeLast()
+        if !heap.isEmpty {
+            heap[0] = last
+            var parent = 0
+            while true {
+                var highest = parent
+                for child in [2 * parent + 1, 2 * parent + 2] where child < heap.count && isHigher(heap[child], heap[highest]) {
+                    highest = child
+                }
+                if highest == parent {
+                    break
+                }
+                heap.swapAt(parent, highest)
+                parent = highest
+            }
+        }
+        return top.id
+    }
+
+    private func isHigher(_ lhs: (generation: UInt32, id: Int), _ rhs: (generation: UInt32, id: Int)) -> Bool {
+        return lhs.generation != rhs.generation ? lhs.generation > rhs.generation : lhs.id > rhs.id
+    }
+}
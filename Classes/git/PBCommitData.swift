@@ -47,6 +47,71 @@ final class PBCommitData: NSObject {
                   parentSHAs: other.parentSHAs)
     }
 
+    /// Data for `sha` read from its raw commit object as `git cat-file`
+    /// prints it, or nil if `object` isn't one. The summary is the first
+    /// paragraph of the message joined onto one line, like `%s`.
+    convenience init?(sha: String, commitObject object: Data) {
+        guard let text = String(data: object, encoding: .utf8) ?? String(data: object, encoding: .isoLatin1),
+              text.hasPrefix("tree ") else {
+            return nil
+        }
+
+        let headerEnd = text.range(of: "\n\n")
+        let header = headerEnd.map { text[..<$0.lowerBound] } ?? Substring(text)
+        let message = headerEnd.map { String(text[$0.upperBound...]) } ?? ""
+
+        var parents: [String] = []
+        var authorName = ""
+        var committerName = ""
+        var timestamp: TimeInterval = 0
+        for line in header.split(separator: "\n") {
+            if line.hasPrefix("parent ") {
+                parents.append(String(line.dropFirst(7)))
+            } else if line.hasPrefix("author ") {
+                authorName = PBCommitData.personName(line.dropFirst(7))
+            } else if line.hasPrefix("committer ") {
+                committerName = PBCommitData.personName(line.dropFirst(10))
+                timestamp = PBCommitData.personTime(line.dropFirst(10))
+            }
+        }
+
+        var summaryLines: [Substring] = []
+        for line in message.split(separator: "\n", omittingEmptySubsequences: false) {
+            let trimmed = line.trimmingCharacters(in: .whitespaces)
+            if trimmed.isEmpty {
+                if summaryLines.isEmpty {
+                    continue
+                }
+                break
+            }
+            summaryLines.append(Substring(trimmed))
+        }
+
+        self.init(sha: sha,
+                  shortSHA: String(sha.prefix(7)),
+                  message: message,
+                  messageSummary: summaryLines.joined(separator: " "),
+                  commitDate: Date(timeIntervalSince1970: timestamp),
+                  authorName: authorName,
+                  committerName: committerName,
+                  parentSHAs: parents)
+    }
+
+    /// "Name <email> 1700000000 +0100" -> "Name"
+    private class func personName(_ ident: Substring) -> String {
+        let name = ident.prefix { $0 != "<" }
+        return name.trimmingCharacters(in: .whitespaces)
+    }
+
+    /// "Name <email> 1700000000 +0100" -> 1700000000
+    private class func personTime(_ ident: Substring) -> TimeInterval {
+        guard let close = ident.lastIndex(of: ">") else {
+            return 0
+        }
+        let seconds = ident[ident.index(after: close)...].split(separator: " ").first
+        return seconds.flatMap { TimeInterval(String($0)) } ?? 0
+    }
+
     @objc(parentSHAsFromString:)
     class func parentSHAs(from string: String?) -> [String] {
         guard let string, !string.isEmpty else {
@@ -0,0 +1,130 @@
+import Foundation
+
+/// The files a commit changes, with added and deleted line counts, read from
+/// `git diff-tree --raw -z --numstat -M`. The history view shows this list
+/// before (or instead of) generating patch text, so it never has to scan a
+/// patch for file headers.
+@objcMembers
+@objc(PBCommitFileList)
+final class PBCommitFileList: NSObject {
+    /// Lists the files changed by `sha` against its first parent (or the empty
+    /// tree for a root commit) off the main thread. `completion` runs on the
+    /// main queue with one dictionary per file, in git's order, or nil if git
+    /// failed. Each dictionary has "status" (M, A, D, R, C, T), "path",
+    /// "oldPath", "oldMode", "newMode", "added" and "deleted" (-1 for binary
+    /// files) and "binary".
+    ///
+    /// Merge commits produce an empty list, as diff-tree shows no diff for them
+    /// without -m; the caller falls back to the patch.
+    @objc(loadForCommit:inRepository:ignoreWhitespace:completion:)
+    class func load(forCommit sha: String,
+                    in repository: PBGitRepository,
+                    ignoreWhitespace: Bool,
+                    completion: @escaping ([[String: Any]]?) -> Void) {
+        var arguments = ["diff-tree", "-r", "--root", "--no-commit-id", "--raw", "-z", "--numstat", "-M"]
+        if ignoreWhitespace {
+            arguments.append("-w")
+        }
+        arguments.append(sha)
+
+        DispatchQueue.global(qos: .userInitiated).async {
+            let parser = Parser()
+            var files: [[String: Any]]?
+            do {
+                try repository.streamGitCommand(arguments, recordSeparator: Data([0])) { record in
+                    parser.consume(record)
+                    return true
+                }
+                files = parser.files
+            } catch {
+                NSLog("Error listing files of %@: %@", sha, error.localizedDescription)
+            }
+
+            DispatchQueue.main.async {
+                completion(files)
+            }
+        }
+    }
+
+    /// Walks the NUL-separated fields. All --raw records come first, as
+    /// ":<old mode> <new mode> <old sha> <new sha> <status>" followed by the
+    /// path, or two paths for renames and copies. The --numstat records follow
+    /// in the same order as "<added>\t<deleted>\t<path>", where a rename has an
+    /// empty path and its two paths in the next fields.
+    private final class Parser {
+        private(set) var files: [[String: Any]] = []
+        private var pathsWanted = 0
+        private var numstatIndex = 0
+        private var numstatPathsToSkip = 0
+
+        func consume(_ record: Data) {
+            if pathsWanted > 0 {
+                let path = String(decoding: record, as: UTF8.self)
+                var file = files[files.count - 1]
+                // The first of two paths is the source of a rename or copy
+                if pathsWanted == 2 || (file["oldPath"] as? String)?.isEmpty != false {
+                    file["oldPath"] = path
+                }
+                file["path"] = path
+                files[files.count - 1] = file
+                pathsWanted -= 1
+                return
+            }
+
+            if numstatPathsToSkip > 0 {
+                numstatPathsToSkip -= 1
+                return
+            }
+
+            if record.first == UInt8(ascii: ":") {
+                consumeRaw(String(decoding: record, as: UTF8.self))
+            } else if !record.isEmpty {
+                consumeNumstat(String(decoding: record, as: UTF8.self))
+            }
+        }
+
+        private func consumeRaw(_ header: String) {
+            let fields = header.dropFirst().split(separator: " ")
+            guard fields.count >= 5, let status = fields[4].first else {
+                return
+            }
+
+            files.append([
+                "status": String(status),
+                "path": "",
+                "oldPath": "",
+                "oldMode": String(fields[0]),
+                "newMode": String(fields[1]),
+                "added": 0,
+                "deleted": 0,
+                "binary": false,
+            ])
+            pathsWanted = (status == "R" || status == "C") ? 2 : 1
+        }
+
+        private func consumeNumstat(_ line: String) {
+            let fields = line.split(separator: "\t", maxSplits: 2, omittingEmptySubsequences: false)
+            guard fields.count == 3 else {
+                return
+            }
+            if fields[2].isEmpty {
+                numstatPathsToSkip = 2
+            }
+
+            guard numstatIndex < files.count else {
+                return
+            }
+            var file = files[numstatIndex]
+            numstatIndex += 1
+            if let added = Int(fields[0]), let deleted = Int(fields[1]) {
+                file["added"] = added
+                file["deleted"] = deleted
+            } else {
+                file["added"] = -1
+                file["deleted"] = -1
+                file["binary"] = true
+            }
+            files[numstatIndex - 1] = file
+        }
+    }
+}
@@ -0,0 +1,594 @@
+import Foundation
+
+/// Read-only view of git's commit-graph: the parents, commit time and
+/// generation number of every commit it covers, memory-mapped straight from
+/// `objects/info/commit-graph` or the layers listed in
+/// `objects/info/commit-graphs/commit-graph-chain`.
+///
+/// Commits are addressed by position, the index git gives them in the file
+/// (sorted by object id, base layer first); parent links are positions too,
+/// so walking the history never turns an id into a string.
+@objcMembers
+@objc(PBCommitGraph)
+final class PBCommitGraph: NSObject {
+    /// Commits in all layers
+    let count: Int
+    /// Bytes per object id: 20 for SHA-1, 32 for SHA-256
+    let hashLength: Int
+
+    private let layers: [Layer]
+
+    static let parentNone: UInt32 = 0x7000_0000
+
+    private init(layers: [Layer]) {
+        self.layers = layers
+        self.count = layers.last.map { $0.start + $0.count } ?? 0
+        self.hashLength = layers.first?.hashLength ?? 20
+        super.init()
+    }
+
+    /// The commit-graph in `objectsInfoDirectory`, or nil if there is none,
+    /// it can't be read, or git itself wouldn't trust it because the
+    /// repository is shallow or has grafts or replace refs.
+    @objc(graphInObjectsInfoDirectory:)
+    class func graph(inObjectsInfoDirectory directory: URL) -> PBCommitGraph? {
+        let commonDir = directory.deletingLastPathComponent().deletingLastPathComponent()
+        let fileManager = FileManager.default
+        if fileManager.fileExists(atPath: commonDir.appendingPathComponent("shallow").path)
+            || fileManager.fileExists(atPath: directory.appendingPathComponent("grafts").path)
+            || !((try? fileManager.contentsOfDirectory(atPath: commonDir.appendingPathComponent("refs/replace").path))?.isEmpty ?? true) {
+            return nil
+        }
+
+        let single = directory.appendingPathComponent("commit-graph").path
+        if fileManager.fileExists(atPath: single) {
+            guard let layer = Layer(path: single, start: 0) else {
+                return nil
+            }
+            return PBCommitGraph(layers: [layer])
+        }
+
+        let chainDirectory = directory.appendingPathComponent("commit-graphs")
+        guard let chain = try? String(contentsOf: chainDirectory.appendingPathComponent("commit-graph-chain"), encoding: .utf8) else {
+            return nil
+        }
+        var layers: [Layer] = []
+        var start = 0
+        for hash in chain.split(separator: "\n") where !hash.isEmpty {
+            let path = chainDirectory.appendingPathComponent("graph-\(hash).graph").path
+            guard let layer = Layer(path: path, start: start) else {
+                return nil
+            }
+            layers.append(layer)
+            start += layer.count
+        }
+        return layers.isEmpty ? nil : PBCommitGraph(layers: layers)
+    }
+
+    /// Whether the files this was read from are still the ones on disk.
+    var isCurrent: Bool {
+        return layers.allSatisfy { FileStamp(path: $0.path) == $0.stamp }
+    }
+
+    // MARK: - Lookups
+
+    /// Position of `sha`, or nil if the graph doesn't cover it.
+    func position(of sha: String) -> Int? {
+        guard let oid = PBCommitGraph.bytes(fromHex: sha), oid.count == hashLength else {
+            return nil
+        }
+        for layer in layers {
+            if let index = layer.find(oid) {
+                return layer.start + index
+            }
+        }
+        return nil
+    }
+
+    func sha(at position: Int) -> String {
+        let (layer, index) = locate(position)
+        return layer.sha(at: index)
+    }
+
+    /// Appends the positions of the parents of the commit at `position`, in
+    /// order, to `parents`.
+    func appendParents(at position: Int, to parents: inout [Int]) {
+        let (layer, index) = locate(position)
+        layer.appendParents(at: index, to: &parents)
+    }
+
+    /// Committer time, in seconds since 1970.
+    func commitTime(at position: Int) -> Int64 {
+        let (layer, index) = locate(position)
+        return layer.commitTime(at: index)
+    }
+
+    /// Topological level: one more than the highest level among the parents,
+    /// so an ancestor always has a lower number than its descendants.
+    func generation(at position: Int) -> UInt32 {
+        let (layer, index) = locate(position)
+        return layer.generation(at: index)
+    }
+
+    private func locate(_ position: Int) -> (Layer, Int) {
+        for layer in layers.reversed() where position >= layer.start {
+            return (layer, position - layer.start)
+        }
+        return (layers[0], position)
+    }
+
+    // MARK: - Walking
+
+    /// Lays out the commits reachable from `tips` in `git rev-list
+    /// --topo-order` order. `firstParentOnly` commits (stashes) are walked
+    /// through their first parent only.
+    ///
+    /// Tips and ancestors the graph doesn't cover yet, such as commits made
+    /// since git last wrote it, are read from their objects with `cat-file`.
+    /// Returns nil if that fails or turns up more than `fringeLimit` commits,
+    /// in which case the graph is too far behind to be worth using.
+    @objc(walkFromTips:firstParentOnly:repository:cancelled:)
+    func walk(fromTips tips: [String],
+              firstParentOnly: Set<String>,
+              repository: PBGitRepository,
+              cancelled: () -> Bool) -> PBCommitGraphWalk? {
+        let walk = PBCommitGraphWalk(graph: self)
+        guard walk.readFringe(tips: tips, firstParentOnly: firstParentOnly, repository: repository),
+              walk.sortTopologically(tips: tips, firstParentOnly: firstParentOnly, cancelled: cancelled) else {
+            return nil
+        }
+        return walk
+    }
+
+    // MARK: - Helpers
+
+    class func bytes(fromHex hex: String) -> [UInt8]? {
+        let digits = Array(hex.utf8)
+        guard digits.count % 2 == 0 else {
+            return nil
+        }
+        var bytes = [UInt8](repeating: 0, count: digits.count / 2)
+        for index in 0..<bytes.count {
+            guard let high = hexValue(digits[2 * index]), let low = hexValue(digits[2 * index + 1]) else {
+                return nil
+            }
+            bytes[index] = high << 4 | low
+        }
+        return bytes
+    }
+
+    private class func hexValue(_ digit: UInt8) -> UInt8? {
+        switch digit {
+        case UInt8(ascii: "0")...UInt8(ascii: "9"): return digit - UInt8(ascii: "0")
+        case UInt8(ascii: "a")...UInt8(ascii: "f"): return digit - UInt8(ascii: "a") + 10
+        case UInt8(ascii: "A")...UInt8(ascii: "F"): return digit - UInt8(ascii: "A") + 10
+        default: return nil
+        }
+    }
+}
+
+/// Commits reachable from a set of tips, in the order the history list shows
+/// them, produced by `PBCommitGraph.walk`.
+///
+/// Rows refer to commits by id: ids below `graph.count` are commit-graph
+/// positions, the rest index the "fringe" of commits the graph doesn't have
+/// yet. Only fringe commits come with their text, since their objects had to
+/// be read anyway.
+@objcMembers
+@objc(PBCommitGraphWalk)
+final class PBCommitGraphWalk: NSObject {
+    /// More commits than this outside the graph means it is badly out of date
+    static let fringeLimit = 20_000
+    private static let readBatchSize = 256
+    private static let maxTagDepth = 5
+
+    private struct FringeCommit {
+        let data: PBCommitData
+        var parents: [Int] = []
+    }
+
+    private let graph: PBCommitGraph
+    private var fringe: [FringeCommit] = []
+    private var fringeIDs: [String: Int] = [:]
+    private var tagTargets: [String: String] = [:]
+    private var firstParentOnlyIDs = Set<Int>()
+    private var order: [Int32] = []
+
+    fileprivate init(graph: PBCommitGraph) {
+        self.graph = graph
+        super.init()
+    }
+
+    var count: Int {
+        return order.count
+    }
+
+    @objc(shaAtRow:)
+    func sha(atRow row: Int) -> String {
+        let id = Int(order[row])
+        return id < graph.count ? graph.sha(at: id) : fringe[id - graph.count].data.sha ?? ""
+    }
+
+    @objc(parentSHAsAtRow:)
+    func parentSHAs(atRow row: Int) -> [String] {
+        var parents: [Int] = []
+        appendParents(of: Int(order[row]), to: &parents)
+        return parents.map { $0 < graph.count ? graph.sha(at: $0) : fringe[$0 - graph.count].data.sha ?? "" }
+    }
+
+    @objc(commitDateAtRow:)
+    func commitDate(atRow row: Int) -> Date {
+        return Date(timeIntervalSince1970: TimeInterval(commitTime(of: Int(order[row]))))
+    }
+
+    /// Everything about a commit the graph doesn't cover, read from its
+    /// object; nil for commits laid out from the graph.
+    @objc(commitDataAtRow:)
+    func commitData(atRow row: Int) -> PBCommitData? {
+        let id = Int(order[row])
+        return id < graph.count ? nil : fringe[id - graph.count].data
+    }
+
+    // MARK: - Fringe
+
+    /// Reads every commit reachable from `tips` that the graph doesn't
+    /// cover, stopping at parents it does. Annotated tags are peeled on the
+    /// way; tips that are neither commits nor tags are dropped, as rev-list
+    /// would.
+    fileprivate func readFringe(tips: [String], firstParentOnly: Set<String>, repository: PBGitRepository) -> Bool {
+        var pending = tips.filter { graph.position(of: $0) == nil }
+        var requested = Set(pending)
+
+        while !pending.isEmpty {
+            let batch = Array(pending.prefix(PBCommitGraphWalk.readBatchSize))
+            pending.removeFirst(batch.count)
+
+            let objects: [String: PBGitObject]
+            do {
+                objects = try PBGitBlobStore.shared.readObjects(batch, in: repository)
+            } catch {
+                NSLog("Could not read commits missing from the commit-graph: %@", error.localizedDescription)
+                return false
+            }
+
+            for sha in batch {
+                guard let object = objects[sha] else {
+                    continue
+                }
+                var next: [String] = []
+                if object.type == "tag" {
+                    guard let target = PBCommitGraphWalk.tagTarget(object.contents) else {
+                        continue
+                    }
+                    tagTargets[sha] = target
+                    next = [target]
+                } else if object.type == "commit" {
+                    guard let data = PBCommitData(sha: sha, commitObject: object.contents) else {
+                        continue
+                    }
+                    if firstParentOnly.contains(sha), let parents = data.parentSHAs, parents.count > 1 {
+                        data.parentSHAs = [parents[0]]
+                    }
+                    fringeIDs[sha] = graph.count + fringe.count
+                    fringe.append(FringeCommit(data: data))
+                    next = data.parentSHAs ?? []
+                    if fringe.count > PBCommitGraphWalk.fringeLimit {
+                        return false
+                    }
+                }
+
+                for parent in next where !requested.contains(parent) && graph.position(of: parent) == nil {
+                    requested.insert(parent)
+                    pending.append(parent)
+                }
+            }
+        }
+
+        for index in fringe.indices {
+            fringe[index].parents = (fringe[index].data.parentSHAs ?? []).compactMap { id(for: $0) }
+        }
+        return true
+    }
+
+    /// The id of the commit `sha` names, peeling annotated tags.
+    private func id(for sha: String) -> Int? {
+        var name = sha
+        for _ in 0...PBCommitGraphWalk.maxTagDepth {
+            if let position = graph.position(of: name) {
+                return position
+            }
+            if let id = fringeIDs[name] {
+                return id
+            }
+            guard let target = tagTargets[name] else {
+                return nil
+            }
+            name = target
+        }
+        return nil
+    }
+
+    private class func tagTarget(_ contents: Data) -> String? {
+        guard let text = String(data: contents.prefix(128), encoding: .utf8) ?? String(data: contents.prefix(128), encoding: .isoLatin1),
+              text.hasPrefix("object ") else {
+            return nil
+        }
+        let line = text.dropFirst(7).prefix { $0 != "\n" }
+        return line.isEmpty ? nil : String(line)
+    }
+
+    // MARK: - Ordering
+
+    private func appendParents(of id: Int, to parents: inout [Int]) {
+        let start = parents.count
+        if id < graph.count {
+            graph.appendParents(at: id, to: &parents)
+        } else {
+            parents.append(contentsOf: fringe[id - graph.count].parents)
+        }
+        if parents.count - start > 1 && firstParentOnlyIDs.contains(id) {
+            parents.removeSubrange((start + 1)...)
+        }
+    }
+
+    private func commitTime(of id: Int) -> Int64 {
+        if id < graph.count {
+            return graph.commitTime(at: id)
+        }
+        return Int64(fringe[id - graph.count].data.commitDate?.timeIntervalSince1970 ?? 0)
+    }
+
+    /// git's --topo-order: count each commit's children within the walk,
+    /// then emit from a stack seeded with the tips, newest first, pushing a
+    /// parent once its last child is out. That keeps each line of history
+    /// together instead of interleaving branches by date.
+    fileprivate func sortTopologically(tips: [String], firstParentOnly: Set<String>, cancelled: () -> Bool) -> Bool {
+        for sha in firstParentOnly {
+            if let id = id(for: sha) {
+                firstParentOnlyIDs.insert(id)
+            }
+        }
+
+        let total = graph.count + fringe.count
+        // Children still to be emitted plus one, for commits in the walk; 0 otherwise
+        var indegree = [Int32](repeating: 0, count: total)
+        var stack: [Int] = []
+        var parents: [Int] = []
+        var steps = 0
+
+        var tipIDs: [Int] = []
+        for sha in tips {
+            guard let id = id(for: sha), indegree[id] == 0 else {
+                continue
+            }
+            indegree[id] = 1
+            tipIDs.append(id)
+            stack.append(id)
+        }
+
+        while let id = stack.popLast() {
+            steps += 1
+            if steps & 0xffff == 0 && cancelled() {
+                return false
+            }
+            parents.removeAll(keepingCapacity: true)
+            appendParents(of: id, to: &parents)
+            for parent in parents {
+                if indegree[parent] == 0 {
+                    indegree[parent] = 1
+                    stack.append(parent)
+                }
+                indegree[parent] += 1
+            }
+        }
+
+        // Tips that are another tip's ancestor are emitted through it
+        stack = tipIDs.filter { indegree[$0] == 1 }
+        stack.sort { commitTime(of: $0) < commitTime(of: $1) }
+        order.reserveCapacity(total)
+
+        while let id = stack.popLast() {
+            steps += 1
+            if steps & 0xffff == 0 && cancelled() {
+                return false
+            }
+            parents.removeAll(keepingCapacity: true)
+            appendParents(of: id, to: &parents)
+            for parent in parents where indegree[parent] != 0 {
+                indegree[parent] -= 1
+                if indegree[parent] == 1 {
+                    stack.append(parent)
+                }
+            }
+            indegree[id] = 0
+            order.append(Int32(id))
+        }
+        return true
+    }
+}
+
+/// One mapped commit-graph file.
+private final class Layer {
+    let path: String
+    let stamp: FileStamp?
+    /// Position of this layer's first commit in the whole graph
+    let start: Int
+    let count: Int
+    let hashLength: Int
+
+    private let base: UnsafeRawPointer
+    private let length: Int
+    private let fanout: Int
+    private let lookup: Int
+    private let commitData: Int
+    private let extraEdges: Int?
+
+    private static let signature: UInt32 = 0x4350_4748 // "CGPH"
+    private static let chunkFanout: UInt32 = 0x4f49_4446 // "OIDF"
+    private static let chunkLookup: UInt32 = 0x4f49_444c // "OIDL"
+    private static let chunkCommitData: UInt32 = 0x4344_4154 // "CDAT"
+    private static let chunkExtraEdges: UInt32 = 0x4544_4745 // "EDGE"
+
+    init?(path: String, start: Int) {
+        let descriptor = open(path, O_RDONLY)
+        guard descriptor >= 0 else {
+            return nil
+        }
+        defer { close(descriptor) }
+
+        var info = stat()
+        guard fstat(descriptor, &info) == 0, info.st_size >= 8 + 12 else {
+            return nil
+        }
+        let length = Int(info.st_size)
+        guard let mapping = mmap(nil, length, PROT_READ, MAP_PRIVATE, descriptor, 0),
+              mapping != UnsafeMutableRawPointer(bitPattern: -1) else {
+            return nil
+        }
+
+        let base = UnsafeRawPointer(mapping)
+        guard let chunks = Layer.readChunkTable(base, length: length) else {
+            munmap(mapping, length)
+            return nil
+        }
+        let hashLength = base.load(fromByteOffset: 5, as: UInt8.self) == 2 ? 32 : 20
+        let fanout = chunks[Layer.chunkFanout] ?? -1
+        let lookup = chunks[Layer.chunkLookup] ?? -1
+        let commitData = chunks[Layer.chunkCommitData] ?? -1
+        let count = fanout >= 0 && fanout + 256 * 4 <= length ? Int(Layer.be32(base, fanout + 255 * 4)) : 0
+        guard fanout >= 0, lookup >= 0, commitData >= 0,
+              lookup + count * hashLength <= length,
+              commitData + count * (hashLength + 16) <= length else {
+            munmap(mapping, length)
+            return nil
+        }
+
+        self.path = path
+        self.stamp = FileStamp(path: path)
+        self.start = start
+        self.count = count
+        self.hashLength = hashLength
+        self.base = base
+        self.length = length
+        self.fanout = fanout
+        self.lookup = lookup
+        self.commitData = commitData
+        self.extraEdges = chunks[Layer.chunkExtraEdges]
+    }
+
+    /// Chunk offsets by id, after checking the header: signature, version 1,
+    /// hash version (1 = SHA-1, 2 = SHA-256), chunk count and base graph
+    /// count, followed by an (id, offset) entry per chunk and a terminating
+    /// entry.
+    private static func readChunkTable(_ base: UnsafeRawPointer, length: Int) -> [UInt32: Int]? {
+        let version = base.load(fromByteOffset: 4, as: UInt8.self)
+        let hashVersion = base.load(fromByteOffset: 5, as: UInt8.self)
+        let chunkCount = Int(base.load(fromByteOffset: 6, as: UInt8.self))
+        guard be32(base, 0) == signature, version == 1, hashVersion == 1 || hashVersion == 2,
+              8 + (chunkCount + 1) * 12 <= length else {
+            return nil
+        }
+
+        var chunks: [UInt32: Int] = [:]
+        for index in 0..<chunkCount {
+            let entry = 8 + index * 12
+            let offset = be64(base, entry + 4)
+            guard offset <= UInt64(length) else {
+                return nil
+            }
+            chunks[be32(base, entry)] = Int(offset)
+        }
+        return chunks
+    }
+
+    deinit {
+        munmap(UnsafeMutableRawPointer(mutating: base), length)
+    }
+
+    /// Index of `oid` in this layer: the fanout narrows the search to ids
+    /// sharing the first byte, then a binary search over the sorted ids.
+    func find(_ oid: [UInt8]) -> Int? {
+        let first = Int(oid[0])
+        var low = first == 0 ? 0 : Int(Layer.be32(base, fanout + (first - 1) * 4))
+        var high = Int(Layer.be32(base, fanout + first * 4)) - 1
+        return oid.withUnsafeBytes { key -> Int? in
+            while low <= high {
+                let middle = (low + high) / 2
+                let order = memcmp(base + lookup + middle * hashLength, key.baseAddress!, hashLength)
+                if order < 0 {
+                    low = middle + 1
+                } else if order > 0 {
+                    high = middle - 1
+                } else {
+                    return middle
+                }
+            }
+            return nil
+        }
+    }
+
+    func sha(at index: Int) -> String {
+        let bytes = UnsafeRawBufferPointer(start: base + lookup + index * hashLength, count: hashLength)
+        let digits = Array("0123456789abcdef".utf8)
+        var hex = [UInt8](repeating: 0, count: hashLength * 2)
+        for (offset, byte) in bytes.enumerated() {
+            hex[2 * offset] = digits[Int(byte >> 4)]
+            hex[2 * offset + 1] = digits[Int(byte & 0xf)]
+        }
+        return String(decoding: hex, as: UTF8.self)
+    }
+
+    /// A commit's record: tree id, first and second parent, then 30 bits of
+    /// generation and 34 bits of commit time. A second parent with the high
+    /// bit set is instead an index into the extra edges list, which holds
+    /// the second and later parents of octopus merges and ends with the
+    /// entry whose high bit is set.
+    func appendParents(at index: Int, to parents: inout [Int]) {
+        let record = commitData + index * (hashLength + 16)
+        let first = Layer.be32(base, record + hashLength)
+        guard first != PBCommitGraph.parentNone else {
+            return
+        }
+        parents.append(Int(first))
+
+        let second = Layer.be32(base, record + hashLength + 4)
+        if second == PBCommitGraph.parentNone {
+            return
+        }
+        if second & 0x8000_0000 == 0 {
+            parents.append(Int(second))
+            return
+        }
+        guard let extraEdges else {
+            return
+        }
+        var edge = extraEdges + Int(second & 0x7fff_ffff) * 4
+        while edge + 4 <= length {
+            let value = Layer.be32(base, edge)
+            parents.append(Int(value & 0x7fff_ffff))
+            if value & 0x8000_0000 != 0 {
+                break
+            }
+            edge += 4
+        }
+    }
+
+    func generation(at index: Int) -> UInt32 {
+        return Layer.be32(base, commitData + index * (hashLength + 16) + hashLength + 8) >> 2
+    }
+
+    func commitTime(at index: Int) -> Int64 {
+        let record = commitData + index * (hashLength + 16) + hashLength + 8
+        let high = Int64(Layer.be32(base, record) & 0x3)
+        return high << 32 | Int64(Layer.be32(base, record + 4))
+    }
+
+    private static func be32(_ base: UnsafeRawPointer, _ offset: Int) -> UInt32 {
+        let bytes = base.advanced(by: offset).assumingMemoryBound(to: UInt8.self)
+        return UInt32(bytes[0]) << 24 | UInt32(bytes[1]) << 16 | UInt32(bytes[2]) << 8 | UInt32(bytes[3])
+    }
+
+    private static func be64(_ base: UnsafeRawPointer, _ offset: Int) -> UInt64 {
+        return UInt64(be32(base, offset)) << 32 | UInt64(be32(base, offset + 4))
+    }
+}
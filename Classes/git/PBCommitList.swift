@@ -0,0 +1,203 @@
+import Foundation
+
+/// An immutable snapshot of a history list, safe to read from any thread.
+///
+/// Commits are kept in fixed-size segments. Appending a batch makes a new
+/// snapshot that shares every full segment with the old one and copies only
+/// the last, partly filled one, so a loading history costs no more than the
+/// rows it adds, and a reader holding an older snapshot keeps seeing exactly
+/// what it took.
+///
+/// Snapshots made by appending share a `lineage` with the one they grew
+/// from; anything that reorders or drops commits starts a new one, which is
+/// how observers tell "rows were added" from "start over". A snapshot with
+/// one commit put in front also starts a new lineage, but remembers the one
+/// it was made from, so observers can show just that commit.
+@objcMembers
+@objc(PBCommitList)
+final class PBCommitList: NSObject, NSFastEnumeration {
+    static let segmentSize = 4096
+
+    /// A list with no commits.
+    static let empty = PBCommitList(segments: [], count: 0, lineage: 0, version: 0)
+
+    let count: Int
+    /// Identifies the chain of appends this snapshot belongs to
+    let lineage: Int
+    /// Increases with every snapshot made, across all lists
+    let version: Int
+
+    private let segments: [[PBGitCommit]]
+    /// Version of the snapshot `prepending(_:)` made this one from
+    private let prependedTo: Int?
+
+    private static let counterLock = NSLock()
+    private static var lastVersion = 0
+    private static var lastLineage = 0
+    /// Snapshots never change, so fast enumeration has nothing to detect
+    private static let mutations: UnsafeMutablePointer<UInt> = {
+        let pointer = UnsafeMutablePointer<UInt>.allocate(capacity: 1)
+        pointer.initialize(to: 0)
+        return pointer
+    }()
+
+    private init(segments: [[PBGitCommit]], count: Int, lineage: Int, version: Int, prependedTo: Int? = nil) {
+        self.segments = segments
+        self.count = count
+        self.lineage = lineage
+        self.version = version
+        self.prependedTo = prependedTo
+        super.init()
+    }
+
+    /// A snapshot holding `commits`, unrelated to any other.
+    @objc(listWithCommits:)
+    class func list(with commits: [PBGitCommit]) -> PBCommitList {
+        return PBCommitList.empty.appending(commits, lineage: nextLineage())
+    }
+
+    // MARK: - Reading
+
+    @objc(commitAtIndex:)
+    func commit(at index: Int) -> PBGitCommit {
+        return segments[index / PBCommitList.segmentSize][index % PBCommitList.segmentSize]
+    }
+
+    @objc(objectAtIndexedSubscript:)
+    func object(atIndexedSubscript index: Int) -> PBGitCommit {
+        return commit(at: index)
+    }
+
+    /// The commits in `range`, copied into an array.
+    @objc(commitsInRange:)
+    func commits(in range: NSRange) -> [PBGitCommit] {
+        var result: [PBGitCommit] = []
+        result.reserveCapacity(range.length)
+        var index = range.location
+        let end = min(NSMaxRange(range), count)
+        while index < end {
+            let segment = segments[index / PBCommitList.segmentSize]
+            let offset = index % PBCommitList.segmentSize
+            let take = min(segment.count - offset, end - index)
+            result.append(contentsOf: segment[offset..<(offset + take)])
+            index += take
+        }
+        return result
+    }
+
+    /// Every commit, copied into an array, for APIs that need one.
+    var allCommits: [PBGitCommit] {
+        return commits(in: NSRange(location: 0, length: count))
+    }
+
+    /// The commits added since `older` if this snapshot grew from it by
+    /// appending, otherwise nil. Everything counts as appended to an empty
+    /// list.
+    @objc(commitsAppendedToList:)
+    func commitsAppended(to older: PBCommitList?) -> [PBGitCommit]? {
+        guard let older, older.count > 0 else {
+            return allCommits
+        }
+        guard older.lineage == lineage, older.count <= count else {
+            return nil
+        }
+        return commits(in: NSRange(location: older.count, length: count - older.count))
+    }
+
+    /// The commit put in front of `older` to make this snapshot, if it was
+    /// made that way, otherwise nil.
+    @objc(commitPrependedToList:)
+    func commitPrepended(to older: PBCommitList?) -> PBGitCommit? {
+        guard let older, let prependedTo, prependedTo == older.version else {
+            return nil
+        }
+        return commit(at: 0)
+    }
+
+    // MARK: - Making new snapshots
+
+    /// This list followed by `commits`, in the same lineage.
+    @objc(listByAppendingCommits:)
+    func appending(_ commits: [PBGitCommit]) -> PBCommitList {
+        return appending(commits, lineage: count > 0 ? lineage : PBCommitList.nextLineage())
+    }
+
+    /// `commits` in place of everything from `row` on, as a new lineage.
+    @objc(listByReplacingCommitsFromRow:withCommits:)
+    func replacingCommits(fromRow row: Int, with commits: [PBGitCommit]) -> PBCommitList {
+        let keptSegments = row / PBCommitList.segmentSize
+        var prefix = PBCommitList(segments: Array(segments.prefix(keptSegments)),
+                                  count: keptSegments * PBCommitList.segmentSize,
+                                  lineage: 0, version: 0)
+        if keptSegments < segments.count {
+            let partial = Array(segments[keptSegments].prefix(row % PBCommitList.segmentSize))
+            prefix = prefix.appending(partial, lineage: 0)
+        }
+        return prefix.appending(commits, lineage: PBCommitList.nextLineage())
+    }
+
+    /// `commit` followed by this list, as a new lineage. Every segment
+    /// shifts, so this copies the list; it is only used for single commits
+    /// made from GitX, and off the main thread.
+    @objc(listByPrependingCommit:)
+    func prepending(_ commit: PBGitCommit) -> PBCommitList {
+        let list = PBCommitList.list(with: [commit] + allCommits)
+        return PBCommitList(segments: list.segments, count: list.count,
+                            lineage: list.lineage, version: list.version, prependedTo: version)
+    }
+
+    private func appending(_ commits: [PBGitCommit], lineage: Int) -> PBCommitList {
+        var segments = self.segments
+        var remaining = commits[...]
+        if var last = segments.popLast() {
+            let room = PBCommitList.segmentSize - last.count
+            last.append(contentsOf: remaining.prefix(room))
+            remaining = remaining.dropFirst(room)
+            segments.append(last)
+        }
+        while !remaining.isEmpty {
+            segments.append(Array(remaining.prefix(PBCommitList.segmentSize)))
+            remaining = remaining.dropFirst(PBCommitList.segmentSize)
+        }
+        return PBCommitList(segments: segments, count: count + commits.count,
+                            lineage: lineage, version: PBCommitList.nextVersion())
+    }
+
+    private class func nextVersion() -> Int {
+        counterLock.lock()
+        defer { counterLock.unlock() }
+        lastVersion += 1
+        return lastVersion
+    }
+
+    private class func nextLineage() -> Int {
+        counterLock.lock()
+        defer { counterLock.unlock() }
+        lastLineage += 1
+        return lastLineage
+    }
+
+    // MARK: - NSFastEnumeration
+
+    func countByEnumerating(with state: UnsafeMutablePointer<NSFastEnumerationState>,
+                            objects buffer: AutoreleasingUnsafeMutablePointer<AnyObject?>,
+                            count length: Int) -> Int {
+        let start = Int(state.pointee.state)
+        guard start < count, length > 0 else {
+            return 0
+        }
+
+        // Hand out the rest of the current segment, up to what fits
+        let segment = segments[start / PBCommitList.segmentSize]
+        let offset = start % PBCommitList.segmentSize
+        let batch = min(segment.count - offset, length)
+        for index in 0..<batch {
+            buffer[index] = segment[offset + index]
+        }
+
+        state.pointee.state = UInt(start + batch)
+        state.pointee.itemsPtr = buffer
+        state.pointee.mutationsPtr = PBCommitList.mutations
+        return batch
+    }
+}
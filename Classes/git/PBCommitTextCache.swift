@@ -0,0 +1,227 @@
+import Foundation
+
+/// Subjects, messages and names of commits that were laid out without them
+/// (see `PBGitCommit.init(repository:sha:parents:commitDate:)`), read on
+/// demand from the commit objects through the blob store's persistent
+/// `cat-file --batch` readers.
+///
+/// Only the most recently used texts are kept, so memory follows what the
+/// history list has shown rather than how long the history is; the
+/// workspace memory budget can trim it further. Text never changes for a
+/// given commit, so nothing has to be invalidated on reload.
+@objcMembers
+@objc(PBCommitTextCache)
+final class PBCommitTextCache: NSObject, GitWorkspaceCache {
+    /// Posted on the main thread when texts queued with
+    /// `prefetchText(forSHAs:)` have been read.
+    static let didLoadTextNotification = Notification.Name("PBCommitTextCacheDidLoadText")
+
+    private final class Entry {
+        let sha: String
+        let text: PBCommitData
+        let cost: Int
+        var newer: Entry?
+        weak var older: Entry?
+
+        init(sha: String, text: PBCommitData) {
+            self.sha = sha
+            self.text = text
+            // Object overhead plus the strings, which are mostly ASCII
+            self.cost = 256 + (text.message?.utf8.count ?? 0) + (text.messageSummary?.utf8.count ?? 0)
+                + (text.authorName?.utf8.count ?? 0) + (text.committerName?.utf8.count ?? 0)
+        }
+    }
+
+    private weak var repository: PBGitRepository?
+    private let capacity: Int
+    private let lock = NSLock()
+    private var entries: [String: Entry] = [:]
+    private var bytesHeld = 0
+    // `oldest.newer` chains to `newest`; strong references run from old to new.
+    private var oldest: Entry?
+    private weak var newest: Entry?
+
+    private let prefetchQueue = DispatchQueue(label: "net.phere.gitx.commitTextPrefetch", qos: .utility)
+    private var prefetching = Set<String>()
+
+    @objc(initWithRepository:capacity:)
+    init(repository: PBGitRepository, capacity: Int) {
+        self.repository = repository
+        self.capacity = capacity
+        super.init()
+    }
+
+    @objc(containsTextForSHA:)
+    func containsText(forSHA sha: String) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return entries[sha] != nil
+    }
+
+    /// The text of `sha` if it has been read, without asking git.
+    @objc(cachedTextForSHA:)
+    func cachedText(forSHA sha: String) -> PBCommitData? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = entries[sha] else {
+            return nil
+        }
+        unlink(entry)
+        append(entry)
+        return entry.text
+    }
+
+    /// The text of `sha`, read from git right away if it isn't cached.
+    /// Callers showing many commits should `loadText(forSHAs:)` first so
+    /// they are read in one batch.
+    @objc(textForSHA:)
+    func text(forSHA sha: String) -> PBCommitData? {
+        if let text = cachedText(forSHA: sha) {
+            return text
+        }
+        loadText(forSHAs: [sha])
+        return cachedText(forSHA: sha)
+    }
+
+    /// Reads the text of every commit in `shas` that isn't cached, in one
+    /// batch, before returning.
+    @objc(loadTextForSHAs:)
+    func loadText(forSHAs shas: [String]) {
+        let missing = shas.filter { !containsText(forSHA: $0) }
+        guard !missing.isEmpty, let repository else {
+            return
+        }
+
+        do {
+            let texts = try PBGitBlobStore.shared.commitData(forSHAs: missing, in: repository)
+            lock.lock()
+            for (sha, text) in texts {
+                insert(text, forSHA: sha)
+            }
+            lock.unlock()
+            GitWorkspace.shared.setNeedsBudgetCheck()
+        } catch {
+            NSLog("Could not read commit messages: %@", error.localizedDescription)
+        }
+    }
+
+    /// Queues `shas` to be read in the background, e.g. the rows just
+    /// outside the visible part of the history list.
+    @objc(prefetchTextForSHAs:)
+    func prefetchText(forSHAs shas: [String]) {
+        lock.lock()
+        let wanted = shas.filter { entries[$0] == nil && !prefetching.contains($0) }
+        prefetching.formUnion(wanted)
+        lock.unlock()
+        guard !wanted.isEmpty else {
+            return
+        }
+
+        prefetchQueue.async { [weak self] in
+            guard let self else { return }
+            self.loadText(forSHAs: wanted)
+            self.lock.lock()
+            self.prefetching.subtract(wanted)
+            self.lock.unlock()
+            DispatchQueue.main.async {
+                NotificationCenter.default.post(name: PBCommitTextCache.didLoadTextNotification, object: self)
+            }
+        }
+    }
+
+    /// Reads the text of each commit in `shas` and passes it to `handler`
+    /// without caching it, for one-off passes over the whole history such
+    /// as a search. Setting the handler's `stop` argument ends the pass
+    /// after the current commit.
+    @objc(enumerateTextForSHAs:error:handler:)
+    func enumerateText(forSHAs shas: [String], handler: (String, PBCommitData, UnsafeMutablePointer<ObjCBool>) -> Void) throws {
+        guard let repository else {
+            return
+        }
+        let batchSize = 4096
+        var start = 0
+        while start < shas.count {
+            let batch = Array(shas[start..<min(start + batchSize, shas.count)])
+            let texts = try PBGitBlobStore.shared.commitData(forSHAs: batch, in: repository)
+            var stop: ObjCBool = false
+            for sha in batch {
+                if let text = texts[sha] {
+                    handler(sha, text, &stop)
+                    if stop.boolValue {
+                        return
+                    }
+                }
+            }
+            start += batch.count
+        }
+    }
+
+    // MARK: - GitWorkspaceCache
+
+    var workspaceCacheCost: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return bytesHeld
+    }
+
+    @objc(trimWorkspaceCacheToCost:)
+    func trimWorkspaceCache(toCost cost: Int) {
+        lock.lock()
+        defer { lock.unlock() }
+        evict { bytesHeld > cost }
+    }
+
+    // MARK: - LRU
+
+    /// Called with `lock` held.
+    private func insert(_ text: PBCommitData, forSHA sha: String) {
+        if let existing = entries[sha] {
+            unlink(existing)
+            bytesHeld -= existing.cost
+        }
+        let entry = Entry(sha: sha, text: text)
+        entries[sha] = entry
+        append(entry)
+        bytesHeld += entry.cost
+
+        evict { entries.count > capacity }
+    }
+
+    /// Drops the oldest entries while `overLimit` holds. Called with `lock`
+    /// held.
+    private func evict(while overLimit: () -> Bool) {
+        while overLimit(), let victim = oldest {
+            unlink(victim)
+            entries[victim.sha] = nil
+            bytesHeld -= victim.cost
+        }
+    }
+
+    private func append(_ entry: Entry) {
+        entry.older = newest
+        entry.newer = nil
+        if let newest {
+            newest.newer = entry
+        } else {
+            oldest = entry
+        }
+        newest = entry
+    }
+
+    private func unlink(_ entry: Entry) {
+        let older = entry.older
+        let newer = entry.newer
+        if let older {
+            older.newer = newer
+        } else {
+            oldest = newer
+        }
+        if let newer {
+            newer.older = older
+        } else {
+            newest = older
+        }
+        entry.older = nil
+        entry.newer = nil
+    }
+}
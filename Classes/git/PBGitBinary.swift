@@ -17,6 +17,7 @@ final class PBGitBinary: NSObject {
     private static var cachedPath: String?
     private static var cachedError: NSError?
     private static var cachedUserConfiguredPath: String?
+    private static var cachedVersion: String?
 
     // MARK: - Public Class Methods
 
@@ -27,10 +28,10 @@ final class PBGitBinary: NSObject {
 
     /// Returns the git version string, or nil if git is not found.
     @objc class func gitVersion() -> String? {
-        guard let gitPath = resolveGitPath(nil) else {
+        guard resolveGitPath(nil) != nil else {
             return nil
         }
-        return versionForPath(gitPath)
+        return resolutionQueue.sync { cachedVersion }
     }
 
     /// Returns the list of standard locations to search for git.
@@ -79,7 +80,8 @@ final class PBGitBinary: NSObject {
             if cachedPath == nil && cachedError == nil {
                 var localError: NSError?
                 let resolved = locateGit(&localError)
-                cachedPath = resolved
+                cachedPath = resolved?.path
+                cachedVersion = resolved?.version
                 cachedError = localError
             }
 
@@ -100,12 +102,13 @@ final class PBGitBinary: NSObject {
             cachedPath = nil
             cachedError = nil
             cachedUserConfiguredPath = nil
+            cachedVersion = nil
         }
     }
 
     // MARK: - Private Helpers
 
-    private class func locateGit(_ error: NSErrorPointer) -> String? {
+    private class func locateGit(_ error: NSErrorPointer) -> (path: String, version: String)? {
         // 1. Check user-configured path
         if let userConfigured = UserDefaults.standard.string(forKey: "gitExecutable") {
             if let resolved = validatedExecutable(at: userConfigured) {
@@ -124,9 +127,9 @@ final class PBGitBinary: NSObject {
             }
         }
 
-        // 3. Use 'which git'
-        if let whichPath = PBEasyPipe.outputForCommand("/usr/bin/which", withArgs: ["git"]) {
-            if let resolved = validatedExecutable(at: whichPath) {
+        // 3. Search PATH, as `which git` would, without starting a process
+        for directory in (ProcessInfo.processInfo.environment["PATH"] ?? "").split(separator: ":") {
+            if let resolved = validatedExecutable(at: (String(directory) as NSString).appendingPathComponent("git")) {
                 return resolved
             }
         }
@@ -159,7 +162,8 @@ final class PBGitBinary: NSObject {
         return nil
     }
 
-    private class func validatedExecutable(at candidate: String) -> String? {
+    /// The standardized path and version of `candidate` if it runs as git.
+    private class func validatedExecutable(at candidate: String) -> (path: String, version: String)? {
         guard let standardized = sanitizedPath(candidate), !standardized.isEmpty else {
             return nil
         }
@@ -168,11 +172,11 @@ final class PBGitBinary: NSObject {
             return nil
         }
 
-        guard versionForPath(standardized) != nil else {
+        guard let version = versionForPath(standardized) else {
             return nil
         }
 
-        return standardized
+        return (standardized, version)
     }
 
     private class func sanitizedPath(_ candidate: String) -> String? {
@@ -0,0 +1,837 @@
+import Foundation
+
+/// Object id and size of a blob, known before any of its contents are read.
+@objcMembers
+@objc(PBGitBlobInfo)
+final class PBGitBlobInfo: NSObject {
+    let oid: String
+    let size: Int
+
+    init(oid: String, size: Int) {
+        self.oid = oid
+        self.size = size
+        super.init()
+    }
+}
+
+/// A whole object read by `PBGitBlobStore.readObjects`.
+struct PBGitObject {
+    let type: String
+    let contents: Data
+}
+
+/// Serves blob contents to the `gitx://` scheme handler.
+///
+/// Each repository gets a small pool of long-lived `git cat-file --batch-check`
+/// and `--batch` processes, so loading a blob is a round trip over a pipe
+/// rather than a process launch. Contents are cached by object id under a byte
+/// budget, which the workspace memory budget can shrink further; blobs are
+/// immutable, so entries never need invalidating. Blobs too large for that
+/// are kept in temporary files once a range from the middle of one is asked
+/// for, since more ranges usually follow.
+@objcMembers
+@objc(PBGitBlobStore)
+final class PBGitBlobStore: NSObject, GitWorkspaceCache {
+    static let shared: PBGitBlobStore = {
+        let store = PBGitBlobStore(readersPerRepository: 4, cacheByteLimit: 64 << 20)
+        GitWorkspace.shared.register(store, for: nil)
+        return store
+    }()
+
+    /// Blobs larger than this are streamed through without being cached in
+    /// memory.
+    let cacheableBlobLimit: Int
+    let readersPerRepository: Int
+
+    private let lock = NSLock()
+    private var pools: [String: ReaderPool] = [:]
+    private let cache: BlobCache
+    private let spill = BlobSpill(byteLimit: PBGitBlobStore.spillByteLimit)
+    /// "<commit>:<path>" -> blob, for specifiers that name a full object id
+    /// and therefore always resolve the same way.
+    private var resolvedSpecifiers: [String: PBGitBlobInfo] = [:]
+    private let resolvedSpecifierLimit = 4096
+
+    private static let chunkSize = 64 * 1024
+    /// Requests written at once by `readObjects`; small enough to fit in the
+    /// pipe while git is still busy writing answers.
+    private static let objectBatchSize = 128
+    private static let idleReaderTimeout: TimeInterval = 30
+    private static let spillByteLimit = 1 << 30
+
+    init(readersPerRepository: Int, cacheByteLimit: Int) {
+        self.readersPerRepository = max(1, readersPerRepository)
+        self.cache = BlobCache(byteLimit: cacheByteLimit)
+        self.cacheableBlobLimit = cacheByteLimit / 8
+        super.init()
+    }
+
+    /// Reads the blob named by `specifier` (anything `git cat-file` accepts,
+    /// usually "<commit>:<path>"). `rangeForBlob` is called once the blob's size
+    /// is known and returns the byte range to deliver, or a location of
+    /// NSNotFound to deliver nothing. The range's bytes are then passed to
+    /// `chunkHandler` in order; returning false stops delivery.
+    @objc(readBlob:inRepository:rangeForBlob:chunkHandler:error:)
+    func readBlob(_ specifier: String,
+                  in repository: PBGitRepository,
+                  rangeForBlob: (PBGitBlobInfo) -> NSRange,
+                  chunkHandler: (Data) -> Bool) throws {
+        guard !specifier.isEmpty, !specifier.contains("\n") else {
+            throw blobError(code: .invalidArguments, description: "Invalid blob specifier")
+        }
+
+        let pool = try readerPool(for: repository)
+        let info = try resolve(specifier, in: pool)
+
+        let range = rangeForBlob(info)
+        guard range.location != NSNotFound else {
+            return
+        }
+        let wanted = clamp(range, toSize: info.size)
+
+        if let contents = cache.contents(forOID: info.oid) ?? spill.contents(forOID: info.oid) {
+            deliver(contents, range: wanted, to: chunkHandler)
+            return
+        }
+
+        // Otherwise each "bytes=N-" of a large blob (a player seeking through
+        // a video) reads it from the start again. Those run to the end of the
+        // blob anyway, so writing all of it out doesn't hold up the request.
+        let spillFile = info.size > cacheableBlobLimit && wanted.location > 0 && NSMaxRange(wanted) == info.size
+            ? spill.beginFile(forOID: info.oid, size: info.size)
+            : nil
+
+        try pool.withReader { reader in
+            try reader.readContents(of: info,
+                                    range: wanted,
+                                    keepingCopy: info.size <= cacheableBlobLimit,
+                                    spillingTo: spillFile,
+                                    chunkHandler: chunkHandler) { contents in
+                cache.insert(contents, forOID: info.oid)
+                GitWorkspace.shared.setNeedsBudgetCheck()
+            }
+        }
+    }
+
+    /// Type and contents of each object in `oids` that exists, through the
+    /// same readers as blobs. Meant for small objects such as commits and
+    /// tags, so nothing is cached. Requests go out a batch at a time so git
+    /// answers them back to back.
+    func readObjects(_ oids: [String], in repository: PBGitRepository) throws -> [String: PBGitObject] {
+        let wanted = oids.filter { PBGitBlobStore.isObjectID($0) }
+        guard !wanted.isEmpty else {
+            return [:]
+        }
+
+        let pool = try readerPool(for: repository)
+        var objects: [String: PBGitObject] = [:]
+        var start = 0
+        while start < wanted.count {
+            let batch = Array(wanted[start..<min(start + PBGitBlobStore.objectBatchSize, wanted.count)])
+            try pool.withReader { reader in
+                try reader.readObjects(batch) { oid, object in
+                    objects[oid] = object
+                }
+            }
+            start += batch.count
+        }
+        return objects
+    }
+
+    /// Subject, message, names and parents of each commit in `shas`, read
+    /// from the commit objects.
+    @objc(commitDataForSHAs:inRepository:error:)
+    func commitData(forSHAs shas: [String], in repository: PBGitRepository) throws -> [String: PBCommitData] {
+        var commits: [String: PBCommitData] = [:]
+        for (sha, object) in try readObjects(shas, in: repository) where object.type == "commit" {
+            commits[sha] = PBCommitData(sha: sha, commitObject: object.contents)
+        }
+        return commits
+    }
+
+    // MARK: - GitWorkspaceCache
+
+    var workspaceCacheCost: Int {
+        return cache.byteCount
+    }
+
+    @objc(trimWorkspaceCacheToCost:)
+    func trimWorkspaceCache(toCost cost: Int) {
+        cache.trim(toBytes: cost)
+    }
+
+    /// Terminates idle reader processes, e.g. when a repository window closes.
+    func closeIdleReaders() {
+        lock.lock()
+        let allPools = Array(pools.values)
+        lock.unlock()
+        allPools.forEach { $0.closeIdleReaders(olderThan: 0) }
+    }
+
+    // MARK: - Resolution
+
+    private func resolve(_ specifier: String, in pool: ReaderPool) throws -> PBGitBlobInfo {
+        let immutable = PBGitBlobStore.namesFixedObject(specifier)
+        if immutable {
+            lock.lock()
+            let known = resolvedSpecifiers[specifier]
+            lock.unlock()
+            if let known {
+                return known
+            }
+        }
+
+        let info = try pool.withReader { reader in
+            try reader.resolve(specifier)
+        }
+
+        if immutable {
+            lock.lock()
+            if resolvedSpecifiers.count >= resolvedSpecifierLimit {
+                resolvedSpecifiers.removeAll(keepingCapacity: true)
+            }
+            resolvedSpecifiers[specifier] = info
+            lock.unlock()
+        }
+        return info
+    }
+
+    /// Whether `specifier` starts with a full object id, so the path it names
+    /// can't change underneath us the way "HEAD:<path>" can.
+    private class func namesFixedObject(_ specifier: String) -> Bool {
+        guard let colon = specifier.firstIndex(of: ":") else {
+            return false
+        }
+        return isObjectID(specifier[..<colon])
+    }
+
+    private class func isObjectID<S: StringProtocol>(_ name: S) -> Bool {
+        return (name.count == 40 || name.count == 64) && name.allSatisfy { $0.isHexDigit }
+    }
+
+    // MARK: - Delivery
+
+    private func clamp(_ range: NSRange, toSize size: Int) -> NSRange {
+        let start = min(range.location, size)
+        return NSRange(location: start, length: min(range.length, size - start))
+    }
+
+    private func deliver(_ contents: Data, range: NSRange, to chunkHandler: (Data) -> Bool) {
+        var offset = range.location
+        let end = range.location + range.length
+        while offset < end {
+            let next = min(offset + PBGitBlobStore.chunkSize, end)
+            if !chunkHandler(contents.subdata(in: offset..<next)) {
+                return
+            }
+            offset = next
+        }
+    }
+
+    // MARK: - Reader pools
+
+    private func readerPool(for repository: PBGitRepository) throws -> ReaderPool {
+        guard let gitPath = PBGitBinary.path(), !gitPath.isEmpty else {
+            throw blobError(code: .gitNotFound, description: "Git binary not found")
+        }
+        guard let workingDirectory = repository.workingDirectory() else {
+            throw blobError(code: .invalidRepository, description: "Repository has no directory to run git in")
+        }
+
+        let key = repository.gitURL()?.path ?? workingDirectory
+        lock.lock()
+        defer { lock.unlock() }
+        if let pool = pools[key] {
+            return pool
+        }
+        let pool = ReaderPool(gitPath: gitPath,
+                              workingDirectory: workingDirectory,
+                              capacity: readersPerRepository,
+                              idleTimeout: PBGitBlobStore.idleReaderTimeout)
+        pools[key] = pool
+        return pool
+    }
+}
+
+// MARK: -
+
+private func blobError(code: PBGitErrorCode, description: String) -> NSError {
+    NSError(domain: "PBGitRepositoryErrorDomain",
+            code: code.rawValue,
+            userInfo: [NSLocalizedDescriptionKey: description])
+}
+
+/// At most `capacity` readers per repository; callers beyond that wait for
+/// one to be handed back. A reader that fails mid-request is discarded,
+/// since its pipes may be out of step with the protocol.
+private final class ReaderPool {
+    private let gitPath: String
+    private let workingDirectory: String
+    private let idleTimeout: TimeInterval
+    private let slots: DispatchSemaphore
+    private let lock = NSLock()
+    private var idle: [(reader: BatchReader, since: Date)] = []
+
+    init(gitPath: String, workingDirectory: String, capacity: Int, idleTimeout: TimeInterval) {
+        self.gitPath = gitPath
+        self.workingDirectory = workingDirectory
+        self.idleTimeout = idleTimeout
+        self.slots = DispatchSemaphore(value: capacity)
+    }
+
+    func withReader<T>(_ body: (BatchReader) throws -> T) throws -> T {
+        slots.wait()
+        defer { slots.signal() }
+
+        lock.lock()
+        let reader = idle.popLast()?.reader ?? BatchReader(gitPath: gitPath, workingDirectory: workingDirectory)
+        lock.unlock()
+
+        do {
+            let result = try body(reader)
+            checkIn(reader)
+            return result
+        } catch {
+            reader.close()
+            throw error
+        }
+    }
+
+    func closeIdleReaders(olderThan age: TimeInterval) {
+        let cutoff = Date(timeIntervalSinceNow: -age)
+        lock.lock()
+        let expired = idle.filter { $0.since <= cutoff }.map(\.reader)
+        idle.removeAll { $0.since <= cutoff }
+        lock.unlock()
+        expired.forEach { $0.close() }
+    }
+
+    private func checkIn(_ reader: BatchReader) {
+        guard reader.isUsable else {
+            reader.close()
+            return
+        }
+        lock.lock()
+        idle.append((reader, Date()))
+        lock.unlock()
+
+        DispatchQueue.global(qos: .utility).asyncAfter(deadline: .now() + idleTimeout) { [weak self] in
+            guard let self else { return }
+            self.closeIdleReaders(olderThan: self.idleTimeout)
+        }
+    }
+}
+
+/// One `--batch-check` process for resolving names to blobs and one `--batch`
+/// process for contents, both started on first use.
+private final class BatchReader {
+    private let gitPath: String
+    private let workingDirectory: String
+    private var checker: BatchProcess?
+    private var contents: BatchProcess?
+    private(set) var isUsable = true
+
+    init(gitPath: String, workingDirectory: String) {
+        self.gitPath = gitPath
+        self.workingDirectory = workingDirectory
+    }
+
+    func resolve(_ specifier: String) throws -> PBGitBlobInfo {
+        let process = try batchProcess(&checker, mode: "--batch-check")
+        let header = try process.request(specifier)
+        return try parseHeader(header, for: specifier)
+    }
+
+    /// Reads the contents of `info`, passing the bytes inside `range` to
+    /// `chunkHandler`. If `keepingCopy`, the whole blob is read even after
+    /// the handler stops and is handed to `completion` for caching; so it is
+    /// with a `spillFile`, which gets every byte and is finished at the end.
+    /// Otherwise a stopped read abandons the process.
+    func readContents(of info: PBGitBlobInfo,
+                      range: NSRange,
+                      keepingCopy: Bool,
+                      spillingTo spillFile: SpillFile?,
+                      chunkHandler: (Data) -> Bool,
+                      completion: (Data) -> Void) throws {
+        let process = try batchProcess(&contents, mode: "--batch")
+        let header = try process.request(info.oid)
+        let reported = try parseHeader(header, for: info.oid)
+        guard reported.size == info.size else {
+            throw blobError(code: .commandFailed, description: "Blob size changed while reading \(info.oid)")
+        }
+
+        var copy = keepingCopy ? Data(capacity: info.size) : nil
+        var spilling = spillFile
+        var offset = 0
+        var delivering = true
+        let rangeEnd = range.location + range.length
+
+        let finished = try process.read(count: info.size) { chunk in
+            let chunkStart = offset
+            offset += chunk.count
+            copy?.append(chunk)
+            if let file = spilling, !file.write(chunk) {
+                spilling = nil
+            }
+
+            if delivering {
+                let start = max(chunkStart, range.location)
+                let end = min(offset, rangeEnd)
+                if start < end {
+                    delivering = chunkHandler(chunk.subdata(in: (start - chunkStart)..<(end - chunkStart)))
+                }
+                if offset >= rangeEnd {
+                    delivering = false
+                }
+            }
+            return delivering || copy != nil || spilling != nil
+        }
+
+        guard finished else {
+            // Contents are still in the pipe; this process can't be reused.
+            isUsable = false
+            return
+        }
+        try process.skipLineTerminator()
+
+        if let copy {
+            completion(copy)
+        }
+        spilling?.finish()
+    }
+
+    /// Writes all of `oids` as one request, then passes each object that
+    /// exists to `handler` as its answer arrives.
+    func readObjects(_ oids: [String], handler: (String, PBGitObject) -> Void) throws {
+        let process = try batchProcess(&contents, mode: "--batch")
+        try process.send(oids)
+        for oid in oids {
+            // "<oid> <type> <size>", or "<oid> missing" with nothing after it
+            let fields = try process.readHeader().split(separator: " ")
+            guard fields.count == 3, let size = Int(fields[2]) else {
+                continue
+            }
+            var body = Data(capacity: size)
+            _ = try process.read(count: size) { chunk in
+                body.append(chunk)
+                return true
+            }
+            try process.skipLineTerminator()
+            handler(oid, PBGitObject(type: String(fields[1]), contents: body))
+        }
+    }
+
+    func close() {
+        isUsable = false
+        checker?.terminate()
+        contents?.terminate()
+        checker = nil
+        contents = nil
+    }
+
+    private func batchProcess(_ slot: inout BatchProcess?, mode: String) throws -> BatchProcess {
+        if let slot {
+            return slot
+        }
+        let process = try BatchProcess(gitPath: gitPath, arguments: ["cat-file", mode], workingDirectory: workingDirectory)
+        slot = process
+        return process
+    }
+
+    /// "<oid> <type> <size>", or "<name> missing" / "<name> ambiguous".
+    private func parseHeader(_ header: String, for name: String) throws -> PBGitBlobInfo {
+        let fields = header.split(separator: " ")
+        guard fields.count == 3, let size = Int(fields[2]) else {
+            throw blobError(code: .invalidRef, description: "No blob named \(name)")
+        }
+        guard fields[1] == "blob" else {
+            throw blobError(code: .invalidRef, description: "\(name) is a \(fields[1]), not a blob")
+        }
+        return PBGitBlobInfo(oid: String(fields[0]), size: size)
+    }
+}
+
+/// A `git cat-file` process driven over its standard input and output.
+private final class BatchProcess {
+    private let process = Process()
+    private let inputDescriptor: Int32
+    private let outputDescriptor: Int32
+    private var buffer = Data()
+    // Keeps the descriptors open for the lifetime of the process.
+    private let inputPipe = Pipe()
+    private let outputPipe = Pipe()
+
+    init(gitPath: String, arguments: [String], workingDirectory: String) throws {
+        process.executableURL = URL(fileURLWithPath: gitPath)
+        process.arguments = arguments
+        process.currentDirectoryURL = URL(fileURLWithPath: workingDirectory)
+        process.standardInput = inputPipe
+        process.standardOutput = outputPipe
+        process.standardError = FileHandle.nullDevice
+
+        inputDescriptor = inputPipe.fileHandleForWriting.fileDescriptor
+        outputDescriptor = outputPipe.fileHandleForReading.fileDescriptor
+        // A reader that died should surface as a write error, not kill the app.
+        _ = fcntl(inputDescriptor, F_SETNOSIGPIPE, 1)
+
+        do {
+            try process.run()
+        } catch {
+            throw blobError(code: .commandFailed, description: "Could not start git cat-file: \(error.localizedDescription)")
+        }
+    }
+
+    deinit {
+        terminate()
+    }
+
+    /// Writes `line` and returns the header line git answers with.
+    func request(_ line: String) throws -> String {
+        try send([line])
+        return try readHeader()
+    }
+
+    /// Writes one request per line without waiting for the answers.
+    func send(_ lines: [String]) throws {
+        try write(Data((lines.joined(separator: "\n") + "\n").utf8))
+    }
+
+    /// The next header line git answers with.
+    func readHeader() throws -> String {
+        guard let header = try readLine() else {
+            throw blobError(code: .commandFailed, description: "git cat-file exited unexpectedly")
+        }
+        return header
+    }
+
+    /// Passes exactly `count` bytes to `handler` as they arrive. Returns false
+    /// if the handler asked to stop before all of them were read.
+    func read(count: Int, handler: (Data) -> Bool) throws -> Bool {
+        var remaining = count
+        while remaining > 0 {
+            if buffer.isEmpty {
+                try fill()
+            }
+            let take = min(remaining, buffer.count)
+            let chunk = buffer.prefix(take)
+            buffer.removeFirst(take)
+            remaining -= take
+            if !handler(Data(chunk)) {
+                return remaining == 0
+            }
+        }
+        return true
+    }
+
+    func skipLineTerminator() throws {
+        if buffer.isEmpty {
+            try fill()
+        }
+        guard buffer.first == UInt8(ascii: "\n") else {
+            throw blobError(code: .commandFailed, description: "Unexpected output from git cat-file")
+        }
+        buffer.removeFirst()
+    }
+
+    func terminate() {
+        if process.isRunning {
+            try? inputPipe.fileHandleForWriting.close()
+            process.terminate()
+        }
+    }
+
+    private func readLine() throws -> String? {
+        while true {
+            if let newline = buffer.firstIndex(of: UInt8(ascii: "\n")) {
+                let line = String(decoding: buffer[buffer.startIndex..<newline], as: UTF8.self)
+                buffer.removeSubrange(buffer.startIndex...newline)
+                return line
+            }
+            do {
+                try fill()
+            } catch {
+                return nil
+            }
+        }
+    }
+
+    private func fill() throws {
+        var chunk = [UInt8](repeating: 0, count: 64 * 1024)
+        while true {
+            let count = Darwin.read(outputDescriptor, &chunk, chunk.count)
+            if count > 0 {
+                buffer.append(chunk, count: count)
+                return
+            }
+            if count < 0 && errno == EINTR {
+                continue
+            }
+            throw blobError(code: .commandFailed, description: "git cat-file exited unexpectedly")
+        }
+    }
+
+    private func write(_ data: Data) throws {
+        try data.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) in
+            var offset = 0
+            while offset < bytes.count {
+                let written = Darwin.write(inputDescriptor, bytes.baseAddress! + offset, bytes.count - offset)
+                if written < 0 {
+                    if errno == EINTR {
+                        continue
+                    }
+                    throw blobError(code: .commandFailed, description: "git cat-file is not accepting requests")
+                }
+                offset += written
+            }
+        }
+    }
+}
+
+/// Least recently used blob contents, evicted once their total size passes
+/// the byte limit.
+private final class BlobCache {
+    private final class Entry {
+        let oid: String
+        let contents: Data
+        var newer: Entry?
+        weak var older: Entry?
+
+        init(oid: String, contents: Data) {
+            self.oid = oid
+            self.contents = contents
+        }
+    }
+
+    private let byteLimit: Int
+    private let lock = NSLock()
+    private var entries: [String: Entry] = [:]
+    private var bytesHeld = 0
+    // `oldest.newer` chains to `newest`; strong references run from old to new.
+    private var oldest: Entry?
+    private weak var newest: Entry?
+
+    init(byteLimit: Int) {
+        self.byteLimit = byteLimit
+    }
+
+    func contents(forOID oid: String) -> Data? {
+        lock.lock()
+        defer { lock.unlock() }
+        guard let entry = entries[oid] else {
+            return nil
+        }
+        unlink(entry)
+        append(entry)
+        return entry.contents
+    }
+
+    func insert(_ contents: Data, forOID oid: String) {
+        guard contents.count <= byteLimit else {
+            return
+        }
+        lock.lock()
+        defer { lock.unlock() }
+        if let existing = entries[oid] {
+            unlink(existing)
+            bytesHeld -= existing.contents.count
+        }
+
+        let entry = Entry(oid: oid, contents: contents)
+        entries[oid] = entry
+        append(entry)
+        bytesHeld += contents.count
+
+        evict(downTo: byteLimit)
+    }
+
+    var byteCount: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return bytesHeld
+    }
+
+    func trim(toBytes limit: Int) {
+        lock.lock()
+        defer { lock.unlock() }
+        evict(downTo: limit)
+    }
+
+    /// Called with `lock` held.
+    private func evict(downTo limit: Int) {
+        while bytesHeld > limit, let victim = oldest {
+            unlink(victim)
+            entries[victim.oid] = nil
+            bytesHeld -= victim.contents.count
+        }
+    }
+
+    private func append(_ entry: Entry) {
+        entry.older = newest
+        entry.newer = nil
+        if let newest {
+            newest.newer = entry
+        } else {
+            oldest = entry
+        }
+        newest = entry
+    }
+
+    private func unlink(_ entry: Entry) {
+        let older = entry.older
+        let newer = entry.newer
+        if let older {
+            older.newer = newer
+        } else {
+            oldest = newer
+        }
+        if let newer {
+            newer.older = older
+        } else {
+            newest = older
+        }
+        entry.older = nil
+        entry.newer = nil
+    }
+}
+
+/// Blobs too large for `BlobCache`, in temporary files that are mapped to
+/// serve later ranges. Least recently used files are removed once their
+/// total size passes the byte limit; the rest go with the process.
+private final class BlobSpill {
+    private let directory: String
+    private let byteLimit: Int
+    private let lock = NSLock()
+    private var sizes: [String: Int] = [:]
+    /// Least recently used first
+    private var order: [String] = []
+    private var writing = Set<String>()
+    private var bytesHeld = 0
+
+    init(byteLimit: Int) {
+        self.byteLimit = byteLimit
+        self.directory = (NSTemporaryDirectory() as NSString).appendingPathComponent("net.phere.gitx.blobs-\(getpid())")
+    }
+
+    deinit {
+        try? FileManager.default.removeItem(atPath: directory)
+    }
+
+    func contents(forOID oid: String) -> Data? {
+        lock.lock()
+        let spilled = sizes[oid] != nil
+        if spilled {
+            order.removeAll { $0 == oid }
+            order.append(oid)
+        }
+        lock.unlock()
+        guard spilled else {
+            return nil
+        }
+        // Removed in the meantime: the caller reads it from git instead
+        return try? Data(contentsOf: URL(fileURLWithPath: path(for: oid)), options: .alwaysMapped)
+    }
+
+    /// A file to write all of `oid` to, or nil when it is too large, already
+    /// spilled or being written by another read.
+    func beginFile(forOID oid: String, size: Int) -> SpillFile? {
+        guard size <= byteLimit else {
+            return nil
+        }
+        lock.lock()
+        let begin = sizes[oid] == nil && writing.insert(oid).inserted
+        lock.unlock()
+        guard begin else {
+            return nil
+        }
+
+        try? FileManager.default.createDirectory(atPath: directory, withIntermediateDirectories: true)
+        let partial = path(for: oid) + ".partial"
+        let descriptor = open(partial, O_WRONLY | O_CREAT | O_TRUNC, 0o600)
+        guard descriptor >= 0 else {
+            finishFile(forOID: oid, size: nil)
+            return nil
+        }
+        return SpillFile(descriptor: descriptor) { [weak self] complete in
+            self?.finishFile(forOID: oid, size: complete ? size : nil)
+        }
+    }
+
+    /// Keeps a complete file, evicting older ones, or removes a partial one.
+    private func finishFile(forOID oid: String, size: Int?) {
+        let partial = path(for: oid) + ".partial"
+        lock.lock()
+        defer { lock.unlock() }
+        writing.remove(oid)
+        guard let size, Darwin.rename(partial, path(for: oid)) == 0 else {
+            Darwin.unlink(partial)
+            return
+        }
+        sizes[oid] = size
+        order.append(oid)
+        bytesHeld += size
+
+        // Under the lock, so a file being spilled again can't be removed
+        while bytesHeld > byteLimit, let victim = order.first {
+            order.removeFirst()
+            bytesHeld -= sizes.removeValue(forKey: victim) ?? 0
+            Darwin.unlink(path(for: victim))
+        }
+    }
+
+    private func path(for oid: String) -> String {
+        return (directory as NSString).appendingPathComponent(oid)
+    }
+}
+
+/// A blob being written out for `BlobSpill`; thrown away unless finished.
+private final class SpillFile {
+    private var descriptor: Int32
+    private let completion: (Bool) -> Void
+
+    init(descriptor: Int32, completion: @escaping (Bool) -> Void) {
+        self.descriptor = descriptor
+        self.completion = completion
+    }
+
+    deinit {
+        close(complete: false)
+    }
+
+    /// Appends `data`; false if it couldn't, and the file is given up.
+    func write(_ data: Data) -> Bool {
+        guard descriptor >= 0 else {
+            return false
+        }
+        let written = data.withUnsafeBytes { (bytes: UnsafeRawBufferPointer) -> Bool in
+            var offset = 0
+            while offset < bytes.count {
+                let count = Darwin.write(descriptor, bytes.baseAddress! + offset, bytes.count - offset)
+                if count < 0 {
+                    if errno == EINTR {
+                        continue
+                    }
+                    return false
+                }
+                offset += count
+            }
+            return true
+        }
+        if !written {
+            close(complete: false)
+        }
+        return written
+    }
+
+    func finish() {
+        close(complete: true)
+    }
+
+    private func close(complete: Bool) {
+        guard descriptor >= 0 else {
+            return
+        }
+        let closed = Darwin.close(descriptor) == 0
+        descriptor = -1
+        completion(complete && closed)
+    }
+}
@@ -13,6 +13,9 @@ final class PBGitCommit: NSObject, PBGitRefish {
     }
 
     private var cachedPatch: String?
+    private var cachedDateColumn: (day: Int, text: String)?
+    private weak var decorationSource: PBGitDecorationIndex?
+    private var cachedDecoration: PBGitCommitDecoration?
 
     var sign: Int8 = 0
     var lineInfo: PBGraphCellInfo?
@@ -40,10 +43,55 @@ final class PBGitCommit: NSObject, PBGitRefish {
         super.init()
     }
 
+    /// A commit placed from the commit-graph file: its position in history is
+    /// known but its message and names are only read, through the
+    /// repository's `commitTexts`, when something asks for them.
+    @objc(initWithRepository:sha:parents:commitDate:)
+    init(repository: PBGitRepository?, sha: String, parents: [String], commitDate: Date) {
+        self.repositoryRef = repository
+        self.commitData = PBCommitData(sha: sha,
+                                       shortSHA: PBGitCommit.shortSha(for: sha),
+                                       message: nil,
+                                       messageSummary: nil,
+                                       commitDate: commitDate,
+                                       authorName: nil,
+                                       committerName: nil,
+                                       parentSHAs: parents)
+        super.init()
+    }
+
     var repository: PBGitRepository? {
         repositoryRef
     }
 
+    /// Whether asking for the subject would have to read the commit from
+    /// git, for callers that want to read a whole window of rows at once.
+    var needsText: Bool {
+        guard commitData.messageSummary == nil, let texts = repository?.commitTexts else {
+            return false
+        }
+        return !texts.containsText(forSHA: sha)
+    }
+
+    /// Where the message and names come from: this commit's own data when
+    /// it was listed with them, otherwise the repository's text cache. A
+    /// text that hasn't been read yet isn't waited for: it is queued to be
+    /// read, the getters below return empty strings meanwhile, and the cache
+    /// posts `didLoadTextNotification` once it is there.
+    private var text: PBCommitData? {
+        if commitData.messageSummary != nil {
+            return commitData
+        }
+        guard let texts = repository?.commitTexts else {
+            return nil
+        }
+        if let text = texts.cachedText(forSHA: sha) {
+            return text
+        }
+        texts.prefetchText(forSHAs: [sha])
+        return nil
+    }
+
     var sha: String {
         commitData.sha ?? ""
     }
@@ -57,29 +105,60 @@ final class PBGitCommit: NSObject, PBGitRefish {
     }
 
     func dateString() -> String {
-        let formatter = DateFormatter()
-        formatter.dateFormat = "yyyy-MM-dd HH:mm:ss"
-        return formatter.string(from: date)
+        PBCommitDateColumnFormatter.timestampFormatter.string(from: date)
+    }
+
+    /// The history list's date column text. Cached per commit and tagged with
+    /// the day it was formatted on, so it is only recomputed after midnight.
+    var dateColumnString: String {
+        let today = PBCommitDateColumnFormatter.today()
+        if let cachedDateColumn, cachedDateColumn.day == today.stamp {
+            return cachedDateColumn.text
+        }
+        let text = PBCommitDateColumnFormatter.string(for: date, relativeTo: today)
+        cachedDateColumn = (today.stamp, text)
+        return text
+    }
+
+    /// Formats the row's display strings ahead of time. Called from the rev
+    /// list's load queue so the table view callbacks only do lookups.
+    func prepareDisplayStrings() {
+        _ = dateColumnString
     }
 
     var subject: String {
-        commitData.messageSummary ?? ""
+        text?.messageSummary ?? ""
     }
 
     var message: String {
-        commitData.message ?? ""
+        text?.message ?? ""
     }
 
     var author: String {
-        commitData.authorName ?? ""
+        text?.authorName ?? ""
     }
 
     var committer: String {
-        commitData.committerName ?? ""
+        text?.committerName ?? ""
     }
 
     var hasNotes: Bool {
-        repository?.noteSHAs?.contains(sha) ?? false
+        decoration.hasNotes
+    }
+
+    /// Refs, notes and HEAD status for drawing this commit's row. Looked up
+    /// once per ref reload; afterwards this is a pointer comparison.
+    var decoration: PBGitCommitDecoration {
+        guard let index = repository?.decorations else {
+            return .empty
+        }
+        if index === decorationSource, let cachedDecoration {
+            return cachedDecoration
+        }
+        let decoration = index.decoration(forSHA: sha)
+        decorationSource = index
+        cachedDecoration = decoration
+        return decoration
     }
 
     var details: String {
@@ -128,6 +207,7 @@ final class PBGitCommit: NSObject, PBGitRefish {
             } else {
                 repository?.refs.removeObject(forKey: currentSha)
             }
+            repository?.invalidateDecorations()
         }
     }
 
@@ -270,3 +350,81 @@ final class PBGitCommit: NSObject, PBGitRefish {
         return String(sha[..<index])
     }
 }
+
+// MARK: - Date column formatting
+
+/// Buckets a commit date into today / this year / older and formats it the way
+/// the history list shows it ("3:07pm", "4/12, 3:07pm", "4/12/19, 3:07pm").
+/// The current day is cached until midnight so formatting a row doesn't have
+/// to ask the calendar about "now" every time.
+@objc(PBCommitDateColumnFormatter)
+final class PBCommitDateColumnFormatter: NSObject {
+    struct Day {
+        let stamp: Int
+        let year: Int
+        let month: Int
+        let day: Int
+        let end: CFAbsoluteTime
+    }
+
+    static let timestampFormatter: DateFormatter = {
+        let formatter = DateFormatter()
+        formatter.dateFormat = "yyyy-MM-dd HH:mm:ss"
+        return formatter
+    }()
+
+    private static let lock = NSLock()
+    private static var currentDay: Day?
+
+    static func today() -> Day {
+        let now = CFAbsoluteTimeGetCurrent()
+        lock.lock()
+        defer { lock.unlock() }
+        if let currentDay, now < currentDay.end {
+            return currentDay
+        }
+
+        let calendar = Calendar.autoupdatingCurrent
+        let start = calendar.startOfDay(for: Date(timeIntervalSinceReferenceDate: now))
+        let end = calendar.date(byAdding: .day, value: 1, to: start) ?? start.addingTimeInterval(86400)
+        let components = calendar.dateComponents([.year, .month, .day], from: start)
+        let day = Day(stamp: Int(start.timeIntervalSinceReferenceDate),
+                      year: components.year ?? 0,
+                      month: components.month ?? 0,
+                      day: components.day ?? 0,
+                      end: end.timeIntervalSinceReferenceDate)
+        currentDay = day
+        return day
+    }
+
+    /// Forgets the cached day, e.g. when the time zone or calendar changes.
+    @objc static func invalidate() {
+        lock.lock()
+        currentDay = nil
+        lock.unlock()
+    }
+
+    static func string(for date: Date, relativeTo today: Day) -> String {
+        let components = Calendar.autoupdatingCurrent.dateComponents([.year, .month, .day, .hour, .minute], from: date)
+        let year = components.year ?? 0
+        let month = components.month ?? 0
+        let day = components.day ?? 0
+
+        // Format time as h:MMam/pm
+        var hour = components.hour ?? 0
+        let ampm = hour >= 12 ? "pm" : "am"
+        hour %= 12
+        if hour == 0 {
+            hour = 12
+        }
+        let time = String(format: "%ld:%02ld%@", hour, components.minute ?? 0, ampm)
+
+        if year == today.year && month == today.month && day == today.day {
+            return time
+        }
+        if year == today.year {
+            return "\(month)/\(day), \(time)"
+        }
+        return "\(month)/\(day)/\(year % 100), \(time)"
+    }
+}
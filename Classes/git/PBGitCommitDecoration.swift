@@ -0,0 +1,86 @@
+import Cocoa
+
+/// Everything the history list draws next to a commit's subject: its refs,
+/// whether it has notes, and whether it is HEAD. Built once per ref reload so
+/// drawing a row is a lookup instead of hashing SHAs and refs on every pass.
+@objcMembers
+@objc(PBGitCommitDecoration)
+final class PBGitCommitDecoration: NSObject {
+    static let empty = PBGitCommitDecoration(refs: [], hasNotes: false, isHead: false, headRefName: nil)
+
+    let refs: [PBGitRef]
+    let hasNotes: Bool
+    let isHead: Bool
+    /// Index into `refs` of the checked out branch, or NSNotFound.
+    let headRefIndex: Int
+
+    private var labelSizes: [NSValue]?
+
+    init(refs: [PBGitRef], hasNotes: Bool, isHead: Bool, headRefName: String?) {
+        self.refs = refs
+        self.hasNotes = hasNotes
+        self.isHead = isHead
+        if let headRefName, let index = refs.firstIndex(where: { $0.ref == headRefName }) {
+            self.headRefIndex = index
+        } else {
+            self.headRefIndex = NSNotFound
+        }
+        super.init()
+    }
+
+    var hasRefs: Bool {
+        !refs.isEmpty
+    }
+
+    /// Sizes of the ref labels drawn with `attributes`, measured on first use.
+    /// The label attributes are fixed for the lifetime of the app, so the
+    /// sizes stay valid until the next ref reload replaces this record.
+    @objc(labelSizesWithAttributes:)
+    func labelSizes(with attributes: [NSAttributedString.Key: Any]) -> [NSValue] {
+        if let labelSizes {
+            return labelSizes
+        }
+        let sizes = refs.map { NSValue(size: ($0.shortName() as NSString).size(withAttributes: attributes)) }
+        labelSizes = sizes
+        return sizes
+    }
+}
+
+/// Per-commit decorations for the whole repository, keyed by SHA.
+/// PBGitRepository replaces the index whenever refs or notes reload; commits
+/// remember which index their cached record came from.
+@objcMembers
+@objc(PBGitDecorationIndex)
+final class PBGitDecorationIndex: NSObject {
+    private let decorations: [String: PBGitCommitDecoration]
+
+    @objc(initWithRefs:noteSHAs:headSHA:headRefName:)
+    init(refs: NSDictionary?, noteSHAs: Set<String>?, headSHA: String?, headRefName: String?) {
+        var decorations: [String: PBGitCommitDecoration] = [:]
+
+        refs?.forEach { key, value in
+            guard let sha = key as? String else { return }
+            let commitRefs = (value as? NSArray)?.compactMap { $0 as? PBGitRef } ?? []
+            decorations[sha] = PBGitCommitDecoration(refs: commitRefs,
+                                                     hasNotes: noteSHAs?.contains(sha) ?? false,
+                                                     isHead: sha == headSHA,
+                                                     headRefName: headRefName)
+        }
+
+        for sha in noteSHAs ?? [] where decorations[sha] == nil {
+            decorations[sha] = PBGitCommitDecoration(refs: [], hasNotes: true, isHead: sha == headSHA, headRefName: nil)
+        }
+
+        if let headSHA, decorations[headSHA] == nil {
+            decorations[headSHA] = PBGitCommitDecoration(refs: [], hasNotes: false, isHead: true, headRefName: nil)
+        }
+
+        self.decorations = decorations
+        super.init()
+    }
+
+    @objc(decorationForSHA:)
+    func decoration(forSHA sha: String) -> PBGitCommitDecoration {
+        decorations[sha] ?? .empty
+    }
+}
@@ -13,6 +13,8 @@ final class PBGitDefaults: NSObject {
         static let branchFilterState = "PBBranchFilter"
         static let historySearchMode = "PBHistorySearchMode"
         static let suppressedDialogWarnings = "Suppressed Dialog Warnings"
+        static let tracingEnabled = "PBTracingEnabled"
+        static let graphLaneLimit = "PBGraphLaneLimit"
     }
 
     private static let defaults = UserDefaults.standard
@@ -26,7 +28,8 @@ final class PBGitDefaults: NSObject {
             Key.shouldCheckoutBranch: true,
             Key.showStageView: true,
             Key.historySearchMode: 1,
-            Key.branchFilterState: 0
+            Key.branchFilterState: 0,
+            Key.graphLaneLimit: 0
         ])
     }()
 
@@ -94,6 +97,24 @@ final class PBGitDefaults: NSObject {
         defaults.set(mode, forKey: Key.historySearchMode)
     }
 
+    @objc class func tracingEnabled() -> Bool {
+        ensureDefaultsRegistered()
+        return defaults.bool(forKey: Key.tracingEnabled)
+    }
+
+    @objc class func setTracingEnabled(_ enabled: Bool) {
+        ensureDefaultsRegistered()
+        defaults.set(enabled, forKey: Key.tracingEnabled)
+    }
+
+    /// Most lanes the history graph shows side by side, keeping lanes in
+    /// fixed columns and folding the rest into an overflow column; 0 for
+    /// the classic layout, where lanes shift left as others end.
+    @objc class func graphLaneLimit() -> Int {
+        ensureDefaultsRegistered()
+        return max(defaults.integer(forKey: Key.graphLaneLimit), 0)
+    }
+
     @objc class func suppressDialogWarningForDialog(_ dialog: String) {
         ensureDefaultsRegistered()
         var suppressed = Set(defaults.stringArray(forKey: Key.suppressedDialogWarnings) ?? [])
@@ -6,6 +6,9 @@
 //  Copyright 2008 __MyCompanyName__. All rights reserved.
 //
 
+#ifndef PBGitGraphLine_h
+#define PBGitGraphLine_h
+
 struct PBGitGraphLine
 {
 	int upper      : 1;
@@ -13,3 +16,21 @@ struct PBGitGraphLine
 	int to         : 8;
 	int colorIndex : 8;
 };
+
+// A point of a prepared graph row, in lane columns across and row heights
+// down: 0 is the top of the row, 0.5 the commit's centre and 1 the bottom.
+struct PBGitGraphPoint
+{
+	float x;
+	float y;
+};
+
+// Segments of a prepared graph row drawn in the same palette colour.
+struct PBGitGraphColorRun
+{
+	int color;
+	int start;
+	int count;
+};
+
+#endif
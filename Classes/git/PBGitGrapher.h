@@ -10,10 +10,14 @@
 
 @class PBGitRepository;
 @class PBGitCommit;
+@class PBGraphCellInfo;
 
 @interface PBGitGrapher : NSObject
 
 - (id) initWithRepository:(PBGitRepository *)repo;
 - (void) decorateCommit:(PBGitCommit *)commit;
+// Lays out the next row like decorateCommit:, but returns the cell instead
+// of setting it on the commit; nil if the row can't be laid out.
+- (PBGraphCellInfo *) cellInfoForCommit:(PBGitCommit *)commit;
 
 @end
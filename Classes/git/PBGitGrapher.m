@@ -9,6 +9,7 @@
 #import "PBGitGrapher.h"
 #import "GitX-Swift.h"
 #import "PBGitGraphLine.h"
+#import "PBGraphLaneLayout.h"
 #import <limits.h>
 
 static inline int PBGitClampedInt(NSInteger value)
@@ -50,6 +51,12 @@ static inline void PBGitAddLine(struct PBGitGraphLine *lines,
     return nil;
 }
 
+static BOOL PBGitObjectIDFromSHA(NSString *sha, PBGraphObjectID *objectID)
+{
+    const char *hex = sha.UTF8String;
+    return hex && PBGraphObjectIDFromHex(hex, strlen(hex), objectID);
+}
+
 @interface PBGitGrapher ()
 
 @property (nonatomic, strong) PBGraphCellInfo *previous;
@@ -58,7 +65,9 @@ @interface PBGitGrapher ()
 
 @end
 
-@implementation PBGitGrapher
+@implementation PBGitGrapher {
+    PBGraphLaneLayout *_laneLayout;
+}
 
 - (instancetype)initWithRepository:(__unused PBGitRepository *)repo
 {
@@ -70,11 +79,70 @@ - (instancetype)initWithRepository:(__unused PBGitRepository *)repo
     _lanes = [NSMutableArray array];
     _laneIndex = 0;
 
+    NSInteger laneLimit = [PBGitDefaults graphLaneLimit];
+    if (laneLimit > 0) {
+        _laneLayout = PBGraphLaneLayoutCreate(PBGitClampedInt(laneLimit));
+    }
+
     return self;
 }
 
+- (void)dealloc
+{
+    PBGraphLaneLayoutFree(_laneLayout);
+}
+
+// Lays the commit out with lanes in fixed columns, capped at the lane limit.
+- (PBGraphCellInfo *)cellInfoInLaneLayoutForCommit:(PBGitCommit *)commit
+{
+    PBGraphObjectID commitID;
+    if (!PBGitObjectIDFromSHA([commit sha], &commitID)) {
+        // Leave no lines from an earlier layout behind on the row
+        self.previous = [[PBGraphCellInfo alloc] init];
+        return self.previous;
+    }
+
+    NSArray *parents = [commit parents];
+    PBGraphObjectID *parentIDs = (PBGraphObjectID *)malloc(sizeof(PBGraphObjectID) * MAX(parents.count, 1U));
+    int parentCount = 0;
+    for (id parent in parents) {
+        NSString *parentSHA = PBGitParentSHA(parent);
+        if (parentSHA && PBGitObjectIDFromSHA(parentSHA, &parentIDs[parentCount])) {
+            parentCount++;
+        }
+    }
+
+    int maxLines = PBGraphLaneLayoutMaxLines(_laneLayout, parentCount);
+    struct PBGitGraphLine *lines = (struct PBGitGraphLine *)malloc(sizeof(struct PBGitGraphLine) * (size_t)maxLines);
+    PBGraphLaneRow row;
+    PBGraphLaneLayoutAddRow(_laneLayout, &commitID, parentIDs, parentCount, lines, &row);
+    free(parentIDs);
+
+    self.previous = [[PBGraphCellInfo alloc] initWithPosition:row.position andLines:lines];
+    self.previous.nLines = row.nLines;
+    self.previous.sign = commit.sign;
+    self.previous.numColumns = row.numColumns;
+    self.previous.overflowColumn = row.overflowColumn;
+    self.previous.overflowAbove = row.overflowAbove;
+    self.previous.overflowBelow = row.overflowBelow;
+    [self.previous prepareGeometry];
+    return self.previous;
+}
+
 - (void)decorateCommit:(PBGitCommit *)commit
 {
+    PBGraphCellInfo *cellInfo = [self cellInfoForCommit:commit];
+    if (cellInfo) {
+        commit.lineInfo = cellInfo;
+    }
+}
+
+- (PBGraphCellInfo *)cellInfoForCommit:(PBGitCommit *)commit
+{
+    if (_laneLayout) {
+        return [self cellInfoInLaneLayoutForCommit:commit];
+    }
+
     NSMutableArray *previousLanes = self.lanes;
     NSMutableArray *currentLanes = [NSMutableArray array];
 
@@ -126,7 +194,7 @@ - (void)decorateCommit:(PBGitCommit *)commit
         NSString *parentSHA = PBGitParentSHA(parents.firstObject);
         if (!parentSHA) {
             free(lines);
-            return;
+            return nil;
         }
 
         PBGitLane *newLane = [[PBGitLane alloc] initWithIndex:self.laneIndex++ sha:parentSHA];
@@ -173,13 +241,9 @@ - (void)decorateCommit:(PBGitCommit *)commit
         }
     }
 
-    if (!commit.lineInfo) {
-        self.previous = [[PBGraphCellInfo alloc] initWithPosition:PBGitClampedInt(newPosition) andLines:lines];
-    } else {
-        self.previous = commit.lineInfo;
-        self.previous.position = PBGitClampedInt(newPosition);
-        self.previous.lines = lines;
-    }
+    // Always a new cell: the one the commit has may belong to a layout
+    // the history list keeps for another branch filter.
+    self.previous = [[PBGraphCellInfo alloc] initWithPosition:PBGitClampedInt(newPosition) andLines:lines];
 
     if (currentLine > maxLines) {
         NSLog(@"Number of lines: %d vs allocated: %ld", currentLine, (long)maxLines);
@@ -188,6 +252,7 @@ - (void)decorateCommit:(PBGitCommit *)commit
     self.previous.nLines = currentLine;
     self.previous.sign = commit.sign;
     self.previous.numColumns = addedParent ? (int)currentLanes.count - 1 : (int)currentLanes.count;
+    [self.previous prepareGeometry];
 
     if (currentLane) {
         NSString *firstParent = PBGitParentSHA(parents.firstObject);
@@ -202,7 +267,7 @@ - (void)decorateCommit:(PBGitCommit *)commit
     }
 
     self.lanes = currentLanes;
-    commit.lineInfo = self.previous;
+    return self.previous;
 }
 
 @end
@@ -14,6 +14,7 @@
 
 
 @class PBGitGrapher;
+@class PBRowMask;
 
 
 @interface PBGitHistoryGrapher : NSObject {
@@ -23,9 +24,16 @@
 	NSMutableSet *searchSHAs;
 	PBGitGrapher *grapher;
 	BOOL viewAllBranches;
+	volatile BOOL cancelled;
 }
 
 - (id) initWithBaseCommits:(NSSet *)commits viewAllBranches:(BOOL)viewAll queue:(NSOperationQueue *)queue delegate:(id)theDelegate;
-- (void) graphCommits:(NSArray *)revList;
+// revList is an NSArray or a PBCommitList
+- (void) graphCommits:(id <NSFastEnumeration>)revList;
+// Graphs the rows of revList set in rows, which already holds everything
+// reachable from the base commits, so no parents are followed.
+- (void) graphCommits:(id <NSFastEnumeration>)revList reachableRows:(PBRowMask *)rows;
+// Stops a graph in progress without sending what is left.
+- (void) cancel;
 
 @end
@@ -37,13 +37,25 @@ - (void)sendCommits:(NSArray *)commits
 }
 
 
-- (void) graphCommits:(NSArray *)revList
+- (void) cancel
 {
-	if (!revList || [revList count] == 0) {
+	cancelled = YES;
+}
+
+
+- (void) graphCommits:(id <NSFastEnumeration>)revList
+{
+	[self graphCommits:revList reachableRows:nil];
+}
+
+
+- (void) graphCommits:(id <NSFastEnumeration>)revList reachableRows:(PBRowMask *)rows
+{
+	if (!revList || [(id)revList count] == 0) {
 		return;
 	}
 
-	//NSDate *start = [NSDate date];
+	PBTraceSpan *span = [[PBTracer shared] beginSpan:@"history graph" category:@"history"];
 	NSThread *currentThread = [NSThread currentThread];
 	NSDate *lastUpdate = [NSDate date];
 	NSMutableArray *commits = [NSMutableArray array];
@@ -53,19 +65,26 @@ - (void) graphCommits:(NSArray *)revList
 
 	@try {
 		for (PBGitCommit *commit in revList) {
-		if ([currentThread isCancelled]) {
+		if (cancelled || [currentThread isCancelled]) {
+			[span endWithArgs:@{@"commits": @(counter), @"cancelled": @YES}];
 			return;
 		}
 		NSString *commitSHA = [commit sha];
 		if (counter % 50 == 0) {
 		}
-		BOOL shouldInclude = viewAllBranches || [searchSHAs containsObject:commitSHA];
+		BOOL shouldInclude;
+		if (viewAllBranches)
+			shouldInclude = YES;
+		else if (rows)
+			shouldInclude = [rows containsRow:counter];
+		else
+			shouldInclude = [searchSHAs containsObject:commitSHA];
 		if (shouldInclude) {
 			@try {
 				[grapher decorateCommit:commit];
 				[commits addObject:commit];
 				addedCount++;
-				if (!viewAllBranches) {
+				if (!viewAllBranches && !rows) {
 					[searchSHAs removeObject:commitSHA];
 					// Parent SHAs are already PBCommitID objects
 					NSArray *parentCommitIDs = [commit parents];
@@ -92,11 +111,12 @@ - (void) graphCommits:(NSArray *)revList
 		}
 	} @catch (NSException *exception) {
 	}
-	//NSTimeInterval duration = [[NSDate date] timeIntervalSinceDate:start];
-	//NSLog(@"Graphed %i commits in %f seconds (%f/sec)", counter, duration, counter/duration);
+	[span endWithArgs:@{@"commits": @(counter), @"graphed": @(addedCount), @"masked": @(rows != nil)}];
+	if (cancelled)
+		return;
 
 	[self sendCommits:commits];
-	[delegate performSelectorOnMainThread:@selector(finishedGraphing) withObject:nil waitUntilDone:NO];
+	[delegate performSelectorOnMainThread:@selector(finishedGraphing:) withObject:currentQueue waitUntilDone:NO];
 }
 
 
@@ -13,6 +13,8 @@
 @class PBGitRef;
 @class PBGitRevList;
 @class PBGitHistoryGrapher;
+@class PBCommitList;
+@class PBGraphLayoutCache;
 
 @interface PBGitHistoryList : NSObject {
 	__weak PBGitRepository *repository;
@@ -26,9 +28,14 @@
 	PBGitRef *lastRemoteRef;
 	BOOL resetCommits;
 	BOOL shouldReloadProjectHistory;
+	BOOL refsJustLoaded;
 
 	PBGitHistoryGrapher *grapher;
 	NSOperationQueue *graphQueue;
+	NSArray<NSOperation *> *cancelledGraphOperations; // Cancelled by the last resetGraphing, maybe still running
+	PBGraphLayoutCache *layoutCache;
+	NSSet *graphTips;
+	NSString *layoutKey;
 
 	NSMutableArray *commits;
 	BOOL isUpdating;
@@ -37,6 +44,7 @@
 - (id) initWithRepository:(PBGitRepository *)repo;
 - (void) forceUpdate;
 - (void) updateHistory;
+- (BOOL) showNewCommit:(NSString *)sha;
 - (void)cleanup;
 
 - (void) updateCommitsFromGrapher:(NSDictionary *)commitData;
@@ -44,7 +52,8 @@
 
 @property  PBGitRevList *projectRevList;
 @property  NSMutableArray *commits;
-@property (readonly) NSArray *projectCommits;
+// Every commit on every branch; a snapshot, so any thread can read it.
+@property (readonly) PBCommitList *projectCommits;
 @property (assign) BOOL isUpdating;
 
 @end
@@ -17,8 +17,12 @@ @interface PBGitHistoryList ()
 
 - (void) resetGraphing;
 
-- (PBGitHistoryGrapher *) grapher;
-- (NSInvocationOperation *) operationForCommits:(NSArray *)newCommits;
+- (NSInvocationOperation *) operationForCommits:(id <NSFastEnumeration>)newCommits;
+- (NSOperation *) operationForFinishedList:(PBCommitList *)list;
+- (void) restoreLayoutForKey:(NSString *)key list:(PBCommitList *)list queue:(NSOperationQueue *)queue;
+- (void) waitForCancelledGraphing:(NSOperation *)operation;
+- (NSString *) layoutKeyForTips:(NSSet *)tips viewAllBranches:(BOOL)viewAllBranches;
+- (BOOL) showPrependedCommit:(PBGitCommit *)commit inList:(PBCommitList *)list;
 
 - (void) updateProjectHistoryForRev:(PBGitRevSpecifier *)rev;
 - (void) updateHistoryForRev:(PBGitRevSpecifier *)rev;
@@ -53,9 +57,13 @@ - (id) initWithRepository:(PBGitRepository *)repo
 	[repository addObserver:self forKeyPath:@"currentBranch" options:0 context:@"currentBranch"];
 	[repository addObserver:self forKeyPath:@"currentBranchFilter" options:0 context:@"currentBranch"];
 	[repository addObserver:self forKeyPath:@"hasChanged" options:0 context:@"repositoryHasChanged"];
+	[repository addObserver:self forKeyPath:@"refsLoaded" options:0 context:@"refsLoaded"];
 
 	shouldReloadProjectHistory = YES;
 	projectRevList = [[PBGitRevList alloc] initWithRepository:repository rev:[PBGitRevSpecifier allBranchesRevSpec] shouldGraph:NO];
+	layoutCache = [[PBGraphLayoutCache alloc] initWithCapacity:8];
+	[[GitWorkspace shared] registerCache:layoutCache forRepository:repository];
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(foregroundRepositoryChanged:) name:GitWorkspace.foregroundDidChangeNotification object:nil];
 
 	return self;
 }
@@ -80,6 +88,12 @@ - (void) updateHistory
 		return;
 	}
 
+	// The walk needs the stash list and the graph needs the refs; this runs
+	// again when they arrive.
+	if (!repository.refsLoaded) {
+		return;
+	}
+
 	if ([rev isSimpleRef]) {
 		[self updateProjectHistoryForRev:rev];
 	} else {
@@ -88,23 +102,61 @@ - (void) updateHistory
 }
 
 
+// Adds a commit that was just made on top of the current history without
+// walking it again. The refs and the commit are read in the background, and
+// the update forces a full one itself if it can't be done that way. Returns
+// NO if the caller should force a full update instead.
+- (BOOL) showNewCommit:(NSString *)sha
+{
+	PBGitRevSpecifier *rev = repository.currentBranch;
+	if (![rev isSimpleRef] || currentRevList != projectRevList || shouldReloadProjectHistory || projectRevList.isParsing)
+		return NO;
+
+	PBGitRevList *revList = projectRevList;
+	PBCommitList *listed = revList.commits;
+	[repository reloadRefsInBackground:^(BOOL applied) {
+		PBGitRepository *repo = self->repository;
+		if (!applied || self->currentRevList != revList || revList.commits != listed || repo.currentBranch != rev) {
+			repo.hasChanged = YES;
+			return;
+		}
+
+		self->lastRefSHAs = [NSSet setWithArray:[repo.refs allKeys]];
+		// The selected branch has moved to the new commit; graph from its new tip.
+		if (self->lastSHA)
+			self->lastSHA = [repo shaForRef:[rev ref]];
+
+		[revList prependNewCommitWithSHA:sha completion:^(BOOL prepended) {
+			if (prepended)
+				return;
+			self->shouldReloadProjectHistory = YES;
+			repo.hasChanged = YES;
+		}];
+	}];
+	return YES;
+}
+
+
 - (void)cleanup
 {
 	if (currentRevList) {
 		[currentRevList removeObserver:self forKeyPath:@"commits"];
 		[currentRevList cancel];
 	}
+	[grapher cancel];
 	[graphQueue cancelAllOperations];
 
 	[repository removeObserver:self forKeyPath:@"currentBranch"];
 	[repository removeObserver:self forKeyPath:@"currentBranchFilter"];
 	[repository removeObserver:self forKeyPath:@"hasChanged"];
+	[repository removeObserver:self forKeyPath:@"refsLoaded"];
+	[[NSNotificationCenter defaultCenter] removeObserver:self name:GitWorkspace.foregroundDidChangeNotification object:nil];
 }
 
 
-- (NSArray *) projectCommits
+- (PBCommitList *) projectCommits
 {
-	return [projectRevList.commits copy];
+	return projectRevList.commits;
 }
 
 
@@ -142,10 +194,16 @@ - (void) updateCommitsFromGrapher:(NSDictionary *)commitData
 	[self addCommitsFromArray:newCommits];
 }
 
-- (void) finishedGraphing
+- (void) finishedGraphing:(NSOperationQueue *)queue
 {
+	if (queue != graphQueue)
+		return;
+
 	if (!currentRevList.isParsing && ([[graphQueue operations] count] == 0)) {
 		self.isUpdating = NO;
+		// Keep the finished layout so switching back to it needs no graphing
+		if (currentRevList == projectRevList && layoutKey)
+			[layoutCache storeLayoutForKey:layoutKey list:projectRevList.commits commits:commits];
 	}
 }
 
@@ -154,22 +212,121 @@ - (void) finishedGraphing
 #pragma mark -
 #pragma mark Private
 
+// Graphing already queued moves up or down with the window
+- (void) foregroundRepositoryChanged:(NSNotification *)notification
+{
+	[graphQueue setQualityOfService:[[GitWorkspace shared] qualityOfServiceForRepositoryAtPath:[repository workingDirectory]]];
+}
+
 - (void) resetGraphing
 {
 	resetCommits = YES;
 	self.isUpdating = YES;
 
+	[grapher cancel];
+	cancelledGraphOperations = [graphQueue operations];
 	[graphQueue cancelAllOperations];
 	graphQueue = [[NSOperationQueue alloc] init];
 	[graphQueue setMaxConcurrentOperationCount:1];
+	// Graphing for a window in the background yields to the one in front
+	[graphQueue setQualityOfService:[[GitWorkspace shared] qualityOfServiceForRepositoryAtPath:[repository workingDirectory]]];
+
+	BOOL viewAllBranches = (repository.currentBranchFilter == PBGitBranchFilterTypeAll);
+	graphTips = [self baseCommits];
+	layoutKey = [self layoutKeyForTips:graphTips viewAllBranches:viewAllBranches];
+	grapher = [[PBGitHistoryGrapher alloc] initWithBaseCommits:graphTips viewAllBranches:viewAllBranches queue:graphQueue delegate:self];
+}
 
-	grapher = [self grapher];
+
+// The lane limit changes how a layout looks, so it is part of the key
+- (NSString *) layoutKeyForTips:(NSSet *)tips viewAllBranches:(BOOL)viewAllBranches
+{
+	return [NSString stringWithFormat:@"%ld %@", (long)[PBGitDefaults graphLaneLimit], [PBGraphLayoutCache keyForTips:tips viewAllBranches:viewAllBranches]];
+}
+
+
+// Shows a commit the rev list put in front of a finished, fully graphed list
+// without graphing it again. With the top row as its only parent, the new
+// commit leaves every row below that one as it was; the top row only gains
+// the line coming in from the new commit above. So only those two rows are
+// laid out, from the lane state at the top of the graph. Returns NO if the
+// graph has to be redone instead.
+- (BOOL) showPrependedCommit:(PBGitCommit *)commit inList:(PBCommitList *)list
+{
+	if (![repository.currentBranch isSimpleRef] || self.isUpdating || [[graphQueue operations] count] > 0 || [commits count] == 0)
+		return NO;
+
+	PBGitCommit *top = [commits objectAtIndex:0];
+	NSArray *parents = [commit parents];
+	if ([parents count] != 1 || ![[parents objectAtIndex:0] isEqualToString:[top sha]])
+		return NO;
+
+	// The new tips have to reach exactly the rows shown, plus the new commit
+	BOOL viewAllBranches = (repository.currentBranchFilter == PBGitBranchFilterTypeAll);
+	NSSet *tips = [self baseCommits];
+	if (!viewAllBranches) {
+		NSMutableSet *kept = [graphTips mutableCopy];
+		[kept removeObject:[top sha]];
+		NSMutableSet *added = [tips mutableCopy];
+		[added minusSet:graphTips];
+		if (![tips containsObject:[commit sha]] || ![kept isSubsetOfSet:tips] || ![added isEqualToSet:[NSSet setWithObject:[commit sha]]])
+			return NO;
+	}
+
+	PBGitGrapher *rowGrapher = [[PBGitGrapher alloc] initWithRepository:nil];
+	PBGraphCellInfo *commitInfo = [rowGrapher cellInfoForCommit:commit];
+	PBGraphCellInfo *topInfo = [rowGrapher cellInfoForCommit:top];
+	if (!commitInfo || !topInfo)
+		return NO;
+
+	commit.lineInfo = commitInfo;
+	top.lineInfo = topInfo;
+	graphTips = tips;
+	layoutKey = [self layoutKeyForTips:tips viewAllBranches:viewAllBranches];
+
+	NSIndexSet *indexes = [NSIndexSet indexSetWithIndex:0];
+	[self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"commits"];
+	[commits insertObject:commit atIndex:0];
+	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"commits"];
+
+	[layoutCache storeLayoutForKey:layoutKey list:list commits:commits];
+	return YES;
 }
 
 
-- (NSInvocationOperation *) operationForCommits:(NSArray *)newCommits
+// newCommits is a batch of new rows or a whole snapshot
+- (NSInvocationOperation *) operationForCommits:(id <NSFastEnumeration>)newCommits
 {
-	return [[NSInvocationOperation alloc] initWithTarget:grapher selector:@selector(graphCommits:) object:newCommits];
+	NSInvocationOperation *operation = [[NSInvocationOperation alloc] initWithTarget:grapher selector:@selector(graphCommits:) object:newCommits];
+	[self waitForCancelledGraphing:operation];
+	return operation;
+}
+
+
+// A cancelled grapher stops at its next row, but until then it still sets
+// lines on the shared commits; nothing new may touch them before it has.
+- (void) waitForCancelledGraphing:(NSOperation *)operation
+{
+	for (NSOperation *cancelled in cancelledGraphOperations)
+		[operation addDependency:cancelled];
+}
+
+
+// Graphs a snapshot no more rows will be appended to, picking the rows to
+// show from a bitset over the layout cache's row table.
+- (NSOperation *) operationForFinishedList:(PBCommitList *)list
+{
+	PBGitHistoryGrapher *theGrapher = grapher;
+	PBGraphLayoutCache *cache = layoutCache;
+	NSSet *tips = graphTips;
+	BOOL viewAllBranches = (repository.currentBranchFilter == PBGitBranchFilterTypeAll);
+
+	NSOperation *operation = [NSBlockOperation blockOperationWithBlock:^{
+		PBRowMask *rows = viewAllBranches ? nil : [cache reachableRowsInList:list fromTips:tips];
+		[theGrapher graphCommits:list reachableRows:rows];
+	}];
+	[self waitForCancelledGraphing:operation];
+	return operation;
 }
 
 
@@ -229,14 +386,6 @@ - (NSSet *) baseCommits
 }
 
 
-- (PBGitHistoryGrapher *) grapher
-{
-	BOOL viewAllBranches = (repository.currentBranchFilter == PBGitBranchFilterTypeAll);
-
-	return [[PBGitHistoryGrapher alloc] initWithBaseCommits:[self baseCommits] viewAllBranches:viewAllBranches queue:graphQueue delegate:self];
-}
-
-
 - (void) setCurrentRevList:(PBGitRevList *)parser
 {
 	if (currentRevList == parser)
@@ -247,7 +396,7 @@ - (void) setCurrentRevList:(PBGitRevList *)parser
 
 	currentRevList = parser;
 
-	[currentRevList addObserver:self forKeyPath:@"commits" options:NSKeyValueObservingOptionNew context:@"commitsUpdated"];
+	[currentRevList addObserver:self forKeyPath:@"commits" options:(NSKeyValueObservingOptionOld | NSKeyValueObservingOptionNew) context:@"commitsUpdated"];
 }
 
 
@@ -297,7 +446,11 @@ - (BOOL) selectedBranchNeedsNewGraph:(PBGitRevSpecifier *)rev
 
 - (BOOL) haveRefsBeenModified
 {
-	[repository reloadRefs];
+	// No need to list the refs again right after the initial load
+	if (refsJustLoaded)
+		refsJustLoaded = NO;
+	else
+		[repository reloadRefs];
 
 	NSMutableSet *currentRefSHAs = [NSMutableSet setWithArray:[repository.refs allKeys]];
 	[currentRefSHAs minusSet:lastRefSHAs];
@@ -331,7 +484,45 @@ - (void) updateProjectHistoryForRev:(PBGitRevSpecifier *)rev
 		return;
 	}
 
-	[graphQueue addOperation:[self operationForCommits:projectRevList.commits]];
+	// A walk still in progress appends rows the grapher has to follow by SHA
+	if (projectRevList.isParsing) {
+		[graphQueue addOperation:[self operationForCommits:projectRevList.commits]];
+		return;
+	}
+
+	PBCommitList *list = projectRevList.commits;
+	if ([layoutCache hasLayoutForKey:layoutKey list:list]) {
+		// Put the stored lines back once the cancelled grapher has stopped
+		NSOperationQueue *queue = graphQueue;
+		NSString *key = layoutKey;
+		NSOperation *restore = [NSBlockOperation blockOperationWithBlock:^{
+			dispatch_async(dispatch_get_main_queue(), ^{
+				[self restoreLayoutForKey:key list:list queue:queue];
+			});
+		}];
+		[self waitForCancelledGraphing:restore];
+		[graphQueue addOperation:restore];
+		return;
+	}
+
+	[graphQueue addOperation:[self operationForFinishedList:list]];
+}
+
+
+- (void) restoreLayoutForKey:(NSString *)key list:(PBCommitList *)list queue:(NSOperationQueue *)queue
+{
+	if (queue != graphQueue)
+		return;
+
+	NSArray *layout = [layoutCache restoreLayoutForKey:key list:list];
+	if (!layout) {
+		// Trimmed while waiting
+		[graphQueue addOperation:[self operationForFinishedList:list]];
+		return;
+	}
+	resetCommits = NO;
+	self.commits = [layout mutableCopy];
+	self.isUpdating = NO;
 }
 
 
@@ -366,15 +557,44 @@ - (void) observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(
 		return;
 	}
 
+	if ([@"refsLoaded" isEqualToString:(__bridge NSString*)context]) {
+		refsJustLoaded = repository.currentBranch != nil;
+		[self updateHistory];
+		return;
+	}
+
 	if ([@"commitsUpdated" isEqualToString:(__bridge NSString*)context]) {
-		NSInteger changeKind = [(NSNumber *)[change objectForKey:NSKeyValueChangeKindKey] intValue];
-		if (changeKind == NSKeyValueChangeInsertion) {
-			NSArray *newCommits = [change objectForKey:NSKeyValueChangeNewKey];
+		id oldList = [change objectForKey:NSKeyValueChangeOldKey];
+		PBCommitList *newList = [change objectForKey:NSKeyValueChangeNewKey];
+		if (![newList isKindOfClass:[PBCommitList class]] || newList.count == 0)
+			return;
+
+		if (![oldList isKindOfClass:[PBCommitList class]])
+			oldList = nil;
+
+		PBGitCommit *prepended = oldList ? [newList commitPrependedToList:oldList] : nil;
+		if (prepended && [self showPrependedCommit:prepended inList:newList])
+			return;
+
+		NSArray *newCommits = [newList commitsAppendedToList:oldList];
+		if (newCommits) {
 			if ([repository.currentBranch isSimpleRef]) {
 				[graphQueue addOperation:[self operationForCommits:newCommits]];
 			} else {
 				[self addCommitsFromArray:newCommits];
 			}
+		} else {
+			// The rev list reordered commits it had already handed out; start over from its final order.
+			if ([repository.currentBranch isSimpleRef]) {
+				[self resetGraphing];
+				if (projectRevList.isParsing)
+					[graphQueue addOperation:[self operationForCommits:newList]];
+				else
+					[graphQueue addOperation:[self operationForFinishedList:newList]];
+			} else {
+				resetCommits = YES;
+				[self addCommitsFromArray:[newList allCommits]];
+			}
 		}
 		return;
 	}
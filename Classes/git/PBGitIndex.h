@@ -51,6 +51,8 @@ extern NSString *PBGitIndexOperationFailed;
 	NSUInteger refreshStatus;
 	NSDictionary *amendEnvironment;
 	BOOL amend;
+
+	NSProgress *commitProgress;
 }
 
 // Whether we want the changes for amending,
@@ -71,6 +73,14 @@ extern NSString *PBGitIndexOperationFailed;
 
 - (void)commitWithMessage:(NSString *)commitMessage andVerify:(BOOL) doVerify;
 
+// The commit started by commitWithMessage:andVerify:, which runs in the
+// background, or nil. Its stages are reported with PBGitIndexCommitStatus.
+@property (readonly) NSProgress *commitProgress;
+
+// Stops the running commit if HEAD hasn't been updated yet. The commit then
+// fails with "cancelled" set in the notification's userInfo.
+- (void)cancelCommit;
+
 // Inter-file changes:
 - (BOOL)stageFiles:(NSArray *)stageFiles;
 - (BOOL)unstageFiles:(NSArray *)unstageFiles;
@@ -78,7 +88,14 @@ extern NSString *PBGitIndexOperationFailed;
 
 // Intra-file changes
 - (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse;
+// Applies all patches with a single git apply, then refreshes only the paths they touch.
+// Patches to one file apply in order, each to what the last one left, so
+// patches cut from the same diff should come bottom-most first.
+- (BOOL)applyPatches:(NSArray *)patches stage:(BOOL)stage reverse:(BOOL)reverse;
+
 - (NSString *)diffForFile:(PBChangedFile *)file staged:(BOOL)staged contextLines:(NSUInteger)context truncated:(BOOL *)truncated;
+// For new files only a prefix is read; fullSize receives the whole file's size in bytes.
+- (NSString *)diffForFile:(PBChangedFile *)file staged:(BOOL)staged contextLines:(NSUInteger)context truncated:(BOOL *)truncated fullSize:(unsigned long long *)fullSize;
 - (NSString *)diffForFile:(PBChangedFile *)file staged:(BOOL)staged contextLines:(NSUInteger)context;
 
 @end
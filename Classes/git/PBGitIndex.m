@@ -9,6 +9,7 @@
 #import "PBGitIndex.h"
 #import "GitX-Swift.h"
 #import "PBGitRepository.h"
+#import "PBGitHistoryList.h"
 
 NSString *PBGitIndexIndexRefreshStatus = @"PBGitIndexIndexRefreshStatus";
 NSString *PBGitIndexIndexRefreshFailed = @"PBGitIndexIndexRefreshFailed";
@@ -32,11 +33,17 @@ @interface PBGitIndex ()
 // Returns the tree to compare the index to, based
 // on whether amend is set or not.
 - (NSString *)parentTree;
-- (void)postCommitUpdate:(NSString *)update;
-- (void)postCommitFailure:(NSString *)reason;
-- (void)postCommitHookFailure:(NSString *)reason;
+- (void)postCommitUpdate:(NSString *)update progress:(NSProgress *)progress;
+- (void)postCommitFailure:(NSString *)reason progress:(NSProgress *)progress;
+- (void)postCommitHookFailure:(NSString *)reason progress:(NSProgress *)progress;
+- (void)postCommitCancelled:(NSProgress *)progress;
 - (void)postIndexChange;
 - (void)postOperationFailed:(NSString *)description;
+- (void)beginRefreshSpan:(NSString *)name;
+- (void)setBlobSHAsOfFile:(PBChangedFile *)file fromStatus:(NSArray *)fileStatus staged:(BOOL)staged;
+
+// Times a refresh from update-index to finalizeRefresh
+@property (nonatomic, strong) PBTraceSpan *refreshSpan;
 @end
 
 @implementation PBGitIndex
@@ -120,11 +127,14 @@ - (BOOL)amend {
 - (void)refresh {
   // Cancel any in-progress refresh
   refreshStatus = 0;
+  [self beginRefreshSpan:@"index refresh"];
 
   // Ask Git to refresh the index first
   [repository executeGitCommandAsync:@[@"update-index", @"-q", @"--unmerged", @"--ignore-missing", @"--refresh"]
                           completion:^(NSString *output, NSString *error, int exitCode) {
     if (exitCode != 0) {
+      [self.refreshSpan endWithArgs:@{@"exitCode": @(exitCode)}];
+      self.refreshSpan = nil;
       [[NSNotificationCenter defaultCenter]
           postNotificationName:PBGitIndexIndexRefreshFailed
                         object:self
@@ -138,6 +148,8 @@ - (void)refresh {
                     userInfo:@{@"description": @"update-index success"}];
 
     if ([repository isBareRepository]) {
+      [self.refreshSpan end];
+      self.refreshSpan = nil;
       return;
     }
 
@@ -160,6 +172,8 @@ - (void)refreshIndexContents {
   ];
 
   [repository executeGitCommandsAsync:commands completion:^(NSArray<NSDictionary *> *results) {
+    PBTraceSpan *span = [[PBTracer shared] beginSpan:@"index read" category:@"index"];
+
     // Process "other" files (untracked)
     NSDictionary *otherResult = results[0];
     NSArray *otherLines = [self linesFromOutput:otherResult[@"output"]];
@@ -185,6 +199,7 @@ - (void)refreshIndexContents {
     NSArray *stagedLines = [self linesFromOutput:stagedResult[@"output"]];
     NSMutableDictionary *stagedDict = [self dictionaryForLines:stagedLines];
     [self addFilesFromDictionary:stagedDict staged:YES tracked:YES];
+    [span endWithArgs:@{@"entries": @([otherLines count] + [unstagedLines count] + [stagedLines count])}];
 
     // All done - clean up files with no changes
     [self finalizeRefresh];
@@ -226,6 +241,15 @@ - (void)finalizeRefresh {
       postNotificationName:PBGitIndexFinishedIndexRefresh
                     object:self];
   [self postIndexChange];
+
+  [self.refreshSpan endWithArgs:@{@"files": @([files count])}];
+  self.refreshSpan = nil;
+}
+
+- (void)beginRefreshSpan:(NSString *)name {
+  // A refresh that starts before the last one finished supersedes it
+  [self.refreshSpan endWithArgs:@{@"superseded": @YES}];
+  self.refreshSpan = [[PBTracer shared] beginSpan:name category:@"index"];
 }
 
 - (NSString *)parentTree {
@@ -238,8 +262,47 @@ - (NSString *)parentTree {
   return parent;
 }
 
-// TODO: make Asynchronous
+- (NSProgress *)commitProgress {
+  return commitProgress;
+}
+
+- (void)cancelCommit {
+  [commitProgress cancel];
+}
+
+// Runs the pre-commit hook, write-tree, commit-msg, commit-tree, update-ref
+// and post-commit on a background queue. The tree is written only once the
+// pre-commit hook has exited, since hooks may restage files and git holds
+// index.lock while writing it; only resolving the parent, which doesn't
+// touch the index, runs alongside the hook.
 - (void)commitWithMessage:(NSString *)commitMessage andVerify:(BOOL)doVerify {
+  if (commitProgress)
+    return;
+
+  NSProgress *progress =
+      [NSProgress discreteProgressWithTotalUnitCount:doVerify ? 6 : 4];
+  progress.cancellable = YES;
+  commitProgress = progress;
+
+  BOOL amending = amend;
+  NSDictionary *environment = amendEnvironment;
+
+  dispatch_async(
+      dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+        [self performCommitWithMessage:commitMessage
+                                verify:doVerify
+                                 amend:amending
+                           environment:environment
+                              progress:progress];
+      });
+}
+
+- (void)performCommitWithMessage:(NSString *)commitMessage
+                          verify:(BOOL)doVerify
+                           amend:(BOOL)amending
+                     environment:(NSDictionary *)environment
+                        progress:(NSProgress *)progress {
+  PBGitRepository *repo = repository;
   NSMutableString *commitSubject = [@"commit: " mutableCopy];
   NSRange newLine = [commitMessage rangeOfString:@"\n"];
   if (newLine.location == NSNotFound)
@@ -248,86 +311,125 @@ - (void)commitWithMessage:(NSString *)commitMessage andVerify:(BOOL)doVerify {
     [commitSubject
         appendString:[commitMessage substringToIndex:newLine.location]];
 
-  NSString *commitMessageFile;
-  commitMessageFile =
-      [repository.gitURL.path stringByAppendingPathComponent:@"COMMIT_EDITMSG"];
+  NSString *commitMessageFile =
+      [repo.gitURL.path stringByAppendingPathComponent:@"COMMIT_EDITMSG"];
 
   [commitMessage writeToFile:commitMessageFile
                   atomically:YES
                     encoding:NSUTF8StringEncoding
                        error:nil];
 
-  [self postCommitUpdate:@"Creating tree"];
-  NSError *error = nil;
-  NSString *tree = [repository
-      executeGitCommand:[NSArray arrayWithObjects:@"write-tree", nil]
-                  error:&error];
-  if ([tree length] != 40)
-    return [self postCommitFailure:@"Creating tree failed"];
+  __block NSString *parentSHA = nil;
+  dispatch_group_t group = dispatch_group_create();
+  dispatch_group_async(group, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+    parentSHA = [repo parseReference:amending ? @"HEAD^" : @"HEAD"];
+  });
 
-  NSMutableArray *arguments =
-      [NSMutableArray arrayWithObjects:@"commit-tree", tree, nil];
-  NSString *parent = amend ? @"HEAD^" : @"HEAD";
-  if ([repository parseReference:parent]) {
-    [arguments addObject:@"-p"];
-    [arguments addObject:parent];
+  if (doVerify) {
+    [self postCommitUpdate:@"Running pre-commit hook" progress:progress];
+    NSString *preCommitOutput = nil;
+    if (![repo executeHook:@"pre-commit"
+                  withArgs:@[]
+                    output:&preCommitOutput
+                  progress:progress]) {
+      dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+      if (progress.isCancelled)
+        return [self postCommitCancelled:progress];
+      return [self postCommitHookFailure:[NSString stringWithFormat:@"Pre-commit hook failed%@%@",
+                                                                    [preCommitOutput length] > 0 ? @":\n" : @"",
+                                                                    preCommitOutput ?: @""]
+                                progress:progress];
+    }
   }
 
-  [self postCommitUpdate:@"Creating commit"];
+  [self postCommitUpdate:@"Creating tree" progress:progress];
+  NSString *tree = nil;
+  if (!progress.isCancelled)
+    tree = [repo executeGitCommand:@[ @"write-tree" ] error:nil];
+  dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+  if (progress.isCancelled)
+    return [self postCommitCancelled:progress];
+
+  if ([tree length] != 40)
+    return [self postCommitFailure:@"Creating tree failed" progress:progress];
 
   if (doVerify) {
-    [self postCommitUpdate:@"Running hooks"];
-    NSString *hookFailureMessage = nil;
+    [self postCommitUpdate:@"Running commit-msg hook" progress:progress];
     NSString *hookOutput = nil;
-    if (![repository executeHook:@"pre-commit" output:&hookOutput]) {
-      hookFailureMessage = [NSString
-          stringWithFormat:@"Pre-commit hook failed%@%@",
-                           [hookOutput length] > 0 ? @":\n" : @"", hookOutput];
+    if (![repo executeHook:@"commit-msg"
+                  withArgs:@[ commitMessageFile ]
+                    output:&hookOutput
+                  progress:progress]) {
+      if (progress.isCancelled)
+        return [self postCommitCancelled:progress];
+      return [self postCommitHookFailure:[NSString stringWithFormat:@"Commit-msg hook failed%@%@",
+                                                                    [hookOutput length] > 0 ? @":\n" : @"",
+                                                                    hookOutput ?: @""]
+                                progress:progress];
     }
+  }
 
-    if (![repository executeHook:@"commit-msg"
-                        withArgs:[NSArray arrayWithObject:commitMessageFile]
-                          output:nil]) {
-      hookFailureMessage = [NSString
-          stringWithFormat:@"Commit-msg hook failed%@%@",
-                           [hookOutput length] > 0 ? @":\n" : @"", hookOutput];
-    }
+  if (progress.isCancelled)
+    return [self postCommitCancelled:progress];
 
-    if (hookFailureMessage != nil) {
-      return [self postCommitHookFailure:hookFailureMessage];
-    }
-  }
+  [self postCommitUpdate:@"Creating commit" progress:progress];
 
+  // The commit-msg hook may have rewritten the message.
   commitMessage = [NSString stringWithContentsOfFile:commitMessageFile
                                             encoding:NSUTF8StringEncoding
                                                error:nil];
 
+  NSMutableArray *arguments =
+      [NSMutableArray arrayWithObjects:@"commit-tree", tree, nil];
+  if (parentSHA) {
+    [arguments addObject:@"-p"];
+    [arguments addObject:parentSHA];
+  }
+
   NSError *commitError = nil;
-  NSString *commit = [repository executeGitCommand:arguments
-                                         withInput:commitMessage
-                                       environment:amendEnvironment
-                                             error:&commitError];
+  NSString *commit = [repo executeGitCommand:arguments
+                                   withInput:commitMessage
+                                 environment:environment
+                                       error:&commitError];
 
   if (commitError || [commit length] != 40)
-    return [self postCommitFailure:@"Could not create a commit object"];
+    return [self postCommitFailure:@"Could not create a commit object" progress:progress];
 
-  [self postCommitUpdate:@"Updating HEAD"];
-  error = nil;
-  [repository executeGitCommand:[NSArray arrayWithObjects:@"update-ref", @"-m",
-                                                          commitSubject,
-                                                          @"HEAD", commit, nil]
-                          error:&error];
+  if (progress.isCancelled)
+    return [self postCommitCancelled:progress];
+
+  // Past this point the commit is on a branch; cancelling no longer applies.
+  progress.cancellable = NO;
+
+  [self postCommitUpdate:@"Updating HEAD" progress:progress];
+  NSError *error = nil;
+  [repo executeGitCommand:@[ @"update-ref", @"-m", commitSubject, @"HEAD", commit ]
+                    error:&error];
   if (error)
-    return [self postCommitFailure:@"Could not update HEAD"];
+    return [self postCommitFailure:@"Could not update HEAD" progress:progress];
 
-  [self postCommitUpdate:@"Running post-commit hook"];
+  [self postCommitUpdate:@"Running post-commit hook" progress:progress];
+  BOOL success = [repo executeHook:@"post-commit" output:nil];
+
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [self finishCommit:commit
+                amended:amending
+        postCommitFailed:!success
+               progress:progress];
+  });
+}
+
+- (void)finishCommit:(NSString *)commit
+             amended:(BOOL)amended
+    postCommitFailed:(BOOL)postCommitFailed
+            progress:(NSProgress *)progress {
+  progress.completedUnitCount = progress.totalUnitCount;
+  if (commitProgress == progress)
+    commitProgress = nil;
 
-  BOOL success = [repository executeHook:@"post-commit" output:nil];
-  NSMutableDictionary *userInfo = [NSMutableDictionary
-      dictionaryWithObject:[NSNumber numberWithBool:success]
-                    forKey:@"success"];
   NSString *description;
-  if (success)
+  if (!postCommitFailed)
     description =
         [NSString stringWithFormat:@"Successfully created commit %@", commit];
   else
@@ -336,17 +438,23 @@ - (void)commitWithMessage:(NSString *)commitMessage andVerify:(BOOL)doVerify {
             @"Post-commit hook failed, but successfully created commit %@",
             commit];
 
-  [userInfo setObject:description forKey:@"description"];
-  [userInfo setObject:commit forKey:@"sha"];
+  NSDictionary *userInfo = @{
+    @"success" : @(!postCommitFailed),
+    @"description" : description,
+    @"sha" : commit
+  };
 
   [[NSNotificationCenter defaultCenter]
       postNotificationName:PBGitIndexFinishedCommit
                     object:self
                   userInfo:userInfo];
-  if (!success)
+  if (postCommitFailed)
     return;
 
-  repository.hasChanged = YES;
+  // An amended commit replaces one already in the history; anything else can
+  // go on top of the list without walking the history again.
+  if (amended || ![repository.revisionList showNewCommit:commit])
+    repository.hasChanged = YES;
 
   amendEnvironment = nil;
   if (amend)
@@ -355,28 +463,52 @@ - (void)commitWithMessage:(NSString *)commitMessage andVerify:(BOOL)doVerify {
     [self refresh];
 }
 
-- (void)postCommitUpdate:(NSString *)update {
-  [[NSNotificationCenter defaultCenter]
-      postNotificationName:PBGitIndexCommitStatus
-                    object:self
-                  userInfo:[NSDictionary dictionaryWithObject:update
-                                                       forKey:@"description"]];
+- (void)postCommitUpdate:(NSString *)update progress:(NSProgress *)progress {
+  int64_t stage = progress.completedUnitCount + 1;
+  progress.completedUnitCount = stage;
+  progress.localizedDescription = update;
+
+  NSDictionary *userInfo = @{
+    @"description" : update,
+    @"stage" : @(stage),
+    @"stageCount" : @(progress.totalUnitCount)
+  };
+  dispatch_async(dispatch_get_main_queue(), ^{
+    [[NSNotificationCenter defaultCenter]
+        postNotificationName:PBGitIndexCommitStatus
+                      object:self
+                    userInfo:userInfo];
+  });
 }
 
-- (void)postCommitFailure:(NSString *)reason {
-  [[NSNotificationCenter defaultCenter]
-      postNotificationName:PBGitIndexCommitFailed
-                    object:self
-                  userInfo:[NSDictionary dictionaryWithObject:reason
-                                                       forKey:@"description"]];
+- (void)postCommitFailure:(NSString *)reason progress:(NSProgress *)progress {
+  [self postCommitEnd:PBGitIndexCommitFailed
+             userInfo:@{@"description" : reason}
+             progress:progress];
 }
 
-- (void)postCommitHookFailure:(NSString *)reason {
-  [[NSNotificationCenter defaultCenter]
-      postNotificationName:PBGitIndexCommitHookFailed
-                    object:self
-                  userInfo:[NSDictionary dictionaryWithObject:reason
-                                                       forKey:@"description"]];
+- (void)postCommitHookFailure:(NSString *)reason progress:(NSProgress *)progress {
+  [self postCommitEnd:PBGitIndexCommitHookFailed
+             userInfo:@{@"description" : reason}
+             progress:progress];
+}
+
+- (void)postCommitCancelled:(NSProgress *)progress {
+  [self postCommitEnd:PBGitIndexCommitFailed
+             userInfo:@{@"description" : @"Commit cancelled", @"cancelled" : @YES}
+             progress:progress];
+}
+
+- (void)postCommitEnd:(NSString *)notificationName
+             userInfo:(NSDictionary *)userInfo
+             progress:(NSProgress *)progress {
+  dispatch_async(dispatch_get_main_queue(), ^{
+    if (commitProgress == progress)
+      commitProgress = nil;
+    [[NSNotificationCenter defaultCenter] postNotificationName:notificationName
+                                                        object:self
+                                                      userInfo:userInfo];
+  });
 }
 
 - (void)postOperationFailed:(NSString *)description {
@@ -471,8 +603,14 @@ - (void)discardChangesForFiles:(NSArray *)discardFiles {
   [self postIndexChange];
 }
 
-- (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse;
-{
+- (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse {
+  return [self applyPatches:@[ hunk ] stage:stage reverse:reverse];
+}
+
+- (BOOL)applyPatches:(NSArray *)patches stage:(BOOL)stage reverse:(BOOL)reverse {
+  if (![patches count])
+    return YES;
+
   NSMutableArray *array =
       [NSMutableArray arrayWithObjects:@"apply", @"--unidiff-zero", nil];
   if (stage)
@@ -480,9 +618,18 @@ - (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse;
   if (reverse)
     [array addObject:@"--reverse"];
 
+  // git apply takes several patches to the same path in one input and
+  // applies them in order
+  NSMutableString *input = [NSMutableString string];
+  for (NSString *patch in patches) {
+    [input appendString:patch];
+    if (![patch hasSuffix:@"\n"])
+      [input appendString:@"\n"];
+  }
+
   NSError *error = nil;
   [repository executeGitCommand:array
-                      withInput:hunk
+                      withInput:input
                           error:&error];
 
   if (error) {
@@ -504,7 +651,7 @@ - (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse;
       @"%@\n\n"
       @"Patch attempted:\n"
       @"----------------\n%@",
-      errorDesc, gitError, gitCommand, hunk];
+      errorDesc, gitError, gitCommand, input];
 
     [fullDetails writeToFile:tempPath atomically:YES encoding:NSUTF8StringEncoding error:nil];
 
@@ -518,11 +665,93 @@ - (BOOL)applyPatch:(NSString *)hunk stage:(BOOL)stage reverse:(BOOL)reverse;
     return NO;
   }
 
-  // TODO: Try to be smarter about what to refresh
-  [self refresh];
+  NSSet *paths = [self pathsTouchedByPatch:input];
+  if (paths)
+    [self refreshPaths:paths];
+  else
+    [self refresh];
   return YES;
 }
 
+// Paths named by the "+++ b/" / "--- a/" lines of a patch, or nil when a
+// path can't be read back reliably (quoted names), so the caller falls
+// back to a full refresh. Only the header block between a "diff --git"
+// line and its first hunk is read; hunk lines can look like headers too.
+- (NSSet *)pathsTouchedByPatch:(NSString *)patch {
+  NSMutableSet *paths = [NSMutableSet set];
+  __block BOOL readable = YES;
+  __block BOOL inHeader = NO;
+
+  [patch enumerateLinesUsingBlock:^(NSString *line, BOOL *stop) {
+    if ([line hasPrefix:@"diff --git "]) {
+      inHeader = YES;
+      return;
+    }
+    if ([line hasPrefix:@"@@"])
+      inHeader = NO;
+    if (!inHeader)
+      return;
+
+    NSString *path = nil;
+    if ([line hasPrefix:@"+++ b/"] || [line hasPrefix:@"--- a/"])
+      path = [line substringFromIndex:6];
+    else if ([line hasPrefix:@"+++ \""] || [line hasPrefix:@"--- \""]) {
+      readable = NO;
+      *stop = YES;
+      return;
+    }
+
+    // git appends a tab when the name has trailing whitespace
+    if ([path hasSuffix:@"\t"])
+      path = [path substringToIndex:[path length] - 1];
+    if ([path length])
+      [paths addObject:path];
+  }];
+
+  if (!readable || ![paths count])
+    return nil;
+  return paths;
+}
+
+// Re-reads the staged and unstaged state of just `paths` instead of
+// rescanning the whole work tree.
+- (void)refreshPaths:(NSSet *)paths {
+  [self beginRefreshSpan:@"index refresh paths"];
+  // File names, not patterns: *, ?, [ or a leading : mean nothing here
+  NSMutableArray *pathspec = [NSMutableArray arrayWithCapacity:[paths count]];
+  for (NSString *path in [[paths allObjects] sortedArrayUsingSelector:@selector(compare:)])
+    [pathspec addObject:[@":(literal)" stringByAppendingString:path]];
+  NSArray *commands = @[
+    [@[@"diff-files", @"-z", @"--"] arrayByAddingObjectsFromArray:pathspec],
+    [@[@"diff-index", @"--cached", @"-z", [self parentTree], @"--"] arrayByAddingObjectsFromArray:pathspec]
+  ];
+
+  // git apply leaves the touched entries stat-dirty, which diff-files would
+  // report as modified; refresh their stat data first, and only theirs.
+  [repository executeGitCommandAsync:[@[@"add", @"--refresh", @"--"] arrayByAddingObjectsFromArray:pathspec]
+                          completion:^(NSString *output, NSString *error, int exitCode) {
+    [self readStateForPaths:paths commands:commands];
+  }];
+}
+
+- (void)readStateForPaths:(NSSet *)paths commands:(NSArray *)commands {
+  [repository executeGitCommandsAsync:commands completion:^(NSArray<NSDictionary *> *results) {
+    NSArray *unstagedLines = [self linesFromOutput:results[0][@"output"]];
+    [self addFilesFromDictionary:[self dictionaryForLines:unstagedLines]
+                          staged:NO
+                         tracked:YES
+                         inPaths:paths];
+
+    NSArray *stagedLines = [self linesFromOutput:results[1][@"output"]];
+    [self addFilesFromDictionary:[self dictionaryForLines:stagedLines]
+                          staged:YES
+                         tracked:YES
+                         inPaths:paths];
+
+    [self finalizeRefresh];
+  }];
+}
+
 - (NSString *)diffForFile:(PBChangedFile *)file
                    staged:(BOOL)staged
              contextLines:(NSUInteger)context {
@@ -536,58 +765,125 @@ - (NSString *)diffForFile:(PBChangedFile *)file
                    staged:(BOOL)staged
              contextLines:(NSUInteger)context
                 truncated:(BOOL *)truncated {
+  return [self diffForFile:file
+                    staged:staged
+              contextLines:context
+                 truncated:truncated
+                  fullSize:NULL];
+}
+
+- (NSString *)diffForFile:(PBChangedFile *)file
+                   staged:(BOOL)staged
+             contextLines:(NSUInteger)context
+                truncated:(BOOL *)truncated
+                 fullSize:(unsigned long long *)fullSize {
+  if (fullSize)
+    *fullSize = 0;
+
+  // New files are shown whole, so only read as much as the preview can show
+  if (file.status == PBChangedFileStatusNew)
+    return [self previewForNewFile:file
+                            staged:staged
+                         truncated:truncated
+                          fullSize:fullSize];
+
   NSString *parameter = [NSString stringWithFormat:@"-U%lu", context];
   NSString *diff = nil;
+  NSError *error = nil;
 
   if (staged) {
-    NSString *indexPath = [@":0:" stringByAppendingString:file.path];
-
-    if (file.status == PBChangedFileStatusNew) {
-      NSError *error = nil;
-      diff = [repository executeGitCommand:@[ @"show", indexPath ]
-                                     error:&error];
-    } else {
-      NSError *error = nil;
-      diff = [repository executeGitCommand:@[
-        @"diff-index", parameter, @"--cached", [self parentTree], @"--",
-        file.path
-      ]
-                              inWorkingDir:YES
-                                     error:&error];
-    }
+    diff = [repository executeGitCommand:@[
+      @"diff-index", parameter, @"--cached", [self parentTree], @"--",
+      file.path
+    ]
+                            inWorkingDir:YES
+                                   error:&error];
   } else {
-    if (file.status == PBChangedFileStatusNew) {
-      NSStringEncoding encoding;
-      NSError *error = nil;
-      NSString *path = [[repository workingDirectory]
-          stringByAppendingPathComponent:file.path];
-      diff = [NSString stringWithContentsOfFile:path
-                                   usedEncoding:&encoding
-                                          error:&error];
-      if (error)
-        diff = nil;
-    } else {
-      NSError *error = nil;
-      diff = [repository
-          executeGitCommand:@[ @"diff-files", parameter, @"--", file.path ]
-               inWorkingDir:YES
-                      error:&error];
-    }
+    diff = [repository
+        executeGitCommand:@[ @"diff-files", parameter, @"--", file.path ]
+             inWorkingDir:YES
+                    error:&error];
   }
 
-  BOOL didTruncate = NO;
-  if (diff && (file.status == PBChangedFileStatusNew ||
-               file.status == PBChangedFileStatusDeleted)) {
-    if ([diff length] > kPBGitIndexDiffPreviewTruncationLimit) {
-      diff = [diff substringToIndex:kPBGitIndexDiffPreviewTruncationLimit];
-      didTruncate = YES;
-    }
+  // Diffs come whole, at whatever context was asked for; the commit view
+  // cuts deletions down to the preview limit once it has re-windowed them
+  if (truncated)
+    *truncated = NO;
+
+  return diff;
+}
+
+// Reads at most the preview limit from the work tree file or the index blob,
+// however large the file is. Returns nil for binary content.
+- (NSString *)previewForNewFile:(PBChangedFile *)file
+                         staged:(BOOL)staged
+                      truncated:(BOOL *)truncated
+                       fullSize:(unsigned long long *)fullSize {
+  NSUInteger limit = kPBGitIndexDiffPreviewTruncationLimit;
+  NSData *prefix = nil;
+  unsigned long long size = 0;
+
+  if (staged) {
+    NSString *indexPath = [@":0:" stringByAppendingString:file.path];
+    NSError *error = nil;
+    NSString *sizeString = [repository executeGitCommand:@[ @"cat-file", @"-s", indexPath ]
+                                                   error:&error];
+    if (error)
+      return nil;
+    size = strtoull([sizeString UTF8String], NULL, 10);
+    prefix = [repository executeGitCommandReturningPrefix:@[ @"cat-file", @"blob", indexPath ]
+                                                   length:limit
+                                                    error:&error];
+  } else {
+    NSString *path = [[repository workingDirectory]
+        stringByAppendingPathComponent:file.path];
+    NSFileHandle *handle = [NSFileHandle fileHandleForReadingAtPath:path];
+    if (!handle)
+      return nil;
+    size = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:nil] fileSize];
+    prefix = [handle readDataOfLength:limit];
+    [handle closeFile];
   }
 
+  if (fullSize)
+    *fullSize = size;
   if (truncated)
-    *truncated = didTruncate;
+    *truncated = size > [prefix length];
 
-  return diff;
+  if (!prefix)
+    return nil;
+  return [self previewStringFromData:prefix];
+}
+
+// Decodes a file prefix for display, or returns nil if it looks binary.
+// Uses git's heuristic: a NUL byte in the first 8000 bytes means binary.
+- (NSString *)previewStringFromData:(NSData *)data {
+  const unsigned char *bytes = [data bytes];
+  NSUInteger length = [data length];
+
+  // A byte order mark means UTF-16/32, which legitimately contains NULs
+  BOOL hasUTF16BOM = length >= 2 && ((bytes[0] == 0xFF && bytes[1] == 0xFE) ||
+                                     (bytes[0] == 0xFE && bytes[1] == 0xFF));
+  if (hasUTF16BOM) {
+    NSUInteger evenLength = length & ~(NSUInteger)1;
+    return [[NSString alloc] initWithData:[data subdataWithRange:NSMakeRange(0, evenLength)]
+                                 encoding:NSUnicodeStringEncoding];
+  }
+
+  if (memchr(bytes, 0, MIN(length, (NSUInteger)8000)))
+    return nil;
+
+  // The prefix may end partway through a UTF-8 sequence; drop the partial
+  // character rather than failing the whole decode.
+  for (NSUInteger trim = 0; trim < 4 && trim < length; trim++) {
+    NSString *string = [[NSString alloc] initWithBytes:bytes
+                                                length:length - trim
+                                              encoding:NSUTF8StringEncoding];
+    if (string)
+      return string;
+  }
+
+  return [[NSString alloc] initWithData:data encoding:NSISOLatin1StringEncoding];
 }
 
 - (void)postIndexChange {
@@ -599,8 +895,23 @@ - (void)postIndexChange {
 - (void)addFilesFromDictionary:(NSMutableDictionary *)dictionary
                         staged:(BOOL)staged
                        tracked:(BOOL)tracked {
+  [self addFilesFromDictionary:dictionary
+                        staged:staged
+                       tracked:tracked
+                       inPaths:nil];
+}
+
+// When paths is set, the dictionary only describes those paths, so other
+// files keep their current state.
+- (void)addFilesFromDictionary:(NSMutableDictionary *)dictionary
+                        staged:(BOOL)staged
+                       tracked:(BOOL)tracked
+                       inPaths:(NSSet *)paths {
   // Iterate over all existing files
   for (PBChangedFile *file in files) {
+    if (paths && ![paths containsObject:file.path])
+      continue;
+
     NSArray *fileStatus = [dictionary objectForKey:file.path];
     // Object found, this is still a cached / uncached thing
     if (fileStatus) {
@@ -609,6 +920,7 @@ - (void)addFilesFromDictionary:(NSMutableDictionary *)dictionary
         NSString *sha = [fileStatus objectAtIndex:2];
         file.commitBlobSHA = sha;
         file.commitBlobMode = mode;
+        [self setBlobSHAsOfFile:file fromStatus:fileStatus staged:staged];
 
         if (staged)
           file.hasStagedChanges = YES;
@@ -666,6 +978,7 @@ - (void)addFilesFromDictionary:(NSMutableDictionary *)dictionary
     if (tracked) {
       file.commitBlobMode = [[fileStatus objectAtIndex:0] substringFromIndex:1];
       file.commitBlobSHA = [fileStatus objectAtIndex:2];
+      [self setBlobSHAsOfFile:file fromStatus:fileStatus staged:staged];
     }
 
     file.hasStagedChanges = staged;
@@ -677,6 +990,19 @@ - (void)addFilesFromDictionary:(NSMutableDictionary *)dictionary
   [self didChangeValueForKey:@"indexChanges"];
 }
 
+// diff-index --cached lists HEAD's blob and the index's, diff-files the
+// index's and zeros for the work tree.
+- (void)setBlobSHAsOfFile:(PBChangedFile *)file
+               fromStatus:(NSArray *)fileStatus
+                   staged:(BOOL)staged {
+  if (staged) {
+    file.headBlobSHA = [fileStatus objectAtIndex:2];
+    file.indexBlobSHA = [fileStatus objectAtIndex:3];
+  } else {
+    file.indexBlobSHA = [fileStatus objectAtIndex:2];
+  }
+}
+
 #pragma mark Utility methods
 
 - (BOOL)isFileAutogenerated:(NSString *)path {
@@ -12,6 +12,10 @@
 @class PBGitRevSpecifier;
 @protocol PBGitRefish;
 @class PBGitRef;
+@class PBGitDecorationIndex;
+@class PBCommitGraph;
+@class PBCommitTextCache;
+@class PBCommitAncestry;
 
 extern NSString* PBGitRepositoryErrorDomain;
 extern NSString *PBGitRepositoryDocumentType;
@@ -68,11 +72,25 @@ static NSString *PBStringFromBranchFilterType(PBGitBranchFilterType type) {
 @property (nonatomic, strong) NSMutableOrderedSet* branchesSet;
 @property (nonatomic, strong) PBGitRevSpecifier* currentBranch;
 @property (nonatomic, strong) NSMutableDictionary* refs;
+// NO until the first ref listing after opening has been applied; refs, branches
+// and stash data are empty before then.
+@property (nonatomic, readonly, assign) BOOL refsLoaded;
 
-@property (nonatomic, strong) NSMutableArray* submodules;
+// PBSubmoduleInfo objects read from .gitmodules and the index; rescanned only when either changes.
+@property (nonatomic, readonly, strong) NSArray* submodules;
 @property (nonatomic, strong) NSSet* noteSHAs;
 @property (nonatomic, strong) NSArray<NSString *>* noteRefs;
 
+// Per-commit ref/notes/HEAD decorations for the history list, rebuilt when refs reload.
+@property (nonatomic, readonly, strong) PBGitDecorationIndex *decorations;
+- (void)invalidateDecorations;
+
+// Messages and names of commits listed without them, read as rows are shown.
+@property (nonatomic, readonly, strong) PBCommitTextCache *commitTexts;
+
+// Is-ancestor, merge-base and ahead/behind answers from the commits in memory.
+@property (nonatomic, readonly, strong) PBCommitAncestry *ancestry;
+
 - (BOOL) checkoutRefish:(id <PBGitRefish>)ref;
 - (BOOL) mergeWithRefish:(id <PBGitRefish>)ref;
 - (BOOL) cherryPickRefish:(id <PBGitRefish>)ref;
@@ -91,6 +109,9 @@ static NSString *PBStringFromBranchFilterType(PBGitBranchFilterType type) {
 
 - (BOOL)executeHook:(NSString *)name output:(NSString **)output;
 - (BOOL)executeHook:(NSString *)name withArgs:(NSArray*) arguments output:(NSString **)output;
+// Cancelling progress terminates the hook and anything it started, and returns
+// at once; the hook then counts as failed.
+- (BOOL)executeHook:(NSString *)name withArgs:(NSArray *)arguments output:(NSString **)output progress:(NSProgress *)progress;
 
 // Async Git Execution (preferred for background operations)
 // Completion block is called on main thread with: output (nil on error), stderr, exit code
@@ -100,24 +121,47 @@ static NSString *PBStringFromBranchFilterType(PBGitBranchFilterType type) {
 // Binary data execution (for blob content that may not be valid UTF-8)
 - (NSData *)executeGitCommandReturningData:(NSArray<NSString *> *)arguments error:(NSError **)error;
 
+// Reads at most length bytes of stdout, then stops the command.
+- (NSData *)executeGitCommandReturningPrefix:(NSArray<NSString *> *)arguments length:(NSUInteger)length error:(NSError **)error;
+
+// Streaming execution: handler receives each separator-delimited record of stdout as it arrives.
+// Return NO from the handler to stop early.
+- (BOOL)streamGitCommand:(NSArray<NSString *> *)arguments recordSeparator:(NSData *)separator handler:(BOOL (NS_NOESCAPE ^)(NSData *record))handler error:(NSError **)error;
+
 - (NSString *)workingDirectory;
 - (NSString *) projectName;
 - (NSString *)gitIgnoreFilename;
 - (BOOL)isBareRepository;
+- (BOOL)hasCommitGraph;
+// The repository's commit-graph, or nil if it has none git would use.
+- (PBCommitGraph *)commitGraph;
+// The shared config file, or nil when the repository wasn't found on disk.
+- (NSString *)configPath;
+- (NSArray<NSString *> *)tipSHAsForRevSpecifier:(PBGitRevSpecifier *)rev;
 
 
 - (void) reloadRefs;
+// Reads the refs in the background and applies them on the main queue, then
+// calls completion there with whether they were (a newer load wins).
+- (void)reloadRefsInBackground:(void (^)(BOOL applied))completion;
 - (void) lazyReload;
 - (PBGitRevSpecifier*)headRef;
 - (NSString *)headSHA;
 - (PBGitCommit *)headCommit;
 - (NSString *)shaForRef:(PBGitRef *)ref;
+// What the last ref listing had for a full ref name; never asks git.
+- (NSString *)listedSHAForRefName:(NSString *)refName;
 - (PBGitCommit *)commitForRef:(PBGitRef *)ref;
+// Looks in the project history snapshot. A SHA it doesn't have yet gives nil;
+// on the main thread, if the history is empty or a ref points at the SHA,
+// the history is reloaded (once per ref listing) so a later call finds it.
 - (PBGitCommit *)commitForSHA:(NSString *)sha;
 - (BOOL)shaHasStashReference:(NSString *)sha;
 - (BOOL)isSuppressedStashCommit:(NSString *)sha;
 - (NSArray<NSString *> *)stashCommitSHAs;
 - (BOOL)isStashCommitSHA:(NSString *)sha;
+// On the main thread these answer NO until the ancestry is worked out in the
+// background; PBCommitAncestry.didUpdateNotification follows.
 - (BOOL)isOnSameBranch:(NSString *)baseSHA asSHA:(NSString *)testSHA;
 - (BOOL)isSHAOnHeadBranch:(NSString *)testSHA;
 - (BOOL)isRefOnHeadBranch:(PBGitRef *)testRef;
@@ -13,6 +13,8 @@
 #import "GitXScriptingConstants.h"
 #import "PBHistorySearchController.h"
 #import "PBGitHistoryList.h"
+#import <fnmatch.h>
+#import <spawn.h>
 
 
 NSString *PBGitRepositoryDocumentType = @"Git Repository";
@@ -22,9 +24,20 @@ @interface PBGitRepository ()
 	NSMutableDictionary *refToSHAMapping; // Maps ref strings to SHA strings
 	NSMutableSet *suppressedStashParents; // SHAs for stash helper commits we hide
 	NSMutableArray<NSString *> *stashCommitSHAs; // Ordered list of stash commits for rev-list
+	PBGitDecorationIndex *_decorations;
+	NSString *submodulesStamp; // .gitmodules and index modification dates of the last scan
+	GitRepoLocation *location; // Found without git; nil when rev-parse had to find the repository
+	GitRefStore *refStore; // Reads refs from disk; nil without a location or with reftable
+	PBCommitGraph *commitGraph; // Last commit-graph read; replaced when git rewrites it
+	PBTraceSpan *openWindowSpan; // From readFromURL to the window showing
+	PBTraceSpan *openRefsSpan; // From readFromURL to the first ref listing being applied
+	__weak NSMutableDictionary *forcedUpdateRefs; // Ref listing commitForSHA: last reloaded the history for
+	NSUInteger refLoadGeneration; // Bumped by each ref load; guarded by @synchronized (self)
 }
 
 @property (nonatomic, copy, nullable) NSString *cachedDisplayName;
+@property (nonatomic, readwrite, strong) NSArray* submodules;
+@property (nonatomic, readwrite, assign) BOOL refsLoaded;
 
 @end
 
@@ -42,8 +55,13 @@ - (id)init
     if (!self) return nil;
 
 	self.branchesSet = [NSMutableOrderedSet orderedSet];
-    self.submodules = [NSMutableArray array];
+    self.submodules = @[];
 	currentBranchFilter = [PBGitDefaults branchFilter];
+	// A few screens' worth for each of several windows onto the history
+	_commitTexts = [[PBCommitTextCache alloc] initWithRepository:self capacity:4096];
+	[[GitWorkspace shared] registerCache:_commitTexts forRepository:self];
+	_ancestry = [[PBCommitAncestry alloc] initWithRepository:self];
+	[[GitWorkspace shared] registerCache:_ancestry forRepository:self];
     return self;
 }
 
@@ -63,6 +81,9 @@ - (void) dealloc
 //this works much better.
 - (BOOL)readFromURL:(NSURL *)absoluteURL ofType:(NSString *)typeName error:(NSError **)outError
 {
+	openWindowSpan = [[PBTracer shared] beginSpan:@"open to window" category:@"open"];
+	openRefsSpan = [[PBTracer shared] beginSpan:@"open to refs" category:@"open"];
+
 	if (![PBGitBinary path])
 	{
 		if (outError) {
@@ -84,9 +105,30 @@ - (BOOL)readFromURL:(NSURL *)absoluteURL ofType:(NSString *)typeName error:(NSEr
 		return NO;
 	}
 
+	// Find the repository by looking for .git ourselves. Setups the walk
+	// leaves to git are checked with rev-parse as before.
+	location = [GitRepoFinder locationForURL:absoluteURL];
+	if (location) {
+		NSString *workDir = location.isBare ? [absoluteURL path] : [location.workDir path];
+		_cachedWorkingDirectory = [workDir stringByStandardizingPath];
+		refStore = [GitRefStore storeForLocation:location];
+	} else if (![self validateRepositoryWithGitAtURL:absoluteURL error:outError]) {
+		return NO;
+	}
+
+	revisionList = [[PBGitHistoryList alloc] initWithRepository:self];
+
+	// The window opens without waiting for refs; the history list waits for
+	// refsLoaded instead.
+	[self loadRefsInBackground];
+
+	return YES;
+}
+
+- (BOOL)validateRepositoryWithGitAtURL:(NSURL *)absoluteURL error:(NSError **)outError
+{
     NSError *error = nil;
     
-    // Use git rev-parse to validate this is a git repository
     // Special case: can't use executeGitCommand as repository isn't initialized yet
     // We need to use PBEasyPipe here since it doesn't require self to be initialized
     int exitCode = 0;
@@ -100,12 +142,10 @@ - (BOOL)readFromURL:(NSURL *)absoluteURL ofType:(NSString *)typeName error:(NSEr
                                   inDir:[absoluteURL path]
                                retValue:&exitCode];
     
-    BOOL isValidRepo = (exitCode == 0);
-    
-	if (!isValidRepo) {
+	if (exitCode != 0) {
 		if (outError) {
 			NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:
-                                      [NSString stringWithFormat:@"%@ does not appear to be a git repository.", [[self fileURL] path]], NSLocalizedRecoverySuggestionErrorKey,
+                                      [NSString stringWithFormat:@"%@ does not appear to be a git repository.", [absoluteURL path]], NSLocalizedRecoverySuggestionErrorKey,
                                       error, NSUnderlyingErrorKey,
                                       nil];
 			*outError = [NSError errorWithDomain:PBGitRepositoryErrorDomain code:PBGitErrorInvalidRepository userInfo:userInfo];
@@ -113,11 +153,6 @@ - (BOOL)readFromURL:(NSURL *)absoluteURL ofType:(NSString *)typeName error:(NSEr
 		return NO;
 	}
 
-	revisionList = [[PBGitHistoryList alloc] initWithRepository:self];
-
-	[self reloadRefs];
-
-
 	return YES;
 }
 
@@ -143,24 +178,37 @@ - (NSString *)displayName
 	return self.cachedDisplayName ?: projectName;
 }
 
+// headSHA is looked up on first use, so the title can be set before the
+// refs are loaded.
 - (void)refreshCachedHeadInfo
 {
 	NSString *projectName = self.projectName ?: @"";
-	NSString *symbolicRef = [self parseSymbolicReference:@"HEAD"];
+	NSString *symbolicRef = [self symbolicHeadRef];
+	_headSha = nil;
 	if (symbolicRef.length > 0) {
 		PBGitRef *ref = [PBGitRef refFromString:symbolicRef];
 		_headRef = [[PBGitRevSpecifier alloc] initWithRef:ref];
-		_headSha = [self shaForRef:[_headRef ref]];
 		NSString *branchName = ref.shortName ?: symbolicRef;
 		self.cachedDisplayName = [NSString localizedStringWithFormat:@"%@ (branch: %@)", projectName, branchName];
 		return;
 	}
 
 	_headRef = [[PBGitRevSpecifier alloc] initWithRef:[PBGitRef refFromString:@"HEAD"]];
-	_headSha = [self shaForRef:[_headRef ref]];
 	self.cachedDisplayName = [NSString localizedStringWithFormat:@"%@ (detached HEAD)", projectName];
 }
 
+// The ref HEAD points to, or nil when detached. Read from the HEAD file when
+// the repository was found without git.
+- (NSString *)symbolicHeadRef
+{
+	if (location) {
+		NSString *head = [GitRepoFinder headInGitDir:location.gitDir];
+		if (head)
+			return [head hasPrefix:@"refs/"] ? head : nil;
+	}
+	return [self parseSymbolicReference:@"HEAD"];
+}
+
 - (void)makeWindowControllers
 {
     // Create our custom window controller
@@ -172,6 +220,9 @@ - (void)makeWindowControllers
 - (void)showWindows
 {
 	[super showWindows];
+
+	[openWindowSpan end];
+	openWindowSpan = nil;
 }
 
 #pragma mark -
@@ -179,6 +230,9 @@ - (void)showWindows
 
 - (NSURL *)getIndexURL
 {
+	if (location)
+		return [location.gitDir URLByAppendingPathComponent:@"index"];
+
 	NSError *error = nil;
 	NSString *indexPath = [self executeGitCommand:@[@"rev-parse", @"--git-path", @"index"] error:&error];
 	
@@ -209,7 +263,107 @@ - (BOOL)isBareRepository
 }
 
 
+- (NSString *)objectsInfoPath
+{
+	NSString *infoPath = [[location.commonDir URLByAppendingPathComponent:@"objects/info"] path];
+	if (!infoPath) {
+		NSError *error = nil;
+		infoPath = [self executeGitCommand:@[@"rev-parse", @"--git-path", @"objects/info"] error:&error];
+		if (error || !infoPath)
+			return nil;
+	}
+
+	if (![infoPath isAbsolutePath])
+		infoPath = [[self workingDirectory] stringByAppendingPathComponent:infoPath];
+	return infoPath;
+}
+
+- (NSString *)configPath
+{
+	return [[location.commonDir URLByAppendingPathComponent:@"config"] path];
+}
+
+// git only streams --topo-order output (using generation numbers) when a
+// commit-graph file is present; otherwise it has to walk everything first.
+- (BOOL)hasCommitGraph
+{
+	NSString *infoPath = [self objectsInfoPath];
+	if (!infoPath)
+		return NO;
+
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	return [fileManager fileExistsAtPath:[infoPath stringByAppendingPathComponent:@"commit-graph"]]
+		|| [fileManager fileExistsAtPath:[infoPath stringByAppendingPathComponent:@"commit-graphs/commit-graph-chain"]];
+}
+
+- (PBCommitGraph *)commitGraph
+{
+	@synchronized (self) {
+		if (commitGraph && [commitGraph isCurrent])
+			return commitGraph;
+
+		NSString *infoPath = [self objectsInfoPath];
+		commitGraph = infoPath ? [PBCommitGraph graphInObjectsInfoDirectory:[NSURL fileURLWithPath:infoPath isDirectory:YES]] : nil;
+		return commitGraph;
+	}
+}
+
+// The commits rev would start rev-list from, looked up in the refs loaded
+// last. Returns nil when rev uses anything besides HEAD, full ref names and
+// the ref selection options, since only git can resolve those.
+- (NSArray<NSString *> *)tipSHAsForRevSpecifier:(PBGitRevSpecifier *)rev
+{
+	if (!self.refsLoaded || [rev hasPathLimiter])
+		return nil;
+
+	NSMutableOrderedSet<NSString *> *tips = [NSMutableOrderedSet orderedSet];
+	for (NSString *parameter in rev.parameters) {
+		if ([parameter isEqualToString:@"HEAD"]) {
+			NSString *sha = [self headSHA];
+			if ([sha length] < 40)
+				return nil;
+			[tips addObject:sha];
+			continue;
+		}
+
+		NSString *pattern = nil;
+		if ([parameter isEqualToString:@"--branches"])
+			pattern = @"refs/heads/";
+		else if ([parameter isEqualToString:@"--remotes"])
+			pattern = @"refs/remotes/";
+		else if ([parameter isEqualToString:@"--tags"])
+			pattern = @"refs/tags/";
+		else if ([parameter hasPrefix:@"--glob="]) {
+			pattern = [parameter substringFromIndex:7];
+			if (![pattern hasPrefix:@"refs/"])
+				pattern = [@"refs/" stringByAppendingString:pattern];
+		}
+
+		if (pattern) {
+			// Like git, a pattern without wildcards matches everything under it
+			BOOL wildcard = [pattern rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"*?["]].location != NSNotFound;
+			if (!wildcard && ![pattern hasSuffix:@"/"])
+				pattern = [pattern stringByAppendingString:@"/"];
+			[refToSHAMapping enumerateKeysAndObjectsUsingBlock:^(NSString *name, NSString *sha, BOOL *stop) {
+				BOOL matches = wildcard ? fnmatch([pattern UTF8String], [name UTF8String], 0) == 0 : [name hasPrefix:pattern];
+				if (matches)
+					[tips addObject:sha];
+			}];
+			continue;
+		}
+
+		NSString *sha = [parameter hasPrefix:@"refs/"] ? refToSHAMapping[parameter] : nil;
+		if (!sha)
+			return nil;
+		[tips addObject:sha];
+	}
+	return [tips array];
+}
+
 - (NSURL *)gitURL {
+	if (location)
+		return location.gitDir;
+
 	NSError *error = nil;
 	NSString *gitPath = [self executeGitCommand:@[@"rev-parse", @"--git-dir"] error:&error];
 	
@@ -264,46 +418,191 @@ - (void)addRef:(PBGitRef *)ref
     }
 }
 
+- (NSString *)currentSubmodulesStamp
+{
+	NSString *gitmodulesPath = [[self workingDirectory] stringByAppendingPathComponent:@".gitmodules"];
+	NSFileManager *fileManager = [NSFileManager defaultManager];
+	NSDate *gitmodulesDate = [[fileManager attributesOfItemAtPath:gitmodulesPath error:nil] fileModificationDate];
+	NSDate *indexDate = [[fileManager attributesOfItemAtPath:[[self indexURL] path] error:nil] fileModificationDate];
+
+	return [NSString stringWithFormat:@"%f:%f", [gitmodulesDate timeIntervalSinceReferenceDate], [indexDate timeIntervalSinceReferenceDate]];
+}
+
 - (void)loadSubmodules
 {
-    self.submodules = [NSMutableArray array];
-    
-    NSError *error = nil;
-    NSString *output = [self executeGitCommand:@[@"submodule", @"status"] error:&error];
-    
-    if (error) {
-        NSLog(@"Error loading submodules: %@", error.localizedDescription);
-        return;
-    }
-    
-    if (output) {
-        output = [output stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-        
-        if ([output length] > 0) {
-            NSArray *lines = [output componentsSeparatedByString:@"\n"];
-            for (NSString *line in lines) {
-                // Git submodule status format: " <sha> <path> (<description>)"
-                // First character indicates status: ' ' initialized, '-' not initialized, '+' modified
-                if ([line length] > 42) { // Minimum: status char + 40 char SHA + space + path
-                    NSString *trimmedLine = [line substringFromIndex:1]; // Skip status character
-                    NSArray *components = [trimmedLine componentsSeparatedByString:@" "];
-                    if ([components count] >= 2) {
-                        NSString *path = [components objectAtIndex:1];
-                        
-                        PBSubmoduleInfo *submoduleInfo = [[PBSubmoduleInfo alloc] init];
-                        submoduleInfo.name = [path lastPathComponent];
-                        submoduleInfo.path = path;
-                        submoduleInfo.parentRepositoryURL = [NSURL fileURLWithPath:[self workingDirectory]];
-                        
-                        [self.submodules addObject:submoduleInfo];
-                    }
-                }
-            }
-        }
-    }
+	if ([self isBareRepository]) {
+		self.submodules = @[];
+		return;
+	}
+
+	// Gitlinks only change with the index or .gitmodules, so skip the scan if neither has.
+	NSString *stamp = [self currentSubmodulesStamp];
+	if ([stamp isEqualToString:submodulesStamp])
+		return;
+
+	submodulesStamp = stamp;
+	self.submodules = [PBSubmoduleInfo submodulesInRepository:self];
+}
+
+// Starts a ref load. Background results of older loads are dropped when
+// they arrive, so they can't overwrite what a newer one applied.
+- (NSUInteger)beginRefLoad
+{
+	@synchronized (self) {
+		return ++refLoadGeneration;
+	}
+}
+
+- (BOOL)isCurrentRefLoad:(NSUInteger)generation
+{
+	@synchronized (self) {
+		return generation == refLoadGeneration;
+	}
 }
 
 - (void) reloadRefs
+{
+	[self beginRefLoad];
+
+	__block NSArray<GitRefEntry *> *refListing = nil;
+	__block NSString *stashLog = nil;
+	__block NSDictionary *notes = nil;
+
+	// The main thread never waits for a process slot, so when it is the one
+	// waiting here the listings it waits for don't either
+	BOOL exempt = [NSThread isMainThread];
+	void (^read)(dispatch_block_t) = ^(dispatch_block_t block) {
+		if (exempt)
+			[[GitWorkspace shared] performExemptFromProcessSlots:block];
+		else
+			block();
+	};
+
+	// The three listings don't depend on each other
+	dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_group_async(group, queue, ^{ read(^{ refListing = [self readRefListing]; }); });
+	dispatch_group_async(group, queue, ^{ read(^{ stashLog = [self readStashLog]; }); });
+	dispatch_group_async(group, queue, ^{ read(^{ notes = [self readNoteSHAs]; }); });
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+	[self loadSubmodules];
+	[self applyNoteSHAs:notes];
+	[self applyRefListing:refListing stashLog:stashLog];
+}
+
+// reloadRefs for the main thread when it can't wait: the listings and the
+// submodule scan are read on background queues and applied together on the
+// main queue, unless a newer load has started by then. completion, if any,
+// runs on the main queue afterwards and is told whether they were applied.
+- (void)reloadRefsInBackground:(void (^)(BOOL applied))completion
+{
+	dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	NSUInteger generation = [self beginRefLoad];
+	NSString *lastSubmodulesStamp = submodulesStamp;
+
+	__block NSArray<GitRefEntry *> *refListing = nil;
+	__block NSString *stashLog = nil;
+	__block NSDictionary *notes = nil;
+	__block NSString *stamp = nil;
+	__block NSArray *submodules = nil;
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_group_async(group, queue, ^{ refListing = [self readRefListing]; });
+	dispatch_group_async(group, queue, ^{ stashLog = [self readStashLog]; });
+	dispatch_group_async(group, queue, ^{ notes = [self readNoteSHAs]; });
+	dispatch_group_async(group, queue, ^{
+		stamp = [self currentSubmodulesStamp];
+		if (![stamp isEqualToString:lastSubmodulesStamp])
+			submodules = [self isBareRepository] ? @[] : [PBSubmoduleInfo submodulesInRepository:self];
+	});
+	dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+		BOOL current = [self isCurrentRefLoad:generation];
+		if (current) {
+			if (submodules) {
+				self->submodulesStamp = stamp;
+				self.submodules = submodules;
+			}
+			[self applyNoteSHAs:notes];
+			[self applyRefListing:refListing stashLog:stashLog];
+		}
+		if (completion)
+			completion(current);
+	});
+}
+
+// Starts the same work as reloadRefs, plus the submodule scan, on background
+// queues and applies each result on the main queue as it arrives, so a new
+// window doesn't wait for any of it.
+- (void)loadRefsInBackground
+{
+	dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	NSUInteger generation = [self beginRefLoad];
+
+	__block NSArray<GitRefEntry *> *refListing = nil;
+	__block NSString *stashLog = nil;
+	dispatch_group_t refsGroup = dispatch_group_create();
+	dispatch_group_async(refsGroup, queue, ^{ refListing = [self readRefListing]; });
+	dispatch_group_async(refsGroup, queue, ^{ stashLog = [self readStashLog]; });
+	dispatch_group_notify(refsGroup, dispatch_get_main_queue(), ^{
+		if ([self isCurrentRefLoad:generation])
+			[self applyRefListing:refListing stashLog:stashLog];
+		[self->openRefsSpan endWithArgs:@{@"refs": @([self->refToSHAMapping count])}];
+		self->openRefsSpan = nil;
+	});
+
+	dispatch_async(queue, ^{
+		NSDictionary *notes = [self readNoteSHAs];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (![self isCurrentRefLoad:generation])
+				return;
+			[self applyNoteSHAs:notes];
+			// Redraw the decorations with the notes markers
+			[self invalidateDecorations];
+			[self willChangeValueForKey:@"refs"];
+			[self didChangeValueForKey:@"refs"];
+		});
+	});
+
+	dispatch_async(queue, ^{
+		NSString *stamp = [self currentSubmodulesStamp];
+		NSArray *submodules = [self isBareRepository] ? @[] : [PBSubmoduleInfo submodulesInRepository:self];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (![self isCurrentRefLoad:generation])
+				return;
+			self->submodulesStamp = stamp;
+			self.submodules = submodules;
+		});
+	});
+}
+
+// Every ref, from the ref store when there is one and otherwise from
+// for-each-ref, or nil. Safe to call off the main thread.
+- (NSArray<GitRefEntry *> *)readRefListing
+{
+	if (refStore)
+		return [refStore allRefs];
+
+	NSError *error = nil;
+	NSString *output = [self executeGitCommand:@[@"for-each-ref", @"--format=%(refname)%09%(objecttype)%09%(objectname)"] error:&error];
+	if (error) {
+		NSLog(@"Error loading refs: %@", error.localizedDescription);
+		return nil;
+	}
+	return [GitRefEntry entriesFromListing:output];
+}
+
+// Lines of "stash@{n}<NUL>sha<NUL>parents" for every stash entry, or nil if
+// there are none. Safe to call off the main thread.
+- (NSString *)readStashLog
+{
+	NSError *logError = nil;
+	NSString *logOutput = [self executeGitCommand:@[@"log", @"-g", @"--format=%gd%x00%H%x00%P", @"refs/stash"] error:&logError];
+	if (logError || !logOutput.length)
+		return nil;
+	return logOutput;
+}
+
+- (void)applyRefListing:(NSArray<GitRefEntry *> *)entries stashLog:(NSString *)stashLog
 {
 	// clear out ref caches
 	_headRef = nil;
@@ -314,89 +613,76 @@ - (void) reloadRefs
 	suppressedStashParents = [NSMutableSet set];
 	stashCommitSHAs = [NSMutableArray array];
 	
-	// Use git for-each-ref to enumerate all references with their commit SHAs
-	NSError *error = nil;
-	NSString *output = [self executeGitCommand:@[@"for-each-ref", @"--format=%(refname)%09%(objecttype)%09%(objectname)"] error:&error];
-	
 	NSMutableOrderedSet *oldBranches = [self.branchesSet mutableCopy];
+
+	// The first listing arrives after the sidebar is up; announce it as one
+	// change rather than an insertion per ref
+	BOOL initialLoad = !self.refsLoaded;
+	if (initialLoad)
+		[self willChangeValueForKey:@"branches"];
 	
-	if (error) {
-		NSLog(@"Error loading refs: %@", error.localizedDescription);
-	} else if (output) {
-		output = [output stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
+	for (GitRefEntry *entry in entries) {
+		NSString *referenceName = entry.name;
+		NSString *commitSHA = entry.sha;
+
+		// Skip refs to trees and blobs
+		if (![entry.objectType isEqualToString:@"commit"] && ![entry.objectType isEqualToString:@"tag"])
+			continue;
+
+		BOOL isBaseStashRef = [referenceName isEqualToString:@"refs/stash"];
+		PBGitRef* gitRef = [PBGitRef refFromString:referenceName];
+		if (!isBaseStashRef) {
+			PBGitRevSpecifier* revSpec = [[PBGitRevSpecifier alloc] initWithRef:gitRef];
+			if (initialLoad)
+				[self.branchesSet addObject:revSpec];
+			else
+				[self addBranch:revSpec];
+			[oldBranches removeObject:revSpec];
+		}
 		
-		if ([output length] > 0) {
-			NSArray *lines = [output componentsSeparatedByString:@"\n"];
-			for (NSString *line in lines) {
-				// Format: refname<tab>objecttype<tab>objectname
-				NSArray *components = [line componentsSeparatedByString:@"\t"];
-				if ([components count] >= 3) {
-					NSString *referenceName = [components objectAtIndex:0];
-					NSString *objectType = [components objectAtIndex:1];
-					NSString *commitSHA = [components objectAtIndex:2];
-					
-					// Skip symbolic references like origin/HEAD that point to other refs
-					if ([objectType isEqualToString:@"commit"] || [objectType isEqualToString:@"tag"]) {
-						BOOL isBaseStashRef = [referenceName isEqualToString:@"refs/stash"];
-						PBGitRef* gitRef = [PBGitRef refFromString:referenceName];
-						if (!isBaseStashRef) {
-							PBGitRevSpecifier* revSpec = [[PBGitRevSpecifier alloc] initWithRef:gitRef];
-							[self addBranch:revSpec];
-							[oldBranches removeObject:revSpec];
-						}
-						
-						// Add ref to commit SHA mapping for branch tags
-						if (commitSHA && [commitSHA length] >= 40) { // Ensure valid SHA
-							NSString *sha = commitSHA;
-							if (sha) {
-								if (!isBaseStashRef) {
-									NSMutableArray *refsForCommit = self->refs[sha];
-									if (!refsForCommit) {
-										refsForCommit = [NSMutableArray array];
-										self->refs[sha] = refsForCommit;
-									}
-									[refsForCommit addObject:gitRef];
-								}
-								
-								// Also store ref->SHA mapping for efficient lookup
-								refToSHAMapping[referenceName] = sha;
-							}
-						}
-					}
+		// Add ref to commit SHA mapping for branch tags
+		if ([commitSHA length] >= 40) { // Ensure valid SHA
+			if (!isBaseStashRef) {
+				NSMutableArray *refsForCommit = self->refs[commitSHA];
+				if (!refsForCommit) {
+					refsForCommit = [NSMutableArray array];
+					self->refs[commitSHA] = refsForCommit;
 				}
+				[refsForCommit addObject:gitRef];
 			}
+			
+			// Also store ref->SHA mapping for efficient lookup
+			refToSHAMapping[referenceName] = commitSHA;
 		}
 	}
     
-    [self loadStashRefsRemovingOld:oldBranches];
+    [self applyStashLog:stashLog removingOld:oldBranches];
+	[self.ancestry refsDidChangeWithTips:[NSSet setWithArray:[refToSHAMapping allValues]]];
+
+	if (initialLoad)
+		[self didChangeValueForKey:@"branches"];
 	
 	// Remove old branches that no longer exist
 	for (PBGitRevSpecifier *branch in oldBranches)
 		if ([branch isSimpleRef] && ![branch isEqual:[self headRef]])
 			[self removeBranch:branch];
 
-    [self loadSubmodules];
-    [self loadNoteSHAs];
-
 	[self willChangeValueForKey:@"refs"];
 	[self didChangeValueForKey:@"refs"];
 
 	[self refreshCachedHeadInfo];
+	[self invalidateDecorations];
+	[self decorations];
 	NSString *title = [self displayName];
 	[[[self windowController] window] setTitle:title];
+
+	if (!self.refsLoaded)
+		self.refsLoaded = YES;
 }
 
-- (void)loadStashRefsRemovingOld:(NSMutableOrderedSet *)oldBranches
+- (void)applyStashLog:(NSString *)logOutput removingOld:(NSMutableOrderedSet *)oldBranches
 {
-    NSError *verifyError = nil;
-    [self executeGitCommand:@[@"rev-parse", @"--verify", @"--quiet", @"refs/stash"] error:&verifyError];
-    if (verifyError) {
-        return;
-    }
-
-    NSError *logError = nil;
-    NSString *logOutput = [self executeGitCommand:@[@"log", @"-g", @"--format=%gd%x00%H", @"refs/stash"] error:&logError];
-    if (logError || !logOutput.length) {
+    if (!logOutput.length) {
         return;
     }
 
@@ -444,46 +730,43 @@ - (void)loadStashRefsRemovingOld:(NSMutableOrderedSet *)oldBranches
 			[stashCommitSHAs addObject:sha];
 		}
 
-		NSError *parentsError = nil;
-		NSString *parentsOutput = [self executeGitCommand:@[@"show", @"-s", @"--format=%P", selector] error:&parentsError];
-		if (!parentsError && parentsOutput.length > 0) {
-			NSString *trimmedParents = [parentsOutput stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-			if (trimmedParents.length > 0) {
-				NSArray<NSString *> *parentSHAs = [trimmedParents componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
-				if ([parentSHAs count] > 1) {
-					for (NSUInteger parentIndex = 1; parentIndex < [parentSHAs count]; parentIndex++) {
-						NSString *parentSHA = parentSHAs[parentIndex];
-						if ([parentSHA length] >= 40) {
-							[suppressedStashParents addObject:parentSHA];
-						}
-					}
+		// The index and untracked-files commits git hangs off a stash are
+		// its second and later parents.
+		NSString *trimmedParents = components.count > 2 ? [components[2] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] : @"";
+		if (trimmedParents.length > 0) {
+			NSArray<NSString *> *parentSHAs = [trimmedParents componentsSeparatedByCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+			for (NSUInteger parentIndex = 1; parentIndex < [parentSHAs count]; parentIndex++) {
+				NSString *parentSHA = parentSHAs[parentIndex];
+				if ([parentSHA length] >= 40) {
+					[suppressedStashParents addObject:parentSHA];
 				}
 			}
 		}
 	    }
 	}
 
-- (void)loadNoteSHAs
+// Note refs and the commits they annotate, as {"refs": NSArray, "shas": NSSet}.
+// Safe to call off the main thread.
+- (NSDictionary *)readNoteSHAs
 {
 	// Discover all note refs
-	NSError *refsError = nil;
-	NSString *refsOutput = [self executeGitCommand:@[@"for-each-ref", @"--format=%(refname)", @"refs/notes/"] error:&refsError];
-
 	NSMutableArray<NSString *> *discoveredRefs = [NSMutableArray array];
-	if (!refsError && refsOutput.length > 0) {
-		NSArray *refLines = [refsOutput componentsSeparatedByString:@"\n"];
-		for (NSString *refLine in refLines) {
-			if (refLine.length > 0) {
-				[discoveredRefs addObject:refLine];
+	if (refStore) {
+		for (GitRefEntry *entry in [refStore allRefs])
+			if ([entry.name hasPrefix:@"refs/notes/"])
+				[discoveredRefs addObject:entry.name];
+	} else {
+		NSError *refsError = nil;
+		NSString *refsOutput = [self executeGitCommand:@[@"for-each-ref", @"--format=%(refname)", @"refs/notes/"] error:&refsError];
+		if (!refsError && refsOutput.length > 0) {
+			NSArray *refLines = [refsOutput componentsSeparatedByString:@"\n"];
+			for (NSString *refLine in refLines) {
+				if (refLine.length > 0) {
+					[discoveredRefs addObject:refLine];
+				}
 			}
 		}
 	}
-	self.noteRefs = [discoveredRefs copy];
-
-	if (discoveredRefs.count == 0) {
-		self.noteSHAs = [NSSet set];
-		return;
-	}
 
 	// Collect SHAs from all note refs
 	NSMutableSet *shas = [NSMutableSet set];
@@ -505,7 +788,29 @@ - (void)loadNoteSHAs
 			}
 		}
 	}
-	self.noteSHAs = [shas copy];
+	return @{@"refs": [discoveredRefs copy], @"shas": [shas copy]};
+}
+
+- (void)applyNoteSHAs:(NSDictionary *)notes
+{
+	self.noteRefs = notes[@"refs"] ?: @[];
+	self.noteSHAs = notes[@"shas"] ?: [NSSet set];
+}
+
+- (PBGitDecorationIndex *)decorations
+{
+	if (!_decorations) {
+		_decorations = [[PBGitDecorationIndex alloc] initWithRefs:refs
+		                                                 noteSHAs:self.noteSHAs
+		                                                  headSHA:[self headSHA]
+		                                              headRefName:[_headRef simpleRef]];
+	}
+	return _decorations;
+}
+
+- (void)invalidateDecorations
+{
+	_decorations = nil;
 }
 
 - (void) lazyReload
@@ -529,7 +834,7 @@ - (PBGitRevSpecifier *)headRef
 - (NSString *)headSHA
 {
 	if (! _headSha)
-		[self headRef];
+		_headSha = [self shaForRef:[[self headRef] ref]];
 
 	return _headSha;
 }
@@ -563,9 +868,19 @@ - (NSString *)shaForRef:(PBGitRef *)ref
 		}
     }
     
-	// Last resort: use git rev-parse (should rarely be needed now)
+	// Full names are read from disk when the store can
+	if (refStore && ([ref.ref hasPrefix:@"refs/"] || [ref.ref isEqualToString:@"HEAD"])) {
+		NSString *storedSha = [[refStore refNamed:ref.ref] sha];
+		if (storedSha) {
+			refToSHAMapping[ref.ref] = storedSha;
+			return storedSha;
+		}
+	}
+
+	// Last resort: git resolves what the store can't, such as peeled tags,
+	// @{upstream}, reflog entries and refs changed since the last listing
 	NSError *error = nil;
-	NSString *shaString = [self executeGitCommand:@[@"rev-parse", ref.ref] error:&error];
+	NSString *shaString = [self executeGitCommand:@[@"rev-parse", @"--verify", ref.ref] error:&error];
 	
 	if (!error && shaString) {
 		shaString = [shaString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
@@ -629,20 +944,28 @@ - (PBGitCommit *)commitForRef:(PBGitRef *)ref
 	return [self commitForSHA:[self shaForRef:ref]];
 }
 
+- (NSString *)listedSHAForRefName:(NSString *)refName
+{
+	return refName ? refToSHAMapping[refName] : nil;
+}
+
 - (PBGitCommit *)commitForSHA:(NSString *)sha
 {
 	if (!sha)
 		return nil;
-	NSArray *revList = revisionList.projectCommits;
-
-    if (!revList) {
-        [revisionList forceUpdate];
-        revList = revisionList.projectCommits;
-    }
+	// A snapshot, so this can run on any thread without copying the list
+	PBCommitList *revList = revisionList.projectCommits;
 	for (PBGitCommit *commit in revList)
 		if ([[commit sha] isEqual:sha])
 			return commit;
 
+	// No history yet, or a ref the history hasn't caught up with: walk
+	// again, once per ref listing so a ref the walk never lists can't
+	// keep reloading it
+	if ([NSThread isMainThread] && (revList.count == 0 || refs[sha]) && !revisionList.isUpdating && forcedUpdateRefs != refs) {
+		forcedUpdateRefs = refs;
+		[revisionList forceUpdate];
+	}
 	return nil;
 }
 
@@ -651,26 +974,7 @@ - (BOOL)isOnSameBranch:(NSString *)branchSHA asSHA:(NSString *)testSHA
 	if (!branchSHA || !testSHA)
 		return NO;
 
-	if ([testSHA isEqual:branchSHA])
-		return YES;
-
-	NSArray *revList = revisionList.projectCommits;
-
-	NSMutableSet *searchSHAs = [NSMutableSet setWithObject:branchSHA];
-
-	for (PBGitCommit *commit in revList) {
-		NSString *commitSHA = [commit sha];
-		if ([searchSHAs containsObject:commitSHA]) {
-			if ([testSHA isEqual:commitSHA])
-				return YES;
-			[searchSHAs removeObject:commitSHA];
-			[searchSHAs addObjectsFromArray:commit.parents];
-		}
-		else if ([testSHA isEqual:commitSHA])
-			return NO;
-	}
-
-	return NO;
+	return [self.ancestry isSHA:testSHA ancestorOfSHA:branchSHA];
 }
 
 - (BOOL)isSHAOnHeadBranch:(NSString *)testSHA
@@ -696,24 +1000,15 @@ - (BOOL)isRefOnHeadBranch:(PBGitRef *)testRef
 
 - (BOOL) checkRefFormat:(NSString *)refName
 {
-	NSError *error = nil;
-	[self executeGitCommand:@[@"check-ref-format", refName] error:&error];
-	
-	// git check-ref-format returns 0 for valid refs
-	if (error) {
-		// Check if it's a command failure (invalid format) vs other error
-		if (error.code == PBGitErrorCommandFailed) {
-			return NO;
-		}
-		// If git is not available, assume valid
-		return YES;
-	}
-	
-	return YES;
+	// Same rules as git check-ref-format, without starting git on each keystroke
+	return [GitRefStore isValidRefName:refName];
 }
 
 - (BOOL) refExists:(PBGitRef *)ref
 {
+	if (refStore)
+		return [refStore refNamed:ref.ref] != nil;
+
 	NSError *error = nil;
 	[self executeGitCommand:@[@"show-ref", @"--verify", @"--quiet", ref.ref] error:&error];
 	
@@ -734,6 +1029,11 @@ - (PBGitRef *)refForName:(NSString *)name
 	if (!name)
 		return nil;
 
+	if (refStore) {
+		GitRefEntry *entry = [refStore firstRefMatchingName:name];
+		return entry ? [PBGitRef refFromString:entry.name] : nil;
+	}
+
 	NSError *error = nil;
 	NSArray<NSString *> *command = @[@"show-ref", name];
     NSString *output = [self executeGitCommand:command error:&error];
@@ -893,35 +1193,10 @@ - (PBGitRef *) remoteRefForBranch:(PBGitRef *)branch error:(NSError **)error
 		return [branch remoteRef];
 	}
 
-	// Use git config to find the remote tracking branch
-	NSString *branchName = [branch shortName];
-	if (branchName) {
-		NSError *error = nil;
-		NSString *mergeRef = [self executeGitCommand:@[@"config", [NSString stringWithFormat:@"branch.%@.merge", branchName]] error:&error];
-		
-		if (!error && mergeRef) {
-			mergeRef = [mergeRef stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-			
-			if (mergeRef.length > 0) {
-				// Get the remote name
-				NSString *remoteName = [self executeGitCommand:@[@"config", [NSString stringWithFormat:@"branch.%@.remote", branchName]] error:&error];
-				
-				if (!error && remoteName) {
-					remoteName = [remoteName stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]];
-					
-					if (remoteName.length > 0) {
-						// Convert refs/heads/branch to refs/remotes/remote/branch
-						if ([mergeRef hasPrefix:@"refs/heads/"]) {
-							NSString *branchPart = [mergeRef substringFromIndex:[@"refs/heads/" length]];
-							NSString *trackingRefName = [NSString stringWithFormat:@"refs/remotes/%@/%@", remoteName, branchPart];
-							PBGitRef *trackingBranchRef = [PBGitRef refFromString:trackingRefName];
-							return trackingBranchRef;
-						}
-					}
-				}
-			}
-		}
-	}
+	// branch.<name>.remote and .merge, read from the config file
+	PBGitRef *trackingBranchRef = [self.ancestry upstreamForBranch:branch];
+	if (trackingBranchRef)
+		return trackingBranchRef;
 
 	if (error != NULL) {
 		NSString *info = [NSString stringWithFormat:@"There is no remote configured for the %@ '%@'.\n\nPlease select a branch from the popup menu, which has a corresponding remote tracking branch set up.\n\nYou can also use a contextual menu to choose a branch by right clicking on its label in the commit history list.", [branch refishType], [branch shortName]];
@@ -1187,30 +1462,177 @@ - (NSData *)executeGitCommandReturningData:(NSArray<NSString *> *)arguments erro
 	return [PBEasyPipe gitDataForArgs:arguments inDir:[self workingDirectory] error:error];
 }
 
+- (BOOL)streamGitCommand:(NSArray<NSString *> *)arguments recordSeparator:(NSData *)separator handler:(BOOL (NS_NOESCAPE ^)(NSData *record))handler error:(NSError **)error
+{
+	return [[GitCommandRunner shared] streamWithArguments:arguments
+	                                           repository:self
+	                                      recordSeparator:separator
+	                                              handler:handler
+	                                                error:error];
+}
+
+- (NSData *)executeGitCommandReturningPrefix:(NSArray<NSString *> *)arguments length:(NSUInteger)length error:(NSError **)error
+{
+	return [[GitCommandRunner shared] readPrefixWithArguments:arguments
+	                                               repository:self
+	                                                    limit:(NSInteger)length
+	                                                    error:error];
+}
+
+// Starts the hook in a process group of its own, so that cancelling can
+// stop whatever it has started too. Both its output streams go to outputFD.
+static pid_t PBSpawnHook(NSString *path, NSArray *arguments, NSDictionary *environment, NSString *directory, int outputFD, int *spawnError)
+{
+	NSUInteger argumentCount = [arguments count];
+	char *argv[argumentCount + 2];
+	argv[0] = (char *)[path fileSystemRepresentation];
+	for (NSUInteger i = 0; i < argumentCount; i++)
+		argv[i + 1] = (char *)[[arguments[i] description] UTF8String];
+	argv[argumentCount + 1] = NULL;
+
+	NSArray *keys = [environment allKeys];
+	char *envp[[keys count] + 1];
+	for (NSUInteger i = 0; i < [keys count]; i++)
+		envp[i] = (char *)[[NSString stringWithFormat:@"%@=%@", keys[i], environment[keys[i]]] UTF8String];
+	envp[[keys count]] = NULL;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+	posix_spawn_file_actions_adddup2(&actions, outputFD, STDOUT_FILENO);
+	posix_spawn_file_actions_adddup2(&actions, outputFD, STDERR_FILENO);
+	if (directory)
+		posix_spawn_file_actions_addchdir_np(&actions, [directory fileSystemRepresentation]);
+
+	// Nothing else of ours leaks into the hook, and it gets the signal
+	// handling a shell would give it
+	posix_spawnattr_t attributes;
+	posix_spawnattr_init(&attributes);
+	posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_CLOEXEC_DEFAULT | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+	posix_spawnattr_setpgroup(&attributes, 0);
+	sigset_t mask;
+	sigemptyset(&mask);
+	posix_spawnattr_setsigmask(&attributes, &mask);
+	sigset_t defaults;
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigdefault(&attributes, &defaults);
+
+	pid_t pid = -1;
+	*spawnError = posix_spawn(&pid, argv[0], &actions, &attributes, argv, envp);
+
+	posix_spawnattr_destroy(&attributes);
+	posix_spawn_file_actions_destroy(&actions);
+	return *spawnError == 0 ? pid : -1;
+}
+
 - (BOOL)executeHook:(NSString *)name output:(NSString **)output
 {
 	return [self executeHook:name withArgs:[NSArray array] output:output];
 }
 
 - (BOOL)executeHook:(NSString *)name withArgs:(NSArray *)arguments output:(NSString **)output
+{
+	return [self executeHook:name withArgs:arguments output:output progress:nil];
+}
+
+- (BOOL)executeHook:(NSString *)name withArgs:(NSArray *)arguments output:(NSString **)output progress:(NSProgress *)progress
 {
 	NSString *hookPath = [[[[self gitURL] path] stringByAppendingPathComponent:@"hooks"] stringByAppendingPathComponent:name];
 	if (![[NSFileManager defaultManager] isExecutableFileAtPath:hookPath])
 		return TRUE;
 
-	NSDictionary *info = [NSDictionary dictionaryWithObjectsAndKeys:
-		[self gitURL].path, @"GIT_DIR",
-		[[self gitURL].path stringByAppendingPathComponent:@"index"], @"GIT_INDEX_FILE",
-		nil
-	];
+	if (progress.isCancelled)
+		return FALSE;
+
+	NSMutableDictionary *environment = [[[NSProcessInfo processInfo] environment] mutableCopy];
+	environment[@"GIT_DIR"] = [self gitURL].path;
+	environment[@"GIT_INDEX_FILE"] = [[self gitURL].path stringByAppendingPathComponent:@"index"];
 
-	int ret = 1;
-	NSString *_output =	[PBEasyPipe outputForCommand:hookPath withArgs:arguments inDir:[self workingDirectory] byExtendingEnvironment:info inputString:nil retValue:&ret];
+	// Hooks usually explain a failure on stderr, so collect both streams.
+	int fds[2];
+	if (pipe(fds) != 0) {
+		if (output)
+			*output = [NSString stringWithFormat:@"Could not run the %@ hook: %s", name, strerror(errno)];
+		return FALSE;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+
+	int spawnError = 0;
+	pid_t pid = PBSpawnHook(hookPath, arguments, environment, [self workingDirectory], fds[1], &spawnError);
+	close(fds[1]);
+	if (pid < 0) {
+		close(fds[0]);
+		if (output)
+			*output = [NSString stringWithFormat:@"Could not run the %@ hook: %s", name, strerror(spawnError)];
+		return FALSE;
+	}
+
+	// Read on another queue: anything the hook started in the background can
+	// keep the pipe open, and a cancelled hook shouldn't be waited on for it.
+	NSMutableData *data = [NSMutableData data];
+	dispatch_semaphore_t finished = dispatch_semaphore_create(0);
+	int readFD = fds[0];
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+		char buffer[16384];
+		ssize_t count;
+		while ((count = read(readFD, buffer, sizeof(buffer))) != 0) {
+			if (count < 0) {
+				if (errno == EINTR)
+					continue;
+				break;
+			}
+			@synchronized (data) {
+				[data appendBytes:buffer length:(NSUInteger)count];
+			}
+		}
+		close(readFD);
+		dispatch_semaphore_signal(finished);
+	});
+
+	// Runs at once if the progress was cancelled before the hook started.
+	// The whole group goes, so nothing the hook started holds the pipe.
+	__block BOOL reaped = NO;
+	NSObject *reapLock = [[NSObject alloc] init];
+	progress.cancellationHandler = ^{
+		@synchronized (reapLock) {
+			if (!reaped)
+				killpg(pid, SIGTERM);
+		}
+		dispatch_semaphore_signal(finished);
+	};
+
+	dispatch_semaphore_wait(finished, DISPATCH_TIME_FOREVER);
+	if (progress.isCancelled) {
+		progress.cancellationHandler = nil;
+		dispatch_async(dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), ^{
+			int status;
+			while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+				;
+			@synchronized (reapLock) {
+				reaped = YES;
+			}
+		});
+		return FALSE;
+	}
 
-	if (output)
-		*output = _output;
+	int status = 0;
+	while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+		;
+	@synchronized (reapLock) {
+		reaped = YES;
+	}
+	progress.cancellationHandler = nil;
+
+	if (output) {
+		NSString *_output = [[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding];
+		if (!_output)
+			_output = [[NSString alloc] initWithData:data encoding:NSISOLatin1StringEncoding];
+		*output = [_output stringByTrimmingCharactersInSet:[NSCharacterSet newlineCharacterSet]];
+	}
 
-	return ret == 0;
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
 - (NSString *)parseReference:(NSString *)reference
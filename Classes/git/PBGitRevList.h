@@ -10,14 +10,23 @@
 
 @class PBGitRepository;
 @class PBGitRevSpecifier;
+@class PBCommitList;
 
 @interface PBGitRevList : NSObject
 
 @property (nonatomic, assign) BOOL isParsing;
-@property (nonatomic, strong) NSMutableArray *commits;
+// Replaced on the main thread as commits arrive; any thread may read it and
+// keep the snapshot it got.
+@property (strong, readonly) PBCommitList *commits;
 
 - (id) initWithRepository:(PBGitRepository *)repo rev:(PBGitRevSpecifier *)rev shouldGraph:(BOOL)graph;
 - (void) loadRevisons;
 - (void)cancel;
 
+// Puts a commit that was just made on top of commits already in the list in
+// front of them, without walking the history again. The commit is read in
+// the background; completion runs on the main thread, with NO if the list
+// has to be reloaded instead.
+- (void)prependNewCommitWithSHA:(NSString *)sha completion:(void (^)(BOOL prepended))completion;
+
 @end
@@ -10,8 +10,9 @@
 #import "PBGitRepository.h"
 #import "GitX-Swift.h"
 #import "PBGitGrapher.h"
+#import <pthread.h>
 
-@interface PBGitRevList ()
+@interface PBGitRevList () <GitWorkspaceCache>
 
 @property (nonatomic, assign) BOOL isGraphing;
 @property (nonatomic, assign) BOOL resetCommits;
@@ -19,14 +20,23 @@ @interface PBGitRevList ()
 @property (nonatomic, weak) PBGitRepository *repository;
 @property (nonatomic, strong) PBGitRevSpecifier *currentRev;
 
+@property (strong) PBCommitList *commits;
+// Commits by SHA from this and earlier loads, shared by the walk threads and
+// the main thread; only touched inside @synchronized (self)
 @property (nonatomic, strong) NSMutableDictionary *commitCache;
 
 @property (nonatomic, strong) NSThread *parseThread;
+// Walk threads still running, counting cancelled ones that haven't noticed yet;
+// commitCache may only be trimmed when this is zero
+@property (nonatomic, assign) NSInteger activeWalks;
 
 @end
 
 
 #define kRevListRevisionsKey @"revisions"
+#define kRevListCommitDelimiter @"\x01GITX_COMMIT_DELIMITER\x02"
+// Rough size of a commit without its text, for the workspace memory budget
+#define kRevListCachedCommitCost 320
 
 
 @implementation PBGitRevList
@@ -41,6 +51,8 @@ - (id) initWithRepository:(PBGitRepository *)repo rev:(PBGitRevSpecifier *)rev s
 	self.currentRev = [rev copy];
 	self.isGraphing = graph;
 	self.commitCache = [NSMutableDictionary new];
+	self.commits = [PBCommitList empty];
+	[[GitWorkspace shared] registerCache:self forRepository:repo];
 	
 	return self;
 }
@@ -50,13 +62,37 @@ - (void) loadRevisons
 {
 	[self cancel];
 	
-	self.parseThread = [[NSThread alloc] initWithTarget:self selector:@selector(beginWalkWithSpecifier:) object:self.currentRev];
+	// Refs are updated on the main thread, so look up the tips here
+	PBGitRevSpecifier *rev = self.currentRev;
+	NSArray<NSString *> *tips = [self.repository tipSHAsForRevSpecifier:rev];
+	@synchronized (self) {
+		self.activeWalks++;
+	}
+	self.parseThread = [[NSThread alloc] initWithBlock:^{
+		[self beginWalkWithSpecifier:rev tips:tips];
+		@synchronized (self) {
+			self.activeWalks--;
+		}
+	}];
+	self.parseThread.qualityOfService = [[GitWorkspace shared] qualityOfServiceForRepositoryAtPath:[self.repository workingDirectory]];
 	self.isParsing = YES;
 	self.resetCommits = YES;
 	[self.parseThread start];
 }
 
 
+// The walk thread's quality of service is set when it starts; the thread
+// moves itself when its window comes to the front or goes to the back, and
+// the load and decorate queues follow from what it hands them.
+- (void) followForegroundQualityOfService
+{
+	NSQualityOfService wanted = [[GitWorkspace shared] qualityOfServiceForRepositoryAtPath:[self.repository workingDirectory]];
+	qos_class_t qos = wanted == NSQualityOfServiceUserInitiated ? QOS_CLASS_USER_INITIATED : QOS_CLASS_UTILITY;
+	if (qos_class_self() != qos)
+		pthread_set_qos_class_self_np(qos, 0);
+}
+
+
 - (void)cancel
 {
 	[self.parseThread cancel];
@@ -65,10 +101,119 @@ - (void)cancel
 }
 
 
+- (void)prependNewCommitWithSHA:(NSString *)sha completion:(void (^)(BOOL prepended))completion
+{
+	PBCommitList *listed = self.commits;
+	if (self.isParsing || listed.count == 0) {
+		completion(NO);
+		return;
+	}
+
+	PBGitRepository *pbRepo = self.repository;
+	dispatch_async(dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^{
+		PBCommitList *list = [self listByPrependingCommitWithSHA:sha toList:listed inPBRepo:pbRepo];
+		dispatch_async(dispatch_get_main_queue(), ^{
+			// A walk started meanwhile lists the commit itself
+			if (!list || self.isParsing || self.commits != listed) {
+				completion(NO);
+				return;
+			}
+			[self cacheCommit:[list commitAtIndex:0]];
+			self.commits = list;
+			completion(YES);
+		});
+	});
+}
+
+// listed with the commit in front, or nil if it doesn't go there. Reads the
+// commit through the blob store's readers; call off the main thread.
+- (PBCommitList *)listByPrependingCommitWithSHA:(NSString *)sha toList:(PBCommitList *)listed inPBRepo:(PBGitRepository *)pbRepo
+{
+	PBCommitData *commitData = [[[PBGitBlobStore shared] commitDataForSHAs:@[sha] inRepository:pbRepo error:nil] objectForKey:sha];
+	if (!commitData || [self cachedCommitForSHA:commitData.sha])
+		return nil;
+
+	// Every parent has to be listed already, or the new commit isn't a tip of
+	// this list. The cache holds every listed commit; one kept from an earlier
+	// load and no longer listed only ends a lane early until the next reload.
+	for (NSString *parentSHA in commitData.parentSHAs) {
+		if (![self cachedCommitForSHA:parentSHA])
+			return nil;
+	}
+
+	PBGitCommit *newCommit = [[PBGitCommit alloc] initWithRepository:pbRepo andCommitData:commitData];
+	[newCommit prepareDisplayStrings];
+
+	// Nothing can come before a commit without children, so the front keeps
+	// the list topologically ordered. Observers are told which commit it is.
+	return [listed listByPrependingCommit:newCommit];
+}
+
+
 - (void) finishedParsing
 {
 	self.parseThread = nil;
 	self.isParsing = NO;
+	[[GitWorkspace shared] setNeedsBudgetCheck];
+}
+
+
+#pragma mark Commit cache
+
+- (PBGitCommit *)cachedCommitForSHA:(NSString *)sha
+{
+	@synchronized (self) {
+		return self.commitCache[sha];
+	}
+}
+
+- (void)cacheCommit:(PBGitCommit *)commit
+{
+	@synchronized (self) {
+		self.commitCache[commit.sha] = commit;
+	}
+}
+
+- (void)uncacheCommitForSHA:(NSString *)sha
+{
+	@synchronized (self) {
+		[self.commitCache removeObjectForKey:sha];
+	}
+}
+
+
+#pragma mark GitWorkspaceCache
+
+// Commits kept from earlier loads so a reload can reuse them. The ones in
+// the current list aren't counted, since the list holds on to them anyway.
+- (NSInteger)workspaceCacheCost
+{
+	NSInteger cached;
+	@synchronized (self) {
+		cached = (NSInteger)[self.commitCache count];
+	}
+	NSInteger extra = cached - (NSInteger)self.commits.count;
+	return MAX(extra, 0) * kRevListCachedCommitCost;
+}
+
+- (void)trimWorkspaceCacheToCost:(NSInteger)cost
+{
+	@synchronized (self) {
+		if (self.activeWalks > 0)
+			return;
+	}
+	if (cost >= [self workspaceCacheCost])
+		return;
+
+	PBCommitList *listed = self.commits;
+	NSMutableDictionary *current = [NSMutableDictionary dictionaryWithCapacity:(NSUInteger)listed.count];
+	for (PBGitCommit *commit in listed) {
+		if (![self.repository isStashCommitSHA:commit.sha])
+			current[commit.sha] = commit;
+	}
+	@synchronized (self) {
+		self.commitCache = current;
+	}
 }
 
 
@@ -81,27 +226,36 @@ - (void) updateCommits:(NSDictionary *)update
 	}
 	
 	if (self.resetCommits) {
-		self.commits = [NSMutableArray array];
+		self.commits = [PBCommitList empty];
 		self.resetCommits = NO;
 	}
 	
-	NSRange range = NSMakeRange([self.commits count], [revisions count]);
-	NSIndexSet *indexes = [NSIndexSet indexSetWithIndexesInRange:range];
-	
-	
-	[self willChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"commits"];
-	[self.commits addObjectsFromArray:revisions];
-	[self didChange:NSKeyValueChangeInsertion valuesAtIndexes:indexes forKey:@"commits"];
-	
+	// Observers find the new rows with commitsAppendedToList:
+	self.commits = [self.commits listByAppendingCommits:revisions];
 }
 
-- (void) beginWalkWithSpecifier:(PBGitRevSpecifier*)rev
+- (void) beginWalkWithSpecifier:(PBGitRevSpecifier*)rev tips:(NSArray<NSString *> *)tips
 {
 	PBGitRepository *pbRepo = self.repository;
+	NSArray<NSString *> *stashSHAs = [pbRepo stashCommitSHAs];
+
+	if (tips) {
+		PBCommitGraph *graph = [pbRepo commitGraph];
+		if (graph && [self addCommitsFromCommitGraph:graph tips:[tips arrayByAddingObjectsFromArray:stashSHAs] stashSHAs:stashSHAs inPBRepo:pbRepo])
+			return;
+	}
 	
 	// Use a unique delimiter that won't appear in commit messages
 	// Using multiple unusual bytes: \x01GITX_COMMIT_DELIMITER\x02
-	NSMutableArray *revListArgs = [NSMutableArray arrayWithObjects:@"rev-list", @"--pretty=format:\x01GITX_COMMIT_DELIMITER\x02%H%x00%s%x00%B%x00%an%x00%cn%x00%ct%x00%P%x00", @"--topo-order", nil];
+	NSMutableArray *revListArgs = [NSMutableArray arrayWithObjects:@"rev-list", @"--pretty=format:" kRevListCommitDelimiter @"%H%x00%s%x00%B%x00%an%x00%cn%x00%ct%x00%P%x00", nil];
+
+	// Without a commit-graph, --topo-order makes git walk the entire history
+	// before it prints the first commit. Walk in git's default (date) order
+	// instead so rows stream in immediately; the rare commit that shows up
+	// after one of its parents (clock skew) is put back in place afterwards.
+	if ([pbRepo hasCommitGraph]) {
+		[revListArgs addObject:@"--topo-order"];
+	}
 	
 	if (rev.isSimpleRef) {
 		[revListArgs addObject:rev.simpleRef];
@@ -111,7 +265,6 @@ - (void) beginWalkWithSpecifier:(PBGitRevSpecifier*)rev
 		}
 	}
 
-	NSArray<NSString *> *stashSHAs = [pbRepo stashCommitSHAs];
 	for (NSString *stashSha in stashSHAs) {
 		if ([stashSha length] >= 40) {
 			[revListArgs addObject:stashSha];
@@ -122,13 +275,56 @@ - (void) beginWalkWithSpecifier:(PBGitRevSpecifier*)rev
 }
 
 
+- (PBCommitData *) commitDataFromRecord:(NSData *)record inPBRepo:(PBGitRepository *)pbRepo
+{
+	NSString *block = [[NSString alloc] initWithData:record encoding:NSUTF8StringEncoding];
+	if (!block) {
+		block = [[NSString alloc] initWithData:record encoding:NSISOLatin1StringEncoding];
+	}
+
+	// Split the data section by NUL characters. The first record is just the
+	// "commit SHA" header that precedes the first delimiter and is skipped here.
+	NSArray *fields = [block componentsSeparatedByString:@"\0"];
+	if ([fields count] < 7) {
+		return nil;
+	}
+
+	// Parse according to git format: %H%x00%s%x00%B%x00%an%x00%cn%x00%ct%x00%P%x00
+	NSString *shaString = fields[0];
+	NSString *messageSummary = fields[1];
+	NSString *message = fields[2];
+	NSString *authorName = fields[3];
+	NSString *committerName = fields[4];
+	NSString *timestampString = fields[5];
+	NSString *parentSHAsString = fields[6];
+
+	if ([shaString length] < 40 || [pbRepo isSuppressedStashCommit:shaString]) {
+		return nil;
+	}
+
+	NSTimeInterval timestamp = [timestampString doubleValue];
+	NSArray *parentSHAs = [PBCommitData parentSHAsFromString:parentSHAsString];
+	if ([pbRepo isStashCommitSHA:shaString] && [parentSHAs count] > 1) {
+		parentSHAs = @[parentSHAs[0]];
+	}
+
+	return [[PBCommitData alloc] initWithSha:shaString
+									shortSHA:[shaString substringToIndex:MIN(7, [shaString length])]
+									 message:message
+							  messageSummary:messageSummary
+								  commitDate:[NSDate dateWithTimeIntervalSince1970:timestamp]
+								  authorName:authorName
+							   committerName:committerName
+								  parentSHAs:parentSHAs];
+}
 
 
 - (void) addCommitsFromRevListArgs:(NSMutableArray *)revListArgs
 						 inPBRepo:(PBGitRepository*)pbRepo;
 {
 	PBGitGrapher *g = [[PBGitGrapher alloc] initWithRepository:pbRepo];
-	__block NSDate *lastUpdate = [NSDate date];
+	// Start in the past so the first screenful is delivered as soon as it's parsed.
+	__block NSDate *lastUpdate = [NSDate distantPast];
 
 	dispatch_queue_t loadQueue = dispatch_queue_create("net.phere.gitx.loadQueue", 0);
 	dispatch_queue_t decorateQueue = dispatch_queue_create("net.phere.gitx.decorateQueue", 0);
@@ -137,145 +333,317 @@ - (void) addCommitsFromRevListArgs:(NSMutableArray *)revListArgs
 	
 	__block int num = 0;
 	__block NSMutableArray *revisions = [NSMutableArray array];
+
+	// Row of every commit handed out so far, only needed when git isn't
+	// guaranteeing topological order. Touched on loadQueue only.
+	BOOL checkOrder = ![revListArgs containsObject:@"--topo-order"];
+	NSMutableDictionary *rowsBySHA = checkOrder ? [NSMutableDictionary dictionary] : nil;
+	NSMutableArray *allRevisions = checkOrder ? [NSMutableArray array] : nil;
+	__block NSUInteger firstMisplacedRow = NSNotFound;
+
+	NSThread *walkThread = [NSThread currentThread];
+	NSData *separator = [kRevListCommitDelimiter dataUsingEncoding:NSUTF8StringEncoding];
+
+	// Parse and graph time is summed per queue and reported once at the end;
+	// a span per commit would swamp the trace.
+	PBTraceSpan *loadSpan = [[PBTracer shared] beginSpan:@"rev-list load" category:@"history"];
+	BOOL tracing = loadSpan != nil;
+	__block uint64_t recordNanos = 0; // walk thread
+	__block uint64_t commitNanos = 0; // loadQueue
+	__block uint64_t graphNanos = 0;  // decorateQueue
 	
-	// Execute git rev-list and parse output
+	// Execute git rev-list and parse each commit as soon as git prints it
 	NSError *error = nil;
-	NSString *output = [pbRepo executeGitCommand:revListArgs inWorkingDir:YES error:&error];
-	
-	if (error) {
-		NSLog(@"Git rev-list command failed with error: %@", error.localizedDescription);
-		return;
-	}
-	
-	if (!output || [output length] == 0) {
-		[self finishedParsing];
-		return;
-	}
-	
-	// Parse the output into commits using our unique delimiter
-	NSArray *commits = [output componentsSeparatedByString:@"\n\x01GITX_COMMIT_DELIMITER\x02"];
-	
-	for (NSString *commitBlock in commits) {
-		if ([commitBlock length] == 0) continue;
-		if ([[NSThread currentThread] isCancelled]) break;
-		
-		NSString *block = commitBlock;
-		
-		// Handle the first commit which starts with "commit SHA\n"
-		if ([block hasPrefix:@"commit "]) {
-			// Skip the "commit SHA\n" line
-			NSRange firstNewline = [block rangeOfString:@"\n"];
-			if (firstNewline.location == NSNotFound) continue;
-			block = [block substringFromIndex:firstNewline.location + 1];
-			// Also skip our delimiter if it's at the start
-			if ([block hasPrefix:@"\x01GITX_COMMIT_DELIMITER\x02"]) {
-				block = [block substringFromIndex:[@"\x01GITX_COMMIT_DELIMITER\x02" length]];
-			}
+	__block NSUInteger records = 0;
+	[pbRepo streamGitCommand:revListArgs recordSeparator:separator handler:^BOOL(NSData *record) {
+		if ([walkThread isCancelled]) {
+			return NO;
 		}
-		
-		NSString *dataSection = block;
-		
-		// Split the data section by NUL characters
-		NSArray *fields = [dataSection componentsSeparatedByString:@"\0"];
-		
-		if ([fields count] >= 7) {
-			// Parse according to git format: %H%x00%s%x00%B%x00%an%x00%cn%x00%ct%x00%P%x00
-			NSString *shaString = fields[0];
-			NSString *messageSummary = fields[1];
-			NSString *message = fields[2];
-			NSString *authorName = fields[3];
-			NSString *committerName = fields[4];
-			NSString *timestampString = fields[5];
-			NSString *parentSHAsString = fields[6];
-			
-				BOOL isSuppressedStash = [pbRepo isSuppressedStashCommit:shaString];
-				if (isSuppressedStash) {
-					continue;
-				}
-				BOOL isStashCommit = [pbRepo isStashCommitSHA:shaString];
-				
-				if ([shaString length] >= 40) {
-					NSTimeInterval timestamp = [timestampString doubleValue];
-					NSArray *parentSHAs = [PBCommitData parentSHAsFromString:parentSHAsString];
-					if (isStashCommit && [parentSHAs count] > 1) {
-						parentSHAs = @[parentSHAs[0]];
-					}
-					PBCommitData *commitData = [[PBCommitData alloc] initWithSha:shaString
-												shortSHA:[shaString substringToIndex:MIN(7, [shaString length])]
-												 message:message
-											messageSummary:messageSummary
-											 commitDate:[NSDate dateWithTimeIntervalSince1970:timestamp]
-											 authorName:authorName
-											committerName:committerName
-											 parentSHAs:parentSHAs];
-					
-					dispatch_group_async(loadGroup, loadQueue, ^{
-						PBGitCommit *newCommit = nil;
-						if (isStashCommit) {
-							[self.commitCache removeObjectForKey:commitData.sha];
-						}
-						PBGitCommit *cachedCommit = isStashCommit ? nil : [self.commitCache objectForKey:commitData.sha];
-						if (cachedCommit) {
-							newCommit = cachedCommit;
-						} else {
-							@try {
-								newCommit = [[PBGitCommit alloc] initWithRepository:pbRepo andCommitData:commitData];
-								if (!isStashCommit) {
-									[self.commitCache setObject:newCommit forKey:commitData.sha];
-								}
-							} @catch (NSException *exception) {
-								return;
-							}
-						}
-						
-					[revisions addObject:newCommit];
-					
-					if (self.isGraphing) {
-						dispatch_group_async(decorateGroup, decorateQueue, ^{
-							if (num % 50 == 0) {
-							}
-							@try {
-								[g decorateCommit:newCommit];
-								if (num % 50 == 0) {
-								}
-							} @catch (NSException *exception) {
-								@throw exception;
-							}
-						});
+		if (++records % 1000 == 0) {
+			[self followForegroundQualityOfService];
+		}
+
+		uint64_t parseStart = tracing ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+		PBCommitData *commitData = [self commitDataFromRecord:record inPBRepo:pbRepo];
+		if (tracing)
+			recordNanos += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - parseStart;
+		if (!commitData) {
+			return YES;
+		}
+		BOOL isStashCommit = [pbRepo isStashCommitSHA:commitData.sha];
+
+		dispatch_group_async(loadGroup, loadQueue, ^{
+			uint64_t commitStart = tracing ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+			PBGitCommit *newCommit = nil;
+			if (isStashCommit) {
+				[self uncacheCommitForSHA:commitData.sha];
+			}
+			PBGitCommit *cachedCommit = isStashCommit ? nil : [self cachedCommitForSHA:commitData.sha];
+			if (cachedCommit) {
+				newCommit = cachedCommit;
+			} else {
+				@try {
+					newCommit = [[PBGitCommit alloc] initWithRepository:pbRepo andCommitData:commitData];
+					[newCommit prepareDisplayStrings];
+					if (!isStashCommit) {
+						[self cacheCommit:newCommit];
 					}
-					
-					if (++num % 100 == 0) {
-						if ([[NSDate date] timeIntervalSinceDate:lastUpdate] > 0.5 && ![[NSThread currentThread] isCancelled]) {
-							dispatch_group_wait(decorateGroup, DISPATCH_TIME_FOREVER);
-							NSDictionary *update = [NSDictionary dictionaryWithObjectsAndKeys:revisions, kRevListRevisionsKey, nil];
-							[self performSelectorOnMainThread:@selector(updateCommits:) withObject:update waitUntilDone:NO];
-							revisions = [NSMutableArray array];
-							lastUpdate = [NSDate date];
-						}
+				} @catch (NSException *exception) {
+					return;
+				}
+			}
+			if (tracing)
+				commitNanos += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - commitStart;
+
+			if (checkOrder) {
+				for (NSString *parentSHA in newCommit.parents) {
+					NSNumber *parentRow = rowsBySHA[parentSHA];
+					if (parentRow && [parentRow unsignedIntegerValue] < firstMisplacedRow) {
+						firstMisplacedRow = [parentRow unsignedIntegerValue];
 					}
+				}
+				rowsBySHA[commitData.sha] = @(num);
+				[allRevisions addObject:newCommit];
+			}
+			
+			[revisions addObject:newCommit];
+			
+			if (self.isGraphing) {
+				dispatch_group_async(decorateGroup, decorateQueue, ^{
+					uint64_t graphStart = tracing ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+					[g decorateCommit:newCommit];
+					if (tracing)
+						graphNanos += clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - graphStart;
 				});
 			}
-		}
-	}
+			
+			if (++num % 100 == 0) {
+				if ([[NSDate date] timeIntervalSinceDate:lastUpdate] > 0.5 && ![walkThread isCancelled]) {
+					dispatch_group_wait(decorateGroup, DISPATCH_TIME_FOREVER);
+					NSDictionary *update = [NSDictionary dictionaryWithObjectsAndKeys:revisions, kRevListRevisionsKey, nil];
+					[self performSelectorOnMainThread:@selector(updateCommits:) withObject:update waitUntilDone:NO];
+					revisions = [NSMutableArray array];
+					lastUpdate = [NSDate date];
+				}
+			}
+		});
+		return YES;
+	} error:&error];
 	
 	dispatch_group_wait(loadGroup, DISPATCH_TIME_FOREVER);
 	
 	dispatch_group_wait(decorateGroup, DISPATCH_TIME_FOREVER);
+
+	if (error) {
+		NSLog(@"Git rev-list command failed with error: %@", error.localizedDescription);
+	}
+
+	if (tracing) {
+		NSDictionary *counts = @{@"commits": @(num)};
+		[[PBTracer shared] recordSpan:@"rev-list parse" category:@"history" duration:recordNanos + commitNanos args:counts];
+		if (self.isGraphing)
+			[[PBTracer shared] recordSpan:@"rev-list graph" category:@"history" duration:graphNanos args:counts];
+		[loadSpan endWithArgs:@{@"commits": @(num), @"cancelled": @([walkThread isCancelled])}];
+	}
 	
+	// Put commits that came after one of their parents back in place here,
+	// so the main thread only has to swap in the finished rows.
+	NSUInteger repairFromRow = firstMisplacedRow;
+	NSArray *repairedRows = nil;
+	NSArray *repairedLineInfos = nil;
+	if (repairFromRow != NSNotFound && ![walkThread isCancelled]) {
+		NSRange tail = NSMakeRange(repairFromRow, [allRevisions count] - repairFromRow);
+		repairedRows = [self topologicallyOrderedCommits:[allRevisions subarrayWithRange:tail]];
+		if (repairedRows && self.isGraphing) {
+			repairedLineInfos = [self lineInfosForCommits:repairedRows afterCommits:[allRevisions subarrayWithRange:NSMakeRange(0, repairFromRow)] inPBRepo:pbRepo];
+		}
+	}
+
 	// Make sure the commits are stored before exiting.
-	if (![[NSThread currentThread] isCancelled]) {
+	if (![walkThread isCancelled]) {
 		NSDictionary *update = [NSDictionary dictionaryWithObjectsAndKeys:revisions, kRevListRevisionsKey, nil];
 		
 		dispatch_async(dispatch_get_main_queue(), ^{
 			[self updateCommits:update];
+			if (repairedRows) {
+				[self replaceCommitsFromRow:repairFromRow withCommits:repairedRows lineInfos:repairedLineInfos];
+			}
 		});
 		
 		dispatch_async(dispatch_get_main_queue(), ^{
 			[self finishedParsing];
 		});
-		
-	} else {
 	}
 }
 
+
+// Lays out the history from the commit-graph rather than rev-list's text, so
+// the rows and their graph lines appear without git formatting every commit
+// first. Subjects and names are left to the repository's commitTexts, which
+// reads them as rows are shown. Returns NO when the graph can't be used and
+// rev-list has to run instead.
+- (BOOL) addCommitsFromCommitGraph:(PBCommitGraph *)graph
+							  tips:(NSArray<NSString *> *)tips
+						 stashSHAs:(NSArray<NSString *> *)stashSHAs
+						  inPBRepo:(PBGitRepository *)pbRepo
+{
+	NSThread *walkThread = [NSThread currentThread];
+	PBTraceSpan *loadSpan = [[PBTracer shared] beginSpan:@"commit-graph load" category:@"history"];
+
+	PBCommitGraphWalk *walk = [graph walkFromTips:tips firstParentOnly:[NSSet setWithArray:stashSHAs] repository:pbRepo cancelled:^BOOL{
+		return [walkThread isCancelled];
+	}];
+	if (!walk) {
+		[loadSpan endWithArgs:@{@"fallback": @(![walkThread isCancelled])}];
+		return [walkThread isCancelled];
+	}
+
+	PBGitGrapher *grapher = self.isGraphing ? [[PBGitGrapher alloc] initWithRepository:pbRepo] : nil;
+	NSMutableArray *revisions = [NSMutableArray array];
+	NSDate *lastUpdate = [NSDate distantPast];
+	NSUInteger rowCount = [walk count];
+	NSUInteger num = 0;
+
+	for (NSUInteger row = 0; row < rowCount; row++) {
+		NSString *sha = [walk shaAtRow:row];
+		if ([pbRepo isSuppressedStashCommit:sha]) {
+			continue;
+		}
+
+		BOOL isStashCommit = [pbRepo isStashCommitSHA:sha];
+		PBGitCommit *commit = isStashCommit ? nil : [self cachedCommitForSHA:sha];
+		if (!commit) {
+			PBCommitData *commitData = [walk commitDataAtRow:row];
+			if (commitData) {
+				commit = [[PBGitCommit alloc] initWithRepository:pbRepo andCommitData:commitData];
+			} else {
+				commit = [[PBGitCommit alloc] initWithRepository:pbRepo sha:sha parents:[walk parentSHAsAtRow:row] commitDate:[walk commitDateAtRow:row]];
+			}
+			[commit prepareDisplayStrings];
+			if (!isStashCommit) {
+				[self cacheCommit:commit];
+			}
+		}
+
+		[grapher decorateCommit:commit];
+		[revisions addObject:commit];
+
+		if (++num % 1000 == 0) {
+			if ([walkThread isCancelled]) {
+				break;
+			}
+			[self followForegroundQualityOfService];
+			if ([[NSDate date] timeIntervalSinceDate:lastUpdate] > 0.5) {
+				NSDictionary *update = @{kRevListRevisionsKey: revisions};
+				[self performSelectorOnMainThread:@selector(updateCommits:) withObject:update waitUntilDone:NO];
+				revisions = [NSMutableArray array];
+				lastUpdate = [NSDate date];
+			}
+		}
+	}
+
+	[loadSpan endWithArgs:@{@"commits": @(num), @"cancelled": @([walkThread isCancelled])}];
+
+	if (![walkThread isCancelled]) {
+		NSDictionary *update = @{kRevListRevisionsKey: revisions};
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if ([walkThread isCancelled]) {
+				return;
+			}
+			[self updateCommits:update];
+			[self finishedParsing];
+		});
+	}
+	return YES;
+}
+
+
+// Returns commits reordered so that none comes after one of its parents,
+// keeping the streamed order wherever it was already valid; nil if they
+// can't be ordered.
+- (NSArray *) topologicallyOrderedCommits:(NSArray *)commits
+{
+	NSUInteger count = [commits count];
+
+	NSMutableDictionary *positions = [NSMutableDictionary dictionaryWithCapacity:count];
+	[commits enumerateObjectsUsingBlock:^(PBGitCommit *commit, NSUInteger idx, BOOL *stop) {
+		positions[commit.sha] = @(idx);
+	}];
+
+	NSUInteger *pendingChildren = calloc(MAX(count, 1U), sizeof(NSUInteger));
+	for (PBGitCommit *commit in commits) {
+		for (NSString *parentSHA in commit.parents) {
+			NSNumber *position = positions[parentSHA];
+			if (position) {
+				pendingChildren[[position unsignedIntegerValue]]++;
+			}
+		}
+	}
+
+	NSMutableIndexSet *ready = [NSMutableIndexSet indexSet];
+	for (NSUInteger idx = 0; idx < count; idx++) {
+		if (pendingChildren[idx] == 0) {
+			[ready addIndex:idx];
+		}
+	}
+
+	NSMutableArray *ordered = [NSMutableArray arrayWithCapacity:count];
+	while ([ready count] > 0) {
+		NSUInteger idx = [ready firstIndex];
+		[ready removeIndex:idx];
+
+		PBGitCommit *commit = commits[idx];
+		[ordered addObject:commit];
+		for (NSString *parentSHA in commit.parents) {
+			NSNumber *position = positions[parentSHA];
+			if (position && --pendingChildren[[position unsignedIntegerValue]] == 0) {
+				[ready addIndex:[position unsignedIntegerValue]];
+			}
+		}
+	}
+	free(pendingChildren);
+
+	return [ordered count] == count ? ordered : nil;
+}
+
+
+// Graph cells for commits shown after the rows in before, one per commit
+// (NSNull where a row can't be laid out). Leaves the commits alone, since
+// the ones on screen are still drawn from their current cells.
+- (NSArray *) lineInfosForCommits:(NSArray *)commits afterCommits:(NSArray *)before inPBRepo:(PBGitRepository *)pbRepo
+{
+	PBTraceSpan *span = [[PBTracer shared] beginSpan:@"rev-list regraph" category:@"history"];
+	PBGitGrapher *grapher = [[PBGitGrapher alloc] initWithRepository:pbRepo];
+	for (PBGitCommit *commit in before) {
+		[grapher cellInfoForCommit:commit];
+	}
+
+	NSMutableArray *lineInfos = [NSMutableArray arrayWithCapacity:[commits count]];
+	for (PBGitCommit *commit in commits) {
+		PBGraphCellInfo *lineInfo = [grapher cellInfoForCommit:commit];
+		[lineInfos addObject:lineInfo ?: (id)[NSNull null]];
+	}
+	[span endWithArgs:@{@"commits": @([before count] + [commits count]), @"replaced": @([commits count])}];
+	return lineInfos;
+}
+
+
+// Publishes the rows put back in order by the walk thread, and their cells
+// when the list is graphed. Observers see a new lineage and re-graph.
+- (void) replaceCommitsFromRow:(NSUInteger)row withCommits:(NSArray *)commits lineInfos:(NSArray *)lineInfos
+{
+	PBCommitList *listed = self.commits;
+	if ((NSUInteger)listed.count != row + [commits count]) {
+		return;
+	}
+
+	[commits enumerateObjectsUsingBlock:^(PBGitCommit *commit, NSUInteger idx, BOOL *stop) {
+		id lineInfo = lineInfos[idx];
+		if (lineInfo != [NSNull null]) {
+			commit.lineInfo = lineInfo;
+		}
+	}];
+	self.commits = [listed listByReplacingCommitsFromRow:(NSInteger)row withCommits:commits];
+}
+
 @end
@@ -0,0 +1,578 @@
+//
+//  PBGraphLaneLayout.c
+//  GitX
+//
+//  Each open lane owns a slot. A lane keeps its slot until the commit it
+//  waits for is reached, so lanes run straight down instead of shifting
+//  left whenever one to their left ends, and a new lane takes the lowest
+//  free slot. Slots at or past the lane limit are hidden: they are drawn
+//  in a single overflow column, and move into a visible slot as soon as
+//  one frees up.
+//
+//  The commits lanes wait for are found through a hash table, and free and
+//  hidden slots are kept in heaps, so a row only ever looks at the visible
+//  slots and the lanes that end or start at its commit.
+//
+
+#include "PBGraphLaneLayout.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	PBTableEmpty = -1,
+	PBTableDeleted = -2,
+};
+
+typedef struct PBGraphLane {
+	PBGraphObjectID waitingFor;
+	int live;
+	int color;
+	// Next slot waiting for the same commit, or -1
+	int next;
+	// Last row that ended, continued or started this lane
+	long row;
+} PBGraphLane;
+
+// Min-heap of slots. Entries can go stale and are checked when taken.
+typedef struct PBSlotHeap {
+	int *slots;
+	int count;
+	int capacity;
+} PBSlotHeap;
+
+struct PBGraphLaneLayout {
+	int laneLimit;
+	int nextColor;
+	long row;
+
+	PBGraphLane *lanes;
+	int laneCount;
+	int laneCapacity;
+	// Slots below laneCount that aren't live
+	int freeCount;
+	// Live slots at or past laneLimit
+	int hiddenCount;
+
+	PBSlotHeap freeSlots;
+	PBSlotHeap hiddenSlots;
+
+	// Commit waited for -> first slot waiting for it, by open addressing
+	int *table;
+	int tableCapacity;
+	// Entries in use, and those plus deleted ones
+	int tableLive;
+	int tableUsed;
+};
+
+#pragma mark Object names
+
+static int PBHexValue(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+bool PBGraphObjectIDFromHex(const char *hex, size_t length, PBGraphObjectID *objectID)
+{
+	if (!hex || length == 0 || length % 2 != 0 || length / 2 > sizeof(objectID->bytes))
+		return false;
+
+	memset(objectID, 0, sizeof(*objectID));
+	for (size_t i = 0; i < length / 2; i++) {
+		int high = PBHexValue(hex[i * 2]);
+		int low = PBHexValue(hex[i * 2 + 1]);
+		if (high < 0 || low < 0)
+			return false;
+		objectID->bytes[i] = (unsigned char)(high << 4 | low);
+	}
+	objectID->length = (unsigned char)(length / 2);
+	return true;
+}
+
+static inline uint64_t PBObjectIDHash(const PBGraphObjectID *objectID)
+{
+	uint64_t hash = 0;
+	memcpy(&hash, objectID->bytes, sizeof(hash));
+	// Object names are already well spread; mix anyway so short or
+	// patterned names don't cluster.
+	hash ^= objectID->length;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+static inline bool PBObjectIDEqual(const PBGraphObjectID *a, const PBGraphObjectID *b)
+{
+	return a->length == b->length && memcmp(a->bytes, b->bytes, a->length) == 0;
+}
+
+#pragma mark Slot heaps
+
+static void PBHeapPush(PBSlotHeap *heap, int slot)
+{
+	if (heap->count == heap->capacity) {
+		heap->capacity = heap->capacity ? heap->capacity * 2 : 64;
+		heap->slots = realloc(heap->slots, sizeof(int) * (size_t)heap->capacity);
+	}
+
+	int index = heap->count++;
+	while (index > 0) {
+		int parent = (index - 1) / 2;
+		if (heap->slots[parent] <= slot)
+			break;
+		heap->slots[index] = heap->slots[parent];
+		index = parent;
+	}
+	heap->slots[index] = slot;
+}
+
+static void PBHeapPop(PBSlotHeap *heap)
+{
+	int last = heap->slots[--heap->count];
+	int index = 0;
+	for (;;) {
+		int child = index * 2 + 1;
+		if (child >= heap->count)
+			break;
+		if (child + 1 < heap->count && heap->slots[child + 1] < heap->slots[child])
+			child++;
+		if (last <= heap->slots[child])
+			break;
+		heap->slots[index] = heap->slots[child];
+		index = child;
+	}
+	if (heap->count > 0)
+		heap->slots[index] = last;
+}
+
+#pragma mark Waiting table
+
+static void PBTableInsert(PBGraphLaneLayout *layout, int slot)
+{
+	size_t mask = (size_t)layout->tableCapacity - 1;
+	size_t index = PBObjectIDHash(&layout->lanes[slot].waitingFor) & mask;
+	while (layout->table[index] >= 0)
+		index = (index + 1) & mask;
+	if (layout->table[index] == PBTableEmpty)
+		layout->tableUsed++;
+	layout->table[index] = slot;
+}
+
+// Rebuilds the table without deleted entries, sized for what is waiting.
+static void PBTableRebuild(PBGraphLaneLayout *layout)
+{
+	int *old = layout->table;
+	int oldCapacity = layout->tableCapacity;
+	int capacity = 64;
+	while (capacity < (layout->tableLive + 1) * 4)
+		capacity *= 2;
+
+	layout->table = malloc(sizeof(int) * (size_t)capacity);
+	for (int i = 0; i < capacity; i++)
+		layout->table[i] = PBTableEmpty;
+	layout->tableCapacity = capacity;
+	layout->tableUsed = 0;
+
+	for (int i = 0; i < oldCapacity; i++)
+		if (old[i] >= 0)
+			PBTableInsert(layout, old[i]);
+	free(old);
+}
+
+// Index of the entry for objectID, or -1.
+static int PBTableFind(const PBGraphLaneLayout *layout, const PBGraphObjectID *objectID)
+{
+	size_t mask = (size_t)layout->tableCapacity - 1;
+	size_t index = PBObjectIDHash(objectID) & mask;
+	for (;;) {
+		int slot = layout->table[index];
+		if (slot == PBTableEmpty)
+			return -1;
+		if (slot >= 0 && PBObjectIDEqual(&layout->lanes[slot].waitingFor, objectID))
+			return (int)index;
+		index = (index + 1) & mask;
+	}
+}
+
+// Removes and returns the first slot waiting for objectID, or -1.
+static int PBTableTake(PBGraphLaneLayout *layout, const PBGraphObjectID *objectID)
+{
+	int index = PBTableFind(layout, objectID);
+	if (index < 0)
+		return -1;
+	int slot = layout->table[index];
+	layout->table[index] = PBTableDeleted;
+	layout->tableLive--;
+	return slot;
+}
+
+static void PBTableAdd(PBGraphLaneLayout *layout, const PBGraphObjectID *objectID, int slot)
+{
+	PBGraphLane *lane = &layout->lanes[slot];
+	lane->waitingFor = *objectID;
+
+	int index = PBTableFind(layout, objectID);
+	if (index >= 0) {
+		lane->next = layout->table[index];
+		layout->table[index] = slot;
+		return;
+	}
+
+	lane->next = -1;
+	if ((layout->tableUsed + 1) * 2 > layout->tableCapacity)
+		PBTableRebuild(layout);
+	PBTableInsert(layout, slot);
+	layout->tableLive++;
+}
+
+#pragma mark Slots
+
+static void PBEnsureLaneCapacity(PBGraphLaneLayout *layout, int count)
+{
+	if (count <= layout->laneCapacity)
+		return;
+	while (layout->laneCapacity < count)
+		layout->laneCapacity = layout->laneCapacity ? layout->laneCapacity * 2 : 64;
+	layout->lanes = realloc(layout->lanes, sizeof(PBGraphLane) * (size_t)layout->laneCapacity);
+}
+
+// Stale heap entries pile up when slots are freed and taken again; drop
+// them once they outnumber the real ones.
+static void PBCompactHeaps(PBGraphLaneLayout *layout)
+{
+	if (layout->freeSlots.count > layout->freeCount * 2 + 64) {
+		layout->freeSlots.count = 0;
+		for (int slot = 0; slot < layout->laneCount; slot++)
+			if (!layout->lanes[slot].live)
+				PBHeapPush(&layout->freeSlots, slot);
+	}
+	if (layout->hiddenSlots.count > layout->hiddenCount * 2 + 64) {
+		layout->hiddenSlots.count = 0;
+		for (int slot = layout->laneLimit; slot < layout->laneCount; slot++)
+			if (layout->lanes[slot].live)
+				PBHeapPush(&layout->hiddenSlots, slot);
+	}
+}
+
+// The lowest free slot, or -1 if every slot is in use.
+static int PBPeekFreeSlot(PBGraphLaneLayout *layout)
+{
+	PBSlotHeap *heap = &layout->freeSlots;
+	while (heap->count > 0) {
+		int slot = heap->slots[0];
+		if (slot < layout->laneCount && !layout->lanes[slot].live)
+			return slot;
+		PBHeapPop(heap);
+	}
+	return -1;
+}
+
+static int PBTakeFreeSlot(PBGraphLaneLayout *layout)
+{
+	int slot = PBPeekFreeSlot(layout);
+	if (slot >= 0) {
+		PBHeapPop(&layout->freeSlots);
+		layout->freeCount--;
+		return slot;
+	}
+
+	PBEnsureLaneCapacity(layout, layout->laneCount + 1);
+	slot = layout->laneCount++;
+	layout->lanes[slot].live = 0;
+	return slot;
+}
+
+// The lowest hidden lane other than skip, taken off the hidden heap, or -1.
+static int PBTakeHiddenSlot(PBGraphLaneLayout *layout, int skip)
+{
+	PBSlotHeap *heap = &layout->hiddenSlots;
+	bool skipped = false;
+	int found = -1;
+	while (heap->count > 0) {
+		int slot = heap->slots[0];
+		PBHeapPop(heap);
+		if (slot < layout->laneLimit || slot >= layout->laneCount || !layout->lanes[slot].live)
+			continue;
+		if (slot == skip) {
+			skipped = true;
+			continue;
+		}
+		found = slot;
+		break;
+	}
+	if (skipped)
+		PBHeapPush(heap, skip);
+	return found;
+}
+
+static void PBStartLane(PBGraphLaneLayout *layout, int slot, int color)
+{
+	PBGraphLane *lane = &layout->lanes[slot];
+	lane->live = 1;
+	lane->color = color;
+	lane->next = -1;
+	lane->row = layout->row;
+	if (slot >= layout->laneLimit) {
+		layout->hiddenCount++;
+		PBHeapPush(&layout->hiddenSlots, slot);
+	}
+}
+
+static void PBEndLane(PBGraphLaneLayout *layout, int slot)
+{
+	layout->lanes[slot].live = 0;
+	if (slot >= layout->laneLimit)
+		layout->hiddenCount--;
+	layout->freeCount++;
+	PBHeapPush(&layout->freeSlots, slot);
+}
+
+// Moves the lane at from into the free slot to, keeping its place among
+// the lanes waiting for the same commit.
+static void PBMoveLane(PBGraphLaneLayout *layout, int from, int to)
+{
+	layout->lanes[to] = layout->lanes[from];
+	layout->lanes[to].row = layout->row;
+
+	int index = PBTableFind(layout, &layout->lanes[from].waitingFor);
+	if (index >= 0) {
+		if (layout->table[index] == from) {
+			layout->table[index] = to;
+		} else {
+			int slot = layout->table[index];
+			while (slot >= 0 && layout->lanes[slot].next != from)
+				slot = layout->lanes[slot].next;
+			if (slot >= 0)
+				layout->lanes[slot].next = to;
+		}
+	}
+
+	PBEndLane(layout, from);
+}
+
+#pragma mark Layout
+
+PBGraphLaneLayout *PBGraphLaneLayoutCreate(int laneLimit)
+{
+	PBGraphLaneLayout *layout = calloc(1, sizeof(PBGraphLaneLayout));
+	if (laneLimit < 1)
+		laneLimit = 1;
+	if (laneLimit > PBGraphLaneLimitMax)
+		laneLimit = PBGraphLaneLimitMax;
+	layout->laneLimit = laneLimit;
+	PBTableRebuild(layout);
+	return layout;
+}
+
+void PBGraphLaneLayoutFree(PBGraphLaneLayout *layout)
+{
+	if (!layout)
+		return;
+	free(layout->lanes);
+	free(layout->freeSlots.slots);
+	free(layout->hiddenSlots.slots);
+	free(layout->table);
+	free(layout);
+}
+
+int PBGraphLaneLayoutMaxLines(const PBGraphLaneLayout *layout, int parentCount)
+{
+	// Two per visible lane passing through, one per visible lane merging
+	// in or moving out of the overflow, one per parent, and the overflow
+	// and commit lane's own.
+	return layout->laneLimit * 4 + (parentCount > 0 ? parentCount : 0) + 4;
+}
+
+static inline int PBColumn(const PBGraphLaneLayout *layout, int slot)
+{
+	return slot < layout->laneLimit ? slot + 1 : layout->laneLimit + 1;
+}
+
+static inline void PBAddLine(struct PBGitGraphLine *lines, int *count, int *maxColumn,
+                             bool upper, int from, int to, int color)
+{
+	struct PBGitGraphLine line = {
+		.upper = upper ? 1 : 0,
+		.from = from,
+		.to = to,
+		// Colours only matter modulo the palette
+		.colorIndex = color & 0x7f
+	};
+	lines[(*count)++] = line;
+	if (from > *maxColumn)
+		*maxColumn = from;
+	if (to > *maxColumn)
+		*maxColumn = to;
+}
+
+void PBGraphLaneLayoutAddRow(PBGraphLaneLayout *layout,
+                             const PBGraphObjectID *commit,
+                             const PBGraphObjectID *parents,
+                             int parentCount,
+                             struct PBGitGraphLine *lines,
+                             PBGraphLaneRow *row)
+{
+	const int overflowColumn = layout->laneLimit + 1;
+	const long rowNumber = ++layout->row;
+	const int hiddenBefore = layout->hiddenCount;
+	int count = 0;
+	int maxColumn = 0;
+	int consumedHidden = 0;
+
+	// The leftmost lane waiting for this commit carries on from it; the
+	// others end here.
+	int chain = PBTableTake(layout, commit);
+	int position = -1;
+	for (int slot = chain; slot >= 0; slot = layout->lanes[slot].next) {
+		if (position < 0 || slot < position)
+			position = slot;
+		layout->lanes[slot].row = rowNumber;
+		if (slot >= layout->laneLimit)
+			consumedHidden++;
+	}
+	if (position < 0) {
+		position = PBTakeFreeSlot(layout);
+		PBStartLane(layout, position, layout->nextColor++);
+	}
+	const int positionColumn = PBColumn(layout, position);
+	if (positionColumn > maxColumn)
+		maxColumn = positionColumn;
+
+	bool drewOverflowAbove = false;
+	for (int slot = chain; slot >= 0; slot = layout->lanes[slot].next) {
+		int column = PBColumn(layout, slot);
+		if (column == overflowColumn) {
+			if (drewOverflowAbove)
+				continue;
+			drewOverflowAbove = true;
+		}
+		PBAddLine(lines, &count, &maxColumn, true, column, positionColumn, layout->lanes[slot].color);
+	}
+
+	// Visible lanes that don't meet this commit pass straight through
+	int visible = layout->laneCount < layout->laneLimit ? layout->laneCount : layout->laneLimit;
+	for (int slot = 0; slot < visible; slot++) {
+		PBGraphLane *lane = &layout->lanes[slot];
+		if (!lane->live || lane->row == rowNumber)
+			continue;
+		PBAddLine(lines, &count, &maxColumn, true, slot + 1, slot + 1, lane->color);
+		PBAddLine(lines, &count, &maxColumn, false, slot + 1, slot + 1, lane->color);
+	}
+
+	for (int slot = chain; slot >= 0; slot = layout->lanes[slot].next)
+		if (slot != position)
+			PBEndLane(layout, slot);
+
+	if (parentCount > 0) {
+		PBTableAdd(layout, &parents[0], position);
+		PBAddLine(lines, &count, &maxColumn, false, positionColumn, positionColumn, layout->lanes[position].color);
+	} else {
+		PBEndLane(layout, position);
+	}
+
+	// Bring hidden lanes into visible slots that just freed up
+	while (layout->hiddenCount > 0) {
+		int freeSlot = PBPeekFreeSlot(layout);
+		if (freeSlot < 0 || freeSlot >= layout->laneLimit)
+			break;
+		int hiddenSlot = PBTakeHiddenSlot(layout, position);
+		if (hiddenSlot < 0)
+			break;
+		PBHeapPop(&layout->freeSlots);
+		layout->freeCount--;
+		PBMoveLane(layout, hiddenSlot, freeSlot);
+		PBAddLine(lines, &count, &maxColumn, false, freeSlot + 1, overflowColumn, layout->lanes[freeSlot].color);
+	}
+
+	// Merged parents join a lane already waiting for them or start one
+	bool drewOverflowBelow = false;
+	for (int i = 1; i < parentCount; i++) {
+		int index = PBTableFind(layout, &parents[i]);
+		int slot;
+		if (index >= 0) {
+			slot = layout->table[index];
+		} else {
+			slot = PBTakeFreeSlot(layout);
+			PBStartLane(layout, slot, layout->nextColor++);
+			PBTableAdd(layout, &parents[i], slot);
+		}
+
+		int column = PBColumn(layout, slot);
+		if (column == overflowColumn) {
+			if (drewOverflowBelow)
+				continue;
+			drewOverflowBelow = true;
+		}
+		PBAddLine(lines, &count, &maxColumn, false, column, positionColumn, layout->lanes[slot].color);
+	}
+
+	while (layout->laneCount > 0 && !layout->lanes[layout->laneCount - 1].live) {
+		layout->laneCount--;
+		layout->freeCount--;
+	}
+	PBCompactHeaps(layout);
+
+	// Below the row that is every hidden lane still open, including ones a
+	// merge or the commit itself just started past the limit
+	int overflowAbove = hiddenBefore - consumedHidden;
+	int overflowBelow = layout->hiddenCount;
+	row->position = positionColumn;
+	row->nLines = count;
+	row->overflowAbove = overflowAbove;
+	row->overflowBelow = overflowBelow;
+	row->overflowColumn = (overflowAbove > 0 || overflowBelow > 0) ? overflowColumn : 0;
+	if (row->overflowColumn > maxColumn)
+		maxColumn = row->overflowColumn;
+	row->numColumns = maxColumn;
+}
+
+#pragma mark Geometry
+
+// Palette slot of a line; negative lane colours wrap like positive ones.
+static inline int PBPaletteColor(struct PBGitGraphLine line)
+{
+	return ((int)line.colorIndex % PBGraphPaletteSize + PBGraphPaletteSize) % PBGraphPaletteSize;
+}
+
+int PBGraphGeometryBuild(const struct PBGitGraphLine *lines,
+                         int count,
+                         struct PBGitGraphPoint *points,
+                         struct PBGitGraphColorRun *runs)
+{
+	if (!lines || count < 0)
+		count = 0;
+
+	// Counting sort on the palette colour keeps lines of a colour in their
+	// original order.
+	int perColor[PBGraphPaletteSize] = { 0 };
+	for (int index = 0; index < count; index++)
+		perColor[PBPaletteColor(lines[index])]++;
+
+	int next[PBGraphPaletteSize];
+	int runCount = 0;
+	int total = 0;
+	for (int color = 0; color < PBGraphPaletteSize; color++) {
+		next[color] = total;
+		if (perColor[color] > 0)
+			runs[runCount++] = (struct PBGitGraphColorRun){ color, total, perColor[color] };
+		total += perColor[color];
+	}
+
+	for (int index = 0; index < count; index++) {
+		struct PBGitGraphLine line = lines[index];
+		int segment = next[PBPaletteColor(line)]++;
+		// Lines marked upper come in from the row above, the rest from below
+		points[segment * 2] = (struct PBGitGraphPoint){ (float)line.from, line.upper == 0 ? 1.0f : 0.0f };
+		points[segment * 2 + 1] = (struct PBGitGraphPoint){ (float)line.to, 0.5f };
+	}
+	return runCount;
+}
@@ -0,0 +1,76 @@
+//
+//  PBGraphLaneLayout.h
+//  GitX
+//
+//  Lane layout for the history graph that keeps lanes in fixed columns,
+//  reuses the columns of lanes that ended and shows at most a set number
+//  of them, folding the rest into one overflow column; and the geometry a
+//  row is drawn from. Plain C, so it can be built, checked and timed
+//  without AppKit (see tests/graph-layout).
+//
+
+#ifndef PBGraphLaneLayout_h
+#define PBGraphLaneLayout_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "PBGitGraphLine.h"
+
+// Visible lanes are limited to what a PBGitGraphLine column can hold
+#define PBGraphLaneLimitMax 120
+
+// A commit's object name in binary; SHA-1 or SHA-256.
+typedef struct PBGraphObjectID {
+	unsigned char bytes[32];
+	unsigned char length;
+} PBGraphObjectID;
+
+// What PBGraphLaneLayoutAddRow worked out for a row. Columns count from 1.
+typedef struct PBGraphLaneRow {
+	int position;
+	int numColumns;
+	int nLines;
+	// The column hidden lanes are folded into, or 0 if none pass this row
+	int overflowColumn;
+	// Hidden lanes coming in at the top of the row and leaving at its bottom
+	int overflowAbove;
+	int overflowBelow;
+} PBGraphLaneRow;
+
+typedef struct PBGraphLaneLayout PBGraphLaneLayout;
+
+// Parses a hex object name. Returns false if it isn't one.
+bool PBGraphObjectIDFromHex(const char *hex, size_t length, PBGraphObjectID *objectID);
+
+// laneLimit is clamped to 1 ... PBGraphLaneLimitMax.
+PBGraphLaneLayout *PBGraphLaneLayoutCreate(int laneLimit);
+void PBGraphLaneLayoutFree(PBGraphLaneLayout *layout);
+
+// Room the lines of a row with parentCount parents can need.
+int PBGraphLaneLayoutMaxLines(const PBGraphLaneLayout *layout, int parentCount);
+
+// Lays out the next row, for commits given children first. Writes its lines,
+// at most PBGraphLaneLayoutMaxLines of them, and fills in row. The cost of a
+// row depends on the lane limit and the commit's parents, not on how many
+// lanes are open.
+void PBGraphLaneLayoutAddRow(PBGraphLaneLayout *layout,
+                             const PBGraphObjectID *commit,
+                             const PBGraphObjectID *parents,
+                             int parentCount,
+                             struct PBGitGraphLine *lines,
+                             PBGraphLaneRow *row);
+
+// Lane colours graph lines cycle through; the view's palette has this many.
+#define PBGraphPaletteSize 8
+
+// Prepares a row's lines for drawing (PBGraphGeometry): each line becomes a
+// segment of two points, from where it enters the row to the commit's centre
+// height, with segments grouped by palette colour. Writes 2 * count points
+// and one run per colour used, at most PBGraphPaletteSize, in ascending
+// colour order; lines of a colour keep their order. Returns the run count.
+int PBGraphGeometryBuild(const struct PBGitGraphLine *lines,
+                         int count,
+                         struct PBGitGraphPoint *points,
+                         struct PBGitGraphColorRun *runs);
+
+#endif
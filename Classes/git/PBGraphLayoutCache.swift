@@ -0,0 +1,275 @@
+import Foundation
+
+/// One bit per row of a `PBCommitList`: the rows a history filter shows.
+@objcMembers
+@objc(PBRowMask)
+final class PBRowMask: NSObject {
+    private let words: [UInt64]
+    /// Rows set
+    let count: Int
+
+    fileprivate init(words: [UInt64]) {
+        self.words = words
+        self.count = words.reduce(0) { $0 + $1.nonzeroBitCount }
+        super.init()
+    }
+
+    @objc(containsRow:)
+    func contains(row: Int) -> Bool {
+        let word = row >> 6
+        return word < words.count && words[word] & (1 << UInt64(row & 63)) != 0
+    }
+
+    fileprivate var byteCount: Int {
+        return words.count * 8
+    }
+}
+
+/// Graph layouts of the project history, one per branch filter or selected
+/// ref recently shown, so switching back to one reuses its rows and lines
+/// instead of graphing the history again.
+///
+/// Which rows a filter shows is worked out on an integer table of the
+/// history (each row's parents as row numbers) with a bitset swept once
+/// from the filter's tips, rather than by following SHA strings through a
+/// set. Masks are cached per set of tips.
+///
+/// Everything is tied to one snapshot of the history; a new snapshot (a
+/// reload) drops it all. The workspace memory budget can trim layouts,
+/// least recently shown first.
+@objcMembers
+@objc(PBGraphLayoutCache)
+final class PBGraphLayoutCache: NSObject, GitWorkspaceCache {
+    private final class Layout {
+        let key: String
+        let commits: [PBGitCommit]
+        let lineInfos: [PBGraphCellInfo]
+        let cost: Int
+
+        init(key: String, commits: [PBGitCommit], lineInfos: [PBGraphCellInfo]) {
+            self.key = key
+            self.commits = commits
+            self.lineInfos = lineInfos
+            // Row references, the cell info objects, their line arrays and geometry
+            self.cost = commits.count * 80 + lineInfos.reduce(0) {
+                $0 + $1.nLines * MemoryLayout<PBGitGraphLine>.stride + $1.geometry.byteCount
+            }
+        }
+    }
+
+    /// Rows of one snapshot with their parents as row numbers.
+    private final class RowTable {
+        let rows: [String: Int32]
+        let parentStart: [Int32]
+        let parentRows: [Int32]
+        let cost: Int
+
+        init(list: PBCommitList) {
+            var rows: [String: Int32] = [:]
+            rows.reserveCapacity(list.count)
+            for row in 0..<list.count {
+                rows[list.commit(at: row).sha] = Int32(row)
+            }
+
+            var parentStart = [Int32](repeating: 0, count: list.count + 1)
+            var parentRows: [Int32] = []
+            parentRows.reserveCapacity(list.count + list.count / 8)
+            for row in 0..<list.count {
+                for parent in list.commit(at: row).parents {
+                    if let parentRow = rows[parent] {
+                        parentRows.append(parentRow)
+                    }
+                }
+                parentStart[row + 1] = Int32(parentRows.count)
+            }
+
+            self.rows = rows
+            self.parentStart = parentStart
+            self.parentRows = parentRows
+            self.cost = rows.count * 96 + (parentStart.count + parentRows.count) * 4
+        }
+
+        /// Rows reachable from `tips`. The list puts children before
+        /// parents, so one pass down from the first tip marks everything.
+        func mask(fromTips tips: Set<String>) -> PBRowMask {
+            var words = [UInt64](repeating: 0, count: (parentStart.count - 1 + 63) / 64)
+            var first = Int.max
+            for tip in tips {
+                if let row = rows[tip] {
+                    words[Int(row) >> 6] |= 1 << UInt64(row & 63)
+                    first = min(first, Int(row))
+                }
+            }
+
+            var row = first
+            let rowCount = parentStart.count - 1
+            while row < rowCount {
+                if words[row >> 6] & (1 << UInt64(row & 63)) != 0 {
+                    for index in Int(parentStart[row])..<Int(parentStart[row + 1]) {
+                        let parent = Int(parentRows[index])
+                        words[parent >> 6] |= 1 << UInt64(parent & 63)
+                    }
+                    row += 1
+                } else if words[row >> 6] >> UInt64(row & 63) == 0 {
+                    // Nothing else set in this word
+                    row = (row | 63) + 1
+                } else {
+                    row += 1
+                }
+            }
+            return PBRowMask(words: words)
+        }
+    }
+
+    private let capacity: Int
+    private static let maskCapacity = 16
+
+    private let lock = NSLock()
+    private weak var list: PBCommitList?
+    private var table: RowTable?
+    /// Least recently used first
+    private var layouts: [Layout] = []
+    private var masks: [(key: String, mask: PBRowMask)] = []
+
+    @objc(initWithCapacity:)
+    init(capacity: Int) {
+        self.capacity = capacity
+        super.init()
+    }
+
+    /// Identifies a filter: every branch, or what is reachable from `tips`.
+    @objc(keyForTips:viewAllBranches:)
+    class func key(forTips tips: Set<String>, viewAllBranches: Bool) -> String {
+        return viewAllBranches ? "*" : tips.sorted().joined(separator: " ")
+    }
+
+    // MARK: - Layouts
+
+    /// Whether a layout is stored for `key` on `list`.
+    @objc(hasLayoutForKey:list:)
+    func hasLayout(forKey key: String, list: PBCommitList) -> Bool {
+        lock.lock()
+        defer { lock.unlock() }
+        return self.list === list && layouts.contains { $0.key == key }
+    }
+
+    /// Puts back the layout stored for `key` on `list`, setting each
+    /// commit's lines, and returns its rows; nil if there is none.
+    /// Call on the main thread.
+    @objc(restoreLayoutForKey:list:)
+    func restoreLayout(forKey key: String, list: PBCommitList) -> [PBGitCommit]? {
+        lock.lock()
+        guard self.list === list, let index = layouts.firstIndex(where: { $0.key == key }) else {
+            lock.unlock()
+            return nil
+        }
+        let layout = layouts.remove(at: index)
+        layouts.append(layout)
+        lock.unlock()
+
+        let span = PBTracer.shared.beginSpan("graph layout restore", category: "history")
+        for (commit, lineInfo) in zip(layout.commits, layout.lineInfos) {
+            commit.lineInfo = lineInfo
+        }
+        span?.end(withArgs: ["rows": layout.commits.count])
+        return layout.commits
+    }
+
+    /// Remembers the rows and lines now showing for `key` on `list`.
+    @objc(storeLayoutForKey:list:commits:)
+    func storeLayout(forKey key: String, list: PBCommitList, commits: [PBGitCommit]) {
+        var kept: [PBGitCommit] = []
+        var lineInfos: [PBGraphCellInfo] = []
+        kept.reserveCapacity(commits.count)
+        lineInfos.reserveCapacity(commits.count)
+        for commit in commits {
+            if let lineInfo = commit.lineInfo {
+                kept.append(commit)
+                lineInfos.append(lineInfo)
+            }
+        }
+        let layout = Layout(key: key, commits: kept, lineInfos: lineInfos)
+
+        lock.lock()
+        use(list)
+        layouts.removeAll { $0.key == key }
+        layouts.append(layout)
+        if layouts.count > capacity {
+            layouts.removeFirst(layouts.count - capacity)
+        }
+        lock.unlock()
+        GitWorkspace.shared.setNeedsBudgetCheck()
+    }
+
+    // MARK: - Reachability
+
+    /// Rows of `list` reachable from `tips`. Builds the row table the first
+    /// time it is asked about a list, so call it off the main thread.
+    @objc(reachableRowsInList:fromTips:)
+    func reachableRows(in list: PBCommitList, fromTips tips: Set<String>) -> PBRowMask {
+        let key = PBGraphLayoutCache.key(forTips: tips, viewAllBranches: false)
+        lock.lock()
+        use(list)
+        if let index = masks.firstIndex(where: { $0.key == key }) {
+            let entry = masks.remove(at: index)
+            masks.append(entry)
+            lock.unlock()
+            return entry.mask
+        }
+        let table = self.table
+        lock.unlock()
+
+        let span = PBTracer.shared.beginSpan("reachability mask", category: "history")
+        let rowTable = table ?? RowTable(list: list)
+        let mask = rowTable.mask(fromTips: tips)
+        span?.end(withArgs: ["rows": list.count, "tips": tips.count, "reachable": mask.count, "built table": table == nil])
+
+        lock.lock()
+        if self.list === list {
+            self.table = self.table ?? rowTable
+            masks.append((key, mask))
+            if masks.count > PBGraphLayoutCache.maskCapacity {
+                masks.removeFirst()
+            }
+        }
+        lock.unlock()
+        GitWorkspace.shared.setNeedsBudgetCheck()
+        return mask
+    }
+
+    /// Forgets everything about any other snapshot. Called with `lock` held.
+    private func use(_ list: PBCommitList) {
+        if self.list !== list {
+            self.list = list
+            table = nil
+            layouts.removeAll()
+            masks.removeAll()
+        }
+    }
+
+    // MARK: - GitWorkspaceCache
+
+    var workspaceCacheCost: Int {
+        lock.lock()
+        defer { lock.unlock() }
+        return costHeld()
+    }
+
+    @objc(trimWorkspaceCacheToCost:)
+    func trimWorkspaceCache(toCost cost: Int) {
+        lock.lock()
+        defer { lock.unlock() }
+        while costHeld() > cost, !layouts.isEmpty {
+            layouts.removeFirst()
+        }
+        if costHeld() > cost {
+            table = nil
+            masks.removeAll()
+        }
+    }
+
+    /// Called with `lock` held.
+    private func costHeld() -> Int {
+        return layouts.reduce(0) { $0 + $1.cost } + (table?.cost ?? 0) + masks.reduce(0) { $0 + $1.mask.byteCount }
+    }
+}
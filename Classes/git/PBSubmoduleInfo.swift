@@ -0,0 +1,201 @@
+import Foundation
+
+@objc(PBSubmoduleStatus)
+enum PBSubmoduleStatus: Int {
+    case unknown
+    case clean
+    case modified
+    case notInitialized
+}
+
+@objc(PBSubmoduleInfo)
+@objcMembers
+final class PBSubmoduleInfo: NSObject {
+    var name: String?
+    var path: String?
+    var parentRepositoryURL: URL?
+    /// Commit recorded for the submodule in the superproject's index.
+    var sha: String?
+    /// Filled in by `loadStatus(for:completion:)`; discovery leaves it unknown.
+    var status: PBSubmoduleStatus = .unknown
+
+    var statusDescription: String? {
+        switch status {
+        case .unknown:
+            return nil
+        case .clean:
+            return "Up to date"
+        case .modified:
+            return "Modified or checked out at a different commit"
+        case .notInitialized:
+            return "Not initialized"
+        }
+    }
+
+    var worktreeURL: URL? {
+        guard let parentRepositoryURL, let path else {
+            return nil
+        }
+        return parentRepositoryURL.appendingPathComponent(path)
+    }
+
+    /// Lists the submodules of `repository` from `.gitmodules` and the gitlink
+    /// entries in the index. Unlike `git submodule status` this never touches
+    /// the submodule worktrees, so it stays cheap with hundreds of submodules.
+    @objc(submodulesInRepository:)
+    class func submodules(in repository: PBGitRepository) -> [PBSubmoduleInfo] {
+        guard !repository.isBareRepository(), let workingDirectory = repository.workingDirectory() else {
+            return []
+        }
+
+        let gitlinks = indexGitlinks(in: repository)
+        guard !gitlinks.isEmpty else {
+            return []
+        }
+
+        let names = configuredNamesByPath(in: workingDirectory)
+        let parentURL = URL(fileURLWithPath: workingDirectory)
+
+        return gitlinks.map { path, sha in
+            let info = PBSubmoduleInfo()
+            info.name = names[path] ?? (path as NSString).lastPathComponent
+            info.path = path
+            info.sha = sha
+            info.parentRepositoryURL = parentURL
+            return info
+        }
+    }
+
+    /// Computes `status` for each submodule concurrently, off the main thread.
+    /// `completion` runs on the main queue once every status has been set.
+    @objc(loadStatusForSubmodules:completion:)
+    class func loadStatus(for submodules: [PBSubmoduleInfo], completion: @escaping () -> Void) {
+        let pending = submodules.filter { $0.status == .unknown }
+        guard !pending.isEmpty else {
+            DispatchQueue.main.async(execute: completion)
+            return
+        }
+
+        DispatchQueue.global(qos: .utility).async {
+            var statuses = [PBSubmoduleStatus](repeating: .unknown, count: pending.count)
+            statuses.withUnsafeMutableBufferPointer { buffer in
+                DispatchQueue.concurrentPerform(iterations: pending.count) { index in
+                    buffer[index] = pending[index].computeStatus()
+                }
+            }
+
+            DispatchQueue.main.async {
+                for (info, status) in zip(pending, statuses) {
+                    info.status = status
+                }
+                completion()
+            }
+        }
+    }
+
+    // MARK: - Discovery
+
+    /// Path -> recorded SHA for every mode 160000 entry in the index, in index order.
+    private class func indexGitlinks(in repository: PBGitRepository) -> [(String, String)] {
+        let gitlinkPrefix = Data("160000 ".utf8)
+        var gitlinks: [(String, String)] = []
+
+        // Records are "<mode> <sha> <stage>\t<path>"; only decode the gitlinks.
+        do {
+            try repository.streamGitCommand(["ls-files", "--stage", "-z"],
+                                            recordSeparator: Data([0])) { record in
+                guard record.starts(with: gitlinkPrefix),
+                      let line = String(data: record, encoding: .utf8),
+                      let tab = line.firstIndex(of: "\t") else {
+                    return true
+                }
+                let fields = line[..<tab].split(separator: " ")
+                let path = String(line[line.index(after: tab)...])
+                // A conflicted gitlink appears once per stage; keep the first.
+                if fields.count >= 2 && gitlinks.last?.0 != path {
+                    gitlinks.append((path, String(fields[1])))
+                }
+                return true
+            }
+        } catch {
+            NSLog("Error listing submodules: %@", error.localizedDescription)
+            return []
+        }
+
+        return gitlinks
+    }
+
+    /// Path -> submodule name from `.gitmodules`, read without a worktree scan.
+    private class func configuredNamesByPath(in workingDirectory: String) -> [String: String] {
+        let gitmodulesPath = (workingDirectory as NSString).appendingPathComponent(".gitmodules")
+        guard FileManager.default.fileExists(atPath: gitmodulesPath),
+              let gitPath = PBGitBinary.path() else {
+            return [:]
+        }
+
+        var exitCode: Int32 = 0
+        guard let output = PBEasyPipe.outputForCommand(
+            gitPath,
+            withArgs: ["config", "--file", ".gitmodules", "-z", "--get-regexp", "^submodule\\..*\\.path$"],
+            inDir: workingDirectory,
+            retValue: &exitCode
+        ), exitCode == 0 else {
+            return [:]
+        }
+
+        // With -z each entry is "submodule.<name>.path\n<value>\0".
+        var names: [String: String] = [:]
+        for entry in output.split(separator: "\0") {
+            guard let newline = entry.firstIndex(of: "\n") else { continue }
+            let key = entry[..<newline]
+            let value = String(entry[entry.index(after: newline)...])
+            guard key.hasPrefix("submodule."), key.hasSuffix(".path"), !value.isEmpty else { continue }
+
+            let name = key.dropFirst("submodule.".count).dropLast(".path".count)
+            if !name.isEmpty {
+                names[value] = String(name)
+            }
+        }
+        return names
+    }
+
+    // MARK: - Status
+
+    private func computeStatus() -> PBSubmoduleStatus {
+        guard let worktreeURL else {
+            return .unknown
+        }
+
+        let dotGitPath = worktreeURL.appendingPathComponent(".git").path
+        guard FileManager.default.fileExists(atPath: dotGitPath) else {
+            return .notInitialized
+        }
+
+        guard let gitPath = PBGitBinary.path() else {
+            return .unknown
+        }
+
+        // One process per submodule: the branch header gives the checked out
+        // commit, any other line is a tracked change.
+        var exitCode: Int32 = 0
+        guard let output = PBEasyPipe.outputForCommand(
+            gitPath,
+            withArgs: ["status", "--porcelain=v2", "--branch", "--untracked-files=no", "--ignore-submodules=all"],
+            inDir: worktreeURL.path,
+            retValue: &exitCode
+        ), exitCode == 0 else {
+            return .unknown
+        }
+
+        for line in output.split(separator: "\n") {
+            if line.hasPrefix("# branch.oid ") {
+                if let sha, line.dropFirst("# branch.oid ".count) != sha {
+                    return .modified
+                }
+            } else if !line.hasPrefix("#") {
+                return .modified
+            }
+        }
+        return .clean
+    }
+}
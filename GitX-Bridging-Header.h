@@ -1,4 +1,5 @@
 #import "PBGitRepository.h"
 #import "PBGitRefish.h"
 #import "PBGitGraphLine.h"
+#import "PBGraphLaneLayout.h"
 #import "PBGitIndexController.h"
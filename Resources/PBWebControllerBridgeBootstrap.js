@@ -26,21 +26,7 @@
         }
       };
     };
-  gitx._dispatchNativeMessage = function (message) {
-    var payload = message;
-    if (typeof message === 'string') {
-      try {
-        payload = JSON.parse(message);
-      } catch (error) {
-        if (window.console && console.error) {
-          console.error('gitx._dispatchNativeMessage parse failure', error, message);
-        }
-        return;
-      }
-    }
-    if (!payload || typeof payload !== 'object') {
-      return;
-    }
+  var deliver = function (payload) {
     if (typeof gitx.onNativeMessage === 'function') {
       try {
         gitx.onNativeMessage(payload);
@@ -60,6 +46,78 @@
       }
     });
   };
+
+  // Large fields arrive as a "bulk" map of field name -> gitx:///payload URL
+  // and are fetched as raw text before the message is delivered. Messages
+  // behind one that is still fetching wait, so handlers see native's order.
+  var queue = [];
+  var fetching = false;
+  var drain = function () {
+    while (queue.length && !fetching) {
+      var payload = queue[0];
+      if (payload.bulk && typeof payload.bulk === 'object') {
+        fetching = true;
+        resolveBulkFields(payload, function () {
+          fetching = false;
+          drain();
+        });
+        return;
+      }
+      queue.shift();
+      deliver(payload);
+    }
+  };
+  var resolveBulkFields = function (payload, done) {
+    var bulk = payload.bulk;
+    delete payload.bulk;
+    var keys = Object.keys(bulk);
+    var remaining = keys.length;
+    if (!remaining) {
+      done();
+      return;
+    }
+    keys.forEach(function (key) {
+      fetch(bulk[key])
+        .then(function (response) {
+          if (!response.ok) {
+            throw new Error('HTTP ' + response.status);
+          }
+          return response.text();
+        })
+        .then(function (text) {
+          payload[key] = text;
+        }, function (error) {
+          // Delivered without the field; handlers already check for it
+          if (window.console && console.error) {
+            console.error('gitx bulk field fetch failed', key, error);
+          }
+        })
+        .then(function () {
+          if (--remaining === 0) {
+            done();
+          }
+        });
+    });
+  };
+
+  gitx._dispatchNativeMessage = function (message) {
+    var payload = message;
+    if (typeof message === 'string') {
+      try {
+        payload = JSON.parse(message);
+      } catch (error) {
+        if (window.console && console.error) {
+          console.error('gitx._dispatchNativeMessage parse failure', error, message);
+        }
+        return;
+      }
+    }
+    if (!payload || typeof payload !== 'object') {
+      return;
+    }
+    queue.push(payload);
+    drain();
+  };
   window.gitxReceiveNativeMessage = gitx._dispatchNativeMessage;
   if (window.gitxBridge && typeof window.gitxBridge.flush === 'function') {
     try {
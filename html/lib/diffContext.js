@@ -0,0 +1,186 @@
+// Re-windowing of unified diffs to a smaller context size, and cutting
+// them down for previews
+// Used by commit.js in browser and by tests in Node.js
+
+(function(exports) {
+    var hunkHeaderPattern = /^@@ -(\d+)(?:,(\d+))? \+(\d+)(?:,(\d+))? @@(.*)$/;
+    var hunkLinePattern = /^[-+ \\]/;
+
+    function formatRange(start, count) {
+        // git writes the line before an empty range, and omits a count of 1
+        if (count == 0)
+            return (start - 1) + ",0";
+        if (count == 1)
+            return start.toString();
+        return start + "," + count;
+    }
+
+    /**
+     * Trim the hunks of a unified diff to `contextLines` lines of context,
+     * splitting hunks whose changes end up further apart than twice that,
+     * exactly as git would have produced with -U<contextLines>.
+     *
+     * The diff must have been generated with at least `contextLines` lines of
+     * context. Lines outside hunks (file headers) are passed through. Hunks
+     * split off from a larger one lose git's function-name suffix.
+     *
+     * @param {string} diff - Unified diff text
+     * @param {number} contextLines - Desired context size
+     * @returns {string} The re-windowed diff
+     */
+    function rewindowDiff(diff, contextLines) {
+        var lines = diff.split("\n");
+        var output = [];
+        var i = 0;
+
+        while (i < lines.length) {
+            var m = lines[i].match(hunkHeaderPattern);
+            if (!m) {
+                output.push(lines[i]);
+                i++;
+                continue;
+            }
+
+            // Collect the hunk body; a "\ No newline" marker sticks to its line
+            var items = [];
+            for (i++; i < lines.length; i++) {
+                var line = lines[i];
+                var type = line.charAt(0);
+                if (type == "\\" && items.length) {
+                    items[items.length - 1].markers.push(line);
+                } else if (type == " " || type == "-" || type == "+") {
+                    items.push({ type: type, text: line, markers: [] });
+                } else {
+                    break;
+                }
+            }
+
+            // An empty range names the line before it, so the hunk starts one later
+            var oldStart = parseInt(m[1], 10) + (m[2] === "0" ? 1 : 0);
+            var newStart = parseInt(m[3], 10) + (m[4] === "0" ? 1 : 0);
+            appendWindowedHunk(output, items, oldStart, newStart, m[5], contextLines);
+        }
+
+        return output.join("\n");
+    }
+
+    function appendWindowedHunk(output, items, oldStart, newStart, suffix, contextLines) {
+        var keep = new Array(items.length);
+        var distance = Infinity;
+        var j;
+
+        // Keep context lines within contextLines of a change on either side
+        for (j = 0; j < items.length; j++) {
+            distance = items[j].type == " " ? distance + 1 : 0;
+            keep[j] = distance <= contextLines;
+        }
+        distance = Infinity;
+        for (j = items.length - 1; j >= 0; j--) {
+            distance = items[j].type == " " ? distance + 1 : 0;
+            keep[j] = keep[j] || distance <= contextLines;
+        }
+
+        var oldLine = oldStart;
+        var newLine = newStart;
+        var hunk = null;
+        var first = true;
+
+        // Lines go straight to output; the header slot is filled once the counts are known
+        var flush = function() {
+            if (!hunk)
+                return;
+            output[hunk.headerIndex] = "@@ -" + formatRange(hunk.oldStart, hunk.oldCount) +
+                " +" + formatRange(hunk.newStart, hunk.newCount) + " @@" +
+                (first ? suffix : "");
+            first = false;
+            hunk = null;
+        };
+
+        for (j = 0; j < items.length; j++) {
+            var item = items[j];
+            if (keep[j]) {
+                if (!hunk) {
+                    hunk = { oldStart: oldLine, newStart: newLine, oldCount: 0, newCount: 0, headerIndex: output.length };
+                    output.push("");
+                }
+                output.push(item.text);
+                for (var k = 0; k < item.markers.length; k++)
+                    output.push(item.markers[k]);
+                if (item.type != "+")
+                    hunk.oldCount++;
+                if (item.type != "-")
+                    hunk.newCount++;
+            } else {
+                flush();
+            }
+
+            if (item.type != "+")
+                oldLine++;
+            if (item.type != "-")
+                newLine++;
+        }
+        flush();
+    }
+
+    /**
+     * Cut a diff down to at most `limit` characters for a preview, keeping
+     * whole hunks. Only when the first hunk alone is over the limit is it
+     * cut, after the last whole line that fits.
+     *
+     * Meant for the diff as shown, after re-windowing, so how much of it
+     * survives doesn't depend on the context it was fetched with.
+     *
+     * @param {string} diff - Unified diff text
+     * @param {number} limit - Characters to keep at most
+     * @returns {{diff: string, truncated: boolean}}
+     */
+    function truncateDiff(diff, limit) {
+        if (diff.length <= limit)
+            return { diff: diff, truncated: false };
+
+        var lines = diff.split("\n");
+        var kept = [];
+        var length = 0;
+        var hunks = 0;
+        var i = 0;
+
+        while (i < lines.length) {
+            if (!hunkHeaderPattern.test(lines[i])) {
+                if (length + lines[i].length + 1 > limit)
+                    break;
+                kept.push(lines[i]);
+                length += lines[i].length + 1;
+                i++;
+                continue;
+            }
+
+            var end = i + 1;
+            var hunkLength = lines[i].length + 1;
+            while (end < lines.length && hunkLinePattern.test(lines[end])) {
+                hunkLength += lines[end].length + 1;
+                end++;
+            }
+
+            if (length + hunkLength <= limit) {
+                for (; i < end; i++)
+                    kept.push(lines[i]);
+                length += hunkLength;
+                hunks++;
+                continue;
+            }
+            if (hunks == 0) {
+                for (; i < end && length + lines[i].length + 1 <= limit; i++) {
+                    kept.push(lines[i]);
+                    length += lines[i].length + 1;
+                }
+            }
+            break;
+        }
+
+        return { diff: kept.join("\n") + "\n", truncated: true };
+    }
+
+    exports.rewindowDiff = rewindowDiff;
+    exports.truncateDiff = truncateDiff;
+
+})(typeof module !== 'undefined' && module.exports ? module.exports : (window.DiffContext = {}));
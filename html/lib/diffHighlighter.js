@@ -3,6 +3,13 @@ var gitxDiffLog = function() {
 		console.log.apply(console, arguments);
 };
 
+// Report a timing to the native tracer; gitxTracing is set when tracing is on
+var gitxTraceSpan = function(name, start, args) {
+	if (!window.gitxTracing || typeof gitxBridge === "undefined")
+		return;
+	gitxBridge.post("traceSpan", { name: name, category: "diff", duration: performance.now() - start, args: args || {} });
+};
+
 var toggleDiff = function(id)
 {
   var content = document.getElementById('content_' + id);
@@ -28,217 +35,66 @@ var toggleDiff = function(id)
   }
 }
 
+// Render a diff into element. `diff` is either unified diff text or a model
+// from DiffModel.parseDiff, so callers that already parsed it don't pay twice.
 var highlightDiff = function(diff, element, callbacks) {
 	if (!diff || diff == "")
 		return;
 
 	if (!callbacks)
 		callbacks = {};
-	var start = new Date().getTime();
+	var start = performance.now();
 	element.className = "diff"
-	var content = diff;  // Don't escape here - escape when building HTML
-
-	var file_index = 0;
 
-	var startname = "";
-	var endname = "";
-	var diffLines = [];  // Array of line objects for side-by-side processing
+	var model = typeof diff === "string" ? DiffModel.parseDiff(diff) : diff;
 	var finalContent = "";
-	var lines = content.split('\n');
-	var binary = false;
-	var mode_change = false;
-	var old_mode = "";
-	var new_mode = "";
 	var linkToTop = "<div class=\"top-link\"><a href=\"#\">Top</a></div>";
 
-	var hunk_start_line_1 = -1;
-	var hunk_start_line_2 = -1;
-
-	var header = false;
-
-	var finishContent = function()
-	{
-		if (!file_index)
-		{
-			file_index++;
-			return;
-		}
+	for (var f = 0; f < model.files.length; f++) {
+		var file = model.files[f];
+		var startname = file.oldName;
+		var endname = file.newName;
 
 		if (callbacks["newfile"])
-			callbacks["newfile"](startname, endname, "file_index_" + (file_index - 1), mode_change, old_mode, new_mode);
+			callbacks["newfile"](startname, endname, "file_index_" + f, file.modeChange, file.oldMode, file.newMode);
 
-		var title = startname;
-		var binaryname = endname;
-		if (endname == "/dev/null") {
-			binaryname = startname;
-			title = startname;
-		}
-		else if (startname == "/dev/null")
-			title = endname;
-		else if (startname != endname)
-			title = startname + " renamed to " + endname;
-
-		if (binary && endname == "/dev/null") {
-			diffLines = [];
-			file_index++;
-			startname = "";
-			endname = "";
-			return;
-		}
+		var binaryname = endname == "/dev/null" ? startname : endname;
+		if (file.binary && endname == "/dev/null")
+			continue;
 
-		if (diffLines.length > 0 || binary) {
-			var escapedTitle = title.replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;').replace(/"/g, '&quot;').replace(/'/g, "\\'");
-			finalContent += '<div class="file" id="file_index_' + (file_index - 1) + '">' +
-				'<div id="title_' + escapedTitle + '" class="expanded fileHeader"><a href="javascript:toggleDiff(\'' + escapedTitle + '\');">' + escapedTitle + '</a></div>';
-		}
+		var hasLines = file.hunkEnd > file.hunkStart;
+		if (!hasLines && !file.binary)
+			continue;
 
-		if (!binary && diffLines.length > 0)  {
+		var escapedTitle = file.title.replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;').replace(/"/g, '&quot;').replace(/'/g, "\\'");
+		finalContent += '<div class="file" id="file_index_' + f + '">' +
+			'<div id="title_' + escapedTitle + '" class="expanded fileHeader"><a href="javascript:toggleDiff(\'' + escapedTitle + '\');">' + escapedTitle + '</a></div>';
+
+		if (!file.binary) {
 			finalContent += '<div id="content_' + escapedTitle + '" class="diffContent">' +
-				'<div class="lines">' + buildSideBySideHtml(diffLines).replace(/\t/g, "    ") + "</div>" +
+				'<div class="lines">' + buildSideBySideHtml(model, file.headerEnd, file.end).replace(/\t/g, "    ") + "</div>" +
 				'</div>';
-		}
-		else {
-			if (binary) {
-				if (callbacks["binaryFile"])
-					finalContent += callbacks["binaryFile"](binaryname);
-				else
-					finalContent += '<div id="content_' + escapedTitle + '">Binary file differs</div>';
-			}
-		}
-
-		if (diffLines.length > 0 || binary)
-			finalContent += '</div>' + linkToTop;
-
-		diffLines = [];
-		file_index++;
-		startname = "";
-		endname = "";
-	}
-
-	for (var lineno = 0, lindex = 0; lineno < lines.length; lineno++) {
-		var l = lines[lineno];
-
-		var firstChar = l.charAt(0);
-
-		if (firstChar == "d" && l.charAt(1) == "i") {
-			header = true;
-			finishContent();
-			binary = false;
-			mode_change = false;
-
-			if(match = l.match(/^diff --git (a\/)+(.*) (b\/)+(.*)$/)) {
-				startname = match[2];
-				endname = match[4];
-			}
-			continue;
-		}
-
-		if (header) {
-			if (firstChar == "n") {
-				if (l.match(/^new file mode .*$/))
-					startname = "/dev/null";
-				if (match = l.match(/^new mode (.*)$/)) {
-					mode_change = true;
-					new_mode = match[1];
-				}
-				continue;
-			}
-			if (firstChar == "o") {
-				if (match = l.match(/^old mode (.*)$/)) {
-					mode_change = true;
-					old_mode = match[1];
-				}
-				continue;
-			}
-			if (firstChar == "d") {
-				if (l.match(/^deleted file mode .*$/))
-					endname = "/dev/null";
-				continue;
-			}
-			if (firstChar == "-") {
-				if (match = l.match(/^--- (a\/)?(.*)$/))
-					startname = match[2];
-				continue;
-			}
-			if (firstChar == "+") {
-				if (match = l.match(/^\+\+\+ (b\/)?(.*)$/))
-					endname = match[2];
-				continue;
-			}
-			if (firstChar == 'r') {
-				if (match = l.match(/^rename (from|to) (.*)$/)) {
-					if (match[1] == "from")
-						startname = match[2];
-					else
-						endname = match[2];
-				}
-				continue;
-			}
-			if (firstChar == "B") {
-				binary = true;
-				if (match = l.match(/^Binary files (a\/)?(.*) and (b\/)?(.*) differ$/)) {
-					startname = match[2];
-					endname = match[4];
-				}
-			}
-			if (firstChar == "@")
-				header = false;
-			else
-				continue;
+		} else if (callbacks["binaryFile"]) {
+			finalContent += callbacks["binaryFile"](binaryname);
+		} else {
+			finalContent += '<div id="content_' + escapedTitle + '">Binary file differs</div>';
 		}
 
-		// Collect line data for side-by-side processing
-		if (firstChar == "+") {
-			diffLines.push({
-				type: 'add',
-				index: lindex,
-				content: l,
-				lineNum: ++hunk_start_line_2
-			});
-		} else if (firstChar == "-") {
-			diffLines.push({
-				type: 'del',
-				index: lindex,
-				content: l,
-				lineNum: ++hunk_start_line_1
-			});
-		} else if (firstChar == "@") {
-			if (header) {
-				header = false;
-			}
-			if (m = l.match(/@@ \-([0-9]+),?\d* \+(\d+),?\d* @@/)) {
-				hunk_start_line_1 = parseInt(m[1]) - 1;
-				hunk_start_line_2 = parseInt(m[2]) - 1;
-			}
-			diffLines.push({
-				type: 'hunk',
-				index: lindex,
-				content: l
-			});
-		} else if (firstChar == " ") {
-			diffLines.push({
-				type: 'context',
-				index: lindex,
-				content: l,
-				oldLineNum: ++hunk_start_line_1,
-				newLineNum: ++hunk_start_line_2
-			});
-		}
-		lindex++;
+		finalContent += '</div>' + linkToTop;
 	}
 
-	finishContent();
-
 	element.innerHTML = finalContent;
+	scheduleWordDiff(element, model);
 
-	if (false)
-		gitxDiffLog("Total time:" + (new Date().getTime() - start));
+	gitxTraceSpan("diff render", start, { files: model.files.length, lines: model.lineCount });
 }
 
-// Build side-by-side HTML from collected diff lines
-var buildSideBySideHtml = function(diffLines) {
+// Build side-by-side HTML for lines [from, to) of a parsed diff. Each row's
+// index attribute is the model line number, which commit.js uses to map a
+// selection back onto the hunk.
+var buildSideBySideHtml = function(model, from, to) {
 	var html = '';
-	var i = 0;
+	var kind = model.kind;
 
 	// Helper to escape content for HTML display
 	var escapeContent = function(text) {
@@ -246,85 +102,62 @@ var buildSideBySideHtml = function(diffLines) {
 		return text.replace(/&/g, '&amp;').replace(/</g, '&lt;').replace(/>/g, '&gt;').replace(/"/g, '&quot;');
 	};
 
-	while (i < diffLines.length) {
-		var line = diffLines[i];
+	// Line text without its +/-/space prefix
+	var bodyText = function(i) {
+		return model.text.substring(model.lineStart[i] + 1, model.lineEnd[i]);
+	};
+
+	var i = from;
+	while (i < to) {
+		var k = kind[i];
 
-		if (line.type === 'hunk') {
+		if (k === DiffModel.HUNK) {
 			// Hunk header spans both sides
-			html += '<div index="' + line.index + '" class="hunkheader">' + escapeContent(line.content) + '</div>';
+			html += '<div index="' + i + '" class="hunkheader">' + escapeContent(DiffModel.lineText(model, i)) + '</div>';
 			i++;
-		} else if (line.type === 'context') {
-			// Context lines appear on both sides - escape content, strip leading space
-			var escapedContent = escapeContent(line.content.substring(1));
-			html += buildRow(line.index, 'noopline', line.oldLineNum, escapedContent, line.newLineNum, escapedContent);
+		} else if (k === DiffModel.CONTEXT) {
+			// Context lines appear on both sides
+			var escapedContent = escapeContent(bodyText(i));
+			html += buildRow(i, 'noopline', model.oldLine[i], escapedContent, model.newLine[i], escapedContent);
 			i++;
-		} else if (line.type === 'del' || line.type === 'add') {
-			// Collect consecutive del/add blocks for pairing
+		} else if (k === DiffModel.DEL || k === DiffModel.ADD) {
+			// A run of deletions followed by additions; the model has paired them up
 			var delLines = [];
 			var addLines = [];
-
-			// First collect all deletions
-			while (i < diffLines.length && diffLines[i].type === 'del') {
-				delLines.push(diffLines[i]);
-				i++;
-			}
-			// Then collect all additions
-			while (i < diffLines.length && diffLines[i].type === 'add') {
-				addLines.push(diffLines[i]);
-				i++;
-			}
-
-			// Apply inline diff highlighting if we have both deletions and additions
-			if (delLines.length > 0 && addLines.length > 0) {
-				var highlighted = highlightChangePair(delLines, addLines);
-				delLines = highlighted.del;
-				addLines = highlighted.add;
-			} else if (delLines.length > 0) {
-				// Only deletions - apply simple highlighting (strip leading -)
-				for (var d = 0; d < delLines.length; d++) {
-					var text = delLines[d].content.substring(1);
-					delLines[d].highlighted = '<del>' + inlinediff.escape(text) + '</del>';
-				}
-			} else if (addLines.length > 0) {
-				// Only additions - apply simple highlighting (strip leading +)
-				for (var a = 0; a < addLines.length; a++) {
-					var text = addLines[a].content.substring(1);
-					addLines[a].highlighted = '<ins>' + highlightTrailingWhitespace(inlinediff.escape(text)) + '</ins>';
-				}
+			for (; i < to; i++) {
+				k = kind[i];
+				if (k === DiffModel.DEL && !addLines.length)
+					delLines.push(i);
+				else if (k === DiffModel.ADD)
+					addLines.push(i);
+				else if (k !== DiffModel.NO_NEWLINE)
+					break;
 			}
 
-			// Helper to get display content - use highlighted if set (even if empty), else strip prefix from content
-			var getDisplayContent = function(line) {
-				if (line.highlighted !== undefined) return line.highlighted;
-				return escapeContent(line.content.substring(1));
-			};
-
-			// Build paired rows
+			// Paired rows show plain text until scheduleWordDiff marks the changed
+			// words; unpaired ones are highlighted whole
 			var maxRows = Math.max(delLines.length, addLines.length);
 			for (var r = 0; r < maxRows; r++) {
-				var delLine = delLines[r];
-				var addLine = addLines[r];
+				var delLine = r < delLines.length ? delLines[r] : -1;
+				var addLine = delLine >= 0 ? model.pair[delLine] : addLines[r];
 
-				// Determine the index - use the line that exists, prefer del
-				var rowIndex = delLine ? delLine.index : addLine.index;
-
-				if (delLine && addLine) {
+				if (delLine >= 0 && addLine >= 0) {
 					// Both sides have content - include add index for staging
-					html += buildRow(rowIndex, 'changeline',
-						delLine.lineNum, getDisplayContent(delLine),
-						addLine.lineNum, getDisplayContent(addLine),
-						'delline', 'addline', addLine.index);
-				} else if (delLine) {
+					html += buildRow(delLine, 'changeline',
+						model.oldLine[delLine], inlinediff.escape(bodyText(delLine)),
+						model.newLine[addLine], highlightTrailingWhitespace(inlinediff.escape(bodyText(addLine))),
+						'delline', 'addline', addLine);
+				} else if (delLine >= 0) {
 					// Only deletion
-					html += buildRow(delLine.index, 'delline',
-						delLine.lineNum, getDisplayContent(delLine),
+					html += buildRow(delLine, 'delline',
+						model.oldLine[delLine], '<del>' + inlinediff.escape(bodyText(delLine)) + '</del>',
 						'', '',
 						'delline', 'empty');
-				} else if (addLine) {
+				} else {
 					// Only addition
-					html += buildRow(addLine.index, 'addline',
+					html += buildRow(addLine, 'addline',
 						'', '',
-						addLine.lineNum, getDisplayContent(addLine),
+						model.newLine[addLine], '<ins>' + highlightTrailingWhitespace(inlinediff.escape(bodyText(addLine))) + '</ins>',
 						'empty', 'addline');
 				}
 			}
@@ -336,24 +169,187 @@ var buildSideBySideHtml = function(diffLines) {
 	return html;
 };
 
-// Apply inline diff highlighting to paired del/add blocks
-var highlightChangePair = function(delLines, addLines) {
-	var oldText = delLines.map(function(l) { return l.content.substring(1); }).join("\n");
-	var newText = addLines.map(function(l) { return l.content.substring(1); }).join("\n");
+// Word-level highlighting of paired del/add rows. The diff is rendered with
+// whole-line colouring first; pairs are then diffed in a worker as their rows
+// come near the viewport, and the results are kept per blob pair and line
+// numbers so re-rendering the same file (context changes, restaging) is free.
+var wordDiffState = {
+	worker: undefined,
+	requests: {},
+	nextRequest: 1,
+	cache: new Map(),
+	cacheLimit: 5000,
+	batchSize: 200
+};
+
+var scheduleWordDiff = function(element, model) {
+	if (element.wordDiffObserver)
+		element.wordDiffObserver.disconnect();
+	element.wordDiffObserver = null;
+
+	var rows = element.querySelectorAll(".diff-row.changeline");
+	if (!rows.length)
+		return;
+
+	var pending = [];
+	var flushScheduled = false;
+	var enqueue = function(row) {
+		pending.push(row);
+		if (flushScheduled)
+			return;
+		flushScheduled = true;
+		setTimeout(function() {
+			flushScheduled = false;
+			requestWordDiff(model, pending.splice(0, pending.length));
+		}, 0);
+	};
+
+	if (typeof IntersectionObserver === "undefined") {
+		for (var i = 0; i < rows.length; i++)
+			enqueue(rows[i]);
+		return;
+	}
+
+	// Rows in collapsed files never intersect, so they are never diffed
+	var observer = new IntersectionObserver(function(entries) {
+		for (var e = 0; e < entries.length; e++) {
+			if (!entries[e].isIntersecting)
+				continue;
+			observer.unobserve(entries[e].target);
+			enqueue(entries[e].target);
+		}
+	}, { rootMargin: "400px 0px" });
+	for (var j = 0; j < rows.length; j++)
+		observer.observe(rows[j]);
+	element.wordDiffObserver = observer;
+};
+
+// Blob pair and line numbers identify a pair across renders; diffs against
+// the work tree have no blob for the new side and aren't cached
+var wordDiffCacheKey = function(model, delLine, addLine) {
+	var hunk = DiffModel.hunkAtLine(model, delLine);
+	if (hunk < 0)
+		return null;
+	var file = model.files[model.hunks[hunk].file];
+	if (!file.oldBlob || !file.newBlob || /^0+$/.test(file.oldBlob) || /^0+$/.test(file.newBlob))
+		return null;
+	return file.oldBlob + ".." + file.newBlob + ":" + model.oldLine[delLine] + ":" + model.newLine[addLine];
+};
+
+var requestWordDiff = function(model, rows) {
+	var cache = wordDiffState.cache;
+	var targets = [];
+	var pairs = [];
 
-	var diffResult = inlinediff.diffString3(oldText, newText);
-	var oldHighlighted = diffResult[1].split(/\n/);
-	var newHighlighted = diffResult[2].split(/\n/);
+	for (var i = 0; i < rows.length; i++) {
+		var row = rows[i];
+		if (!row.isConnected)
+			continue;
+		var delLine = parseInt(row.getAttribute("index"), 10);
+		var addLine = parseInt(row.getAttribute("data-add-index"), 10);
+		var key = wordDiffCacheKey(model, delLine, addLine);
+		if (key && cache.has(key)) {
+			var cached = cache.get(key);
+			cache.delete(key);
+			cache.set(key, cached);
+			applyWordDiff(row, model, delLine, addLine, cached);
+			continue;
+		}
+		targets.push({ row: row, delLine: delLine, addLine: addLine, key: key });
+		pairs.push(DiffModel.lineText(model, delLine).substring(1), DiffModel.lineText(model, addLine).substring(1));
+	}
+
+	for (var start = 0; start < targets.length; start += wordDiffState.batchSize) {
+		var id = wordDiffState.nextRequest++;
+		var end = start + wordDiffState.batchSize;
+		var payload = { id: id, pairs: pairs.slice(2 * start, 2 * end) };
+		wordDiffState.requests[id] = { model: model, targets: targets.slice(start, end), payload: payload };
+		postWordDiffRequest(payload);
+	}
+};
 
-	// Strip leading +/- since colors indicate add/del
-	for (var d = 0; d < delLines.length; d++) {
-		delLines[d].highlighted = mergeInsDel(oldHighlighted[d] || '');
+var postWordDiffRequest = function(request) {
+	if (wordDiffState.worker === undefined) {
+		wordDiffState.worker = WordDiff.createWorker();
+		if (wordDiffState.worker) {
+			wordDiffState.worker.onmessage = function(event) {
+				finishWordDiffRequest(event.data);
+			};
+			wordDiffState.worker.onerror = function() {
+				// Finish whatever was in flight on this thread and stop using the worker
+				gitxDiffLog("Word diff worker failed; diffing on the main thread");
+				wordDiffState.worker = null;
+				for (var id in wordDiffState.requests)
+					runWordDiffInSlices(wordDiffState.requests[id].payload);
+			};
+		}
 	}
-	for (var a = 0; a < addLines.length; a++) {
-		addLines[a].highlighted = mergeInsDel(highlightTrailingWhitespace(newHighlighted[a] || ''));
+
+	if (wordDiffState.worker) {
+		wordDiffState.worker.postMessage(request);
+	} else {
+		runWordDiffInSlices(request);
 	}
+};
+
+// Without a worker, diff a few pairs per timer tick to keep scrolling smooth
+var runWordDiffInSlices = function(request) {
+	var results = [];
+	var next = 0;
+	var slice = function() {
+		if (!wordDiffState.requests[request.id])
+			return;
+		var deadline = Date.now() + 8;
+		while (next + 1 < request.pairs.length && Date.now() < deadline) {
+			results.push(WordDiff.diffLines(request.pairs[next], request.pairs[next + 1]));
+			next += 2;
+		}
+		if (next + 1 < request.pairs.length)
+			setTimeout(slice, 0);
+		else
+			finishWordDiffRequest({ id: request.id, results: results });
+	};
+	setTimeout(slice, 0);
+};
+
+var finishWordDiffRequest = function(response) {
+	var request = wordDiffState.requests[response.id];
+	if (!request)
+		return;
+	delete wordDiffState.requests[response.id];
+
+	var cache = wordDiffState.cache;
+	for (var i = 0; i < request.targets.length; i++) {
+		var target = request.targets[i];
+		var result = response.results[i];
+		if (target.key) {
+			cache.set(target.key, result);
+			if (cache.size > wordDiffState.cacheLimit)
+				cache.delete(cache.keys().next().value);
+		}
+		if (target.row.isConnected)
+			applyWordDiff(target.row, request.model, target.delLine, target.addLine, result);
+	}
+};
+
+var applyWordDiff = function(row, model, delLine, addLine, result) {
+	if (!result)
+		return;
+
+	var setCell = function(cell, html) {
+		if (!cell)
+			return;
+		// Keep the stage/unstage button commit.js puts in the selected row
+		var actions = Array.prototype.slice.call(cell.querySelectorAll(".selection-action"));
+		cell.innerHTML = html.replace(/\t/g, "    ");
+		for (var a = 0; a < actions.length; a++)
+			cell.appendChild(actions[a]);
+	};
 
-	return { del: delLines, add: addLines };
+	setCell(row.querySelector(".old-content"),
+		WordDiff.renderLine(DiffModel.lineText(model, delLine).substring(1), result.del, "del"));
+	setCell(row.querySelector(".new-content"),
+		highlightTrailingWhitespace(WordDiff.renderLine(DiffModel.lineText(model, addLine).substring(1), result.add, "ins")));
 };
 
 // Build a single row of the side-by-side diff
@@ -0,0 +1,303 @@
+// Structured form of a unified diff, parsed once and shared by the renderers
+// Used by diffHighlighter.js, commit.js and history.js in browser and by tests in Node.js
+
+(function(exports) {
+    // Per-line kinds stored in model.kind
+    var HEADER = 0;      // "diff --git", "index", "---", "+++", ... and anything before the first file
+    var HUNK = 1;        // "@@ -a,b +c,d @@"
+    var CONTEXT = 2;
+    var DEL = 3;
+    var ADD = 4;
+    var NO_NEWLINE = 5;  // "\ No newline at end of file"
+    var OTHER = 6;       // Anything else in a file body, such as the empty line after the last hunk
+
+    var hunkHeaderPattern = /^@@ -(\d+)(?:,(\d+))? \+(\d+)(?:,(\d+))? @@/;
+
+    /**
+     * Parse unified diff text into a model the views can render and cut
+     * patches from without looking at the text again.
+     *
+     * Line data is kept in parallel typed arrays indexed by line number:
+     *   kind      - one of the kinds above
+     *   oldLine   - line number in the old file (context and deleted lines), else 0
+     *   newLine   - line number in the new file (context and added lines), else 0
+     *   pair      - for a deleted line, the added line shown next to it in the
+     *               side-by-side view, and the other way around; -1 if unpaired
+     *   lineStart, lineEnd - offsets of the line in `text`, without the newline
+     *
+     * `hunks` and `files` are small arrays of plain objects that refer to
+     * lines by number.
+     *
+     * @param {string} text - Unified diff, as printed by git diff or git show
+     * @returns {Object} The model
+     */
+    function parseDiff(text) {
+        text = text || "";
+
+        var lineCount = 1;
+        for (var p = text.indexOf("\n"); p !== -1; p = text.indexOf("\n", p + 1))
+            lineCount++;
+
+        var model = {
+            text: text,
+            lineCount: lineCount,
+            lineStart: new Uint32Array(lineCount),
+            lineEnd: new Uint32Array(lineCount),
+            kind: new Uint8Array(lineCount),
+            oldLine: new Int32Array(lineCount),
+            newLine: new Int32Array(lineCount),
+            pair: new Int32Array(lineCount),
+            hunks: [],
+            files: []
+        };
+
+        var start = 0;
+        for (var i = 0; i < lineCount; i++) {
+            var end = text.indexOf("\n", start);
+            if (end === -1)
+                end = text.length;
+            model.lineStart[i] = start;
+            model.lineEnd[i] = end;
+            model.pair[i] = -1;
+            start = end + 1;
+        }
+
+        var file = null;
+        var hunk = null;
+        var inHeader = false;
+        var oldNumber = 0;
+        var newNumber = 0;
+        var dels = [];
+        var adds = [];
+        var match;
+
+        var pairRun = function() {
+            for (var r = 0; r < dels.length && r < adds.length; r++) {
+                model.pair[dels[r]] = adds[r];
+                model.pair[adds[r]] = dels[r];
+            }
+            dels = [];
+            adds = [];
+        };
+
+        var closeHunk = function(line) {
+            pairRun();
+            if (hunk) {
+                hunk.end = line;
+                hunk = null;
+            }
+        };
+
+        var closeFile = function(line) {
+            closeHunk(line);
+            if (file) {
+                if (file.headerEnd < 0)
+                    file.headerEnd = line;
+                file.end = line;
+                file.hunkEnd = model.hunks.length;
+                file.title = fileTitle(file.oldName, file.newName);
+                model.files.push(file);
+                file = null;
+            }
+        };
+
+        for (i = 0; i < lineCount; i++) {
+            var l = text.substring(model.lineStart[i], model.lineEnd[i]);
+            var c = l.charAt(0);
+
+            if (c === "d" && l.charAt(1) === "i") {
+                closeFile(i);
+                file = {
+                    oldName: "", newName: "", title: "",
+                    binary: false, modeChange: false, oldMode: "", newMode: "",
+                    oldBlob: "", newBlob: "",
+                    start: i, headerEnd: -1, end: i,
+                    hunkStart: model.hunks.length, hunkEnd: model.hunks.length
+                };
+                if ((match = l.match(/^diff --git (a\/)+(.*) (b\/)+(.*)$/))) {
+                    file.oldName = match[2];
+                    file.newName = match[4];
+                }
+                inHeader = true;
+                model.kind[i] = HEADER;
+                continue;
+            }
+
+            if (!file) {
+                model.kind[i] = HEADER;
+                continue;
+            }
+
+            if (inHeader) {
+                if (c !== "@") {
+                    parseHeaderLine(file, l, c);
+                    model.kind[i] = HEADER;
+                    continue;
+                }
+                inHeader = false;
+                file.headerEnd = i;
+            }
+
+            if (c === "@") {
+                closeHunk(i);
+                hunk = { line: i, end: lineCount, file: model.files.length,
+                         oldStart: 0, oldCount: 0, newStart: 0, newCount: 0 };
+                if ((match = l.match(hunkHeaderPattern))) {
+                    hunk.oldStart = parseInt(match[1], 10);
+                    hunk.oldCount = match[2] === undefined ? 1 : parseInt(match[2], 10);
+                    hunk.newStart = parseInt(match[3], 10);
+                    hunk.newCount = match[4] === undefined ? 1 : parseInt(match[4], 10);
+                }
+                oldNumber = hunk.oldStart - 1;
+                newNumber = hunk.newStart - 1;
+                model.hunks.push(hunk);
+                model.kind[i] = HUNK;
+            } else if (hunk && c === "-") {
+                if (adds.length)
+                    pairRun();
+                dels.push(i);
+                model.kind[i] = DEL;
+                model.oldLine[i] = ++oldNumber;
+            } else if (hunk && c === "+") {
+                adds.push(i);
+                model.kind[i] = ADD;
+                model.newLine[i] = ++newNumber;
+            } else if (hunk && c === " ") {
+                pairRun();
+                model.kind[i] = CONTEXT;
+                model.oldLine[i] = ++oldNumber;
+                model.newLine[i] = ++newNumber;
+            } else if (hunk && c === "\\") {
+                // Belongs to the line before it and doesn't break a run of changes
+                model.kind[i] = NO_NEWLINE;
+            } else {
+                closeHunk(i);
+                model.kind[i] = OTHER;
+            }
+        }
+        closeFile(lineCount);
+
+        return model;
+    }
+
+    function parseHeaderLine(file, l, c) {
+        var match;
+        if (c === "n") {
+            if (/^new file mode /.test(l))
+                file.oldName = "/dev/null";
+            if ((match = l.match(/^new mode (.*)$/))) {
+                file.modeChange = true;
+                file.newMode = match[1];
+            }
+        } else if (c === "o") {
+            if ((match = l.match(/^old mode (.*)$/))) {
+                file.modeChange = true;
+                file.oldMode = match[1];
+            }
+        } else if (c === "d") {
+            if (/^deleted file mode /.test(l))
+                file.newName = "/dev/null";
+        } else if (c === "-") {
+            if ((match = l.match(/^--- (a\/)?(.*)$/)))
+                file.oldName = match[2];
+        } else if (c === "+") {
+            if ((match = l.match(/^\+\+\+ (b\/)?(.*)$/)))
+                file.newName = match[2];
+        } else if (c === "r") {
+            if ((match = l.match(/^rename (from|to) (.*)$/))) {
+                if (match[1] === "from")
+                    file.oldName = match[2];
+                else
+                    file.newName = match[2];
+            }
+        } else if (c === "i") {
+            if ((match = l.match(/^index ([0-9a-f]+)\.\.([0-9a-f]+)/))) {
+                file.oldBlob = match[1];
+                file.newBlob = match[2];
+            }
+        } else if (c === "B") {
+            file.binary = true;
+            if ((match = l.match(/^Binary files (a\/)?(.*) and (b\/)?(.*) differ$/))) {
+                file.oldName = match[2];
+                file.newName = match[4];
+            }
+        }
+    }
+
+    function fileTitle(oldName, newName) {
+        if (newName === "/dev/null")
+            return oldName;
+        if (oldName === "/dev/null")
+            return newName;
+        if (oldName !== newName)
+            return oldName + " renamed to " + newName;
+        return oldName;
+    }
+
+    /** Text of line `i`, without its newline. */
+    function lineText(model, i) {
+        return model.text.substring(model.lineStart[i], model.lineEnd[i]);
+    }
+
+    /** Text of lines [from, to), joined by newlines, without a trailing one. */
+    function linesText(model, from, to) {
+        if (to <= from)
+            return "";
+        return model.text.substring(model.lineStart[from], model.lineEnd[to - 1]);
+    }
+
+    /** The "diff --git" ... "+++" lines of file `f`. */
+    function fileHeaderText(model, f) {
+        var file = model.files[f];
+        return linesText(model, file.start, file.headerEnd);
+    }
+
+    /** Body lines of hunk `h` (without the @@ line) as an array of strings. */
+    function hunkLines(model, h) {
+        var hunk = model.hunks[h];
+        var lines = [];
+        for (var i = hunk.line + 1; i < hunk.end; i++)
+            lines.push(lineText(model, i));
+        return lines;
+    }
+
+    /** Hunk `h` with its file header, ready for git apply. */
+    function hunkPatch(model, h) {
+        var hunk = model.hunks[h];
+        return fileHeaderText(model, hunk.file) + "\n" + linesText(model, hunk.line, hunk.end) + "\n";
+    }
+
+    /** Index of the hunk containing line `line`, or -1. */
+    function hunkAtLine(model, line) {
+        var low = 0;
+        var high = model.hunks.length - 1;
+        while (low <= high) {
+            var mid = (low + high) >> 1;
+            var hunk = model.hunks[mid];
+            if (line < hunk.line)
+                high = mid - 1;
+            else if (line >= hunk.end)
+                low = mid + 1;
+            else
+                return mid;
+        }
+        return -1;
+    }
+
+    exports.HEADER = HEADER;
+    exports.HUNK = HUNK;
+    exports.CONTEXT = CONTEXT;
+    exports.DEL = DEL;
+    exports.ADD = ADD;
+    exports.NO_NEWLINE = NO_NEWLINE;
+    exports.OTHER = OTHER;
+
+    exports.parseDiff = parseDiff;
+    exports.lineText = lineText;
+    exports.linesText = linesText;
+    exports.fileHeaderText = fileHeaderText;
+    exports.hunkLines = hunkLines;
+    exports.hunkPatch = hunkPatch;
+    exports.hunkAtLine = hunkAtLine;
+
+})(typeof module !== 'undefined' && module.exports ? module.exports : (window.DiffModel = {}));
@@ -107,6 +107,56 @@
         };
     }
 
+    /**
+     * Partial patches for lines selected across several hunks, applied
+     * together by one git apply. Without context lines git places a patch
+     * by its line numbers, counted in the file as the patches before it
+     * left it. So the patches come bottom-most first, where nothing applied
+     * earlier has moved their lines, and the start of the side a patch
+     * produces is worked out from the side it applies to, rather than
+     * taken from a hunk that also counts the changes left unselected.
+     *
+     * @param {Object[]} hunks - In diff order, each { header, oldStart, newStart, lines, baseIndex },
+     *     header being the file's "diff --git" ... "+++" lines
+     * @param {Object} selectedIndices - As for generatePatchContent
+     * @param {Object} delToAddPair - As for generatePatchContent
+     * @param {boolean} reverse - True for unstaging, false for staging
+     * @returns {string[]} Patches, leaving out hunks with no selected changes
+     */
+    function generateSelectionPatches(hunks, selectedIndices, delToAddPair, reverse) {
+        var patches = [];
+        for (var h = hunks.length - 1; h >= 0; h--) {
+            var hunk = hunks[h];
+            var changed = false;
+            for (var i = 0; i < hunk.lines.length && !changed; i++) {
+                var firstChar = hunk.lines[i].charAt(0);
+                changed = selectedIndices[hunk.baseIndex + i] && (firstChar == '-' || firstChar == '+');
+            }
+            if (!changed)
+                continue;
+
+            var result = generatePatchContent({
+                lines: hunk.lines,
+                selectedIndices: selectedIndices,
+                delToAddPair: delToAddPair,
+                reverse: reverse,
+                baseIndex: hunk.baseIndex
+            });
+            // A side without lines starts at the line before the change
+            var oldStart = hunk.oldStart;
+            var newStart = hunk.newStart;
+            if (!reverse)
+                newStart = oldStart + (result.oldCount == 0 ? 1 : 0) - (result.newCount == 0 ? 1 : 0);
+            else
+                oldStart = newStart + (result.newCount == 0 ? 1 : 0) - (result.oldCount == 0 ? 1 : 0);
+
+            patches.push(hunk.header + '\n' + "@@ -" + oldStart + "," + result.oldCount +
+                " +" + newStart + "," + result.newCount + " @@\n" + result.content);
+        }
+        return patches;
+    }
+
     exports.generatePatchContent = generatePatchContent;
+    exports.generateSelectionPatches = generateSelectionPatches;
 
 })(typeof module !== 'undefined' && module.exports ? module.exports : (window.PatchGenerator = {}));
@@ -0,0 +1,290 @@
+// Word-level diff of a deleted line against the added line paired with it
+// Used by diffHighlighter.js in browser (directly or in a Web Worker) and by tests in Node.js
+
+(function wordDiffModule(exports) {
+    // Lines longer than this on either side keep whole-line highlighting; the
+    // result would be noise and the cost grows with length times differences
+    var MAX_LINE_LENGTH = 1000;
+
+    var tokenPattern = / *[\-><!=]+ *|[ \t]+|[<$&#§%]\w+|\w+|\W/g;
+
+    function tokenize(text) {
+        return text !== "" && text.match(tokenPattern) || [];
+    }
+
+    /**
+     * Find which tokens of `a` and `b` are outside their longest common
+     * subsequence, using Myers' divide and conquer on the middle snake so
+     * memory stays linear in the token count.
+     *
+     * Tokens are compared with ===, so callers intern strings to numbers.
+     *
+     * @returns {Object} { a: Uint8Array, b: Uint8Array } with 1 for changed tokens
+     */
+    function diffTokens(a, b) {
+        var changedA = new Uint8Array(a.length);
+        var changedB = new Uint8Array(b.length);
+        compare(a, 0, a.length, b, 0, b.length, changedA, changedB);
+        return { a: changedA, b: changedB };
+    }
+
+    function compare(a, aLow, aHigh, b, bLow, bHigh, changedA, changedB) {
+        while (aLow < aHigh && bLow < bHigh && a[aLow] === b[bLow]) {
+            aLow++;
+            bLow++;
+        }
+        while (aLow < aHigh && bLow < bHigh && a[aHigh - 1] === b[bHigh - 1]) {
+            aHigh--;
+            bHigh--;
+        }
+
+        var i;
+        if (aLow === aHigh || bLow === bHigh) {
+            for (i = aLow; i < aHigh; i++)
+                changedA[i] = 1;
+            for (i = bLow; i < bHigh; i++)
+                changedB[i] = 1;
+            return;
+        }
+
+        var split = middleSnake(a, aLow, aHigh, b, bLow, bHigh);
+        if (!split) {
+            for (i = aLow; i < aHigh; i++)
+                changedA[i] = 1;
+            for (i = bLow; i < bHigh; i++)
+                changedB[i] = 1;
+            return;
+        }
+
+        compare(a, aLow, aLow + split.x, b, bLow, bLow + split.y, changedA, changedB);
+        compare(a, aLow + split.x, aHigh, b, bLow + split.y, bHigh, changedA, changedB);
+    }
+
+    // Walk forward from the start and backward from the end until the paths
+    // overlap; the overlap lies on an optimal edit path and splits the
+    // problem in two. Returns the split as offsets into the two ranges, or
+    // null if the ranges share nothing.
+    function middleSnake(a, aLow, aHigh, b, bLow, bHigh) {
+        var n = aHigh - aLow;
+        var m = bHigh - bLow;
+        var maxD = (n + m + 1) >> 1;
+        var offset = maxD;
+        var length = 2 * maxD + 2;
+        var forward = new Int32Array(length).fill(-1);
+        var backward = new Int32Array(length).fill(-1);
+        forward[offset + 1] = 0;
+        backward[offset + 1] = 0;
+
+        var delta = n - m;
+        // With an odd delta the forward walk is the one to detect the overlap
+        var checkForward = (delta & 1) !== 0;
+        var kForwardStart = 0, kForwardEnd = 0;
+        var kBackwardStart = 0, kBackwardEnd = 0;
+
+        for (var d = 0; d < maxD; d++) {
+            var k, kOffset, x, y, otherOffset;
+
+            for (k = -d + kForwardStart; k <= d - kForwardEnd; k += 2) {
+                kOffset = offset + k;
+                if (k === -d || (k !== d && forward[kOffset - 1] < forward[kOffset + 1]))
+                    x = forward[kOffset + 1];
+                else
+                    x = forward[kOffset - 1] + 1;
+                y = x - k;
+                while (x < n && y < m && a[aLow + x] === b[bLow + y]) {
+                    x++;
+                    y++;
+                }
+                forward[kOffset] = x;
+                if (x > n) {
+                    kForwardEnd += 2;
+                } else if (y > m) {
+                    kForwardStart += 2;
+                } else if (checkForward) {
+                    otherOffset = offset + delta - k;
+                    if (otherOffset >= 0 && otherOffset < length && backward[otherOffset] !== -1 &&
+                        x >= n - backward[otherOffset])
+                        return { x: x, y: y };
+                }
+            }
+
+            for (k = -d + kBackwardStart; k <= d - kBackwardEnd; k += 2) {
+                kOffset = offset + k;
+                if (k === -d || (k !== d && backward[kOffset - 1] < backward[kOffset + 1]))
+                    x = backward[kOffset + 1];
+                else
+                    x = backward[kOffset - 1] + 1;
+                y = x - k;
+                while (x < n && y < m && a[aHigh - x - 1] === b[bHigh - y - 1]) {
+                    x++;
+                    y++;
+                }
+                backward[kOffset] = x;
+                if (x > n) {
+                    kBackwardEnd += 2;
+                } else if (y > m) {
+                    kBackwardStart += 2;
+                } else if (!checkForward) {
+                    otherOffset = offset + delta - k;
+                    if (otherOffset >= 0 && otherOffset < length && forward[otherOffset] !== -1) {
+                        var forwardX = forward[otherOffset];
+                        var forwardY = forwardX - (otherOffset - offset);
+                        if (forwardX >= n - x)
+                            return { x: forwardX, y: forwardY };
+                    }
+                }
+            }
+        }
+
+        return null;
+    }
+
+    // Character ranges [start, end, start, end, ...] covered by changed
+    // tokens, with neighbouring ranges merged
+    function changedRanges(tokens, changed) {
+        var ranges = [];
+        var position = 0;
+        for (var i = 0; i < tokens.length; i++) {
+            var end = position + tokens[i].length;
+            if (changed[i]) {
+                if (ranges.length && ranges[ranges.length - 1] === position)
+                    ranges[ranges.length - 1] = end;
+                else
+                    ranges.push(position, end);
+            }
+            position = end;
+        }
+        return ranges;
+    }
+
+    /**
+     * Word diff of one deleted line against the added line paired with it.
+     *
+     * @param {string} oldText - Deleted line, without its "-" prefix
+     * @param {string} newText - Added line, without its "+" prefix
+     * @returns {Object|null} { del: ranges, add: ranges }, where ranges is a
+     *   flat array of [start, end) character offsets to highlight, or null if
+     *   either line is over the length cutoff
+     */
+    function diffLines(oldText, newText) {
+        if (oldText.length > MAX_LINE_LENGTH || newText.length > MAX_LINE_LENGTH)
+            return null;
+
+        var oldTokens = tokenize(oldText);
+        var newTokens = tokenize(newText);
+
+        // Intern tokens so the inner loops compare numbers
+        var ids = Object.create(null);
+        var nextId = 0;
+        var intern = function(tokens) {
+            var result = new Int32Array(tokens.length);
+            for (var i = 0; i < tokens.length; i++) {
+                var id = ids[tokens[i]];
+                if (id === undefined)
+                    id = ids[tokens[i]] = nextId++;
+                result[i] = id;
+            }
+            return result;
+        };
+        var oldIds = intern(oldTokens);
+        var newIds = intern(newTokens);
+
+        // Line up the words first so runs of spaces can't outvote them, then
+        // diff the whitespace left between each pair of matched words
+        var oldWords = wordIndices(oldTokens);
+        var newWords = wordIndices(newTokens);
+        var pick = function(tokenIds, indices) {
+            var result = new Int32Array(indices.length);
+            for (var i = 0; i < indices.length; i++)
+                result[i] = tokenIds[indices[i]];
+            return result;
+        };
+        var words = diffTokens(pick(oldIds, oldWords), pick(newIds, newWords));
+
+        var changedOld = new Uint8Array(oldTokens.length);
+        var changedNew = new Uint8Array(newTokens.length);
+        var oldPosition = 0, newPosition = 0;
+        var j = 0;
+        for (var i = 0; i < oldWords.length; i++) {
+            if (words.a[i])
+                continue;
+            while (words.b[j])
+                j++;
+            compare(oldIds, oldPosition, oldWords[i], newIds, newPosition, newWords[j], changedOld, changedNew);
+            oldPosition = oldWords[i] + 1;
+            newPosition = newWords[j] + 1;
+            j++;
+        }
+        compare(oldIds, oldPosition, oldIds.length, newIds, newPosition, newIds.length, changedOld, changedNew);
+
+        return {
+            del: changedRanges(oldTokens, changedOld),
+            add: changedRanges(newTokens, changedNew)
+        };
+    }
+
+    function wordIndices(tokens) {
+        var indices = [];
+        for (var i = 0; i < tokens.length; i++) {
+            if (!/^[ \t]+$/.test(tokens[i]))
+                indices.push(i);
+        }
+        return indices;
+    }
+
+    /**
+     * Diff a batch of line pairs, as posted to the worker.
+     *
+     * @param {Object} request - { id, pairs: [oldText, newText, oldText, newText, ...] }
+     * @returns {Object} { id, results: [diffLines result, ...] }
+     */
+    function handleRequest(request) {
+        var results = [];
+        for (var i = 0; i + 1 < request.pairs.length; i += 2)
+            results.push(diffLines(request.pairs[i], request.pairs[i + 1]));
+        return { id: request.id, results: results };
+    }
+
+    function escape(s) {
+        return s.replace(/&/g, "&amp;").replace(/</g, "&lt;").replace(/>/g, "&gt;").replace(/"/g, "&quot;");
+    }
+
+    /** Escaped HTML for `text` with `ranges` wrapped in <tag>. */
+    function renderLine(text, ranges, tag) {
+        var html = "";
+        var position = 0;
+        for (var i = 0; i + 1 < ranges.length; i += 2) {
+            html += escape(text.substring(position, ranges[i])) +
+                "<" + tag + ">" + escape(text.substring(ranges[i], ranges[i + 1])) + "</" + tag + ">";
+            position = ranges[i + 1];
+        }
+        return html + escape(text.substring(position));
+    }
+
+    /**
+     * A Web Worker running handleRequest, built from this module's own
+     * source so it needs no file access of its own. Returns null where
+     * workers are unavailable.
+     */
+    function createWorker() {
+        if (typeof Worker === "undefined" || typeof Blob === "undefined" || typeof URL === "undefined")
+            return null;
+        var source = "var WordDiff = {};\n(" + wordDiffModule.toString() + ")(WordDiff);\n" +
+            "self.onmessage = function(event) { self.postMessage(WordDiff.handleRequest(event.data)); };\n";
+        try {
+            return new Worker(URL.createObjectURL(new Blob([source], { type: "text/javascript" })));
+        } catch (e) {
+            return null;
+        }
+    }
+
+    exports.MAX_LINE_LENGTH = MAX_LINE_LENGTH;
+
+    exports.tokenize = tokenize;
+    exports.diffTokens = diffTokens;
+    exports.diffLines = diffLines;
+    exports.handleRequest = handleRequest;
+    exports.renderLine = renderLine;
+    exports.createWorker = createWorker;
+
+})(typeof module !== 'undefined' && module.exports ? module.exports : (window.WordDiff = {}));
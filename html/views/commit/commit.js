@@ -3,6 +3,13 @@
 
 var contextLines = 0;
 var currentCommitSelection = null;
+// Last diff received for the current selection, fetched with the widest
+// context the slider allows so moving the slider never goes back to git.
+var wideCommitDiff = null;
+// Wide diffs of recently shown files, least recently used first, keyed on
+// the path and the blobs compared so going back to a file doesn't either.
+var wideDiffCache = [];
+var wideDiffCacheSize = 8;
 var pendingScrollY = null;
 
 // Cross-browser scroll helpers
@@ -31,7 +38,10 @@ var showNewFile = function(file, diffContents, options)
 	var notice = "";
 	if (options.diffWasTruncated) {
 		var limit = typeof options.truncateLimit === "number" && options.truncateLimit > 0 ? options.truncateLimit : 1024;
-		notice = '<div class="truncation-notice">Diff truncated to ' + limit + " characters for preview.</div>";
+		if (typeof options.fileSize === "number" && options.fileSize > 0)
+			notice = '<div class="truncation-notice">Showing the first ' + limit + " of " + options.fileSize + " bytes.</div>";
+		else
+			notice = '<div class="truncation-notice">Diff truncated to ' + limit + " characters for preview.</div>";
 	}
 	diff.innerHTML = "<pre>" + contents.escapeHTML() + "</pre>" + notice;
 	diff.style.display = '';
@@ -58,7 +68,7 @@ var setTitle = function(status) {
 var displayContext = function() {
 	document.getElementById("contextSize").style.display = "";
 	document.getElementById("contextTitle").style.display = "";
-	contextLines = document.getElementById("contextSize").value;
+	contextLines = parseInt(document.getElementById("contextSize").value, 10) || 0;
 }
 
 var showFileChanges = function(file, cached, options) {
@@ -75,28 +85,28 @@ var showFileChanges = function(file, cached, options) {
 	var isBinary = options.isBinary === true;
 	var diffWasTruncated = options.diffWasTruncated === true;
 	var truncateLimit = typeof options.truncateLimit === "number" && options.truncateLimit > 0 ? options.truncateLimit : null;
-	if (typeof options.contextLines !== "undefined") {
-		contextLines = parseInt(options.contextLines, 10) || 0;
-	}
+	var fileSize = typeof options.fileSize === "number" ? options.fileSize : null;
 
 	var slider = document.getElementById("contextSize");
 	if (slider) {
 		slider.oninput = function() {
 			contextLines = parseInt(slider.value, 10) || 0;
-			requestCommitDiff();
+			if (wideCommitDiff) {
+				pendingScrollY = getScrollY();
+				showFileChanges(file, cached, wideCommitDiff);
+			} else {
+				requestCommitDiff();
+			}
 		};
-		if (typeof options.contextLines !== "undefined")
-			slider.value = options.contextLines;
-		else
-			contextLines = parseInt(slider.value, 10) || 0;
+		contextLines = parseInt(slider.value, 10) || 0;
 	}
 
 	// Use isNewFile from response if available (most up-to-date), fall back to file.status
 	var isNewFile = (typeof options.isNewFile !== "undefined") ? options.isNewFile : (file.status == 0);
 	if (isNewFile) {
 		if (isBinary)
-			return showNewFile(file, null, { diffWasTruncated: diffWasTruncated, truncateLimit: truncateLimit });
-		return showNewFile(file, diffData, { diffWasTruncated: diffWasTruncated, truncateLimit: truncateLimit });
+			return showNewFile(file, null, { diffWasTruncated: diffWasTruncated, truncateLimit: truncateLimit, fileSize: fileSize });
+		return showNewFile(file, diffData, { diffWasTruncated: diffWasTruncated, truncateLimit: truncateLimit, fileSize: fileSize });
 	}
 
 	var path = file.path.toString();
@@ -114,17 +124,69 @@ var showFileChanges = function(file, cached, options) {
 		return;
 	}
 
+	// The diff arrives with options.contextLines of context; trim it locally
+	var fetchedContext = parseInt(options.contextLines, 10);
+	if (!isNaN(fetchedContext) && contextLines < fetchedContext)
+		diffData = DiffContext.rewindowDiff(diffData, contextLines);
+
+	// A preview limit applies to the hunks shown, not to the wide diff
+	if (truncateLimit) {
+		var preview = DiffContext.truncateDiff(diffData, truncateLimit);
+		diffData = preview.diff;
+		diffWasTruncated = diffWasTruncated || preview.truncated;
+	}
+
 	displayDiff(diffData, cached, { diffWasTruncated: diffWasTruncated, truncateLimit: truncateLimit });
 }
 
-var requestCommitDiff = function () {
+var cachedWideDiff = function(key) {
+	for (var i = 0; i < wideDiffCache.length; i++) {
+		if (wideDiffCache[i].key === key) {
+			var entry = wideDiffCache.splice(i, 1)[0];
+			wideDiffCache.push(entry);
+			return entry.diff;
+		}
+	}
+	return null;
+};
+
+var storeWideDiff = function(key, diff) {
+	for (var i = 0; i < wideDiffCache.length; i++) {
+		if (wideDiffCache[i].key === key) {
+			wideDiffCache.splice(i, 1);
+			break;
+		}
+	}
+	wideDiffCache.push({ key: key, diff: diff });
+	if (wideDiffCache.length > wideDiffCacheSize)
+		wideDiffCache.shift();
+};
+
+/* Shows the selection's diff from the cache, or asks for it. After a hunk
+   was applied (refetch) the selection's blob names are out of date until the
+   index is read again, so the cache is neither used nor filled. */
+var requestCommitDiff = function (refetch) {
 	if (!currentCommitSelection || !currentCommitSelection.file)
 		return;
 
+	var slider = document.getElementById("contextSize");
+	var widestContext = slider ? (parseInt(slider.max, 10) || contextLines) : contextLines;
+	var wantedContext = Math.max(widestContext, contextLines);
+
+	var key = currentCommitSelection.diffKey;
+	var cached = !refetch && key ? cachedWideDiff(key) : null;
+	if (cached && (parseInt(cached.contextLines, 10) || 0) >= wantedContext) {
+		wideCommitDiff = cached;
+		showFileChanges(currentCommitSelection.file, !!currentCommitSelection.cached, cached);
+		return;
+	}
+
+	currentCommitSelection.cacheDiff = !refetch;
+	wideCommitDiff = null;
 	gitxBridge.post("requestCommitDiff", {
 		path: currentCommitSelection.path || "",
 		cached: !!currentCommitSelection.cached,
-		contextLines: contextLines
+		contextLines: wantedContext
 	});
 };
 
@@ -151,6 +213,7 @@ var handleCommitSelectionChanged = function (message) {
 	}
 
 	currentCommitSelection = null;
+	wideCommitDiff = null;
 
 	var diffElement = document.getElementById("diff");
 	if (diffElement) {
@@ -168,14 +231,15 @@ var handleCommitSelectionChanged = function (message) {
 	currentCommitSelection = {
 		file: fileData,
 		cached: cached,
-		path: pathString
+		path: pathString,
+		diffKey: message.diffKey ? message.diffKey.toString() : null
 	};
 
 	var slider = document.getElementById("contextSize");
 	if (slider)
 		contextLines = parseInt(slider.value, 10) || 0;
 
-	requestCommitDiff();
+	requestCommitDiff(forceRefresh);
 };
 
 var findParentElementByTag = function (el, tagName)
@@ -296,8 +360,8 @@ var setSelectHandlers = function()
 	}
 }
 
-var diffHeader;
-var originalDiff;
+// The diff on display, parsed once; hunk and line actions cut their patches from it
+var currentDiffModel;
 var originalCached;
 
 var displayDiff = function(diff, cached, options)
@@ -305,21 +369,12 @@ var displayDiff = function(diff, cached, options)
 	options = options || {};
 	var diffWasTruncated = options.diffWasTruncated === true;
 	var truncateLimit = typeof options.truncateLimit === "number" && options.truncateLimit > 0 ? options.truncateLimit : 1024;
-	// Find the diff header by looking for the first hunk marker
-	// Header ends just before the first @@ line
-	var firstHunkIdx = diff.indexOf("\n@@");
-	if (firstHunkIdx !== -1) {
-		diffHeader = diff.substring(0, firstHunkIdx);
-	} else {
-		// Fallback: no hunk found, use first 4 lines
-		diffHeader = diff.split("\n").slice(0,4).join("\n");
-	}
-	originalDiff = diff;
+	currentDiffModel = DiffModel.parseDiff(diff);
 	originalCached = cached;
 
 	var diffElement = document.getElementById("diff");
 	diffElement.style.display = "";
-	highlightDiff(diff, diffElement);
+	highlightDiff(currentDiffModel, diffElement);
 	hunkHeaders = diffElement.getElementsByClassName("hunkheader");
 
 	for (i = 0; i < hunkHeaders.length; ++i) {
@@ -346,51 +401,46 @@ var displayDiff = function(diff, cached, options)
 	}
 }
 
-var getNextText = function(element)
+/* The model's index of the hunk whose header row is headerElement */
+var hunkForHeader = function(headerElement)
 {
-	// gets the next DOM sibling which has type "text" (e.g. our hunk-header)
-	next = element;
-	while (next.nodeType != 3) {
-		next = next.nextSibling;
-	}
-	return next;
+	if (!currentDiffModel || !headerElement)
+		return -1;
+	var line = parseInt(headerElement.getAttribute("index"), 10);
+	if (isNaN(line))
+		return -1;
+	return DiffModel.hunkAtLine(currentDiffModel, line);
 }
 
-
-/* Get the original hunk lines attached to the given hunk header */
-var getLines = function (hunkHeader)
+/* Get the full hunk text, including diff top header, for a hunk button */
+var getFullHunk = function(button)
 {
-	var start = originalDiff.indexOf(hunkHeader);
-	var end = originalDiff.indexOf("\n@@", start + 1);
-	var end2 = originalDiff.indexOf("\ndiff", start + 1);
-	if (end2 < end && end2 > 0)
-		end = end2;
-	if (end == -1)
-		end = originalDiff.length;
-	return originalDiff.substring(start, end)+'\n';
+	var hunk = hunkForHeader(findParentElementByClass(button, "hunkheader"));
+	if (hunk < 0)
+		return "";
+	return DiffModel.hunkPatch(currentDiffModel, hunk);
 }
 
-/* Get the full hunk test, including diff top header */
-var getFullHunk = function(hunk)
+var findParentElementByClass = function(el, className)
 {
-	hunk = getNextText(hunk);
-	var hunkHeader = hunk.data.split("\n")[0];
-	var m;
-	if (m = hunkHeader.match(/@@.*@@/))
-		hunkHeader = m;
-	return diffHeader + "\n" + getLines(hunkHeader);
+	while (el && !(el.classList && el.classList.contains(className)))
+		el = el.parentNode;
+	return el;
 }
 
+// hunkText may be a single patch or an array of patches; an array is applied
+// by one git apply and followed by a refresh of only the paths it touches.
 var addHunkText = function(hunkText, reverse)
 {
-	if (!hunkText)
+	if (!hunkText || !hunkText.length)
 		return;
 
-	gitxBridge.post("commitApplyPatch", {
-		patch: hunkText,
-		reverse: !!reverse,
-		stage: true
-	});
+	var message = { reverse: !!reverse, stage: true };
+	if (typeof hunkText === "string")
+		message.patch = hunkText;
+	else
+		message.patches = hunkText;
+	gitxBridge.post("commitApplyPatch", message);
 }
 
 /* Add the hunk located below the current element */
@@ -403,6 +453,8 @@ var addHunk = function(hunk, reverse)
 var discardHunk = function(hunk, event)
 {
 	var hunkText = getFullHunk(hunk);
+	if (!hunkText)
+		return;
 	var altPressed = event && event.altKey === true;
 
 	pendingScrollY = getScrollY();
@@ -412,11 +464,15 @@ var discardHunk = function(hunk, event)
 	});
 }
 
-// Extract just the @@ line from hunk header text (strips button text)
-var extractHunkHeaderLine = function(text) {
-	var match = text.match(/@@[^@]+@@/);
-	return match ? match[0] : null;
-};
+/* The hunk header row above row, or null */
+var findHunkHeaderRow = function(row)
+{
+	for (var next = row.previousSibling; next; next = next.previousSibling) {
+		if (next.classList && next.classList.contains("hunkheader"))
+			return next;
+	}
+	return null;
+}
 
 /* Split a hunk at the selected unchanged line */
 var splitHunk = function(button)
@@ -428,118 +484,58 @@ var splitHunk = function(button)
 	var selectedClass = selectedLine.getAttribute("class") || "";
 	if (selectedClass.indexOf("noopline") < 0) return false;
 
-	var selectedIndex = parseInt(selectedLine.getAttribute("index"));
-	var hunkHeader = null;
-	var hunkHeaderIndex = -1;
-
-	// Find the hunk header by walking siblings
-	for (var next = selectedLine.previousSibling; next; next = next.previousSibling) {
-		var elem_class = next.getAttribute ? (next.getAttribute("class") || "") : "";
-		if (elem_class.indexOf("hunkheader") >= 0) {
-			var rawText = next.textContent || next.innerText;
-			hunkHeader = extractHunkHeaderLine(rawText);
-			hunkHeaderIndex = parseInt(next.getAttribute("index"));
-			break;
-		}
-	}
+	var model = currentDiffModel;
+	var headerRow = findHunkHeaderRow(selectedLine);
+	var hunkIndex = hunkForHeader(headerRow);
+	if (hunkIndex < 0) return false;
+	var hunk = model.hunks[hunkIndex];
 
-	if (!hunkHeader) return false;
+	// Lines before the selected one stay in the first hunk, lines after it go
+	// to the second; the selected context line itself is dropped
+	var selectedIndex = parseInt(selectedLine.getAttribute("index"), 10);
+	var preselect = selectedIndex - hunk.line - 1;
+	var lines = DiffModel.hunkLines(model, hunkIndex);
 
-	// Calculate preselect as the difference in indices (accounts for paired rows)
-	var preselect = selectedIndex - hunkHeaderIndex - 1;
-
-	// Parse the original hunk header to get line numbers
-	var m;
-	if (m = hunkHeader.match(/@@ \-(\d+)(,\d+)? \+(\d+)(,\d+)? @@/)) {
-		var start_old = parseInt(m[1]);
-		var start_new = parseInt(m[3]);
-	} else return false;
-
-	// Get all lines in this hunk
-	var subhunkText = getLines(hunkHeader);
-	var lines = subhunkText.split('\n');
-	lines.shift();  // Remove hunk header
-	if (lines[lines.length-1] == "") lines.pop(); // Remove final newline
-
-	// Split the lines at the selected position
 	var firstHunkLines = lines.slice(0, preselect);
-	var secondHunkLines = lines.slice(preselect + 1); // Skip the splitting line
+	var secondHunkLines = lines.slice(preselect + 1);
 
-	// Calculate line counts for each new hunk
-	var calculateCounts = function(hunkLines) {
+	// Count old and new lines from the model's per-line kinds
+	var calculateCounts = function(from, to) {
 		var oldCount = 0, newCount = 0;
-		for (var i = 0; i < hunkLines.length; i++) {
-			var firstChar = hunkLines[i].charAt(0);
-			if (firstChar == '-') {
+		for (var i = from; i < to; i++) {
+			var kind = model.kind[i];
+			if (kind === DiffModel.DEL || kind === DiffModel.CONTEXT)
 				oldCount++;
-			} else if (firstChar == '+') {
-				newCount++;
-			} else {
-				oldCount++; 
+			if (kind === DiffModel.ADD || kind === DiffModel.CONTEXT)
 				newCount++;
-			}
 		}
 		return [oldCount, newCount];
 	};
 
-	var firstCounts = calculateCounts(firstHunkLines);
-	var secondCounts = calculateCounts(secondHunkLines);
+	var firstCounts = calculateCounts(hunk.line + 1, selectedIndex);
+	var secondCounts = calculateCounts(selectedIndex + 1, hunk.end);
 
-	// Calculate line numbers for second hunk
-	var secondStart_old = start_old;
-	var secondStart_new = start_new;
-	for (var i = 0; i <= preselect; i++) {
-		var firstChar = lines[i].charAt(0);
-		if (firstChar == '-' || firstChar == ' ') {
-			secondStart_old++;
-		}
-		if (firstChar == '+' || firstChar == ' ') {
-			secondStart_new++;
-		}
-	}
+	// The second hunk starts on the line after the selected one
+	var secondStart_old = model.oldLine[selectedIndex] + 1;
+	var secondStart_new = model.newLine[selectedIndex] + 1;
 
-	// Create the two new hunks
-	var firstHunk = "";
+	var newHunksText = "";
 	if (firstHunkLines.length > 0) {
-		firstHunk = diffHeader + '\n' + 
-			"@@ -" + start_old + "," + firstCounts[0] + 
-			" +" + start_new + "," + firstCounts[1] + " @@\n" +
+		newHunksText += "@@ -" + hunk.oldStart + "," + firstCounts[0] +
+			" +" + hunk.newStart + "," + firstCounts[1] + " @@\n" +
 			firstHunkLines.join('\n') + '\n';
 	}
-
-	var secondHunk = "";
 	if (secondHunkLines.length > 0) {
-		secondHunk = diffHeader + '\n' + 
-			"@@ -" + secondStart_old + "," + secondCounts[0] + 
+		newHunksText += "@@ -" + secondStart_old + "," + secondCounts[0] +
 			" +" + secondStart_new + "," + secondCounts[1] + " @@\n" +
 			secondHunkLines.join('\n') + '\n';
 	}
 
-	// Apply the split by creating a modified diff and refreshing
-	var modifiedDiff = originalDiff;
-	var originalHunkStart = modifiedDiff.indexOf(hunkHeader);
-	var originalHunkEnd = modifiedDiff.indexOf("\n@@", originalHunkStart + 1);
-	var originalHunkEnd2 = modifiedDiff.indexOf("\ndiff", originalHunkStart + 1);
-	if (originalHunkEnd2 < originalHunkEnd && originalHunkEnd2 > 0)
-		originalHunkEnd = originalHunkEnd2;
-	if (originalHunkEnd == -1)
-		originalHunkEnd = modifiedDiff.length;
-
-	var beforeHunk = modifiedDiff.substring(0, originalHunkStart);
-	var afterHunk = modifiedDiff.substring(originalHunkEnd);
-	
-	var newHunksText = "";
-	if (firstHunk) {
-		newHunksText += firstHunk.substring(diffHeader.length + 1); // Remove diff header since it's already in modifiedDiff
-	}
-	if (secondHunk) {
-		newHunksText += secondHunk.substring(diffHeader.length + 1); // Remove diff header since it's already in modifiedDiff
-	}
-	
-	modifiedDiff = beforeHunk + newHunksText + afterHunk;
-	
-	// Refresh the display with the modified diff
-	displayDiff(modifiedDiff, originalCached);
+	// Replace the hunk's lines in the displayed diff and render it again
+	var text = model.text;
+	var beforeHunk = text.substring(0, model.lineStart[hunk.line]);
+	var afterHunk = hunk.end < model.lineCount ? text.substring(model.lineStart[hunk.end]) : "";
+	displayDiff(beforeHunk + newHunksText + afterHunk, originalCached);
 }
 
 /* Find all contiguous add/del/change lines. A quick way to select "just this
@@ -583,32 +579,21 @@ var deselect = function() {
 }
 
 /* Stage individual selected lines.  Note that for staging, unselected
- * delete lines are context, and v.v. for unstaging. */
+ * delete lines are context, and v.v. for unstaging.  A selection across
+ * several hunks is staged with one patch per hunk, all sent at once. */
 var stageLines = function(reverse) {
 	// Find all selected rows (marked with .selected-row class)
 	var selectedRows = document.querySelectorAll('.selected-row');
 	if (selectedRows.length == 0) return false;
 	currentSelection = false;
 
-	// Find the hunk header by walking backwards from first selected row
-	var hunkHeader = false;
-	var hunkHeaderIndex = -1;
+	var model = currentDiffModel;
 
-	for (var next = selectedRows[0].previousSibling; next; next = next.previousSibling) {
-		var elem_class = next.getAttribute ? (next.getAttribute("class") || "") : "";
-		if (elem_class.indexOf("hunkheader") >= 0) {
-			var rawText = next.textContent || next.innerText;
-			hunkHeader = extractHunkHeaderLine(rawText);
-			hunkHeaderIndex = parseInt(next.getAttribute("index"));
-			break;
-		}
-	}
-
-	if (!hunkHeader) return false;
-
-	// Build set of selected line indices and del→add pairing from selected rows
+	// Build set of selected line indices and del→add pairing from selected
+	// rows, and note the hunks they are in
 	var selectedIndices = {};
 	var delToAddPair = {};
+	var hunkIndices = [];
 	for (var i = 0; i < selectedRows.length; i++) {
 		var child = selectedRows[i];
 
@@ -622,34 +607,32 @@ var stageLines = function(reverse) {
 				selectedIndices[addIdxNum] = true;
 				delToAddPair[idx] = addIdxNum;
 			}
+
+			var hunkIndex = DiffModel.hunkAtLine(model, idx);
+			if (hunkIndex >= 0 && hunkIndices.indexOf(hunkIndex) < 0)
+				hunkIndices.push(hunkIndex);
 		}
 	}
+	hunkIndices.sort(function(a, b) { return a - b; });
 
-	var subhunkText = getLines(hunkHeader);
-	var lines = subhunkText.split('\n');
-	lines.shift();  // Trim old hunk header (we'll compute our own)
-	if (lines[lines.length - 1] == "") lines.pop(); // Omit final newline
-
-	var m;
-	if (m = hunkHeader.match(/@@ \-(\d+)(,\d+)? \+(\d+)(,\d+)? @@/)) {
-		var start_old = parseInt(m[1]);
-		var start_new = parseInt(m[3]);
-	} else return false;
-
-	// Generate the patch content using shared logic
-	var result = PatchGenerator.generatePatchContent({
-		lines: lines,
-		selectedIndices: selectedIndices,
-		delToAddPair: delToAddPair,
-		reverse: reverse,
-		baseIndex: hunkHeaderIndex + 1
-	});
+	var hunks = [];
+	for (var i = 0; i < hunkIndices.length; i++) {
+		var hunk = model.hunks[hunkIndices[i]];
+		hunks.push({
+			header: DiffModel.fileHeaderText(model, hunk.file),
+			oldStart: hunk.oldStart,
+			newStart: hunk.newStart,
+			lines: DiffModel.hunkLines(model, hunkIndices[i]),
+			baseIndex: hunk.line + 1
+		});
+	}
 
-	var patch = diffHeader + '\n' + "@@ -" + start_old.toString() + "," + result.oldCount.toString() +
-		" +" + start_new.toString() + "," + result.newCount.toString() + " @@\n" + result.content;
+	// Generate the patches using shared logic
+	var patches = PatchGenerator.generateSelectionPatches(hunks, selectedIndices, delToAddPair, reverse);
+	if (patches.length == 0) return false;
 
 	pendingScrollY = getScrollY();
-	addHunkText(patch, reverse);
+	addHunkText(patches.length == 1 ? patches[0] : patches, reverse);
 }
 
 /* Compute the selection before actually making it.  Return as object
@@ -674,7 +657,6 @@ var computeSelection = function(list, from, to)
 
 	var insel = from.parentNode && from.parentNode.id == "selected";
 	var good = false;
-	var last = from;
 
 	for (var elem = from; ; elem = elem[nextelem]) {
 		if (!insel && elem.id && elem.id == "selected") {
@@ -683,15 +665,10 @@ var computeSelection = function(list, from, to)
 			insel = true;
 		}
 
-		var elem_class = elem.getAttribute ? (elem.getAttribute("class") || "") : "";
-		if (elem_class) {
-			if (elem_class.indexOf("hunkheader") >= 0) {
-				elem = last;
-				break; // Stay inside this hunk
-			}
-			if (!good && isChangeRow(elem)) {
-				good = true; // A good selection
-			}
+		// A selection may run over hunk headers; stageLines cuts a patch
+		// from each hunk it covers
+		if (!good && isChangeRow(elem)) {
+			good = true; // A good selection
 		}
 		if (elem == to) break;
 
@@ -700,13 +677,11 @@ var computeSelection = function(list, from, to)
 				elem == elem.parentNode.lastChild :
 				elem == elem.parentNode.childNodes[1]) {
 				// Come up out of selection div
-				last = elem;
 				insel = false;
 				elem = elem.parentNode;
 				continue;
 			}
 		}
-		last = elem;
 	}
 	to = elem;
 	return { bounds: [from, to], good: good };
@@ -765,7 +740,7 @@ var showSelection = function(file, from, to, trust)
 	for (var i = 0; i < children.length; i++) {
 		var child = children[i];
 		var idx = parseInt(child.getAttribute("index"));
-		if (!isNaN(idx) && idx >= beg && idx <= end) {
+		if (!isNaN(idx) && idx >= beg && idx <= end && !child.classList.contains("hunkheader")) {
 			elementList.push(child);
 		}
 	}
@@ -829,7 +804,7 @@ var handleCommitNativeMessage = function (message) {
     case "commitHunkApplied":
       // Hunk was successfully staged/unstaged/discarded
       // Request fresh diff - pendingScrollY will be restored in displayDiff
-      requestCommitDiff();
+      requestCommitDiff(true);
       break;
     case "commitSelectionChanged":
       handleCommitSelectionChanged(message);
@@ -848,6 +823,9 @@ var handleCommitNativeMessage = function (message) {
       ) {
         return;
       }
+      wideCommitDiff = message;
+      if (currentCommitSelection.cacheDiff && message.diffKey)
+        storeWideDiff(message.diffKey.toString(), message);
       showFileChanges(
         currentCommitSelection.file,
         !!currentCommitSelection.cached,
@@ -856,6 +834,7 @@ var handleCommitNativeMessage = function (message) {
       break;
     case "commitMultipleSelection":
       currentCommitSelection = null;
+      wideCommitDiff = null;
       if (typeof showMultipleFilesSelection === "function") {
         try {
           var files = [];
@@ -21,10 +21,29 @@ var Commit = function (data) {
   this.notificationID = null;
   this.fullyLoaded = !!data.fullyLoaded;
 
+  // Filled in by separate messages: the changed files from diff-tree, and
+  // the patch, which is null until it arrives and never arrives by itself
+  // when native deferred it for a large commit
+  this.fileList = null;
+  this.fileEntries = null;
+  this.patchDeferred = false;
+  this.patchRequested = false;
+  this.diff = null;
+  this.autogenerated = null;
+
+  // The diff parsed by DiffModel, built on first use and shared by the
+  // file list and the diff view
+  this.diffModel = null;
+  this.getDiffModel = function () {
+    if (!this.diffModel) this.diffModel = DiffModel.parseDiff(this.diff || "");
+    return this.diffModel;
+  };
+
   // This can be called later with the output of
   // 'git show' to fill in missing commit details (such as a diff)
   this.parseDetails = function (details) {
     this.raw = details;
+    this.diffModel = null;
 
     var diffStart = this.raw.indexOf("\ndiff ");
     var messageStart = this.raw.indexOf("\n\n") + 2;
@@ -40,7 +59,6 @@ var Commit = function (data) {
         .substring(messageStart)
         .replace(/^    /gm, "")
         .escapeHTML();
-      this.diff = "";
     }
     this.header = this.raw.substring(0, messageStart);
 
@@ -288,230 +306,239 @@ var sortAndReorderFiles = function (autogeneratedList) {
   }
 };
 
-// Lightweight file list extraction from diff headers only (no full parse).
-// Used for large commits so the user can see which files changed without
-// rendering the entire diff.
-var showFileListFromHeaders = function (rawDiff) {
-  var filesElement = document.getElementById("files");
-  filesElement.innerHTML = "";
-
-  var lines = rawDiff.split("\n");
-  var startname = "";
-  var endname = "";
-  var inHeader = false;
-  var match;
-  var files = [];
-
-  var flush = function () {
-    if (!startname && !endname) return;
-    files.push({ start: startname, end: endname });
-    startname = "";
-    endname = "";
+// One entry of the file list: an icon and a link that points into the
+// rendered diff once there is one
+var createFileEntry = function (oldName, newName, modeChange, oldMode, newMode) {
+  var img = document.createElement("img");
+  var p = document.createElement("p");
+  var link = document.createElement("a");
+  p.appendChild(link);
+  var finalFile = "";
+  if (oldName == newName) {
+    finalFile = oldName;
+    img.src = "../../images/modified.svg";
+    if (modeChange)
+      p.appendChild(
+        document.createTextNode(" mode " + oldMode + " → " + newMode)
+      );
+  } else if (oldName == "/dev/null") {
+    img.src = "../../images/added.svg";
+    img.title = "Added file";
+    p.title = "Added file";
+    finalFile = newName;
+  } else if (newName == "/dev/null") {
+    img.src = "../../images/removed.svg";
+    img.title = "Removed file";
+    p.title = "Removed file";
+    finalFile = oldName;
+  } else {
+    img.src = "../../images/renamed.svg";
+    img.title = "Renamed file";
+    p.title = "Renamed file";
+    finalFile = newName;
+    var rfd = renameDiff(oldName, newName);
+    link.innerHTML = [
+      '<span class="renamed">',
+      rfd[0].escapeHTML(),
+      '<span class="meta"> { </span>',
+      '<span class="old">',
+      rfd[1].escapeHTML(),
+      "</span>",
+      '<span class="meta"> -&gt; </span>',
+      '<span class="new">',
+      rfd[2].escapeHTML(),
+      "</span>",
+      '<span class="meta"> } </span>',
+      rfd[3].escapeHTML(),
+      "</span>",
+    ].join("");
+  }
+  if (!link.firstChild) link.appendChild(document.createTextNode(finalFile));
+  link.setAttribute("representedFile", finalFile);
+  p.insertBefore(img, link);
+
+  return {
+    element: p,
+    link: link,
+    id: null,
+    oldName: oldName,
+    newName: newName,
+    filename: (finalFile || newName || oldName || "").replace(/^\/?/, ""),
+    isAutogenerated: false
   };
+};
 
-  for (var i = 0; i < lines.length; i++) {
-    var l = lines[i];
-    var fc = l.charAt(0);
+// Point a file list entry at its section of the rendered diff
+var linkFileEntry = function (entry, id) {
+  entry.id = id;
+  entry.link.setAttribute("href", "#" + id);
+  entry.link.onclick = null;
+  entry.element.setAttribute("data-file-id", id);
+};
 
-    if (fc === "d" && l.charAt(1) === "i") {
-      flush();
-      inHeader = true;
-      if ((match = l.match(/^diff --git (a\/)+(.*) (b\/)+(.*)$/))) {
-        startname = match[2];
-        endname = match[4];
-      }
-      continue;
-    }
+// Show the entries in #files and ask native which of them are generated
+var showFileEntries = function (entries) {
+  var filesElement = document.getElementById("files");
+  filesElement.innerHTML = "";
+  var fileNames = [];
+  for (var i = 0; i < entries.length; i++) {
+    filesElement.appendChild(entries[i].element);
+    // Deleted files don't exist at this commit
+    if (entries[i].newName !== "/dev/null") fileNames.push(entries[i].filename);
+  }
 
-    if (inHeader) {
-      if (fc === "n") {
-        if (l.match(/^new file mode /)) startname = "/dev/null";
-        continue;
-      }
-      if (fc === "d") {
-        if (l.match(/^deleted file mode /)) endname = "/dev/null";
-        continue;
-      }
-      if (fc === "r") {
-        if ((match = l.match(/^rename (from|to) (.*)$/))) {
-          if (match[1] === "from") startname = match[2];
-          else endname = match[2];
-        }
-        continue;
-      }
-      if (fc === "-") {
-        if ((match = l.match(/^--- (a\/)?(.*)$/))) startname = match[2];
-        continue;
-      }
-      if (fc === "+") {
-        if ((match = l.match(/^\+\+\+ (b\/)?(.*)$/))) endname = match[2];
-        continue;
-      }
-      if (fc === "@") {
-        inHeader = false;
-        // don't bother scanning diff body lines
-      }
-      continue;
-    }
+  pendingFileEntries = entries;
+  pendingCommitSha = commit.sha;
+  if (fileNames.length > 0 && commit.sha) {
+    gitxBridge.post("checkAutogeneratedFiles", {
+      sha: commit.sha,
+      files: fileNames
+    });
   }
-  flush();
+};
 
+// File list from native's diff-tree output, shown as soon as it arrives.
+// Entries link into the diff once it is rendered; until then, clicking one
+// loads just that file's patch.
+var showFileList = function (files) {
+  var entries = [];
   for (var i = 0; i < files.length; i++) {
-    var f = files[i];
-    var img = document.createElement("img");
-    var p = document.createElement("p");
-    var span = document.createElement("span");
-    var displayName = "";
-
-    if (f.start === "/dev/null") {
-      img.src = "../../images/added.svg";
-      img.title = "Added file";
-      p.title = "Added file";
-      displayName = f.end;
-    } else if (f.end === "/dev/null") {
-      img.src = "../../images/removed.svg";
-      img.title = "Removed file";
-      p.title = "Removed file";
-      displayName = f.start;
-    } else if (f.start !== f.end) {
-      img.src = "../../images/renamed.svg";
-      img.title = "Renamed file";
-      p.title = "Renamed file";
-      var rfd = renameDiff(f.start, f.end);
-      span.innerHTML = [
-        '<span class="renamed">',
-        rfd[0].escapeHTML(),
-        '<span class="meta"> { </span>',
-        '<span class="old">', rfd[1].escapeHTML(), "</span>",
-        '<span class="meta"> -&gt; </span>',
-        '<span class="new">', rfd[2].escapeHTML(), "</span>",
-        '<span class="meta"> } </span>',
-        rfd[3].escapeHTML(),
-        "</span>",
-      ].join("");
+    var file = files[i];
+    var oldName = file.status === "A" ? "/dev/null" : file.oldPath || file.path;
+    var newName = file.status === "D" ? "/dev/null" : file.path;
+    var modeChange = file.status !== "A" && file.status !== "D" && file.oldMode !== file.newMode;
+    var entry = createFileEntry(oldName, newName, modeChange, file.oldMode, file.newMode);
+
+    var stat = document.createElement("span");
+    stat.className = "diffstat";
+    if (file.binary) {
+      stat.textContent = "binary";
     } else {
-      img.src = "../../images/modified.svg";
-      displayName = f.start;
+      stat.innerHTML = '<span class="added">+' + file.added + '</span> <span class="removed">−' + file.deleted + "</span>";
     }
+    entry.element.appendChild(stat);
 
-    if (displayName) {
-      span.appendChild(document.createTextNode(displayName));
-    }
-
-    p.appendChild(img);
-    p.appendChild(span);
-    filesElement.appendChild(p);
+    entry.link.setAttribute("href", "#");
+    entry.link.onclick = requestFileDiff.bind(null, file);
+    entries.push(entry);
   }
+
+  commit.fileEntries = entries;
+  showFileEntries(entries);
 };
 
-var showDiff = function () {
-  var filesElement = document.getElementById("files");
+var requestFileDiff = function (file) {
+  document.getElementById("diff").innerHTML = "<div class='loading'>Loading " + file.path.escapeHTML() + "…</div>";
+  gitxBridge.post("requestFileDiff", { sha: commit.sha, path: file.path, oldPath: file.oldPath || "" });
+  return false;
+};
+
+// A single file's patch, requested from the file list of a large commit
+var showFileDiff = function (diffText) {
   var diffElement = document.getElementById("diff");
-  filesElement.innerHTML = "";
+  highlightDiff(diffText, diffElement, { binaryFile: binaryDiff });
+  var notice = document.createElement("div");
+  notice.innerHTML = largeCommitNotice;
+  diffElement.insertBefore(notice.firstChild, diffElement.firstChild);
+  diffElement.scrollIntoView();
+};
 
-  // Collect file entries for sorting
-  var fileEntries = [];
-  var fileNames = [];
-  var rawDiff = commit.diff || "";
+var largeCommitNotice =
+  "<a class='showdiff' href='' onclick='showDiff(); return false;'>This is a large commit. Click a file to view its changes, or click here or press 'v' to view all.</a>";
 
-  // Callback for the diff highlighter. Used to generate a filelist
-  var newfile = function (name1, name2, id, mode_change, old_mode, new_mode) {
-    var img = document.createElement("img");
-    var p = document.createElement("p");
-    var link = document.createElement("a");
-    link.setAttribute("href", "#" + id);
-    p.appendChild(link);
-    var finalFile = "";
-    var renamed = false;
-    if (name1 == name2) {
-      finalFile = name1;
-      img.src = "../../images/modified.svg";
-      if (mode_change)
-        p.appendChild(
-          document.createTextNode(" mode " + old_mode + " → " + new_mode)
-        );
-    } else if (name1 == "/dev/null") {
-      img.src = "../../images/added.svg";
-      img.title = "Added file";
-      p.title = "Added file";
-      finalFile = name2;
-    } else if (name2 == "/dev/null") {
-      img.src = "../../images/removed.svg";
-      img.title = "Removed file";
-      p.title = "Removed file";
-      finalFile = name1;
-    } else {
-      renamed = true;
-    }
-    if (renamed) {
-      img.src = "../../images/renamed.svg";
-      img.title = "Renamed file";
-      p.title = "Renamed file";
-      finalFile = name2;
-      var rfd = renameDiff(name1.unEscapeHTML(), name2.unEscapeHTML());
-      var html = [
-        '<span class="renamed">',
-        rfd[0].escapeHTML(),
-        '<span class="meta"> { </span>',
-        '<span class="old">',
-        rfd[1].escapeHTML(),
-        "</span>",
-        '<span class="meta"> -&gt; </span>',
-        '<span class="new">',
-        rfd[2].escapeHTML(),
-        "</span>",
-        '<span class="meta"> } </span>',
-        rfd[3].escapeHTML(),
-        "</span>",
-      ].join("");
-      link.innerHTML = html;
-    } else {
-      link.appendChild(document.createTextNode(finalFile.unEscapeHTML()));
-    }
-    link.setAttribute("representedFile", finalFile);
+// Fill in the file list and diff from whatever has arrived so far
+var showChanges = function () {
+  if (!commit) return;
+  if (commit.diff !== null && commit.diff.length < 200000) {
+    showDiff();
+    return;
+  }
+  if (commit.diff === null && !commit.patchDeferred) return;
 
-    p.insertBefore(img, link);
-    p.setAttribute("data-file-id", id);
+  if (!commit.fileEntries && commit.diff !== null)
+    showFileListFromHeaders(commit.getDiffModel());
+  document.getElementById("diff").innerHTML = largeCommitNotice;
+};
 
-    var checkFilename = (finalFile || name2 || name1 || "").replace(/^\/?/, "");
-    fileEntries.push({ element: p, id: id, filename: checkFilename, isAutogenerated: false });
+// File list from the parsed diff's headers alone, for merges, which have
+// no list from native. Used for large ones so the user can see which files
+// changed without rendering the entire diff.
+var showFileListFromHeaders = function (model) {
+  var entries = [];
+  for (var i = 0; i < model.files.length; i++) {
+    var file = model.files[i];
+    if (file.oldName || file.newName)
+      entries.push(createFileEntry(file.oldName, file.newName, file.modeChange, file.oldMode, file.newMode));
+  }
+  commit.fileEntries = entries;
+  showFileEntries(entries);
+};
 
-    // Don't include deleted files in the check (they don't exist at this commit)
-    if (name2 !== "/dev/null") {
-      fileNames.push(checkFilename);
-    }
-  };
+var binaryDiff = function (filename) {
+  if (filename.match(/\.(png|jpg|icns|psd)$/i))
+    return (
+      '<a href="#" onclick="return showImage(this, \'' +
+      filename +
+      "')\">Display image</a>"
+    );
+  else return "Binary file differs";
+};
 
-  var binaryDiff = function (filename) {
-    if (filename.match(/\.(png|jpg|icns|psd)$/i))
-      return (
-        '<a href="#" onclick="return showImage(this, \'' +
-        filename +
-        "')\">Display image</a>"
-      );
-    else return "Binary file differs";
+var showDiff = function () {
+  if (!commit) return;
+  if (commit.diff === null) {
+    // Deferred for a large commit; ask for all of it now
+    commit.patchRequested = true;
+    document.getElementById("diff").innerHTML = "<div class='loading'>Loading changes…</div>";
+    gitxBridge.post("requestCommitPatch", { sha: commit.sha });
+    return;
+  }
+
+  var diffElement = document.getElementById("diff");
+  var diffModel = commit.getDiffModel();
+  var entries = commit.fileEntries;
+  var createEntries = !entries;
+  if (createEntries) entries = [];
+
+  // Entries from the file list are matched to the diff's files by path;
+  // without a list, the diff's files become the list
+  var entriesByPath = {};
+  for (var i = 0; i < entries.length; i++) {
+    var entry = entries[i];
+    entriesByPath[entry.newName === "/dev/null" ? entry.oldName : entry.newName] = entry;
+  }
+
+  var newfile = function (name1, name2, id, mode_change, old_mode, new_mode) {
+    var path = name2 === "/dev/null" ? name1 : name2;
+    var entry = entriesByPath[path];
+    if (!entry && createEntries) {
+      entry = createFileEntry(name1, name2, mode_change, old_mode, new_mode);
+      entries.push(entry);
+    }
+    if (entry) linkFileEntry(entry, id);
   };
 
-  highlightDiff(rawDiff, diffElement, {
+  highlightDiff(diffModel, diffElement, {
     newfile: newfile,
     binaryFile: binaryDiff,
   });
 
-  // Initially append files in original order
-  for (var i = 0; i < fileEntries.length; i++) {
-    filesElement.appendChild(fileEntries[i].element);
+  if (createEntries) {
+    commit.fileEntries = entries;
+    showFileEntries(entries);
+    return;
   }
 
-  // Store for async callback
-  pendingFileEntries = fileEntries;
-  pendingCommitSha = commit.sha;
-
-  // Request autogenerated file check from native side
-  if (fileNames.length > 0 && commit.sha) {
-    gitxBridge.post("checkAutogeneratedFiles", {
-      sha: commit.sha,
-      files: fileNames
-    });
+  // A file can be missing from the diff, e.g. a whitespace-only change with -w
+  for (var e = 0; e < entries.length; e++) {
+    if (entries[e].id === null) {
+      entries[e].link.removeAttribute("href");
+      entries[e].link.onclick = null;
+    }
+  }
+  if (commit.autogenerated) {
+    // The list was sorted before the diff existed; sort its sections too
+    sortAndReorderFiles(commit.autogenerated);
   }
 };
 
@@ -594,15 +621,9 @@ var loadCommitDetails = function (data) {
     document.getElementById("notes_section").style.display = "";
   }
 
-  if (commit.diff.length < 200000) showDiff();
-  else {
-    showFileListFromHeaders(commit.diff);
-    document.getElementById("diff").innerHTML =
-      "<a class='showdiff' href='' onclick='showDiff(); return false;'>This is a large commit. Click here or press 'v' to view.</a>";
-  }
-
   hideNotification();
   commit.fullyLoaded = true;
+  showChanges();
 };
 
 var handleNativeMessage = function (message) {
@@ -621,6 +642,26 @@ var handleNativeMessage = function (message) {
         loadCommitDetails(message.details);
       }
       break;
+    case "commitFileList":
+      if (!commit || message.sha !== commit.sha) return;
+      if (isArray(message.files)) {
+        commit.fileList = message.files;
+        commit.patchDeferred = !!message.patchDeferred;
+        showFileList(message.files);
+        showChanges();
+      }
+      break;
+    case "commitPatch":
+      if (!commit || message.sha !== commit.sha) return;
+      commit.diff = typeof message.diff === "string" ? message.diff : "";
+      commit.diffModel = null;
+      if (commit.patchRequested) showDiff();
+      else showChanges();
+      break;
+    case "commitFileDiff":
+      if (!commit || message.sha !== commit.sha || commit.diff !== null) return;
+      if (typeof message.diff === "string") showFileDiff(message.diff);
+      break;
     case "commitNotes":
       if (!commit) return;
       if (message.sha && message.sha !== commit.sha) return;
@@ -645,6 +686,7 @@ var handleNativeMessage = function (message) {
       // Only process if this is for the current commit
       if (message.sha && message.sha === pendingCommitSha && pendingFileEntries) {
         var autogenerated = message.autogenerated;
+        if (commit && commit.sha === message.sha) commit.autogenerated = autogenerated;
         if (autogenerated && autogenerated.length > 0) {
           sortAndReorderFiles(autogenerated);
         }
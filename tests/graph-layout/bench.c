@@ -0,0 +1,218 @@
+// Headless benchmark for the compact history graph layout
+// (Classes/git/PBGraphLaneLayout.c).
+//
+// Builds merge-heavy histories with hundreds of long-lived parallel
+// branches, lays them out children first the way the history list does,
+// and times the rows in windows. Fails if a row breaks the layout's
+// limits or if later windows get much slower than the first, i.e. if
+// per-row cost grows with the number of open lanes.
+//
+// Usage: bench [commits] [branches]
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "PBGraphLaneLayout.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_PARENTS 8
+#define WINDOWS 10
+
+typedef struct Commit {
+	int parents[MAX_PARENTS];
+	int parentCount;
+} Commit;
+
+static uint64_t randomState = 0x9e3779b97f4a7c15ULL;
+
+static uint32_t nextRandom(void)
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return (uint32_t)(randomState >> 32);
+}
+
+static PBGraphObjectID objectIDFor(int commit)
+{
+	// A SHA-1 sized name that isn't just the counter, like a real one
+	PBGraphObjectID objectID;
+	memset(&objectID, 0, sizeof(objectID));
+	uint64_t value = (uint64_t)commit * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL;
+	for (int i = 0; i < 20; i++) {
+		value ^= value >> 29;
+		value *= 0xbf58476d1ce4e5b9ULL;
+		objectID.bytes[i] = (unsigned char)(value >> 56);
+	}
+	objectID.length = 20;
+	return objectID;
+}
+
+// Commits oldest first: every branch moves ahead one commit at a time, a
+// third of the commits merge other branches in (some as octopus merges),
+// and merged branches fork again from somewhere else so the number of
+// parallel branches stays up.
+static Commit *makeHistory(int count, int branchCount)
+{
+	Commit *commits = calloc((size_t)count, sizeof(Commit));
+	int *heads = malloc(sizeof(int) * (size_t)branchCount);
+
+	for (int b = 0; b < branchCount && b < count; b++) {
+		commits[b].parentCount = b == 0 ? 0 : 1;
+		commits[b].parents[0] = 0;
+		heads[b] = b;
+	}
+
+	for (int c = branchCount; c < count; c++) {
+		int branch = (int)(nextRandom() % (uint32_t)branchCount);
+		Commit *commit = &commits[c];
+		commit->parents[commit->parentCount++] = heads[branch];
+
+		uint32_t roll = nextRandom() % 100;
+		int merges = roll < 25 ? 1 : roll < 33 ? 2 + (int)(nextRandom() % (MAX_PARENTS - 2)) : 0;
+		for (int m = 0; m < merges; m++) {
+			int other = (int)(nextRandom() % (uint32_t)branchCount);
+			if (other == branch)
+				continue;
+			commit->parents[commit->parentCount++] = heads[other];
+			// The merged branch starts over from an older commit
+			heads[other] = c - 1 - (int)(nextRandom() % (uint32_t)(c < 64 ? c : 64));
+		}
+		heads[branch] = c;
+	}
+
+	free(heads);
+	return commits;
+}
+
+static double now(void)
+{
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+// Lays out every row, checking each one. Returns 0 on success.
+static int run(const Commit *commits, int count, int laneLimit, double *windowNanos)
+{
+	PBGraphLaneLayout *layout = PBGraphLaneLayoutCreate(laneLimit);
+	struct PBGitGraphLine *lines = malloc(sizeof(struct PBGitGraphLine) * (size_t)PBGraphLaneLayoutMaxLines(layout, MAX_PARENTS));
+	PBGraphObjectID *objectIDs = malloc(sizeof(PBGraphObjectID) * (size_t)count);
+	for (int c = 0; c < count; c++)
+		objectIDs[c] = objectIDFor(c);
+
+	int windowSize = count / WINDOWS;
+	int failures = 0;
+	// Visible columns a lane leaves at the bottom of the last row
+	uint64_t below[2] = { 0, 0 };
+	// Hidden lanes leaving the bottom of the last row
+	int hiddenBelow = 0;
+	long totalLines = 0;
+	int widest = 0;
+	for (int window = 0; window < WINDOWS; window++) {
+		double start = now();
+		for (int i = window * windowSize; i < (window + 1) * windowSize; i++) {
+			// Newest first, as the history list shows them
+			int c = count - 1 - i;
+			const Commit *commit = &commits[c];
+			PBGraphObjectID parents[MAX_PARENTS];
+			for (int p = 0; p < commit->parentCount; p++)
+				parents[p] = objectIDs[commit->parents[p]];
+
+			PBGraphLaneRow row;
+			PBGraphLaneLayoutAddRow(layout, &objectIDs[c], parents, commit->parentCount, lines, &row);
+
+			int maxLines = PBGraphLaneLayoutMaxLines(layout, commit->parentCount);
+			int bad = row.nLines > maxLines || row.position < 1 || row.position > row.numColumns
+				|| row.numColumns > laneLimit + 1 || row.overflowAbove < 0 || row.overflowBelow < 0;
+			for (int l = 0; l < row.nLines && !bad; l++)
+				bad = lines[l].from < 1 || lines[l].from > row.numColumns || lines[l].to < 1 || lines[l].to > row.numColumns;
+			if (bad && failures++ < 5)
+				fprintf(stderr, "row %d: position %d, %d columns, %d lines (max %d)\n", i, row.position, row.numColumns, row.nLines, maxLines);
+
+			// Every lane that left the row above must come in at the top of
+			// this one, in the same column, and nothing else may
+			uint64_t above[2] = { 0, 0 };
+			uint64_t nextBelow[2] = { 0, 0 };
+			for (int l = 0; l < row.nLines; l++) {
+				int column = lines[l].from;
+				if (column < 1 || column > laneLimit)
+					continue;
+				if (lines[l].upper)
+					above[column / 64] |= 1ULL << (column % 64);
+				else
+					nextBelow[column / 64] |= 1ULL << (column % 64);
+			}
+			if ((above[0] != below[0] || above[1] != below[1]) && failures++ < 5)
+				fprintf(stderr, "row %d: lanes coming in don't match the lanes that left the row above\n", i);
+			below[0] = nextBelow[0];
+			below[1] = nextBelow[1];
+
+			// Hidden lanes only come in at the top if they left the row
+			// above, and one leaving through the overflow column is counted
+			int leavesHidden = 0;
+			for (int l = 0; l < row.nLines; l++)
+				if (!lines[l].upper && lines[l].from == laneLimit + 1)
+					leavesHidden = 1;
+			if ((row.overflowAbove > hiddenBelow || (leavesHidden && row.overflowBelow == 0)) && failures++ < 5)
+				fprintf(stderr, "row %d: %d hidden lanes above (%d left the row above), %d below\n", i, row.overflowAbove, hiddenBelow, row.overflowBelow);
+			hiddenBelow = row.overflowBelow;
+
+			totalLines += row.nLines;
+			if (row.numColumns > widest)
+				widest = row.numColumns;
+		}
+		windowNanos[window] = (now() - start) * 1e9 / windowSize;
+	}
+
+	printf("  lane limit %3d: %4.0f ns/row first tenth, %4.0f ns/row last tenth, %.1f lines/row, %d columns at most\n",
+	       laneLimit, windowNanos[0], windowNanos[WINDOWS - 1], (double)totalLines / (windowSize * WINDOWS), widest);
+
+	free(objectIDs);
+	free(lines);
+	PBGraphLaneLayoutFree(layout);
+	return failures;
+}
+
+int main(int argc, char **argv)
+{
+	int count = argc > 1 ? atoi(argv[1]) : 400000;
+	int branchCount = argc > 2 ? atoi(argv[2]) : 400;
+	if (count < WINDOWS * 100 || branchCount < 2 || branchCount > count / 2) {
+		fprintf(stderr, "usage: bench [commits >= %d] [branches >= 2]\n", WINDOWS * 100);
+		return 2;
+	}
+
+	Commit *commits = makeHistory(count, branchCount);
+	printf("%d commits, %d parallel branches\n", count, branchCount);
+
+	int failures = 0;
+	const int limits[] = { 16, 32, PBGraphLaneLimitMax };
+	for (size_t i = 0; i < sizeof(limits) / sizeof(limits[0]); i++) {
+		double windowNanos[WINDOWS];
+		failures += run(commits, count, limits[i], windowNanos);
+
+		// The slowest tenth against the median one; allow plenty for noise
+		double sorted[WINDOWS];
+		memcpy(sorted, windowNanos, sizeof(sorted));
+		for (int a = 0; a < WINDOWS; a++)
+			for (int b = a + 1; b < WINDOWS; b++)
+				if (sorted[b] < sorted[a]) {
+					double t = sorted[a];
+					sorted[a] = sorted[b];
+					sorted[b] = t;
+				}
+		if (sorted[WINDOWS - 1] > sorted[WINDOWS / 2] * 4) {
+			fprintf(stderr, "lane limit %d: per-row cost is not flat (%.0f vs median %.0f ns/row)\n",
+			        limits[i], sorted[WINDOWS - 1], sorted[WINDOWS / 2]);
+			failures++;
+		}
+	}
+
+	free(commits);
+	return failures ? 1 : 0;
+}
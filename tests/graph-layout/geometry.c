@@ -0,0 +1,225 @@
+// Headless check of the per-row graph geometry PBGraphGeometry draws
+// (PBGraphGeometryBuild in Classes/git/PBGraphLaneLayout.c): the points
+// every line becomes and the runs of segments drawn in one colour.
+//
+// It is run on hand-made rows with known answers, and on the rows
+// PBGraphLaneLayout gives a small history with a merge and a lane crossing
+// out of the overflow column.
+//
+// Usage: geometry
+
+#include "PBGraphLaneLayout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PARENTS 2
+
+typedef struct Geometry {
+	int segmentCount;
+	int runCount;
+	struct PBGitGraphPoint *points;
+	struct PBGitGraphColorRun runs[PBGraphPaletteSize];
+} Geometry;
+
+static int failures = 0;
+
+static int colorOf(struct PBGitGraphLine line)
+{
+	return ((int)line.colorIndex % PBGraphPaletteSize + PBGraphPaletteSize) % PBGraphPaletteSize;
+}
+
+static void buildGeometry(const struct PBGitGraphLine *lines, int count, Geometry *geometry)
+{
+	geometry->segmentCount = count;
+	geometry->points = malloc(sizeof(struct PBGitGraphPoint) * (size_t)(count > 0 ? count * 2 : 1));
+	geometry->runCount = PBGraphGeometryBuild(lines, count, geometry->points, geometry->runs);
+}
+
+static struct PBGitGraphLine makeLine(int upper, int from, int to, int colorIndex)
+{
+	struct PBGitGraphLine line;
+	line.upper = upper;
+	line.from = from;
+	line.to = to;
+	line.colorIndex = colorIndex;
+	return line;
+}
+
+static void expectGeometry(const char *name,
+                           const struct PBGitGraphLine *lines, int count,
+                           const struct PBGitGraphPoint *points,
+                           const struct PBGitGraphColorRun *runs, int runCount)
+{
+	Geometry geometry;
+	buildGeometry(lines, count, &geometry);
+
+	if (geometry.segmentCount != count || geometry.runCount != runCount) {
+		fprintf(stderr, "%s: %d segments in %d runs, expected %d in %d\n", name, geometry.segmentCount, geometry.runCount, count, runCount);
+		failures++;
+	} else {
+		for (int r = 0; r < runCount; r++)
+			if (memcmp(&geometry.runs[r], &runs[r], sizeof(runs[r])) != 0) {
+				fprintf(stderr, "%s: run %d is colour %d from %d for %d, expected colour %d from %d for %d\n", name, r,
+				        geometry.runs[r].color, geometry.runs[r].start, geometry.runs[r].count, runs[r].color, runs[r].start, runs[r].count);
+				failures++;
+			}
+		for (int p = 0; p < count * 2; p++)
+			if (geometry.points[p].x != points[p].x || geometry.points[p].y != points[p].y) {
+				fprintf(stderr, "%s: point %d is (%g, %g), expected (%g, %g)\n", name, p,
+				        geometry.points[p].x, geometry.points[p].y, points[p].x, points[p].y);
+				failures++;
+			}
+	}
+	free(geometry.points);
+}
+
+// A merge row: the commit in column 1 continues the lane from above, its
+// first parent goes straight down and its second opens column 2; a lane in
+// column 3 passes by. Colour 9 wraps to the same slot as 1.
+static void checkMergeRow(void)
+{
+	struct PBGitGraphLine lines[] = {
+		makeLine(1, 1, 1, 0),
+		makeLine(1, 3, 3, 2),
+		makeLine(0, 3, 3, 2),
+		makeLine(0, 1, 1, 0),
+		makeLine(0, 2, 1, 9),
+	};
+	struct PBGitGraphPoint points[] = {
+		{ 1, 0 }, { 1, 0.5f },
+		{ 1, 1 }, { 1, 0.5f },
+		{ 2, 1 }, { 1, 0.5f },
+		{ 3, 0 }, { 3, 0.5f },
+		{ 3, 1 }, { 3, 0.5f },
+	};
+	struct PBGitGraphColorRun runs[] = {
+		{ 0, 0, 2 },
+		{ 1, 2, 1 },
+		{ 2, 3, 2 },
+	};
+	expectGeometry("merge row", lines, 5, points, runs, 3);
+}
+
+// A crossing row: the lane from column 3 comes in above and leaves through
+// column 2 below, crossing the commit's lane from column 2 to 1. Negative
+// colours wrap like positive ones (-3 is 5).
+static void checkCrossingRow(void)
+{
+	struct PBGitGraphLine lines[] = {
+		makeLine(1, 2, 1, -3),
+		makeLine(0, 1, 1, -3),
+		makeLine(1, 3, 2, 4),
+		makeLine(0, 2, 2, 4),
+	};
+	struct PBGitGraphPoint points[] = {
+		{ 3, 0 }, { 2, 0.5f },
+		{ 2, 1 }, { 2, 0.5f },
+		{ 2, 0 }, { 1, 0.5f },
+		{ 1, 1 }, { 1, 0.5f },
+	};
+	struct PBGitGraphColorRun runs[] = {
+		{ 4, 0, 2 },
+		{ 5, 2, 2 },
+	};
+	expectGeometry("crossing row", lines, 4, points, runs, 2);
+}
+
+static PBGraphObjectID objectIDFor(int commit)
+{
+	PBGraphObjectID objectID;
+	memset(&objectID, 0, sizeof(objectID));
+	objectID.bytes[0] = (unsigned char)(commit + 1);
+	objectID.bytes[19] = 0x5a;
+	objectID.length = 20;
+	return objectID;
+}
+
+// Every line is one segment in the run of its colour, in the order the
+// lines came in, and runs go up by colour without gaps between them.
+static int geometryMatchesLines(const struct PBGitGraphLine *lines, int count, const Geometry *geometry)
+{
+	if (geometry->segmentCount != count)
+		return 0;
+	int segment = 0;
+	int lastColor = -1;
+	for (int r = 0; r < geometry->runCount; r++) {
+		const struct PBGitGraphColorRun *run = &geometry->runs[r];
+		if (run->color <= lastColor || run->start != segment || run->count < 1)
+			return 0;
+		lastColor = run->color;
+		for (int l = 0; l < count; l++) {
+			if (colorOf(lines[l]) != run->color)
+				continue;
+			const struct PBGitGraphPoint *points = &geometry->points[segment * 2];
+			if (points[0].x != lines[l].from || points[0].y != (lines[l].upper ? 0 : 1)
+			    || points[1].x != lines[l].to || points[1].y != 0.5f)
+				return 0;
+			segment++;
+		}
+		if (segment != run->start + run->count)
+			return 0;
+	}
+	return segment == count;
+}
+
+// Lays out, with two visible lanes, a merge M of A and B (a child of A),
+// a tip C that only gets a hidden lane, and the commits below; where B's
+// lane ends at A, C's lane moves out of the overflow column into B's.
+static void checkLaidOutRows(void)
+{
+	enum { M, C, B, A, D, R, COUNT };
+	static const int parents[COUNT][MAX_PARENTS] = {
+		[M] = { A, B }, [C] = { D }, [B] = { A }, [A] = { R }, [D] = { R }, [R] = { 0 },
+	};
+	static const int parentCounts[COUNT] = { [M] = 2, [C] = 1, [B] = 1, [A] = 1, [D] = 1, [R] = 0 };
+
+	PBGraphLaneLayout *layout = PBGraphLaneLayoutCreate(2);
+	struct PBGitGraphLine *lines = malloc(sizeof(struct PBGitGraphLine) * (size_t)PBGraphLaneLayoutMaxLines(layout, MAX_PARENTS));
+	int sawMerge = 0;
+	int sawCrossing = 0;
+
+	for (int c = 0; c < COUNT; c++) {
+		PBGraphObjectID commit = objectIDFor(c);
+		PBGraphObjectID parentIDs[MAX_PARENTS];
+		for (int p = 0; p < parentCounts[c]; p++)
+			parentIDs[p] = objectIDFor(parents[c][p]);
+
+		PBGraphLaneRow row;
+		PBGraphLaneLayoutAddRow(layout, &commit, parentIDs, parentCounts[c], lines, &row);
+
+		Geometry geometry;
+		buildGeometry(lines, row.nLines, &geometry);
+		if (!geometryMatchesLines(lines, row.nLines, &geometry)) {
+			fprintf(stderr, "laid out row %d: geometry doesn't match its %d lines\n", c, row.nLines);
+			failures++;
+		}
+		free(geometry.points);
+
+		if (parentCounts[c] > 1)
+			sawMerge = 1;
+		// A lane that changes column without meeting the commit
+		for (int l = 0; l < row.nLines; l++)
+			if (lines[l].from != lines[l].to && lines[l].to != row.position)
+				sawCrossing = 1;
+	}
+
+	if (!sawMerge || !sawCrossing) {
+		fprintf(stderr, "laid out rows: expected a merge and a crossing lane (merge %d, crossing %d)\n", sawMerge, sawCrossing);
+		failures++;
+	}
+
+	free(lines);
+	PBGraphLaneLayoutFree(layout);
+}
+
+int main(void)
+{
+	checkMergeRow();
+	checkCrossingRow();
+	checkLaidOutRows();
+	if (!failures)
+		printf("graph geometry: merge, crossing and laid out rows ok\n");
+	return failures ? 1 : 0;
+}
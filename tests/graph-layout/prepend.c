@@ -0,0 +1,158 @@
+// Headless check of what the history list relies on to show a commit made
+// from GitX without graphing the history again: a commit put on top of the
+// first row, with that row as its only parent, leaves every row below as it
+// was, and only gives the first row a line coming in from above.
+//
+// It lays out a merge-heavy history with and without such a commit, with
+// lane limits small enough for lanes to fold into the overflow column.
+//
+// Usage: prepend
+
+#include "PBGraphLaneLayout.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COMMITS 3000
+#define MAX_PARENTS 3
+
+typedef struct Commit {
+	int parents[MAX_PARENTS];
+	int parentCount;
+} Commit;
+
+typedef struct Row {
+	PBGraphLaneRow row;
+	struct PBGitGraphLine *lines;
+} Row;
+
+static int failures = 0;
+static uint64_t randomState = 0x2545f4914f6cdd1dULL;
+
+static uint32_t nextRandom(void)
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 7;
+	randomState ^= randomState << 17;
+	return (uint32_t)(randomState >> 32);
+}
+
+static PBGraphObjectID objectIDFor(int commit)
+{
+	PBGraphObjectID objectID;
+	memset(&objectID, 0, sizeof(objectID));
+	memcpy(objectID.bytes, &commit, sizeof(commit));
+	objectID.bytes[19] = 0xa5;
+	objectID.length = 20;
+	return objectID;
+}
+
+// Commits children first: each one's parents come later in the list, a
+// third of them are merges and a few start a new root.
+static Commit *makeHistory(int count)
+{
+	Commit *commits = calloc((size_t)count, sizeof(Commit));
+	for (int c = 0; c < count; c++) {
+		int left = count - 1 - c;
+		if (left == 0 || nextRandom() % 200 == 0)
+			continue;
+		int wanted = nextRandom() % 3 == 0 ? 2 + (int)(nextRandom() % (MAX_PARENTS - 1)) : 1;
+		for (int p = 0; p < wanted; p++) {
+			int parent = c + 1 + (int)(nextRandom() % (uint32_t)(left < 60 ? left : 60));
+			int seen = 0;
+			for (int q = 0; q < commits[c].parentCount; q++)
+				seen |= commits[c].parents[q] == parent;
+			if (!seen)
+				commits[c].parents[commits[c].parentCount++] = parent;
+		}
+	}
+	return commits;
+}
+
+// Lays out order[0 ... count - 1] (commit numbers) into rows.
+static void layOut(const Commit *commits, const int *order, int count, int laneLimit, Row *rows)
+{
+	PBGraphLaneLayout *layout = PBGraphLaneLayoutCreate(laneLimit);
+	for (int r = 0; r < count; r++) {
+		int c = order[r];
+		PBGraphObjectID commit = objectIDFor(c);
+		PBGraphObjectID parents[MAX_PARENTS];
+		for (int p = 0; p < commits[c].parentCount; p++)
+			parents[p] = objectIDFor(commits[c].parents[p]);
+
+		rows[r].lines = malloc(sizeof(struct PBGitGraphLine) * (size_t)PBGraphLaneLayoutMaxLines(layout, commits[c].parentCount));
+		PBGraphLaneLayoutAddRow(layout, &commit, parents, commits[c].parentCount, rows[r].lines, &rows[r].row);
+	}
+	PBGraphLaneLayoutFree(layout);
+}
+
+static int sameLines(const struct PBGitGraphLine *a, const struct PBGitGraphLine *b, int count)
+{
+	for (int l = 0; l < count; l++)
+		if (a[l].upper != b[l].upper || a[l].from != b[l].from || a[l].to != b[l].to || a[l].colorIndex != b[l].colorIndex)
+			return 0;
+	return 1;
+}
+
+static void check(int laneLimit)
+{
+	// Commit COMMITS is the new one, on top of commit 0
+	Commit *commits = makeHistory(COMMITS + 1);
+	memmove(&commits[1], &commits[0], sizeof(Commit) * COMMITS);
+	for (int c = 1; c <= COMMITS; c++)
+		for (int p = 0; p < commits[c].parentCount; p++)
+			commits[c].parents[p]++;
+	commits[0].parents[0] = 1;
+	commits[0].parentCount = 1;
+
+	int *order = malloc(sizeof(int) * (COMMITS + 1));
+	for (int r = 0; r <= COMMITS; r++)
+		order[r] = r;
+
+	Row *before = malloc(sizeof(Row) * COMMITS);
+	Row *after = malloc(sizeof(Row) * (COMMITS + 1));
+	layOut(commits, order + 1, COMMITS, laneLimit, before);
+	layOut(commits, order, COMMITS + 1, laneLimit, after);
+
+	const PBGraphLaneRow *oldTop = &before[0].row;
+	const PBGraphLaneRow *newTop = &after[1].row;
+	if (newTop->nLines != oldTop->nLines + 1
+	    || !after[1].lines[0].upper || after[1].lines[0].from != oldTop->position || after[1].lines[0].to != oldTop->position
+	    || !sameLines(after[1].lines + 1, before[0].lines, oldTop->nLines)
+	    || newTop->position != oldTop->position || newTop->numColumns != oldTop->numColumns
+	    || newTop->overflowColumn != oldTop->overflowColumn || newTop->overflowBelow != oldTop->overflowBelow) {
+		fprintf(stderr, "lane limit %d: the old first row isn't its old self with a line from above\n", laneLimit);
+		failures++;
+	}
+
+	for (int r = 1; r < COMMITS; r++) {
+		const Row *old = &before[r];
+		const Row *new = &after[r + 1];
+		if (memcmp(&old->row, &new->row, sizeof(old->row)) != 0 || !sameLines(old->lines, new->lines, old->row.nLines)) {
+			fprintf(stderr, "lane limit %d: row %d changed when a commit was put on top\n", laneLimit, r);
+			failures++;
+			break;
+		}
+	}
+
+	for (int r = 0; r < COMMITS; r++)
+		free(before[r].lines);
+	for (int r = 0; r <= COMMITS; r++)
+		free(after[r].lines);
+	free(before);
+	free(after);
+	free(order);
+	free(commits);
+}
+
+int main(void)
+{
+	static const int laneLimits[] = { 1, 2, 8, PBGraphLaneLimitMax };
+	for (size_t i = 0; i < sizeof(laneLimits) / sizeof(laneLimits[0]); i++)
+		check(laneLimits[i]);
+	if (!failures)
+		printf("graph prepend: rows below the new commit unchanged\n");
+	return failures ? 1 : 0;
+}
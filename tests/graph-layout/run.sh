@@ -0,0 +1,22 @@
+#!/bin/bash
+# Build and run the graph geometry and prepend checks and the lane layout
+# benchmark. Prints the timings; fails if a row's geometry is wrong, a commit
+# put on top moves rows below it, a row breaks the layout or per-row cost
+# grows
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+SOURCES="$SCRIPT_DIR/../../Classes/git"
+BUILD_DIR="$(mktemp -d)"
+trap 'rm -rf "$BUILD_DIR"' EXIT
+
+cc -std=c11 -O2 -Wall -Wno-unknown-pragmas -I"$SOURCES" \
+	"$SCRIPT_DIR/geometry.c" "$SOURCES/PBGraphLaneLayout.c" -o "$BUILD_DIR/geometry"
+cc -std=c11 -O2 -Wall -Wno-unknown-pragmas -I"$SOURCES" \
+	"$SCRIPT_DIR/prepend.c" "$SOURCES/PBGraphLaneLayout.c" -o "$BUILD_DIR/prepend"
+cc -std=c11 -O2 -Wall -Wno-unknown-pragmas -I"$SOURCES" \
+	"$SCRIPT_DIR/bench.c" "$SOURCES/PBGraphLaneLayout.c" -o "$BUILD_DIR/bench"
+"$BUILD_DIR/geometry"
+"$BUILD_DIR/prepend"
+"$BUILD_DIR/bench" "$@"
@@ -2,7 +2,11 @@
 // Test cases for line staging/unstaging patch generation
 // Tests the actual code from html/lib/patchGenerator.js
 
-const { generatePatchContent } = require('../../html/lib/patchGenerator.js');
+const PatchGenerator = require('../../html/lib/patchGenerator.js');
+const { generatePatchContent } = PatchGenerator;
+const { rewindowDiff, truncateDiff } = require('../../html/lib/diffContext.js');
+const DiffModel = require('../../html/lib/diffModel.js');
+const WordDiff = require('../../html/lib/wordDiff.js');
 
 // Wrapper to match old test interface
 function generatePatch(options) {
@@ -771,6 +775,268 @@ index abc123..def456 100644
     assertPatchApplies(patch, initial, expected, false);
 });
 
+// ============================================================================
+// CONTEXT RE-WINDOWING: trimming a wide diff must match git's own -U<n>
+// ============================================================================
+
+function gitDiffWithContext(initialContent, modifiedContent, contextLines) {
+    const tmpDir = fs.mkdtempSync(path.join(os.tmpdir(), 'gitx-test-'));
+    try {
+        execSync('git init -q', { cwd: tmpDir });
+        const filePath = path.join(tmpDir, 'test.txt');
+        fs.writeFileSync(filePath, initialContent);
+        execSync('git add test.txt', { cwd: tmpDir });
+        fs.writeFileSync(filePath, modifiedContent);
+        return execSync(`git diff-files -U${contextLines} -- test.txt`, { cwd: tmpDir, encoding: 'utf8' });
+    } finally {
+        fs.rmSync(tmpDir, { recursive: true, force: true });
+    }
+}
+
+function assertRewindowMatchesGit(initialContent, modifiedContent) {
+    // Split hunks don't carry git's function-name suffix, so compare without it
+    const stripSuffix = (diff) => diff.replace(/^(@@ [^@]+ @@).*$/gm, '$1');
+    const wide = gitDiffWithContext(initialContent, modifiedContent, 10);
+    for (let n = 0; n <= 10; n++) {
+        assertEqual(stripSuffix(rewindowDiff(wide, n)),
+            stripSuffix(gitDiffWithContext(initialContent, modifiedContent, n)),
+            `Mismatch at -U${n}`);
+    }
+}
+
+function numberedLines(count) {
+    const lines = [];
+    for (let i = 1; i <= count; i++)
+        lines.push(String(i));
+    return lines;
+}
+
+test('rewindow scattered modifications', () => {
+    const initial = numberedLines(60);
+    const modified = initial.slice();
+    modified[4] = '5 changed';
+    modified[12] = '13 changed';
+    modified[30] = '31 changed';
+    modified[33] = '34 changed';
+    modified[58] = '59 changed';
+    assertRewindowMatchesGit(initial.join('\n') + '\n', modified.join('\n') + '\n');
+});
+
+test('rewindow additions at start and deletions at end', () => {
+    const initial = numberedLines(40);
+    const modified = ['0a', '0b'].concat(initial.slice(0, 17), initial.slice(18, 36));
+    assertRewindowMatchesGit(initial.join('\n') + '\n', modified.join('\n') + '\n');
+});
+
+test('rewindow missing newline at end of file', () => {
+    const initial = numberedLines(30);
+    const modified = initial.slice();
+    modified[2] = '3 changed';
+    modified[29] = '30 changed';
+    assertRewindowMatchesGit(initial.join('\n') + '\n', modified.join('\n'));
+});
+
+test('preview limit keeps whole hunks of the re-windowed diff', () => {
+    const initial = numberedLines(200);
+    const modified = initial.slice();
+    for (let i = 10; i < 200; i += 20)
+        modified[i] = initial[i] + ' changed';
+    const wide = gitDiffWithContext(initial.join('\n') + '\n', modified.join('\n') + '\n', 10);
+    const shown = rewindowDiff(wide, 3);
+    const hunkCount = (diff) => (diff.match(/^@@ /gm) || []).length;
+
+    // The limit falls in the fourth hunk at -U3; at -U10 there is only one
+    const limit = shown.indexOf('@@ -68,7') + 10;
+    const preview = truncateDiff(shown, limit);
+    assertEqual(preview.truncated, true, 'Expected the preview to be cut');
+    assertEqual(preview.diff.length <= limit, true, 'Preview longer than the limit');
+    assertEqual(hunkCount(preview.diff), 3);
+    assertEqual(shown.startsWith(preview.diff), true, 'Preview should be the start of the diff');
+
+    const whole = truncateDiff(shown, shown.length);
+    assertEqual(!whole.truncated && whole.diff === shown, true, 'A diff within the limit is left alone');
+
+    // A first hunk over the limit is cut after its last whole line
+    const firstLimit = shown.indexOf('@@ -8,7') + 30;
+    const cut = truncateDiff(shown, firstLimit);
+    assertEqual(cut.truncated && cut.diff.length <= firstLimit, true, 'Expected the first hunk to be cut');
+    assertEqual(hunkCount(cut.diff), 1);
+    assertEqual(shown.startsWith(cut.diff), true, 'Cut hunk should be the start of the diff');
+});
+
+// ============================================================================
+// DIFF MODEL: line numbers, pairing and patches cut from the parsed diff
+// ============================================================================
+
+const modelDiff = [
+    'diff --git a/test.txt b/test.txt',
+    'index 1111111..2222222 100644',
+    '--- a/test.txt',
+    '+++ b/test.txt',
+    '@@ -1,4 +1,4 @@ header',
+    ' one',
+    '-two',
+    '-three',
+    '+TWO',
+    ' four',
+    '@@ -10,2 +10,3 @@',
+    ' ten',
+    '+ten and a half',
+    ' eleven',
+    'diff --git a/old.txt b/new.txt',
+    'similarity index 90%',
+    'rename from old.txt',
+    'rename to new.txt',
+    'diff --git a/image.png b/image.png',
+    'new file mode 100644',
+    'index 0000000..3333333',
+    'Binary files /dev/null and b/image.png differ',
+    ''
+].join('\n');
+
+test('diff model line numbers and pairing', () => {
+    const model = DiffModel.parseDiff(modelDiff);
+    assertEqual(model.hunks.length, 2, 'hunk count');
+    assertEqual(model.kind[4], DiffModel.HUNK, 'hunk kind');
+    assertEqual(model.oldLine[6], 2, 'old line of first deletion');
+    assertEqual(model.newLine[8], 2, 'new line of addition');
+    assertEqual(model.oldLine[9] + ',' + model.newLine[9], '4,3', 'context line numbers');
+    assertEqual(model.pair[6], 8, 'first deletion pairs with the addition');
+    assertEqual(model.pair[8], 6, 'addition pairs back');
+    assertEqual(model.pair[7], -1, 'second deletion is unpaired');
+    assertEqual(model.newLine[12], 11, 'line numbers restart at the second hunk');
+});
+
+test('diff model files and hunk lookup', () => {
+    const model = DiffModel.parseDiff(modelDiff);
+    assertEqual(model.files.length, 3, 'file count');
+    assertEqual(model.files[0].hunkEnd - model.files[0].hunkStart, 2, 'hunks in first file');
+    assertEqual(model.files[1].title, 'old.txt renamed to new.txt', 'rename title');
+    assertEqual(model.files[2].binary, true, 'binary file');
+    assertEqual(model.files[2].title, 'image.png', 'new file title');
+    assertEqual(DiffModel.hunkAtLine(model, 3), -1, 'header is outside any hunk');
+    assertEqual(DiffModel.hunkAtLine(model, 9), 0, 'line in first hunk');
+    assertEqual(DiffModel.hunkAtLine(model, 13), 1, 'line in second hunk');
+    assertEqual(DiffModel.hunkAtLine(model, 14), -1, 'next file header');
+});
+
+test('diff model hunk patch applies', () => {
+    const initial = 'one\ntwo\nthree\nfour\n';
+    const modified = 'one\nTWO\nfour\n';
+    const diff = gitDiffWithContext(initial, modified, 3);
+    const model = DiffModel.parseDiff(diff);
+    assertEqual(DiffModel.hunkLines(model, 0).join('\n'), ' one\n-two\n-three\n+TWO\n four', 'hunk lines');
+    assertPatchApplies(DiffModel.hunkPatch(model, 0), initial, modified);
+});
+
+// ============================================================================
+// SELECTIONS OVER SEVERAL HUNKS: one git apply for all of their patches
+// ============================================================================
+
+// Hunk descriptors for generateSelectionPatches, as stageLines builds them
+function selectionHunks(model) {
+    return model.hunks.map((hunk, h) => ({
+        header: DiffModel.fileHeaderText(model, hunk.file),
+        oldStart: hunk.oldStart,
+        newStart: hunk.newStart,
+        lines: DiffModel.hunkLines(model, h),
+        baseIndex: hunk.line + 1
+    }));
+}
+
+// Model line numbers of the lines reading text
+function linesReading(model, texts) {
+    const selected = {};
+    for (let i = 0; i < model.lineCount; i++)
+        if (texts.indexOf(DiffModel.lineText(model, i)) >= 0)
+            selected[i] = true;
+    return selected;
+}
+
+// Joins patches the way -[PBGitIndex applyPatches:stage:reverse:] does
+function joinPatches(patches) {
+    return patches.map(patch => patch.endsWith('\n') ? patch : patch + '\n').join('');
+}
+
+const severalHunksInitial = numberedLines(30);
+const severalHunksModified = severalHunksInitial.slice(0, 3).concat(
+    ['A1', 'A2'], severalHunksInitial.slice(3, 19), ['twenty'], severalHunksInitial.slice(20, 25),
+    ['B1'], severalHunksInitial.slice(25));
+
+// With no context lines git has nothing to find a moved hunk by
+[0, 3].forEach(context => {
+    test(`stage lines from several hunks in one apply (-U${context})`, () => {
+        const initial = severalHunksInitial.join('\n') + '\n';
+        const model = DiffModel.parseDiff(gitDiffWithContext(initial, severalHunksModified.join('\n') + '\n', context));
+
+        // Lines added by the first patch move the later ones down
+        const selected = linesReading(model, ['+A1', '+A2', '+B1']);
+        const patches = PatchGenerator.generateSelectionPatches(selectionHunks(model), selected, {}, false);
+        assertEqual(patches.length, 2, 'one patch per hunk with selected changes');
+
+        const expected = severalHunksInitial.slice(0, 3).concat(['A1', 'A2'], severalHunksInitial.slice(3, 25),
+            ['B1'], severalHunksInitial.slice(25));
+        assertPatchApplies(joinPatches(patches), initial, expected.join('\n') + '\n');
+    });
+
+    test(`unstage lines from several hunks in one apply (-U${context})`, () => {
+        const modified = severalHunksModified.join('\n') + '\n';
+        const model = DiffModel.parseDiff(gitDiffWithContext(severalHunksInitial.join('\n') + '\n', modified, context));
+
+        const selected = linesReading(model, ['+A1', '+B1']);
+        const patches = PatchGenerator.generateSelectionPatches(selectionHunks(model), selected, {}, true);
+
+        const expected = severalHunksModified.filter(line => line !== 'A1' && line !== 'B1');
+        assertPatchApplies(joinPatches(patches), modified, expected.join('\n') + '\n', true);
+    });
+});
+
+test('stage a line below changes left unstaged (-U0)', () => {
+    const initial = severalHunksInitial.join('\n') + '\n';
+    const model = DiffModel.parseDiff(gitDiffWithContext(initial, severalHunksModified.join('\n') + '\n', 0));
+    const patches = PatchGenerator.generateSelectionPatches(selectionHunks(model), linesReading(model, ['+B1']), {}, false);
+
+    const expected = severalHunksInitial.slice(0, 25).concat(['B1'], severalHunksInitial.slice(25));
+    assertPatchApplies(joinPatches(patches), initial, expected.join('\n') + '\n');
+});
+
+test('selection patches skip hunks without selected changes', () => {
+    const initial = severalHunksInitial.join('\n') + '\n';
+    const model = DiffModel.parseDiff(gitDiffWithContext(initial, severalHunksModified.join('\n') + '\n', 3));
+    const selected = linesReading(model, [' 1', '+B1']);
+    assertEqual(PatchGenerator.generateSelectionPatches(selectionHunks(model), selected, {}, false).length, 1, 'patches');
+});
+
+// ============================================================================
+// WORD DIFF: changed words within a paired deletion and addition
+// ============================================================================
+
+test('word diff marks only the changed words', () => {
+    const result = WordDiff.diffLines('return foo(a, b);', 'return foo(a, c);');
+    assertEqual(JSON.stringify(result), JSON.stringify({ del: [14, 15], add: [14, 15] }), 'ranges');
+    assertEqual(WordDiff.renderLine('if (a < b)', [6, 7], 'del'), 'if (a <del>&lt;</del> b)', 'rendered line');
+});
+
+test('word diff keeps a longest common subsequence', () => {
+    const result = WordDiff.diffLines('one two three four five', 'zero one three five six');
+    const kept = (text, ranges) => {
+        let out = '';
+        let position = 0;
+        for (let i = 0; i < ranges.length; i += 2) {
+            out += text.substring(position, ranges[i]);
+            position = ranges[i + 1];
+        }
+        return out + text.substring(position);
+    };
+    assertEqual(kept('one two three four five', result.del), kept('zero one three five six', result.add), 'unchanged text');
+    assertEqual(kept('one two three four five', result.del).replace(/ /g, ''), 'onethreefive', 'common words');
+});
+
+test('word diff skips lines over the length cutoff', () => {
+    const long = 'x'.repeat(WordDiff.MAX_LINE_LENGTH + 1);
+    assertEqual(WordDiff.diffLines(long, 'x'), null, 'over cutoff');
+});
+
 // ============================================================================
 // Run tests
 // ============================================================================